@@ -43,10 +43,17 @@ int source_unique = 0;
 typedef struct info_filter_s {
 	char name[MAX_INFO_KEY];
 	pcre2_code* regex;
+	pcre2_match_data* match_data;
 	qbool pass;
 	qbool exec;
 } info_filter_t;
 
+// sb_info_filter compiled, kept until the cvar changes
+static info_filter_t* compiled_info_filters;
+static int compiled_info_filter_count;
+static char* compiled_info_filter_string;
+
+static void SB_InfoFilter_Compile(void);
 static info_filter_t* SB_InfoFilter_Parse(int* count);
 static qbool SB_InfoFilter_Exec(info_filter_t* info_filters, int info_filter_count, server_data* s);
 static void SB_InfoFilter_Free(info_filter_t* info_filters, int info_filter_count);
@@ -107,7 +114,12 @@ cvar_t  sb_nosockraw     = {"sb_nosockraw",        "0"}; // when enabled, forces
 
 cvar_t  sb_liveupdate    = {"sb_liveupdate",       "2"}; // not in menu
 
-cvar_t  sb_sortservers   = {"sb_sortservers",     "32"}; // not in new menu
+static void sb_trigger_resort(cvar_t* var, char* value, qbool* cancel)
+{
+	resort_servers = 1;
+}
+
+cvar_t  sb_sortservers   = {"sb_sortservers",     "32", 0, sb_trigger_resort }; // not in new menu
 cvar_t  sb_sortplayers   = {"sb_sortplayers",     "92"}; // not in new menu
 cvar_t  sb_sortsources   = {"sb_sortsources",      "3"}; // not in new menu
 
@@ -116,11 +128,6 @@ cvar_t  sb_findroutes    = {"sb_findroutes",       "0"};
 cvar_t  sb_ignore_proxy  = {"sb_ignore_proxy",     ""};
 
 // filters
-static void sb_trigger_resort(cvar_t* var, char* value, qbool* cancel)
-{
-	resort_servers = 1;
-}
-
 cvar_t  sb_hideempty     = {"sb_hideempty",        "1", 0, sb_trigger_resort };
 cvar_t  sb_hidenotempty  = {"sb_hidenotempty",     "0", 0, sb_trigger_resort };
 cvar_t  sb_hidefull      = {"sb_hidefull",         "0", 0, sb_trigger_resort };
@@ -146,8 +153,11 @@ int all_players_n = 0;
 
 /// when 1, in the next frame in which the list is drawn also sorting will be done
 int resort_servers = 1; 
+/// when 1, servers marked by SB_Server_Changed are put back in place in the next frame the list is drawn
+int resort_changed_servers = 0;
 int resort_sources = 1;
 void Sort_Servers (void);
+void Sort_Changed_Servers (void);
 
 int testing_connection = 0;
 int ping_phase = 0;
@@ -1018,6 +1028,10 @@ void SB_Servers_Draw (int x, int y, int w, int h)
 		Sort_Servers();
 		resort_servers = 0;
 	}
+	else if (resort_changed_servers)
+	{
+		Sort_Changed_Servers();
+	}
 
 	if (serversn_passed > 0)
 	{
@@ -2839,7 +2853,7 @@ int Servers_Compare_Func(const void * p_s1, const void * p_s2)
 		switch (*sort_string++)
 		{
 			case '1':
-				d = funcmp(s1->display.name, s2->display.name);
+				d = strcmp(s1->sortname, s2->sortname);
 				break;
 			case '2':
 				d = memcmp(&(s1->address.ip), &(s2->address.ip), 4);
@@ -2850,10 +2864,10 @@ int Servers_Compare_Func(const void * p_s1, const void * p_s2)
 				d = Servers_Compare_Ping_Func(s1, s2);
 				break;
 			case '4':
-				d = Q_strcmp2(s1->display.gamedir, s2->display.gamedir);
+				d = strcmp(s1->sortgamedir, s2->sortgamedir);
 				break;
 			case '5':
-				d = Q_strcmp2(s1->display.map, s2->display.map);
+				d = strcmp(s1->sortmap, s2->sortmap);
 				break;
 			case '6':
 				d = s1->playersn - s2->playersn;
@@ -2873,57 +2887,79 @@ int Servers_Compare_Func(const void * p_s1, const void * p_s2)
 	}
 }
 
-void Filter_Servers(void)
+// lowercase, as Q_strcmp2 compares
+static void SB_SortKey_Lower(char *dst, const char *src, size_t size)
 {
-	int i, info_filter_count;
-	info_filter_t* info_filters = SB_InfoFilter_Parse(&info_filter_count);
+	size_t i;
 
-	serversn_passed = 0;
-	for (i=0; i < serversn; i++)
-	{
-		char *tmp;
-		server_data *s = servers[i];
-		s->passed_filters = 0;
+	for (i = 0; i + 1 < size && src[i]; i++)
+		dst[i] = tolower(src[i] & 0x7f);
+	dst[i] = 0;
+}
 
-		if (searchstring[0] && !strstri(s->display.name, searchstring)) {
-			continue;
-		}
+// what Servers_Compare_Func and the filters use instead of going through
+// the keys and the fun chars on every comparison
+static void SB_Server_SortKeys(server_data *s)
+{
+	char *tmp;
 
-		if (sb_showproxies.integer == 0 && (s->qwfwd || s->qizmo))
-			continue; // hide
+	strlcpy(s->sortname, s->display.name, sizeof(s->sortname));
+	FunToSort(s->sortname);
+	SB_SortKey_Lower(s->sortmap, s->display.map, sizeof(s->sortmap));
+	SB_SortKey_Lower(s->sortgamedir, s->display.gamedir, sizeof(s->sortgamedir));
 
-		if (sb_showproxies.integer == 2 && !(s->qwfwd || s->qizmo))
-			continue; // exclusive
+	tmp = ValueForKey(s, "maxclients");
+	s->maxclients = tmp ? atoi(tmp) : 255;
 
-		if (sb_hidedead.value  &&  s->ping < 0)
-			continue;
+	s->sortdirty = false;
+}
 
-		if (!s->qizmo && !s->qwfwd) {
-			if (sb_hideempty.value  &&  s->playersn + s->spectatorsn <= 0)
-				continue;
+static qbool SB_Server_PassesFilters(server_data *s)
+{
+	if (searchstring[0] && !strstri(s->display.name, searchstring))
+		return false;
 
-			if (sb_hidenotempty.value  &&  s->playersn + s->spectatorsn > 0)
-				continue;
-		}
+	if (sb_showproxies.integer == 0 && (s->qwfwd || s->qizmo))
+		return false; // hide
 
-		if (sb_hidehighping.integer && s->ping > sb_pinglimit.integer)
-			continue;
+	if (sb_showproxies.integer == 2 && !(s->qwfwd || s->qizmo))
+		return false; // exclusive
 
-		tmp = ValueForKey(s, "maxclients");
-		if (sb_hidefull.value  &&  s->playersn >= (tmp ? atoi(tmp) : 255))
-			continue;
+	if (sb_hidedead.value  &&  s->ping < 0)
+		return false;
 
-		if (!SB_InfoFilter_Exec(info_filters, info_filter_count, s)) {
-			continue;
-		}
+	if (!s->qizmo && !s->qwfwd) {
+		if (sb_hideempty.value  &&  s->playersn + s->spectatorsn <= 0)
+			return false;
 
-		s->passed_filters = 1;  // passed
-		serversn_passed++;
+		if (sb_hidenotempty.value  &&  s->playersn + s->spectatorsn > 0)
+			return false;
 	}
 
-	SB_InfoFilter_Free(info_filters, info_filter_count);
+	if (sb_hidehighping.integer && s->ping > sb_pinglimit.integer)
+		return false;
+
+	if (sb_hidefull.value  &&  s->playersn >= s->maxclients)
+		return false;
+
+	return SB_InfoFilter_Exec(compiled_info_filters, compiled_info_filter_count, s);
+}
+
+void Filter_Servers(void)
+{
+	int i;
+
+	SB_InfoFilter_Compile();
+
+	serversn_passed = 0;
+	for (i=0; i < serversn; i++)
+	{
+		server_data *s = servers[i];
 
-	return;
+		SB_Server_SortKeys(s);
+		s->passed_filters = SB_Server_PassesFilters(s);
+		serversn_passed += s->passed_filters;
+	}
 }
 
 void Sort_Servers (void)
@@ -2931,6 +2967,64 @@ void Sort_Servers (void)
 	SB_ServerList_Lock();
 	Filter_Servers();
 	qsort(servers, serversn, sizeof(servers[0]), Servers_Compare_Func);
+	resort_changed_servers = 0;
+	SB_ServerList_Unlock();
+}
+
+// main thread only, s got a new ping or serverinfo
+void SB_Server_Changed(server_data *s)
+{
+	s->sortdirty = true;
+	resort_changed_servers = 1;
+}
+
+/*
+==================
+Sort_Changed_Servers
+
+Puts the servers marked by SB_Server_Changed back in place. The others are still
+in order, so only the changed ones are filtered and sorted, then merged in.
+==================
+*/
+void Sort_Changed_Servers (void)
+{
+	static server_data *changed[MAX_SERVERS];
+	int i, kept, changedn, n;
+
+	SB_ServerList_Lock();
+	SB_InfoFilter_Compile();
+
+	serversn_passed = kept = changedn = 0;
+	for (i = 0; i < serversn; i++)
+	{
+		server_data *s = servers[i];
+
+		if (s->sortdirty)
+		{
+			SB_Server_SortKeys(s);
+			s->passed_filters = SB_Server_PassesFilters(s);
+			changed[changedn++] = s;
+		}
+		else
+		{
+			servers[kept++] = s;
+		}
+
+		serversn_passed += s->passed_filters;
+	}
+
+	qsort(changed, changedn, sizeof(changed[0]), Servers_Compare_Func);
+
+	// merge from the back, the ones kept are at the front now
+	for (n = serversn - 1, i = kept - 1; changedn > 0; n--)
+	{
+		if (i >= 0 && Servers_Compare_Func(&servers[i], &changed[changedn - 1]) > 0)
+			servers[n] = servers[i--];
+		else
+			servers[n] = changed[--changedn];
+	}
+
+	resort_changed_servers = 0;
 	SB_ServerList_Unlock();
 }
 
@@ -3301,6 +3395,7 @@ void Browser_Init (void)
 	Cmd_AddCommand("sb_sourcesupdate", SB_Sources_Update_f);
 	Cmd_AddCommand("sb_buildpingtree", SB_PingTree_Build);
 	Cmd_AddCommand("sb_proxygetpings", SB_ProxyGetPings_f);
+	SB_Query_Init();
 
 	if (sb_listcache.integer) {
 		SB_Serverlist_Unserialize_f();
@@ -3335,6 +3430,9 @@ void Browser_Init2 (void)
 }
 
 void SB_ExecuteQueuedTriggers(void) {
+	// results of a running refresh, this may queue SB_TRIGGER_REFRESHDONE
+	SB_Query_Apply();
+
 	if (sb_queuedtriggers & SB_TRIGGER_REFRESHDONE) {
 		TP_ExecTrigger("f_sbrefreshdone");
 		sb_queuedtriggers &= ~SB_TRIGGER_REFRESHDONE;
@@ -3387,12 +3485,9 @@ static qbool SB_InfoFilter_Exec(info_filter_t* info_filters, int info_filter_cou
 		}
 		else {
 			// Rule specified, check it matches the regex
-			pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(filter->regex, NULL);
-			if (pcre2_match(filter->regex, (PCRE2_SPTR)value, strlen(value), 0, 0, match_data, NULL) >= 0) {
-				pcre2_match_data_free (match_data);
+			if (pcre2_match(filter->regex, (PCRE2_SPTR)value, strlen(value), 0, 0, filter->match_data, NULL) >= 0) {
 				return filter->pass;
 			}
-			pcre2_match_data_free (match_data);
 		}
 	}
 
@@ -3447,6 +3542,7 @@ static info_filter_t* SB_InfoFilter_Parse(int* count)
 				Con_Printf("Invalid rule definition: %s\n", error_str);
 				continue;
 			}
+			filter->match_data = pcre2_match_data_create_from_pattern(filter->regex, NULL);
 		}
 
 		filter->exec = true;
@@ -3460,6 +3556,9 @@ static void SB_InfoFilter_Free(info_filter_t* info_filters, int info_filter_coun
 	int i;
 
 	for (i = 0; i < info_filter_count; ++i) {
+		if (info_filters[i].match_data) {
+			pcre2_match_data_free(info_filters[i].match_data);
+		}
 		if (info_filters[i].regex) {
 			pcre2_code_free(info_filters[i].regex);
 		}
@@ -3467,3 +3566,18 @@ static void SB_InfoFilter_Free(info_filter_t* info_filters, int info_filter_coun
 
 	Q_free(info_filters);
 }
+
+// parses sb_info_filter if it changed since the last time
+static void SB_InfoFilter_Compile(void)
+{
+	if (compiled_info_filter_string && !strcmp(compiled_info_filter_string, sb_info_filter.string))
+		return;
+
+	if (compiled_info_filter_string) {
+		SB_InfoFilter_Free(compiled_info_filters, compiled_info_filter_count);
+		Q_free(compiled_info_filter_string);
+	}
+
+	compiled_info_filters = SB_InfoFilter_Parse(&compiled_info_filter_count);
+	compiled_info_filter_string = Q_strdup(sb_info_filter.string);
+}
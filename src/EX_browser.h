@@ -132,6 +132,13 @@ typedef struct server_data_s
 	qbool qizmo;
 	qbool qwfwd;
 	qbool support_teams; // is server support team per player
+
+	// sort keys, filled in by Filter_Servers
+	char sortname[COL_NAME + 1];		// display.name with fun chars folded, see FunToSort
+	char sortmap[COL_MAP + 1];			// lowercase
+	char sortgamedir[COL_GAMEDIR + 1];	// lowercase
+	int maxclients;
+	qbool sortdirty;					// changed since the list was sorted, see SB_Server_Changed
 } server_data;
 
 
@@ -179,6 +186,7 @@ extern serverbrowser_window_t Browser_window;
 extern server_data * show_serverinfo;
 
 extern int resort_servers;
+extern int resort_changed_servers;
 extern int rebuild_servers_list;
 extern int resort_all_players;
 extern int rebuild_all_players;
@@ -207,6 +215,7 @@ server_data * Clone_Server(server_data* source);
 server_data * Create_Server2(netadr_t n);
 void Reset_Server(server_data *s);
 void Delete_Server(server_data *s);
+void SB_Server_Changed(server_data *s);
 source_data * Create_Source(void);
 void Reset_Source(source_data *s);
 void Delete_Source(source_data *s);
@@ -249,6 +258,16 @@ void GetServerPingsAndInfos(int full);
 void GetServerPingsAndInfos_f(void);
 void Start_Autoupdate(server_data *s);
 void Alter_Autoupdate(server_data *s);
+void Parse_Serverinfo(server_data *s, char *info);
+
+// query
+#define SBQ_PINGFIRST	1	// ping the servers before asking for their status
+#define SBQ_PROGRESS	2	// drive ping_phase and ping_pos
+void SB_Query_Init(void);
+void SB_Query_Run(server_data *servs[], int servsn, int flags, void (*done)(void));
+void SB_Query_Apply(void);
+qbool SB_Query_Begin(void);
+qbool SB_Query_Busy(void);
 
 char *ValueForKey(server_data *s, char *k);
 
@@ -39,17 +39,12 @@ extern qbool useNewPing;
 int oldPingHost(char *host_to_ping, int count);
 int oldPingHosts(server_data *servs[], int servsn, int count);
 int PingHost(char *host_to_ping, unsigned short port, int count, int time_out);
-int PingHosts(server_data *servs[], int servsn, int count);
 
 extern sem_t serverinfo_semaphore;
 // To prevent several Serverinfo threads to be started at the same time
 static int serverinfo_lock;
-
-typedef struct infohost_s
-{
-    double lastsenttime;
-    int phase;
-} infohost;
+// whether the refresh in progress updates the sources too
+static int refresh_full;
 
 int autoupdate_serverinfo = 0;
 
@@ -372,165 +367,6 @@ void GetServerInfo(server_data *serv)
     closesocket(newsocket);
 }
 
-//
-// Gets multiple server info simultaneously
-//
-
-int GetServerInfosProc(void * lpParameter)
-{
-    infohost *hosts;   // 0 if not sent yet, -1 if data read
-    double interval, lastsenttime;
-
-    socket_t newsocket;
-    struct sockaddr_storage dest;
-    int ret, i;
-    fd_set fd;
-    struct timeval timeout;
-
-    if (abort_ping)
-        return 0;
-
-    // so we have a socket
-    newsocket = UDP_OpenSocket(PORT_ANY);
-
-    hosts = (infohost *) Q_malloc (serversn * sizeof(infohost));
-    for (i=0; i < serversn; i++)
-    {
-        hosts[i].phase = 0;
-        hosts[i].lastsenttime = -1000;
-        Reset_Server(servers[i]);
-
-        // do not update dead servers
-		if (servers[i]->ping < 0) {
-            hosts[i].phase = -1;//(int)sb_inforetries.value;
-		}
-		// do not update too distant servers
-		else if (sb_hidehighping.integer && servers[i]->ping > sb_pinglimit.integer) {
-			hosts[i].phase = -1;
-		}
-    }
-
-    interval = (1000.0 / sb_infospersec.value) / 1000;
-    lastsenttime = Sys_DoubleTime() - interval;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = (long)(interval * 1000.0 * 1000.0 / 2);
-
-    ping_pos = 0;
-
-    while (1  &&  !abort_ping)
-    {
-        int index = -1;
-        double time = Sys_DoubleTime();
-
-        // if it is time to send next request
-        if (time > lastsenttime + interval)
-        {
-            int finished = 0;
-            int to_ask = 0;
-            int phase = (int)(sb_inforetries.value);
-
-            // find next server to ask
-            for (i=0; i < serversn; i++)
-            {
-                if (hosts[i].phase < phase  &&  hosts[i].phase >= 0  &&
-                    time > hosts[i].lastsenttime + (sb_infotimeout.value / 1000))
-                {
-                    index = i;
-                    phase = hosts[i].phase;
-                }
-
-                if (hosts[i].phase >= (int)sb_inforetries.value)
-                    finished++;
-                else
-                    if (hosts[i].phase >= 0)
-                        to_ask++;
-            }
-            //ping_pos = finished / (double)serversn;
-            ping_pos = (finished+to_ask <= 0) ? 0 :
-            finished / (double)(finished+to_ask);
-        }
-
-        // check if we should finish
-        if (index < 0)
-            if (time > lastsenttime + 1.2 * (sb_infotimeout.value / 1000))
-                break;
-
-        // send status request
-        if (index >= 0)
-        {
-            hosts[index].phase ++;
-            hosts[index].lastsenttime = time;
-            lastsenttime = time;
-
-            NetadrToSockadr (&(servers[index]->address), &dest);
-
-            ret = sendto (newsocket, senddata, sizeof(senddata), 0,
-                          (struct sockaddr *)&dest, sizeof(*(struct sockaddr *)&dest));
-            if(ret < 0)
-            {
-                Com_DPrintf("sendto() gave errno = %d : %s\n", errno, strerror(errno));
-            }
-            if (ret == -1)
-                ;//return;
-
-            // requests_sent++;
-            // ping_pos = requests_total <= 0 ? 0 : requests_sent / (double)requests_total;
-        }
-
-        // check if answer arrived and decode it
-        //fd.fd_count = 1;
-        //fd.fd_array[0] = newsocket;
-        FD_ZERO(&fd);
-        FD_SET(newsocket, &fd);
-
-        ret = select(newsocket+1, &fd, NULL, NULL, &timeout);
-        if (ret < 1)
-        {
-            Com_DPrintf("select() gave errno = %d : %s\n", errno, strerror(errno));
-        }
-
-        if (FD_ISSET(newsocket, &fd))
-        {
-            struct sockaddr_storage hostaddr;
-            netadr_t from;
-            int i;
-            char answer[5000];
-            answer[0] = 0;
-
-            i = sizeof(hostaddr);
-            ret = recvfrom (newsocket, answer, 5000, 0, (struct sockaddr *)&hostaddr, (socklen_t *)&i);
-            answer[max(0, min(ret, 4999))] = 0;
-
-            if (ret > 0)
-            {
-                SockadrToNetadr (&hostaddr, &from);
-
-                for (i=0; i < serversn; i++)
-                    if (from.ip[0] == servers[i]->address.ip[0] &&
-                        from.ip[1] == servers[i]->address.ip[1] &&
-                        from.ip[2] == servers[i]->address.ip[2] &&
-                        from.ip[3] == servers[i]->address.ip[3] &&
-                        from.port == servers[i]->address.port)
-                    {
-                        hosts[i].phase = (int)sb_inforetries.value;
-                        Parse_Serverinfo(servers[i], answer);
-                        break;
-                    }
-            }
-        }
-    }
-
-    // reset pings to 999 if server didn't answer
-    for (i=0; i < serversn; i++)
-        if (servers[i]->keysn <= 0)
-            SetPing(servers[i], -1);
-
-    closesocket(newsocket);
-    Q_free(hosts);
-
-    return 0;
-}
-
 void GetServerPing(server_data *serv)
 {
     int p;
@@ -553,16 +389,37 @@ void GetServerPing(server_data *serv)
         SetPing(serv, p-1);
 }
 
-int GetServerPingsAndInfosProc(void * lpParameter)
+// runs on the main thread once the query is through
+static void GetServerPingsAndInfos_Done(void)
 {
-	unsigned int SB_Sources_Marked_Count(void);
 	extern cvar_t sb_listcache;
 	extern void SB_Serverlist_Serialize_f(void);
 
-	int full = (int)(uintptr_t)lpParameter;
+    // the list has been kept sorted as the results came in, see SB_Server_Changed
+    rebuild_all_players = 1;
+    ping_phase = 0;
+
+	sb_queuedtriggers |= SB_TRIGGER_REFRESHDONE;
+
+	if (sb_listcache.integer) {
+		SB_Serverlist_Serialize_f();
+	}
+
+	if (sb_findroutes.integer && (refresh_full || !SB_PingTree_Built())) {
+		SB_PingTree_Build();
+	}
+
+	serverinfo_lock = 0;
+}
+
+int GetServerPingsAndInfosProc(void * lpParameter)
+{
+	unsigned int SB_Sources_Marked_Count(void);
+
+	int flags = SBQ_PROGRESS;
     abort_ping = 0;
 
-	if (full || serversn_passed == 0) {
+	if (refresh_full || serversn_passed == 0) {
 		if (SB_Sources_Marked_Count() == 0) {
 			// ensure some sources are marked, otherwise the refresh makes no sense
 			MarkDefaultSources();
@@ -570,8 +427,8 @@ int GetServerPingsAndInfosProc(void * lpParameter)
 
 		SB_Sources_Update(true);
 		if (useNewPing) {
-			// New Ping = UPD QW Packet ping using 2 threads (sender and receiver)
-			PingHosts(servers, serversn, sb_pings.integer);
+			// New Ping = UDP QW Packet ping, sent by the query along with the status requests
+			flags |= SBQ_PINGFIRST;
 		}
 		else {
 			// Old Ping = ICMP PING Packet using single thread
@@ -579,38 +436,16 @@ int GetServerPingsAndInfosProc(void * lpParameter)
 		}
 	}
 
-    if (!abort_ping)
-    {
-        ping_phase = 2;
-        GetServerInfosProc(NULL);
-    }
-
-    /*
-	if (abort_ping)
-        Sys_MSleep(500);    // let the packets end the road
-	*/
+	// pings and infos of every server in one go, the results are picked up
+	// by SB_Query_Apply on the main thread, which calls us back when done
+	SB_Query_Run(servers, serversn, flags, GetServerPingsAndInfos_Done);
 
-    resort_servers = 1;
-    rebuild_all_players = 1;
-    ping_phase = 0;
-
-	sb_queuedtriggers |= SB_TRIGGER_REFRESHDONE;
-
-	if (sb_listcache.integer) {
-		SB_Serverlist_Serialize_f();
-	}
-
-	if (sb_findroutes.integer && (full || !SB_PingTree_Built())) {
-		SB_PingTree_Build();
-	}
-
-	serverinfo_lock = 0;
     return 0;
 }
 
 void GetServerPingsAndInfos(int full)
 {
-	if (serverinfo_lock || SB_PingTree_IsBuilding()) {
+	if (serverinfo_lock || SB_PingTree_IsBuilding() || !SB_Query_Begin()) {
 		Com_Printf("Server list refresh is still pending\n");
 		return;
 	}
@@ -631,9 +466,13 @@ void GetServerPingsAndInfos(int full)
 
 	ping_phase = 1;
 	ping_pos = 0;
+	refresh_full = full;
 
-	if (Sys_CreateDetachedThread (GetServerPingsAndInfosProc, (void *)(uintptr_t)full) < 0) {
+	if (Sys_CreateDetachedThread (GetServerPingsAndInfosProc, NULL) < 0) {
 		Com_Printf("Failed to create GetServerPingsAndInfosProc thread\n");
+		ping_phase = 0;
+		serverinfo_lock = 0;
+		SB_Query_Run(NULL, 0, 0, NULL);	// an empty query, hands the engine back next frame
 	}
 }
 
@@ -0,0 +1,798 @@
+/*
+Copyright (C) 2011 azazello and ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// EX_browser_query.c - asynchronous server browser queries
+//
+// One nonblocking socket for every server on the list. Pings (A2A_PING) and status
+// requests go out paced by sb_pingspersec and sb_infospersec, a server gets its
+// status asked for as soon as its own pings are done instead of after the whole list
+// has been pinged, and replies find their server through a hash of its address.
+// Timeouts sit on a timer wheel, so a pass of the loop only touches the servers that
+// have something to send, something arrived for, or a timer due.
+//
+// The query thread never writes to server_data. When a server is done its result is
+// swapped into the host's mailbox with an atomic pointer exchange, and the main thread
+// moves it into the list once per frame in SB_Query_Apply, so drawing the list never
+// waits for the refresh and the refresh never waits for drawing.
+
+#include "quakedef.h"
+#ifndef _WIN32
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#endif
+#include <SDL.h>
+#include "EX_browser.h"
+
+#define SBQ_TICK		0.01	// timer wheel resolution, in seconds
+#define SBQ_WHEEL_SIZE	512		// slots, must be power of 2; a lap is 5.12 seconds
+#define SBQ_HASH_SIZE	2048	// must be power of 2
+
+#define SBQ_MAX_PINGS	6
+
+typedef enum { SBQ_PING, SBQ_STATUS, SBQ_DONE } sbq_state_t;
+
+typedef struct sbq_result_s
+{
+	int			ping;		// -1 if the server is dead
+	server_data	*info;		// status reply, NULL if it didn't come or wasn't asked for
+} sbq_result_t;
+
+typedef struct sbq_host_s
+{
+	netadr_t	address;
+	server_data	*serv;		// only the main thread touches it
+	sbq_state_t	state;
+
+	int			pings_sent, pings_received;
+	double		pingtime;	// sum of the round trips
+	double		senttime[SBQ_MAX_PINGS];
+	int			tries;		// status requests sent
+	int			ping;
+
+	double		due;		// when the timer fires
+	int			slot;		// timer wheel slot, -1 if no timer
+	int			wheelprev, wheelnext;
+	int			sendnext;	// next in its send queue
+	int			hashnext;
+
+	void		*result;	// sbq_result_t, swapped in by the query thread, out by the main thread
+} sbq_host_t;
+
+typedef struct sbq_queue_s
+{
+	int		head, tail;
+	double	tokens;			// requests we may send right now
+} sbq_queue_t;
+
+static struct
+{
+	sbq_host_t	*hosts;
+	int			hostsn;
+	int			pending;	// hosts not done yet
+	void		(*done)(void);
+
+	socket_t	sock;
+	int			hash[SBQ_HASH_SIZE];
+	int			wheel[SBQ_WHEEL_SIZE];
+	int			tick;		// first wheel tick not run yet
+	sbq_queue_t	pingqueue, statusqueue;
+	int			pingcount;	// pings per server
+
+	SDL_atomic_t	ready;		// hosts set up by SB_Query_Run, the only ones SB_Query_Apply reads
+	SDL_atomic_t	published;	// results waiting for SB_Query_Apply
+	SDL_atomic_t	finished;
+	SDL_atomic_t	busy;
+
+	// for sb_querybench
+	double		starttime, endtime;
+	int			pings_sent, status_sent, retries, passes, visits;
+} sbq;
+
+static const char sbq_status_request[] = {255, 255, 255, 255, 's','t','a','t','u','s',' ','2','3','\n'};
+static const char sbq_ping_request[] = {255, 255, 255, 255, 'k', '\n'};
+
+static int SBQ_Hash (const netadr_t *a)
+{
+	return (a->ip[0] * 31 + a->ip[1] * 17 + a->ip[2] * 7 + a->ip[3] + a->port * 13) & (SBQ_HASH_SIZE - 1);
+}
+
+static sbq_host_t *SBQ_FindHost (const netadr_t *a)
+{
+	int i;
+
+	for (i = sbq.hash[SBQ_Hash(a)]; i >= 0; i = sbq.hosts[i].hashnext)
+	{
+		sbq.visits++;
+		if (!memcmp(sbq.hosts[i].address.ip, a->ip, 4) && sbq.hosts[i].address.port == a->port)
+			return &sbq.hosts[i];
+	}
+
+	return NULL;
+}
+
+//
+// timer wheel
+//
+
+static void SBQ_TimerCancel (sbq_host_t *h)
+{
+	if (h->slot < 0)
+		return;
+
+	if (h->wheelprev >= 0)
+		sbq.hosts[h->wheelprev].wheelnext = h->wheelnext;
+	else
+		sbq.wheel[h->slot] = h->wheelnext;
+	if (h->wheelnext >= 0)
+		sbq.hosts[h->wheelnext].wheelprev = h->wheelprev;
+
+	h->slot = -1;
+}
+
+static void SBQ_TimerSet (sbq_host_t *h, double due)
+{
+	int index = h - sbq.hosts;
+
+	SBQ_TimerCancel(h);
+
+	// never behind the wheel, or it would only come round a lap later
+	h->due = due;
+	h->slot = max((int)(due / SBQ_TICK), sbq.tick) & (SBQ_WHEEL_SIZE - 1);
+	h->wheelprev = -1;
+	h->wheelnext = sbq.wheel[h->slot];
+	if (h->wheelnext >= 0)
+		sbq.hosts[h->wheelnext].wheelprev = index;
+	sbq.wheel[h->slot] = index;
+}
+
+//
+// send queues
+//
+
+static void SBQ_Enqueue (sbq_queue_t *q, sbq_host_t *h)
+{
+	int index = h - sbq.hosts;
+
+	h->sendnext = -1;
+	if (q->tail >= 0)
+		sbq.hosts[q->tail].sendnext = index;
+	else
+		q->head = index;
+	q->tail = index;
+}
+
+static sbq_host_t *SBQ_Dequeue (sbq_queue_t *q)
+{
+	sbq_host_t *h;
+
+	if (q->head < 0)
+		return NULL;
+
+	h = &sbq.hosts[q->head];
+	if ((q->head = h->sendnext) < 0)
+		q->tail = -1;
+
+	return h;
+}
+
+//
+// host states
+//
+
+static void SBQ_Publish (sbq_host_t *h, int ping, server_data *info)
+{
+	sbq_result_t *r = (sbq_result_t *) Q_malloc(sizeof(*r)), *old;
+
+	r->ping = ping;
+	r->info = info;
+
+	if ((old = (sbq_result_t *) SDL_AtomicSetPtr(&h->result, r)))
+	{
+		// can't happen, every host is published once
+		if (old->info)
+			Delete_Server(old->info);
+		Q_free(old);
+	}
+	SDL_AtomicAdd(&sbq.published, 1);
+
+	SBQ_TimerCancel(h);
+	h->state = SBQ_DONE;
+	sbq.pending--;
+}
+
+static void SBQ_AskStatus (sbq_host_t *h)
+{
+	h->state = SBQ_STATUS;
+	SBQ_TimerCancel(h);
+	SBQ_Enqueue(&sbq.statusqueue, h);
+}
+
+static void SBQ_PingsDone (sbq_host_t *h)
+{
+	h->ping = h->pings_received ? (int)(h->pingtime / h->pings_received * 1000) : -1;
+
+	if (h->ping < 0)
+		SBQ_Publish(h, -1, NULL);
+	else if (sb_hidehighping.integer && h->ping > sb_pinglimit.integer)
+		SBQ_Publish(h, h->ping, NULL); // too far to bother
+	else
+		SBQ_AskStatus(h);
+}
+
+static void SBQ_Expire (sbq_host_t *h)
+{
+	if (h->state == SBQ_PING)
+	{
+		SBQ_PingsDone(h);
+	}
+	else if (h->state == SBQ_STATUS)
+	{
+		if (h->tries < sb_inforetries.integer)
+		{
+			sbq.retries++;
+			SBQ_AskStatus(h);
+		}
+		else
+		{
+			SBQ_Publish(h, -1, NULL);
+		}
+	}
+}
+
+static void SBQ_RunTimers (double now)
+{
+	int nowtick = (int)(now / SBQ_TICK), laps, i, next;
+	sbq_host_t *h;
+
+	// only ticks that are over, anything due in them is due now
+	for (laps = 0; sbq.tick < nowtick && laps < SBQ_WHEEL_SIZE; sbq.tick++, laps++)
+	{
+		for (i = sbq.wheel[sbq.tick & (SBQ_WHEEL_SIZE - 1)]; i >= 0; i = next)
+		{
+			h = &sbq.hosts[i];
+			next = h->wheelnext;
+			sbq.visits++;
+
+			if (h->due <= now)
+			{
+				SBQ_TimerCancel(h);
+				SBQ_Expire(h);
+			}
+		}
+	}
+
+	sbq.tick = max(sbq.tick, nowtick);
+}
+
+static void SBQ_Send (sbq_host_t *h, const char *data, int len)
+{
+	struct sockaddr_storage dest;
+
+	NetadrToSockadr(&h->address, &dest);
+	if (sendto(sbq.sock, data, len, 0, (struct sockaddr *)&dest, sizeof(struct sockaddr_in)) < 0)
+		Com_DPrintf("sendto() gave errno = %d : %s\n", qerrno, strerror(qerrno));
+}
+
+static void SBQ_SendRequests (double now, double elapsed)
+{
+	sbq_host_t *h;
+
+	sbq.pingqueue.tokens = min(sbq.pingqueue.tokens + elapsed * max(1, sb_pingspersec.value), max(1, sb_pingspersec.value * SBQ_TICK * 2));
+	sbq.statusqueue.tokens = min(sbq.statusqueue.tokens + elapsed * max(1, sb_infospersec.value), max(1, sb_infospersec.value * SBQ_TICK * 2));
+
+	while (sbq.pingqueue.tokens >= 1 && (h = SBQ_Dequeue(&sbq.pingqueue)))
+	{
+		sbq.visits++;
+		SBQ_Send(h, sbq_ping_request, sizeof(sbq_ping_request));
+		h->senttime[h->pings_sent++] = now;
+		sbq.pingqueue.tokens--;
+		sbq.pings_sent++;
+
+		// go round the others before the next ping, the last one waits for the replies
+		if (h->pings_sent < sbq.pingcount)
+			SBQ_Enqueue(&sbq.pingqueue, h);
+		else
+			SBQ_TimerSet(h, now + sb_pingtimeout.value / 1000);
+	}
+
+	while (sbq.statusqueue.tokens >= 1 && (h = SBQ_Dequeue(&sbq.statusqueue)))
+	{
+		sbq.visits++;
+		SBQ_Send(h, sbq_status_request, sizeof(sbq_status_request));
+		h->tries++;
+		sbq.statusqueue.tokens--;
+		sbq.status_sent++;
+
+		SBQ_TimerSet(h, now + sb_infotimeout.value / 1000);
+	}
+}
+
+static void SBQ_Receive (double now)
+{
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	netadr_t adr;
+	sbq_host_t *h;
+	server_data *info;
+	char answer[5000];
+	int ret;
+
+	while (1)
+	{
+		fromlen = sizeof(from);
+		ret = recvfrom(sbq.sock, answer, sizeof(answer) - 1, 0, (struct sockaddr *)&from, &fromlen);
+		if (ret <= 0)
+			break; // nonblocking, nothing more for now
+		answer[ret] = 0;
+
+		SockadrToNetadr(&from, &adr);
+		if (!(h = SBQ_FindHost(&adr)))
+			continue;
+
+		if (answer[0] == 'l' && h->state == SBQ_PING)
+		{
+			// A2A_ACK, they come back in the order the pings went out
+			if (h->pings_received < h->pings_sent)
+				h->pingtime += now - h->senttime[h->pings_received++];
+			if (h->pings_received == sbq.pingcount)
+				SBQ_PingsDone(h);
+		}
+		else if (!strncmp(answer, "\xFF\xFF\xFF\xFFn", 5) && h->state == SBQ_STATUS)
+		{
+			info = Create_Server2(h->address);
+			Parse_Serverinfo(info, answer);
+			SBQ_Publish(h, h->ping, info);
+		}
+	}
+}
+
+static void SBQ_Wait (double seconds)
+{
+	struct timeval timeout;
+	fd_set fd;
+
+	FD_ZERO(&fd);
+	FD_SET(sbq.sock, &fd);
+	timeout.tv_sec = 0;
+	timeout.tv_usec = (long)(seconds * 1000000);
+	select(sbq.sock + 1, &fd, NULL, NULL, &timeout);
+}
+
+/*
+==================
+SB_Query_Run
+
+Pings (SBQ_PINGFIRST) and asks the status of every server on the list, returns when
+all of them answered or gave up. Runs on the caller's thread, which is meant to
+be a thread of its own; the results reach the servers through SB_Query_Apply, and
+done is called on the main thread once they all have.
+Without SBQ_PINGFIRST the pings the servers already have are used, and dead ones
+are left alone.
+==================
+*/
+void SB_Query_Run (server_data *servs[], int servsn, int flags, void (*done)(void))
+{
+	double now, last;
+	sbq_host_t *h;
+	int i, hash;
+
+	sbq.hosts = (sbq_host_t *) Q_malloc(max(1, servsn) * sizeof(sbq_host_t));
+	sbq.hostsn = sbq.pending = 0;
+	sbq.done = done;
+	sbq.pingcount = bound(1, sb_pings.integer, SBQ_MAX_PINGS);
+	sbq.pingqueue.head = sbq.pingqueue.tail = sbq.statusqueue.head = sbq.statusqueue.tail = -1;
+	sbq.pingqueue.tokens = sbq.statusqueue.tokens = 1;
+	sbq.pings_sent = sbq.status_sent = sbq.retries = sbq.passes = sbq.visits = 0;
+	memset(sbq.hash, -1, sizeof(sbq.hash));
+	memset(sbq.wheel, -1, sizeof(sbq.wheel));
+
+	last = sbq.starttime = Sys_DoubleTime();
+	sbq.tick = (int)(last / SBQ_TICK);
+
+	for (i = 0; i < servsn; i++)
+	{
+		if (SBQ_FindHost(&servs[i]->address))
+			continue;
+
+		h = &sbq.hosts[sbq.hostsn];
+		h->address = servs[i]->address;
+		h->serv = servs[i];
+		h->slot = -1;
+		h->ping = servs[i]->ping;
+
+		hash = SBQ_Hash(&h->address);
+		h->hashnext = sbq.hash[hash];
+		sbq.hash[hash] = sbq.hostsn++;
+		sbq.pending++;
+
+		if (flags & SBQ_PINGFIRST)
+		{
+			h->state = SBQ_PING;
+			SBQ_Enqueue(&sbq.pingqueue, h);
+		}
+		else if (h->ping < 0 || (sb_hidehighping.integer && h->ping > sb_pinglimit.integer))
+		{
+			SBQ_Publish(h, h->ping < 0 ? -1 : h->ping, NULL);
+		}
+		else
+		{
+			SBQ_AskStatus(h);
+		}
+	}
+
+	// hosts and hostsn aren't touched again, hand them to the main thread
+	SDL_AtomicSet(&sbq.ready, sbq.hostsn);
+
+	sbq.sock = UDP_OpenSocket(PORT_ANY);
+
+	while (sbq.sock != INVALID_SOCKET && sbq.pending > 0 && !abort_ping)
+	{
+		now = Sys_DoubleTime();
+		sbq.passes++;
+
+		SBQ_Receive(now);
+		SBQ_RunTimers(now);
+		SBQ_SendRequests(now, now - last);
+		last = now;
+
+		if (flags & SBQ_PROGRESS)
+		{
+			ping_phase = sbq.pingqueue.head >= 0 ? 1 : 2;
+			ping_pos = sbq.hostsn ? (sbq.hostsn - sbq.pending) / (double) sbq.hostsn : 0;
+		}
+
+		if (sbq.pending > 0)
+			SBQ_Wait(SBQ_TICK);
+	}
+
+	if (sbq.sock != INVALID_SOCKET)
+		closesocket(sbq.sock);
+
+	// whatever is left keeps what it had
+	for (i = 0; i < sbq.hostsn; i++)
+	{
+		if (sbq.hosts[i].state != SBQ_DONE)
+			SBQ_TimerCancel(&sbq.hosts[i]);
+	}
+
+	sbq.endtime = Sys_DoubleTime();
+	SDL_AtomicSet(&sbq.finished, 1);
+}
+
+static void SB_Query_ApplyResult (server_data *s, sbq_result_t *r)
+{
+	server_data *info = r->info;
+
+	Reset_Server(s);
+
+	if (info && info->keysn > 0)
+	{
+		memcpy(s->keys, info->keys, sizeof(s->keys));
+		memcpy(s->values, info->values, sizeof(s->values));
+		memcpy(s->players, info->players, sizeof(s->players));
+		s->keysn = info->keysn;
+		s->playersn = info->playersn;
+		s->spectatorsn = info->spectatorsn;
+		s->occupancy = info->occupancy;
+		s->support_teams = info->support_teams;
+		s->qizmo = info->qizmo;
+		s->qwfwd = info->qwfwd;
+		s->passed_filters = info->passed_filters;
+
+		strlcpy(s->display.name, info->display.name, sizeof(s->display.name));
+		strlcpy(s->display.map, info->display.map, sizeof(s->display.map));
+		strlcpy(s->display.gamedir, info->display.gamedir, sizeof(s->display.gamedir));
+		strlcpy(s->display.players, info->display.players, sizeof(s->display.players));
+		strlcpy(s->display.fraglimit, info->display.fraglimit, sizeof(s->display.fraglimit));
+		strlcpy(s->display.timelimit, info->display.timelimit, sizeof(s->display.timelimit));
+
+		// s owns them now
+		info->keysn = info->playersn = info->spectatorsn = 0;
+		SetPing(s, r->ping);
+	}
+	else
+	{
+		// a reply we couldn't make sense of counts as none
+		SetPing(s, info ? -1 : r->ping);
+	}
+
+	if (info)
+		Delete_Server(info);
+	Q_free(r);
+
+	SB_Server_Changed(s);
+}
+
+/*
+==================
+SB_Query_Apply
+
+Main thread, once per frame: moves the results that came in into the server list
+and finishes the query once everything has.
+==================
+*/
+void SB_Query_Apply (void)
+{
+	extern sem_t serverinfo_semaphore;
+	sbq_result_t *r;
+	void (*done)(void);
+	qbool finished;
+	int i, ready;
+
+	if (!SDL_AtomicGet(&sbq.busy))
+		return;
+
+	// read before the results, so none that come in after are missed
+	finished = SDL_AtomicGet(&sbq.finished);
+	ready = SDL_AtomicGet(&sbq.ready);
+
+	if (SDL_AtomicGet(&sbq.published) || finished)
+	{
+		SDL_AtomicSet(&sbq.published, 0);
+
+		SB_ServerList_Lock();
+		Sys_SemWait(&serverinfo_semaphore);
+		for (i = 0; i < ready; i++)
+		{
+			if ((r = (sbq_result_t *) SDL_AtomicSetPtr(&sbq.hosts[i].result, NULL)))
+				SB_Query_ApplyResult(sbq.hosts[i].serv, r);
+		}
+		Sys_SemPost(&serverinfo_semaphore);
+		SB_ServerList_Unlock();
+	}
+
+	if (!finished)
+		return;
+
+	done = sbq.done;
+	Q_free(sbq.hosts);
+	sbq.hosts = NULL;
+	sbq.hostsn = 0;
+	SDL_AtomicSet(&sbq.ready, 0);
+	SDL_AtomicSet(&sbq.busy, 0);
+
+	if (done)
+		done();
+}
+
+// a query is running or its results haven't all been applied yet
+qbool SB_Query_Busy (void)
+{
+	return SDL_AtomicGet(&sbq.busy);
+}
+
+// claims the query engine for a new query, false if it's in use
+qbool SB_Query_Begin (void)
+{
+	if (!SDL_AtomicCAS(&sbq.busy, 0, 1))
+		return false;
+
+	SDL_AtomicSet(&sbq.ready, 0);
+	SDL_AtomicSet(&sbq.published, 0);
+	SDL_AtomicSet(&sbq.finished, 0);
+	return true;
+}
+
+//
+// sb_querybench: fake servers on the loopback for timing the query engine
+//
+
+#ifndef _WIN32
+
+static struct
+{
+	socket_t		*socks;
+	server_data		**servs;
+	int				count;
+	int				loss;		// percent of requests ignored
+	SDL_atomic_t	stop;
+	SDL_atomic_t	running;
+	int				answered;	// status requests answered
+} sbqbench;
+
+static int SB_QueryBench_ServerProc (void *unused)
+{
+	struct pollfd *fds = (struct pollfd *) Q_malloc(sbqbench.count * sizeof(struct pollfd));
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	char request[64], reply[1024];
+	int i, ret, len;
+
+	for (i = 0; i < sbqbench.count; i++)
+	{
+		fds[i].fd = sbqbench.socks[i];
+		fds[i].events = POLLIN;
+	}
+
+	while (!SDL_AtomicGet(&sbqbench.stop))
+	{
+		if (poll(fds, sbqbench.count, 50) <= 0)
+			continue;
+
+		for (i = 0; i < sbqbench.count; i++)
+		{
+			if (!(fds[i].revents & POLLIN))
+				continue;
+
+			while (1)
+			{
+				fromlen = sizeof(from);
+				ret = recvfrom(fds[i].fd, request, sizeof(request), 0, (struct sockaddr *)&from, &fromlen);
+				if (ret < 5)
+					break;
+				if (sbqbench.loss > 0 && rand() % 100 < sbqbench.loss)
+					continue;
+
+				if (request[4] == 'k')
+				{
+					sendto(fds[i].fd, "l", 1, 0, (struct sockaddr *)&from, fromlen);
+				}
+				else if (ret >= 10 && !strncmp(request + 4, "status", 6))
+				{
+					len = snprintf(reply, sizeof(reply),
+						"\xFF\xFF\xFF\xFFn\\hostname\\fake server %d\\map\\dm%d\\maxclients\\16\\*gamedir\\qw"
+						"\\fraglimit\\150\\timelimit\\20\\*version\\MVDSV 0.36\n"
+						"%d 12 15 25 \"player%d\" \"base\" 4 4 \"red\"\n"
+						"%d 7 15 40 \"other%d\" \"base\" 13 13 \"blue\"\n"
+						"%d 0 3 -60 \"\\\\s\\\\watcher%d\" \"\" 0 0 \"\"\n",
+						i, 1 + i % 6, i * 3 + 1, i, i * 3 + 2, i, i * 3 + 3, i);
+					sendto(fds[i].fd, reply, len, 0, (struct sockaddr *)&from, fromlen);
+					sbqbench.answered++;
+				}
+			}
+		}
+	}
+
+	Q_free(fds);
+	SDL_AtomicSet(&sbqbench.running, 0);
+	return 0;
+}
+
+static void SB_QueryBench_Stop (void)
+{
+	int i;
+
+	SDL_AtomicSet(&sbqbench.stop, 1);
+	while (SDL_AtomicGet(&sbqbench.running))
+		Sys_MSleep(10);
+
+	for (i = 0; i < sbqbench.count; i++)
+	{
+		closesocket(sbqbench.socks[i]);
+		Delete_Server(sbqbench.servs[i]);
+	}
+	Q_free(sbqbench.socks);
+	Q_free(sbqbench.servs);
+	sbqbench.count = 0;
+}
+
+static void SB_QueryBench_Done (void)
+{
+	double elapsed = max(sbq.endtime - sbq.starttime, 0.001);
+	int i, alive = 0, ping = 0;
+
+	for (i = 0; i < sbqbench.count; i++)
+	{
+		if (sbqbench.servs[i]->keysn > 0)
+		{
+			alive++;
+			ping += sbqbench.servs[i]->ping;
+		}
+	}
+
+	Com_Printf("sb_querybench: %d of %d servers answered in %.2f s, average ping %d ms\n",
+		alive, sbqbench.count, elapsed, alive ? ping / alive : 0);
+	Com_Printf("%d pings and %d status requests sent (%.0f/s), %d retries, %d status replies\n",
+		sbq.pings_sent, sbq.status_sent, (sbq.pings_sent + sbq.status_sent) / elapsed, sbq.retries, sbqbench.answered);
+	Com_Printf("%d loop passes, %.1f hosts touched per pass\n",
+		sbq.passes, sbq.passes ? sbq.visits / (double) sbq.passes : 0);
+
+	SB_QueryBench_Stop();
+}
+
+static int SB_QueryBench_Proc (void *unused)
+{
+	SB_Query_Run(sbqbench.servs, sbqbench.count, SBQ_PINGFIRST, SB_QueryBench_Done);
+	return 0;
+}
+
+static void SB_QueryBench_f (void)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen;
+	netadr_t adr;
+	int i, count;
+
+	if (Cmd_Argc() > 3)
+	{
+		Com_Printf("Usage: %s [servers] [loss %%]\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (ping_phase || !SB_Query_Begin())
+	{
+		Com_Printf("Server list refresh is still pending\n");
+		return;
+	}
+
+	count = bound(1, Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 500, MAX_SERVERS);
+	sbqbench.loss = bound(0, Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 0, 90);
+	sbqbench.socks = (socket_t *) Q_malloc(count * sizeof(socket_t));
+	sbqbench.servs = (server_data **) Q_malloc(count * sizeof(server_data *));
+	sbqbench.answered = 0;
+
+	memset(&adr, 0, sizeof(adr));
+	adr.type = NA_IP;
+	adr.ip[0] = 127;
+	adr.ip[3] = 1;
+
+	for (sbqbench.count = 0; sbqbench.count < count; sbqbench.count++)
+	{
+		i = sbqbench.count;
+		if ((sbqbench.socks[i] = UDP_OpenSocket(PORT_ANY)) == INVALID_SOCKET)
+			break;
+
+		addrlen = sizeof(addr);
+		getsockname(sbqbench.socks[i], (struct sockaddr *)&addr, &addrlen);
+		adr.port = addr.sin_port;
+		sbqbench.servs[i] = Create_Server2(adr);
+	}
+
+	if (sbqbench.count < count)
+		Com_Printf("sb_querybench: could only open %d sockets\n", sbqbench.count);
+
+	SDL_AtomicSet(&sbqbench.stop, 0);
+	SDL_AtomicSet(&sbqbench.running, 1);
+	if (!sbqbench.count || Sys_CreateDetachedThread(SB_QueryBench_ServerProc, NULL) < 0)
+	{
+		SDL_AtomicSet(&sbqbench.running, 0);
+		SB_QueryBench_Stop();
+		SDL_AtomicSet(&sbq.busy, 0);
+		return;
+	}
+
+	Com_Printf("sb_querybench: %d fake servers, %d%% loss\n", sbqbench.count, sbqbench.loss);
+	abort_ping = 0;
+
+	if (Sys_CreateDetachedThread(SB_QueryBench_Proc, NULL) < 0)
+	{
+		Com_Printf("Failed to create SB_QueryBench_Proc thread\n");
+		SB_QueryBench_Stop();
+		SDL_AtomicSet(&sbq.busy, 0);
+	}
+}
+
+#else
+
+static void SB_QueryBench_f (void)
+{
+	Com_Printf("%s is not available on this platform\n", Cmd_Argv(0));
+}
+
+#endif // !_WIN32
+
+void SB_Query_Init (void)
+{
+	Cmd_AddCommand("sb_querybench", SB_QueryBench_f);
+}
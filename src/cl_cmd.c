@@ -699,6 +699,48 @@ void CL_Download_f (void){
 	}
 }
 
+#ifdef FTE_PEXT_CHUNKEDDOWNLOADS
+// Times a chunked download from the local server and throws the file away.
+// Latency and jitter come from cl_delay_packet and cl_delay_packet_deviation.
+void CL_DownloadBench_f (void)
+{
+	char *filename = Cmd_Argv(1);
+
+	if (Cmd_Argc() != 2 || !filename[0]) {
+		Com_Printf ("Usage: %s <datafile>\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (cls.state != ca_active || cls.demoplayback || cls.server_adr.type != NA_LOOPBACK) {
+		Com_Printf ("%s needs a local game\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (!(cls.fteprotocolextensions & FTE_PEXT_CHUNKEDDOWNLOADS)) {
+		Com_Printf ("%s needs chunked downloads\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (cls.download || cls.downloadbench) {
+		Com_Printf ("A download is already running\n");
+		return;
+	}
+
+	cls.downloadtype      = dl_single;
+	cls.downloadmethod    = DL_QW; // the server switches it to chunks
+	cls.downloadstarttime = Sys_DoubleTime();
+	cls.downloadbench     = true;
+
+	snprintf(cls.downloadname, sizeof(cls.downloadname), "%s/dlbench.tmp", cls.gamedir);
+	strlcpy(cls.downloadtempname, cls.downloadname, sizeof(cls.downloadtempname));
+
+	Com_Printf ("dlbench: %s, %d ms added round trip\n", filename, cl_delay_packet.integer);
+
+	MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
+	SZ_Print (&cls.netchan.message, va("download \"%s\"", filename));
+}
+#endif
+
 void CL_User_f (void) {
 	int uid, i;
 
@@ -930,6 +972,9 @@ void CL_InitCommands (void) {
 	// general commands
 	Cmd_AddCommand ("cmd", CL_ForwardToServer_f);
 	Cmd_AddCommand ("download", CL_Download_f);
+#ifdef FTE_PEXT_CHUNKEDDOWNLOADS
+	Cmd_AddCommand ("dlbench", CL_DownloadBench_f);
+#endif
 	Cmd_AddCommand ("qstat", CL_QStat_f);
 	Cmd_AddCommand ("packet", CL_Packet_f);
 	Cmd_AddCommand ("rcon", CL_Rcon_f);
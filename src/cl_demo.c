@@ -115,6 +115,7 @@ static char tempqwd_name[MAX_PATH] = { 0 }; // This file must be deleted after p
 static char tempqwz_name[MAX_PATH] = { 0 };
 
 static vfsfile_t *CL_Open_Demo_File(const char *name, qbool searchpaks, char **fullpath);
+static qbool CL_DemoHasExtension(const char *path, const char *ext);
 static void OnChange_demo_dir(cvar_t *var, char *string, qbool *cancel);
 cvar_t demo_dir = {"demo_dir", "", 0, OnChange_demo_dir};
 cvar_t demo_benchmarkdumps = {"demo_benchmarkdumps", "1"};
@@ -1530,6 +1531,368 @@ void CL_RecordMvd_f(void)
 	}
 }
 
+//=============================================================================
+//								DEMO KEYFRAMES
+//=============================================================================
+//
+// While a demo file is played back, a snapshot of the parsed client state is
+// taken every demo_keyframes_interval seconds together with the position of
+// the next message in the file. Seeking (backwards, or far enough forward)
+// then restores the closest snapshot before the target and only parses the
+// remaining few seconds, instead of replaying the demo from the start.
+//
+// Snapshots are only taken when the demo is memory mapped (so we can seek
+// in it) and are only restored on the same level they were taken on, since
+// precached models, sounds and static entities are not part of them.
+//
+
+cvar_t demo_keyframes = {"demo_keyframes", "1"};
+cvar_t demo_keyframes_interval = {"demo_keyframes_interval", "30"};
+cvar_t demo_keyframes_maxmem = {"demo_keyframes_maxmem", "64"};
+
+typedef struct demo_keyframe_s {
+	double          time;           // cls.demopackettime when the snapshot was taken.
+	unsigned long   offset;         // Position of the next message in playbackfile.
+	int             servercount;
+	unsigned int    map_checksum2;
+	int             rawsize;        // Size of the snapshot when unpacked.
+	int             size;           // Size of data.
+	qbool           compressed;
+	byte            *data;
+} demo_keyframe_t;
+
+// Demo state outside of cl that has to match the snapshot.
+typedef struct demo_keyframe_state_s {
+	netchan_t       netchan;
+	double          demopackettime;
+	double          olddemotime;
+	double          nextdemotime;
+	int             lastto;
+	int             lasttype;
+	int             cmdtime_msec;
+	int             mvdstatesize;
+} demo_keyframe_state_t;
+
+static demo_keyframe_t *keyframes = NULL;   // Sorted by time.
+static int keyframes_count = 0;
+static int keyframes_size = 0;
+static size_t keyframes_memory = 0;
+static double keyframes_spacing = 0;        // Grows when we run out of memory.
+
+static byte *keyframe_buffer = NULL;        // Scratch space for packing/unpacking.
+static int keyframe_buffer_size = 0;
+
+static void CL_Demo_Keyframes_Clear(void)
+{
+	int i;
+
+	for (i = 0; i < keyframes_count; i++) {
+		Q_free(keyframes[i].data);
+	}
+	Q_free(keyframes);
+	Q_free(keyframe_buffer);
+
+	keyframes_count = keyframes_size = 0;
+	keyframe_buffer_size = 0;
+	keyframes_memory = 0;
+	keyframes_spacing = 0;
+}
+
+static byte *CL_Demo_Keyframe_Buffer(int size)
+{
+	if (size > keyframe_buffer_size) {
+		Q_free(keyframe_buffer);
+		keyframe_buffer = (byte *) Q_malloc(size);
+		keyframe_buffer_size = size;
+	}
+
+	return keyframe_buffer;
+}
+
+static qbool CL_Demo_Keyframe_Matches(const demo_keyframe_t *kf)
+{
+	return kf->servercount == cl.servercount && kf->map_checksum2 == cl.map_checksum2;
+}
+
+//
+// Returns the index of the first keyframe taken after the given time.
+//
+static int CL_Demo_Keyframe_Upper(double time)
+{
+	int lo = 0, hi = keyframes_count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (keyframes[mid].time <= time) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+//
+// Drops every other keyframe once we're using more memory than allowed,
+// and takes new ones half as often from now on.
+//
+static void CL_Demo_Keyframes_Thin(void)
+{
+	int i, j;
+
+	for (i = j = 0; i < keyframes_count; i++) {
+		if (i & 1) {
+			keyframes_memory -= keyframes[i].size;
+			Q_free(keyframes[i].data);
+		}
+		else {
+			keyframes[j++] = keyframes[i];
+		}
+	}
+
+	keyframes_count = j;
+	keyframes_spacing *= 2;
+
+	Com_DPrintf("Demo keyframes: over memory limit, spacing is now %.0fs\n", keyframes_spacing);
+}
+
+//
+// Takes a snapshot if we're far enough from the existing ones. Called between two
+// demo messages, so the state matches the position of the file exactly.
+//
+static void CL_Demo_Keyframe_Capture(void)
+{
+	extern int cmdtime_msec;
+	demo_keyframe_state_t *state;
+	demo_keyframe_t *kf;
+	double time = cls.demopackettime;
+	int mvdsize, rawsize, size, pos;
+	byte *raw, *data;
+	qbool compressed = false;
+
+	if (!demo_keyframes.integer || cls.state != ca_active || !cl.validsequence) {
+		return;
+	}
+
+	if (cls.nqdemoplayback || cls.mvdplayback == QTV_PLAYBACK || !playbackfile || !FSMMAP_IsMemoryMapped(playbackfile)) {
+		return;
+	}
+
+	if (keyframes_spacing <= 0) {
+		keyframes_spacing = bound(1, demo_keyframes_interval.value, 3600);
+	}
+
+	// Is there a keyframe close enough already?
+	pos = CL_Demo_Keyframe_Upper(time);
+	if (pos > 0 && time - keyframes[pos - 1].time < keyframes_spacing) {
+		return;
+	}
+	if (pos < keyframes_count && keyframes[pos].time - time < keyframes_spacing) {
+		return;
+	}
+
+	mvdsize = MVD_Stats_StateSize();
+	rawsize = sizeof(*state) + sizeof(cl) + sizeof(cl_entities) + sizeof(cl_lightstyle) + mvdsize;
+
+#ifdef WITH_ZLIB
+	raw = CL_Demo_Keyframe_Buffer(rawsize + compressBound(rawsize));
+#else
+	raw = CL_Demo_Keyframe_Buffer(rawsize);
+#endif
+
+	state = (demo_keyframe_state_t *) raw;
+	state->netchan = cls.netchan;
+	state->demopackettime = cls.demopackettime;
+	state->olddemotime = olddemotime;
+	state->nextdemotime = nextdemotime;
+	state->lastto = cls.lastto;
+	state->lasttype = cls.lasttype;
+	state->cmdtime_msec = cmdtime_msec;
+	state->mvdstatesize = mvdsize;
+
+	size = sizeof(*state);
+	memcpy(raw + size, &cl, sizeof(cl));
+	size += sizeof(cl);
+	memcpy(raw + size, cl_entities, sizeof(cl_entities));
+	size += sizeof(cl_entities);
+	memcpy(raw + size, cl_lightstyle, sizeof(cl_lightstyle));
+	size += sizeof(cl_lightstyle);
+	MVD_Stats_SaveState(raw + size);
+
+	data = raw;
+	size = rawsize;
+
+#ifdef WITH_ZLIB
+	{
+		uLongf destlen = compressBound(rawsize);
+
+		// Most of the client state is zeroes or unchanged between frames, so even
+		// the fastest level packs it down to a small fraction.
+		if (compress2(raw + rawsize, &destlen, raw, rawsize, Z_BEST_SPEED) == Z_OK) {
+			data = raw + rawsize;
+			size = (int) destlen;
+			compressed = true;
+		}
+	}
+#endif
+
+	if (keyframes_count == keyframes_size) {
+		keyframes_size = keyframes_size ? keyframes_size * 2 : 64;
+		keyframes = (demo_keyframe_t *) Q_realloc(keyframes, keyframes_size * sizeof(demo_keyframe_t));
+	}
+
+	memmove(keyframes + pos + 1, keyframes + pos, (keyframes_count - pos) * sizeof(demo_keyframe_t));
+	keyframes_count++;
+
+	kf = &keyframes[pos];
+	kf->time = time;
+	kf->offset = VFS_TELL(playbackfile);
+	kf->servercount = cl.servercount;
+	kf->map_checksum2 = cl.map_checksum2;
+	kf->rawsize = rawsize;
+	kf->size = size;
+	kf->compressed = compressed;
+	kf->data = (byte *) Q_malloc(size);
+	memcpy(kf->data, data, size);
+
+	keyframes_memory += size;
+
+	Com_DPrintf("Demo keyframe at %.1fs: %d bytes (%d unpacked)\n", time - demostarttime, size, rawsize);
+
+	if (keyframes_memory > (size_t) max(1, demo_keyframes_maxmem.integer) * 1024 * 1024 && keyframes_count > 1) {
+		CL_Demo_Keyframes_Thin();
+	}
+}
+
+//
+// Restores the client state from a keyframe and positions the demo right after it.
+//
+static qbool CL_Demo_Keyframe_Restore(const demo_keyframe_t *kf)
+{
+	extern int cmdtime_msec;
+	demo_keyframe_state_t *state;
+	clientState_t *current;
+	byte *raw;
+	int i, size;
+
+	if (kf->compressed) {
+#ifdef WITH_ZLIB
+		uLongf destlen = kf->rawsize;
+
+		raw = CL_Demo_Keyframe_Buffer(kf->rawsize);
+		if (uncompress(raw, &destlen, kf->data, kf->size) != Z_OK || destlen != (uLongf) kf->rawsize) {
+			return false;
+		}
+#else
+		return false;
+#endif
+	}
+	else {
+		raw = kf->data;
+	}
+
+	state = (demo_keyframe_state_t *) raw;
+	if (kf->rawsize != (int)(sizeof(*state) + sizeof(cl) + sizeof(cl_entities) + sizeof(cl_lightstyle)) + state->mvdstatesize) {
+		return false;
+	}
+
+	// Everything loaded for the level stays as it is now, as well as what the
+	// user controls (pause, camera tracking).
+	current = (clientState_t *) Q_malloc(sizeof(clientState_t));
+	memcpy(current, &cl, sizeof(clientState_t));
+
+	size = sizeof(*state);
+	memcpy(&cl, raw + size, sizeof(cl));
+	size += sizeof(cl);
+	memcpy(cl_entities, raw + size, sizeof(cl_entities));
+	size += sizeof(cl_entities);
+	memcpy(cl_lightstyle, raw + size, sizeof(cl_lightstyle));
+	size += sizeof(cl_lightstyle);
+	MVD_Stats_RestoreState(raw + size, state->mvdstatesize);
+
+	memcpy(cl.model_precache, current->model_precache, sizeof(cl.model_precache));
+	memcpy(cl.vw_model_precache, current->vw_model_precache, sizeof(cl.vw_model_precache));
+	memcpy(cl.sound_precache, current->sound_precache, sizeof(cl.sound_precache));
+	memcpy(cl.clipmodels, current->clipmodels, sizeof(cl.clipmodels));
+	memcpy(cl.static_sounds, current->static_sounds, sizeof(cl.static_sounds));
+	cl.num_static_sounds = current->num_static_sounds;
+	cl.worldmodel = current->worldmodel;
+	cl.free_efrags = current->free_efrags;
+	cl.num_statics = current->num_statics;
+	cl.paused = current->paused;
+	VectorCopy(current->viewangles, cl.viewangles);
+	cl.autocam = current->autocam;
+	cl.spec_track = current->spec_track;
+	cl.ideal_track = current->ideal_track;
+	cl.spec_locked = current->spec_locked;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		cl.players[i].skin = current->players[i].skin;
+
+		if (strcmp(cl.players[i].userinfo, current->players[i].userinfo)) {
+			TP_RefreshSkin(i);
+		}
+	}
+
+	Q_free(current);
+
+	cls.netchan = state->netchan;
+	cls.demopackettime = state->demopackettime;
+	cls.lastto = state->lastto;
+	cls.lasttype = state->lasttype;
+	olddemotime = state->olddemotime;
+	nextdemotime = state->nextdemotime;
+	cmdtime_msec = state->cmdtime_msec;
+
+	VFS_SEEK(playbackfile, kf->offset, SEEK_SET);
+
+	CL_ClearPredict();
+	R_ClearParticles();
+
+	Com_DPrintf("Demo keyframe restored at %.1fs\n", kf->time - demostarttime);
+
+	return true;
+}
+
+//
+// Finds the latest usable keyframe at or before the given time and restores it.
+// Only keyframes later than "after" are worth restoring.
+//
+static qbool CL_Demo_Keyframe_Seek(double time, double after)
+{
+	int pos;
+
+	if (!demo_keyframes.integer || cls.state != ca_active || !playbackfile || !FSMMAP_IsMemoryMapped(playbackfile)) {
+		return false;
+	}
+
+	pos = CL_Demo_Keyframe_Upper(time) - 1;
+	if (pos < 0 || keyframes[pos].time <= after || !CL_Demo_Keyframe_Matches(&keyframes[pos])) {
+		return false;
+	}
+
+	return CL_Demo_Keyframe_Restore(&keyframes[pos]);
+}
+
+static void CL_Demo_Keyframes_f(void)
+{
+	int i;
+
+	if (!cls.demoplayback) {
+		Com_Printf("Not playing a demo\n");
+		return;
+	}
+
+	for (i = 0; i < keyframes_count; i++) {
+		Com_Printf("%3d: %7.1fs %8lu %s%s\n", i, keyframes[i].time - demostarttime, keyframes[i].offset,
+			CL_Demo_Keyframe_Matches(&keyframes[i]) ? "" : "(other level) ", keyframes[i].compressed ? "" : "(uncompressed)");
+	}
+	Com_Printf("%d keyframes, %d KB, every %.0fs\n", keyframes_count, (int)(keyframes_memory / 1024), keyframes_spacing);
+}
+
 //=============================================================================
 //								DEMO READING
 //=============================================================================
@@ -1995,6 +2358,9 @@ qbool CL_GetDemoMessage (void)
 		CL_Demo_Check_For_Rewind(nextdemotime);
 	}
 
+	// Everything read so far has been parsed, so this is where keyframes are taken.
+	CL_Demo_Keyframe_Capture();
+
 	// Adjust the time for MVD playback.
 	if (cls.mvdplayback)
 	{
@@ -3337,6 +3703,7 @@ void CL_StopPlayback(void)
 	if (playbackfile) {
 		VFS_CLOSE(playbackfile);
 	}
+	CL_Demo_Keyframes_Clear();
 
 	// Reset demo playback vars.
 	playbackfile = NULL;
@@ -3825,7 +4192,7 @@ static void CL_StartDemoCommand(void)
 	}
 	else if (!playbackfile) {
 		int i;
-		static char* demo_file_extensions[] = { "qwd", "mvd", "dem" };
+		static char* demo_file_extensions[] = { "qwd", "mvd", "dem", "mvd.gz", "qwd.gz" };
 
 		//
 		// Find the demo path, trying different extensions if needed.
@@ -3833,7 +4200,7 @@ static void CL_StartDemoCommand(void)
 
 		// If they specified a valid extension, try that first
 		for (i = 0; playbackfile == NULL && i < sizeof(demo_file_extensions) / sizeof(demo_file_extensions[0]); ++i) {
-			if (!strcasecmp(COM_FileExtension(name), demo_file_extensions[i])) {
+			if (CL_DemoHasExtension(name, demo_file_extensions[i])) {
 				playbackfile = CL_Open_Demo_File(name, true, NULL);
 			}
 		}
@@ -3841,12 +4208,20 @@ static void CL_StartDemoCommand(void)
 		for (i = 0; playbackfile == NULL && i < sizeof(demo_file_extensions) / sizeof(demo_file_extensions[0]); ++i) {
 			// Strip the extension from the specified filename and append
 			// the one we're currently checking for.
+			if (CL_DemoHasExtension(name, "gz")) {
+				COM_StripExtension(name, name, sizeof(name));
+			}
 			COM_StripExtension(name, name, sizeof(name));
 			strlcat(name, ".", sizeof(name));
 			strlcat(name, demo_file_extensions[i], sizeof(name));
 
 			playbackfile = CL_Open_Demo_File(name, true, NULL);
 		}
+
+		// Gzipped demos were unpacked by CL_Open_Demo_File, the playback type comes from the inner extension.
+		if (playbackfile && CL_DemoHasExtension(name, "gz")) {
+			COM_StripExtension(name, name, sizeof(name));
+		}
 	}
 
 	// Read the file completely into memory
@@ -3934,6 +4309,69 @@ static void CL_Play_f(void)
 	CL_StartDemoCommand();
 }
 
+//
+// Does the path end with "." + ext, where ext may itself contain a dot ("mvd.gz").
+//
+static qbool CL_DemoHasExtension(const char* path, const char* ext)
+{
+	size_t path_len = strlen(path);
+	size_t ext_len = strlen(ext);
+
+	return path_len > ext_len && path[path_len - ext_len - 1] == '.' && !strcasecmp(path + path_len - ext_len, ext);
+}
+
+//
+// Inflates a gzipped demo into memory, so seeking and keyframes work on it like on
+// any other demo. A server demo that is still being recorded ends at the last sync
+// flush the server made, which is at the end of a demo frame, so what we got so far
+// is played rather than treated as an error.
+//
+static vfsfile_t* CL_Open_GZip_Demo(vfsfile_t* file)
+{
+	z_stream zs;
+	byte in[16 * 1024];
+	byte* out = NULL;
+	size_t out_size = 0;
+	vfserrno_t err;
+	int ret = Z_OK, len;
+
+	memset(&zs, 0, sizeof(zs));
+
+	// 15 + 32 window bits takes either a gzip or a zlib header
+	if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+		VFS_CLOSE(file);
+		return NULL;
+	}
+
+	while (ret == Z_OK && (len = VFS_READ(file, in, sizeof(in), &err)) > 0) {
+		zs.next_in = in;
+		zs.avail_in = len;
+
+		while (ret == Z_OK && (zs.avail_in || !zs.avail_out)) {
+			if (zs.total_out == out_size) {
+				out_size = out_size ? out_size * 2 : 4 * VFS_GETLEN(file) + sizeof(in);
+				out = (byte *) Q_realloc(out, out_size);
+			}
+
+			zs.next_out = out + zs.total_out;
+			zs.avail_out = out_size - zs.total_out;
+			ret = inflate(&zs, Z_NO_FLUSH);
+		}
+	}
+
+	VFS_CLOSE(file);
+	inflateEnd(&zs);
+
+	// Z_BUF_ERROR just means the file ended early
+	if ((ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) || !zs.total_out) {
+		Com_Printf("Failed to unpack the gzipped demo\n");
+		Q_free(out);
+		return NULL;
+	}
+
+	return FSMMAP_OpenVFS(out, zs.total_out);
+}
+
 static vfsfile_t* CL_Open_Demo_File(const char* name, qbool searchpaks, char** fullPath)
 {
 	static char fullname[MAX_OSPATH];
@@ -3970,6 +4408,11 @@ static vfsfile_t* CL_Open_Demo_File(const char* name, qbool searchpaks, char** f
 		file = FS_OpenVFS(name, "rb", FS_NONE_OS);
 	}
 
+	// Read compressed server demos natively.
+	if (file && CL_DemoHasExtension(name, "gz")) {
+		file = CL_Open_GZip_Demo(file);
+	}
+
 	return file;
 }
 
@@ -4051,6 +4494,94 @@ void QTV_CloseRequest(qbool warn)
 	qtvrequestsize = 0;
 }
 
+//
+// Builds the reply to an AUTH request of a QTV proxy into connrequest.
+// Returns false if we can't answer it, the connection should be dropped then.
+//
+qbool CL_QTVAuthRequest(const char *authmethod, const char *challenge, const char *password, const char *source, char *connrequest, size_t size)
+{
+	char hash[512] = {0};
+
+	if (!strcmp(authmethod, "PLAIN"))
+	{
+		strlcpy(connrequest, QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM), size);
+		strlcat(connrequest, "AUTH: PLAIN\nPASSWORD: \"", size);
+		strlcat(connrequest, password, size);
+		strlcat(connrequest, "\"\n", size);
+		strlcat(connrequest, source, size);
+		strlcat(connrequest, "\n", size);
+
+		return true;
+	}
+	else if (!strcmp(authmethod, "SHA3_512"))
+	{
+		if (strlen(challenge)>=63)
+		{
+			sha3_context c;
+			const uint8_t *byte_hash;
+
+			sha3_Init512(&c);
+			sha3_Update(&c, challenge, strlen(challenge));
+			sha3_Update(&c, password, strlen(password));
+			byte_hash = sha3_Finalize(&c);
+			sha3_512_ByteToHex(hash, byte_hash);
+			snprintf(connrequest, size,
+				"%s" "AUTH: SHA3_512\nPASSWORD: \"%s\"\n\n", QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM), hash);
+
+			return true;
+		}
+
+		Com_Printf("Wrong challenge for AUTH: %s\n", authmethod);
+	}
+	else if (!strcmp(authmethod, "CCITT"))
+	{
+		if (strlen(challenge)>=32)
+		{
+			unsigned short crcvalue;
+
+			snprintf(hash, sizeof(hash), "%s%s", challenge, password);
+			crcvalue = CRC_Block((byte *)hash, strlen(hash));
+			snprintf(hash, sizeof(hash), "0x%X", (unsigned int)CRC_Value(crcvalue));
+			snprintf(connrequest, size, 
+				"%s" "AUTH: CCITT\nPASSWORD: \"%s\"\n\n", QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM), hash);
+
+			return true;
+		}
+
+		Com_Printf("Wrong challenge for AUTH: %s\n", authmethod);
+	}
+	else if (!strcmp(authmethod, "MD4"))
+	{
+		if (strlen(challenge)>=8)
+		{
+			unsigned int md4sum[4];
+
+			snprintf(hash, sizeof(hash), "%s%s", challenge, password);
+			Com_BlockFullChecksum (hash, strlen(hash), (unsigned char*)md4sum);
+			snprintf(hash, sizeof(hash), "%X%X%X%X", md4sum[0], md4sum[1], md4sum[2], md4sum[3]);
+			snprintf(connrequest, size, 
+				"%s" "AUTH: MD4\nPASSWORD: \"%s\"\n\n", QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM), hash);
+
+			return true;
+		}
+
+		Com_Printf("Wrong challenge for AUTH: %s\n", authmethod);
+	}
+	else if (!strcmp(authmethod, "NONE"))
+	{
+		snprintf(connrequest, size,
+				"%s" "AUTH: NONE\nPASSWORD: \n\n", QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM));
+
+		return true;
+	}
+	else
+	{
+		Com_Printf("Unknown auth method %s\n", authmethod);
+	}
+
+	return false;
+}
+
 //
 // Polls a QTV proxy. (Called on each frame to see if we have a new QTV request available)
 //
@@ -4059,7 +4590,6 @@ void CL_QTVPoll (void)
 	char QTVSV[] = "QTVSV ";
 	int	 QTVSVLEN = sizeof(QTVSV)-1;
 
-	char hash[512] = {0};
 	char challenge[128] = {0};
 	char authmethod[128] = {0};
 	vfserrno_t err;
@@ -4265,92 +4795,12 @@ void CL_QTVPoll (void)
 	{
 		char connrequest[2048];
 
-		if (!strcmp(authmethod, "PLAIN"))
+		if (CL_QTVAuthRequest(authmethod, challenge, qtvpassword, cls.qtv_source, connrequest, sizeof(connrequest)))
 		{
-			strlcpy(connrequest, QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM), sizeof(connrequest));
-			strlcat(connrequest, "AUTH: PLAIN\nPASSWORD: \"", sizeof(connrequest));
-			strlcat(connrequest, qtvpassword, sizeof(connrequest));
-			strlcat(connrequest, "\"\n", sizeof(connrequest));
-			strlcat(connrequest, cls.qtv_source, sizeof(connrequest));
-			strlcat(connrequest, "\n", sizeof(connrequest));
-
 			VFS_WRITE(qtvrequest, connrequest, strlen(connrequest));
 
 			return;
 		}
-		else if (!strcmp(authmethod, "SHA3_512"))
-		{
-			if (strlen(challenge)>=63)
-			{
-				sha3_context c;
-				const uint8_t *byte_hash;
-
-				sha3_Init512(&c);
-				sha3_Update(&c, challenge, strlen(challenge));
-				sha3_Update(&c, qtvpassword, strlen(qtvpassword));
-				byte_hash = sha3_Finalize(&c);
-				sha3_512_ByteToHex(hash, byte_hash);
-				snprintf(connrequest, sizeof(connrequest),
-					"%s" "AUTH: SHA3_512\nPASSWORD: \"%s\"\n\n", QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM), hash);
-
-				VFS_WRITE(qtvrequest, connrequest, strlen(connrequest));
-
-				return;
-			}
-
-			Com_Printf("Wrong challenge for AUTH: %s\n", authmethod);
-		}
-		else if (!strcmp(authmethod, "CCITT"))
-		{
-			if (strlen(challenge)>=32)
-			{
-				unsigned short crcvalue;
-
-				snprintf(hash, sizeof(hash), "%s%s", challenge, qtvpassword);
-				crcvalue = CRC_Block((byte *)hash, strlen(hash));
-				snprintf(hash, sizeof(hash), "0x%X", (unsigned int)CRC_Value(crcvalue));
-				snprintf(connrequest, sizeof(connrequest), 
-					"%s" "AUTH: CCITT\nPASSWORD: \"%s\"\n\n", QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM), hash);
-
-				VFS_WRITE(qtvrequest, connrequest, strlen(connrequest));
-
-				return;
-			}
-
-			Com_Printf("Wrong challenge for AUTH: %s\n", authmethod);
-		}
-		else if (!strcmp(authmethod, "MD4"))
-		{
-			if (strlen(challenge)>=8)
-			{
-				unsigned int md4sum[4];
-
-				snprintf(hash, sizeof(hash), "%s%s", challenge, qtvpassword);
-				Com_BlockFullChecksum (hash, strlen(hash), (unsigned char*)md4sum);
-				snprintf(hash, sizeof(hash), "%X%X%X%X", md4sum[0], md4sum[1], md4sum[2], md4sum[3]);
-				snprintf(connrequest, sizeof(connrequest), 
-					"%s" "AUTH: MD4\nPASSWORD: \"%s\"\n\n", QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM), hash);
-
-				VFS_WRITE(qtvrequest, connrequest, strlen(connrequest));
-
-				return;
-			}
-
-			Com_Printf("Wrong challenge for AUTH: %s\n", authmethod);
-		}
-		else if (!strcmp(authmethod, "NONE"))
-		{
-			snprintf(connrequest, sizeof(connrequest),
-					"%s" "AUTH: NONE\nPASSWORD: \n\n", QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM));
-
-			VFS_WRITE(qtvrequest, connrequest, strlen(connrequest));
-
-			return;
-		}
-		else
-		{
-			Com_Printf("Unknown auth method %s\n", authmethod);
-		}
 	}
 
 	QTV_CloseRequest(true);
@@ -4798,9 +5248,6 @@ void CL_Demo_Check_For_Rewind(float nextdemotime)
 	// If we're seeking and our seek destination is in the past we need to rewind.
 	if (cls.demoseeking && !cls.demorewinding && (cls.demotime < nextdemotime))
 	{
-		// Restart playback from the start of the file and then demo seek to the rewind spot.
-		VFS_SEEK(playbackfile, 0, SEEK_SET);
-
 		// We need to save track information.
 		CL_MultiviewDemoStartRewind ();
 		rewind_spec_track = WhoIsSpectated(); //spec_track;
@@ -4809,12 +5256,30 @@ void CL_Demo_Check_For_Rewind(float nextdemotime)
 		VectorCopy(cl.viewangles, rewind_angle);
 		VectorCopy(cl.simorg, rewind_pos);
 
+		// Jump back to the closest keyframe if we have one, the demo seek will
+		// then only have to parse the last few seconds.
+		if (CL_Demo_Keyframe_Seek(cls.demotime, -1))
+		{
+			cls.demoseeking     = DST_SEEKING_NORMAL;
+			cls.demorewinding   = true;
+			return;
+		}
+
+		// Restart playback from the start of the file and then demo seek to the rewind spot.
+		VFS_SEEK(playbackfile, 0, SEEK_SET);
+
 		// Restart the demo from scratch.
 		CL_DemoPlaybackInit();
 
 		cls.demopackettime  = 0.0;
 		cls.demorewinding   = true;
 	}
+	else if (cls.demoseeking == DST_SEEKING_NORMAL && (cls.demotime > nextdemotime))
+	{
+		// Seeking forward (also after restarting for a rewind), skip ahead
+		// to a keyframe if there's one past where we are.
+		CL_Demo_Keyframe_Seek(cls.demotime, cls.demopackettime + 1.0);
+	}
 	
 	if (cls.demorewinding)
 	{
@@ -5468,6 +5933,7 @@ void CL_Demo_Init(void)
 	Cmd_AddCommand("demo_jump_mark", CL_Demo_Jump_Mark_f);
 	Cmd_AddCommand("demo_jump_status", CL_Demo_Jump_Status_f);
 	Cmd_AddCommand("demo_jump_end", CL_Demo_Jump_End_f);
+	Cmd_AddCommand("demo_keyframes_list", CL_Demo_Keyframes_f);
 	Cmd_AddCommand("demo_controls", DemoControls_f);
 
 	//
@@ -5497,6 +5963,9 @@ void CL_Demo_Init(void)
 	Cvar_Register(&demo_jump_rewind);
 	Cvar_Register(&cl_demo_qwd_delta);
 	Cvar_Register(&demo_jump_skip_messages);
+	Cvar_Register(&demo_keyframes);
+	Cvar_Register(&demo_keyframes_interval);
+	Cvar_Register(&demo_keyframes_maxmem);
 
 	Cvar_ResetCurrentGroup();
 }
@@ -2811,6 +2811,7 @@ void CL_Frame(double time)
 	Sys_ReadIPC();
 
 	CL_QTVPoll();
+	QTV_Streams_Poll();
 #ifdef WITH_IRC
 	IRC_Update();
 #endif
@@ -2833,6 +2834,7 @@ void CL_Frame(double time)
 void CL_Shutdown (void) 
 {
 	CL_Disconnect();
+	QTV_Streams_Shutdown();
 	SList_Shutdown();
 	CDAudio_Shutdown();
 	S_Shutdown();
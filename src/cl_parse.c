@@ -801,6 +801,18 @@ extern void CL_RequestNextDownload (void);
 
 #define MAXBLOCKS 1024	// Must be power of 2
 #define DLBLOCKSIZE 1024
+#define DLMAXRANGE 32	// most blocks one nextdl asks for, if the server takes a count
+
+// window limits, in blocks
+#define DL_MIN_WINDOW		4
+#define DL_INITIAL_WINDOW	16
+#define DL_MAX_WINDOW		(MAXBLOCKS / 2)
+#define DL_LOSS_TOLERANCE	10		// a round trip losing less than 1 in this many blocks isn't congestion
+
+// blockflags
+#define DLBLOCK_INFLIGHT	1	// asked for and not back yet
+#define DLBLOCK_RANGED		2	// asked for as part of a range, not at its head
+#define DLBLOCK_RETRIED		4	// asked for more than once, its arrival time says nothing about the round trip
 
 int chunked_download_number = 0; // Never reset, bumped up.
 
@@ -808,66 +820,274 @@ int downloadsize;
 int receivedbytes;
 int recievedblock[MAXBLOCKS];
 int firstblock;
-int blockcycle;
 
-int CL_RequestADownloadChunk(void)
+static double requestedblock[MAXBLOCKS];	// when a block in flight was asked for
+static byte blockflags[MAXBLOCKS];
+static byte requestslot[MAXBLOCKS];		// which nextdl of its packet asked for it
+static int nextblock;				// first block never asked for
+
+//
+// The download is paced by a window of blocks in flight rather than by how many
+// requests fit in a frame. It doubles every round trip until blocks start going
+// missing, then keeps growing by a sixteenth per round trip, and backs off when a
+// round trip loses more than one block in DL_LOSS_TOLERANCE; the odd stray loss on a
+// bad line just gets asked for again. Missing means not back after srtt + 4 * rttvar.
+// A server that takes a count in nextdl meters ranges by time, not per packet, so
+// the whole window can go out in one packet and the rate doesn't depend on our
+// framerate; what it drops over its budget is loss like any other.
+// Older servers only answer so many nextdl per packet (sv_downloadchunksperframe) and
+// drop the rest without a word. So when a block goes missing from further into its
+// packet than any request has ever come back from, that isn't congestion: we lower
+// maxslots, the number of nextdl we send per packet, to what did come back, and leave
+// the window alone. With those the rate stays bound to the framerate.
+// All of it carries over from one file to the next, so a map followed by a handful
+// of skins doesn't start from scratch every time.
+//
+static struct
 {
-	int i;
-	int b;
+	netadr_t	server;
+	double		lastactive;
 
-	if (cls.downloadmethod != DL_QWCHUNKS) // Paranoia!
-		Host_Error("download not initiated\n");
+	double		window;
+	double		ssthresh;
+	double		srtt;		// smoothed round trip, 0 until the first sample
+	double		rttvar;
+	double		roundstart;
+	int			delivered;	// this round trip
+	int			lost;
+	int			inflight;
 
-	for (i = 0; i < MAXBLOCKS; i++)
-	{
-		blockcycle++;
+	int			maxslots;	// nextdl per packet the server answers, without ranges
+	int			slotsanswered;	// highest slot we got an answer to, plus one
 
-		b = ((blockcycle) & (MAXBLOCKS-1)) + firstblock;
+	int			ranges;		// server takes a count in nextdl: -1 don't know yet, 0 no, 1 yes
+	qbool		probed;		// a two block range went out to find out
 
-		if (!recievedblock[b&(MAXBLOCKS-1)]) // Don't ask for ones we've already got.
-		{
-			if (b >= (downloadsize+DLBLOCKSIZE-1)/DLBLOCKSIZE)	// Don't ask for blocks that are over the size of the file.
-				continue;
-			return b;
+	int			requests;	// this file, for dlbench
+	int			retries;
+} dlcc;
+
+static double CL_DownloadTimeout (void)
+{
+	if (!dlcc.srtt)
+		return 1.0;
+
+	return bound(0.05, dlcc.srtt + 4 * dlcc.rttvar, 3.0);
+}
+
+static void CL_StartChunkedDownload (void)
+{
+	double now = Sys_DoubleTime();
+
+	// first download, new server, or it's been a while: forget what we knew about the path
+	if (!dlcc.window || !NET_CompareAdr(dlcc.server, cls.netchan.remote_address) || now - dlcc.lastactive > 10) {
+		memset(&dlcc, 0, sizeof(dlcc));
+		dlcc.server = cls.netchan.remote_address;
+		dlcc.window = DL_INITIAL_WINDOW;
+		dlcc.ssthresh = DL_MAX_WINDOW;
+		dlcc.ranges = -1;
+		dlcc.maxslots = 30;
+	}
+
+	dlcc.lastactive = now;
+	dlcc.inflight = 0;
+	dlcc.requests = dlcc.retries = 0;
+
+	nextblock = 0;
+	memset(requestedblock, 0, sizeof(requestedblock));
+	memset(blockflags, 0, sizeof(blockflags));
+}
+
+static void CL_ChunkArrived (int chunknum)
+{
+	int i = chunknum & (MAXBLOCKS-1);
+	double now = Sys_DoubleTime(), rtt;
+
+	if (blockflags[i] & DLBLOCK_RANGED)
+		dlcc.ranges = 1;
+
+	if (blockflags[i] & DLBLOCK_INFLIGHT) {
+		dlcc.inflight--;
+		dlcc.delivered++;
+		dlcc.slotsanswered = max(dlcc.slotsanswered, requestslot[i] + 1);
+
+		if (!(blockflags[i] & DLBLOCK_RETRIED)) {
+			rtt = now - requestedblock[i];
+			if (!dlcc.srtt) {
+				dlcc.srtt = rtt;
+				dlcc.rttvar = rtt / 2;
+			} else {
+				dlcc.rttvar += (fabs(dlcc.srtt - rtt) - dlcc.rttvar) / 4;
+				dlcc.srtt += (rtt - dlcc.srtt) / 8;
+			}
 		}
 	}
 
+	if (dlcc.window < dlcc.ssthresh)
+		dlcc.window += 1;
+	else
+		dlcc.window += max(1, dlcc.window / 16) / dlcc.window;
+	dlcc.window = min(dlcc.window, DL_MAX_WINDOW);
+
+	blockflags[i] = 0;
+	dlcc.lastactive = now;
+}
+
+// gives up on blocks that are overdue so they get asked for again
+static void CL_ExpireChunkRequests (double now)
+{
+	double timeout = CL_DownloadTimeout();
+	int b, i;
+
+	for (b = firstblock; b < nextblock; b++) {
+		i = b & (MAXBLOCKS-1);
+		if (!(blockflags[i] & DLBLOCK_INFLIGHT) || now - requestedblock[i] < timeout)
+			continue;
+
+		dlcc.inflight--;
+
+		if ((blockflags[i] & DLBLOCK_RANGED) && dlcc.ranges != 1) {
+			// only the head of a range came back, the server doesn't take a count
+			dlcc.ranges = 0;
+			blockflags[i] = 0;
+			continue;
+		}
+
+		if (dlcc.ranges != 1 && dlcc.slotsanswered && requestslot[i] >= dlcc.slotsanswered) {
+			// past what the server answers per packet
+			dlcc.maxslots = dlcc.slotsanswered;
+			blockflags[i] = DLBLOCK_RETRIED;
+			continue;
+		}
+
+		blockflags[i] = DLBLOCK_RETRIED;
+		dlcc.lost++;
+	}
+
+	if (now - dlcc.roundstart < max(dlcc.srtt, 0.05))
+		return;
+
+	if (dlcc.lost * DL_LOSS_TOLERANCE > dlcc.lost + dlcc.delivered) {
+		dlcc.ssthresh = max(dlcc.window * 0.7, DL_MIN_WINDOW);
+		dlcc.window = dlcc.ssthresh;
+	}
+
+	dlcc.roundstart = now;
+	dlcc.delivered = dlcc.lost = 0;
+}
+
+// the block to ask for next, -1 if there's none we can ask for right now
+static int CL_NextChunkToRequest (int from, int numblocks)
+{
+	int b;
+
+	for (b = max(from, firstblock); b < nextblock; b++) {
+		if (!recievedblock[b&(MAXBLOCKS-1)] && !(blockflags[b&(MAXBLOCKS-1)] & DLBLOCK_INFLIGHT))
+			return b;
+	}
+
+	if (b < numblocks && b - firstblock < MAXBLOCKS)
+		return b;
+
 	return -1;
 }
 
 void CL_SendChunkDownloadReq(void)
 {
 	extern cvar_t cl_chunksperframe;
-	int i, j, chunks;
-	
-	chunks = bound(1, cl_chunksperframe.integer, 30);
+	int b, i, count, limit, room, requests, maxrequests, numblocks;
+	double now;
+
+	if (cls.downloadmethod != DL_QWCHUNKS)
+		return;
 
-	for (j = 0; j < chunks; j++)
+	numblocks = (downloadsize + DLBLOCKSIZE - 1) / DLBLOCKSIZE;
+
+	// all of it is here, let server know
+	// qqshka: download percent optional, server does't really require it, that my extension, hope does't fuck up something
+	if (firstblock >= numblocks)
 	{
-		if (cls.downloadmethod != DL_QWCHUNKS)
-			return;
+		if (strstr(Info_ValueForKey(cl.serverinfo, "*version"), "MVDSV"))
+			CL_SendClientCommand(true, "nextdl %d %d %d", -1, cls.downloadpercent, chunked_download_number);
+		else
+			CL_SendClientCommand(true, "stopdownload");
 
-		i = CL_RequestADownloadChunk();
-		// i < 0 mean client complete download, let server know
-		// qqshka: download percent optional, server does't really require it, that my extension, hope does't fuck up something
+		cls.downloadpercent = 100;
+		CL_FinishDownload(); // this also request next dl
+		return;
+	}
 
-		if (i < 0)
-		{
-			if (strstr(Info_ValueForKey(cl.serverinfo, "*version"), "MVDSV"))
-				CL_SendClientCommand(true, "nextdl %d %d %d", i, cls.downloadpercent, chunked_download_number);
-			else
-				CL_SendClientCommand(true, "stopdownload");
+	now = Sys_DoubleTime();
+	CL_ExpireChunkRequests(now);
 
-			cls.downloadpercent = 100;
-			CL_FinishDownload(); // this also request next dl
-		}
+	room = (int) dlcc.window - dlcc.inflight;
+	if (dlcc.ranges == 1)
+		maxrequests = DL_MAX_WINDOW;	// the server meters us by time, the window is the limit
+	else
+		maxrequests = bound(1, min(cl_chunksperframe.integer, dlcc.maxslots), 30);
+
+	for (requests = 0, b = firstblock; room > 0 && requests < maxrequests; requests++)
+	{
+		// leave room in the packet for one more nextdl
+		if (cls.cmdmsg.cursize + 64 > cls.cmdmsg.maxsize)
+			break;
+
+		if ((b = CL_NextChunkToRequest(b, numblocks)) < 0)
+			break;
+
+		// take as many of the following blocks as the window allows, while they're
+		// ones we still need; until we know the server can do it, try it once with two
+		if (dlcc.ranges == 1)
+			limit = min(room, DLMAXRANGE);
+		else if (dlcc.ranges < 0 && !dlcc.probed)
+			limit = min(room, 2);
 		else
-		{
-			CL_SendClientCommand(false, "nextdl %d %d %d", i, cls.downloadpercent, chunked_download_number);
+			limit = 1;
+
+		for (count = 1; count < limit; count++) {
+			if (CL_NextChunkToRequest(b + count, numblocks) != b + count)
+				break;
+		}
+
+		// once the server takes ranges, always send a count so it meters these by time too
+		if (count > 1 || dlcc.ranges == 1) {
+			CL_SendClientCommand(false, "nextdl %d %d %d %d", b, cls.downloadpercent, chunked_download_number, count);
+			dlcc.probed = true;
+		}
+		else {
+			CL_SendClientCommand(false, "nextdl %d %d %d", b, cls.downloadpercent, chunked_download_number);
 		}
+
+		for (i = 0; i < count; i++) {
+			int j = (b + i) & (MAXBLOCKS-1);
+
+			if (blockflags[j] & DLBLOCK_RETRIED)
+				dlcc.retries++;
+			else if (i)
+				blockflags[j] |= DLBLOCK_RANGED;
+			blockflags[j] |= DLBLOCK_INFLIGHT;
+			requestedblock[j] = now;
+			requestslot[j] = min(requests, 255);
+		}
+
+		dlcc.requests += count;
+		dlcc.inflight += count;
+		room -= count;
+		b += count;
+		nextblock = max(nextblock, b);
 	}
 }
 
+// dlbench's report, when the file it asked for is done
+void CL_DownloadBenchReport (void)
+{
+	double tm = Sys_DoubleTime() - cls.downloadstarttime;
+
+	Com_Printf("%.2f MB in %.2f s: %.2f MB/s\n", downloadsize / (1024.0 * 1024.0), tm, tm > 0 ? downloadsize / (1024.0 * 1024.0) / tm : 0);
+	Com_Printf("window %.0f blocks, rtt %.0f ms, %d blocks asked for, %d again, ranges %s\n",
+		dlcc.window, dlcc.srtt * 1000, dlcc.requests, dlcc.retries, dlcc.ranges == 1 ? "yes" : "no");
+}
+
 void CL_ParseDownload (void);
 
 void CL_Parse_OOB_ChunkedDownload(void)
@@ -967,8 +1187,8 @@ void CL_ParseChunkedDownload(void)
 
 		firstblock    = 0;
 		receivedbytes = 0;
-		blockcycle    = -1;	//so it requests 0 first. :)
 		memset(recievedblock, 0, sizeof(recievedblock));
+		CL_StartChunkedDownload();
 		return;
 	}
 
@@ -1005,6 +1225,7 @@ void CL_ParseChunkedDownload(void)
 
 	receivedbytes += DLBLOCKSIZE;
 	recievedblock[chunknum&(MAXBLOCKS-1)] = true;
+	CL_ChunkArrived(chunknum);
 
 	while(recievedblock[firstblock&(MAXBLOCKS-1)])
 	{
@@ -1052,10 +1273,19 @@ void CL_RequestNextDownload (void)
 
 void CL_FinishDownload(void)
 {
+#ifdef FTE_PEXT_CHUNKEDDOWNLOADS
+	if (cls.downloadbench) {
+		if (cls.download && cls.downloadpercent == 100)
+			CL_DownloadBenchReport();
+		else
+			Com_Printf ("dlbench: download failed\n");
+	}
+#endif
+
 	if (cls.download) {
 		fclose (cls.download);
 
-		if (cls.downloadpercent == 100) {
+		if (cls.downloadpercent == 100 && !cls.downloadbench) {
 			Com_DPrintf("Download took %.1f seconds\n", Sys_DoubleTime() - cls.downloadstarttime);
 
 			// rename the temp file to its final name
@@ -1071,6 +1301,7 @@ void CL_FinishDownload(void)
 	cls.download = NULL;
 	cls.downloadpercent = 0;
 	cls.downloadmethod = DL_NONE;
+	cls.downloadbench = false;
 
 	// VFS-FIXME: D-Kure: Surely there is somewhere better for this in fs.c
 	filesystemchanged = true;
@@ -1390,35 +1621,12 @@ void CL_StopUpload(void)
 =====================================================================
 */
 
-void CL_ParseServerData (void) 
+// Reads the protocol version and extension numbers at the start of
+// svc_serverdata, allows 2.2 and 2.29 demos to play.
+int CL_ParseProtocolVersion (void)
 {
-	char *str, fn[MAX_OSPATH];
-	FILE *f;
-	qbool cflag = false;
-	int i, protover;
-
-	Com_DPrintf("Serverdata packet received.\n");
+	int protover;
 
-	// Save tracking state before clearing
-	int saved_spec_track = cl.spec_track;
-	qbool saved_spec_locked = cl.spec_locked;
-	int saved_autocam = cl.autocam;
-	int saved_ideal_track = cl.ideal_track;
-	qbool was_spectator = cl.spectator;
-
-	// wipe the clientState_t struct
-	CL_ClearState();
-
-	// Restore tracking state if we were spectating
-	if (was_spectator && saved_spec_track >= 0) {
-		cl.spec_track = saved_spec_track;
-		cl.spec_locked = saved_spec_locked;
-		cl.autocam = saved_autocam;
-		cl.ideal_track = saved_ideal_track;
-	}
-
-	// parse protocol version number
-	// allow 2.2 and 2.29 demos to play
 #ifdef PROTOCOL_VERSION_FTE
 	cls.fteprotocolextensions = 0;
 #endif // PROTOCOL_VERSION_FTE
@@ -1508,6 +1716,39 @@ void CL_ParseServerData (void)
 	}
 #endif
 
+	return protover;
+}
+
+void CL_ParseServerData (void) 
+{
+	char *str, fn[MAX_OSPATH];
+	FILE *f;
+	qbool cflag = false;
+	int i, protover;
+
+	Com_DPrintf("Serverdata packet received.\n");
+
+	// Save tracking state before clearing
+	int saved_spec_track = cl.spec_track;
+	qbool saved_spec_locked = cl.spec_locked;
+	int saved_autocam = cl.autocam;
+	int saved_ideal_track = cl.ideal_track;
+	qbool was_spectator = cl.spectator;
+
+	// wipe the clientState_t struct
+	CL_ClearState();
+
+	// Restore tracking state if we were spectating
+	if (was_spectator && saved_spec_track >= 0) {
+		cl.spec_track = saved_spec_track;
+		cl.spec_locked = saved_spec_locked;
+		cl.autocam = saved_autocam;
+		cl.ideal_track = saved_ideal_track;
+	}
+
+	// parse protocol version number
+	protover = CL_ParseProtocolVersion();
+
 	cl.protoversion = protover;
 	cl.servercount = MSG_ReadLong ();
 
@@ -1865,8 +2106,6 @@ void CL_ParseBaseline (entity_state_t *es)
 
 // An easy way to keep compatability with other entity extensions
 #if defined (PROTOCOL_VERSION_FTE) && defined (FTE_PEXT_SPAWNSTATIC2)
-extern void CL_ParseDelta (entity_state_t *from, entity_state_t *to, int bits);
-
 static void CL_ParseSpawnBaseline2 (void)
 {
 	entity_state_t nullst, es;
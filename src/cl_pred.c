@@ -31,6 +31,7 @@ cvar_t	cl_predict_beam = { "cl_predict_beam", "1" };
 cvar_t	cl_predict_projectiles = { "cl_predict_projectiles", "1" };
 cvar_t	cl_predict_jump = { "cl_predict_jump", "1" };
 cvar_t	cl_predict_buffer = { "cl_predict_buffer", "1" };
+cvar_t	cl_predict_incremental = { "cl_predict_incremental", "0" };
 
 extern cvar_t cl_independentPhysics;
 
@@ -59,6 +60,42 @@ extern cvar_t cl_predict_buffer;
 static qbool nolerp[2];
 static qbool nolerp_nextpos;
 
+// Incremental prediction. Until a new server frame arrives the same commands
+// get predicted from the same state every frame, so the results are kept per
+// outgoing sequence and only the frames after the first changed command are run
+// again. The other players are solid where they were when the server frame came.
+
+// what pmove leaves behind that the caller reads and player_state_t lacks
+typedef struct predframe_s {
+	int			sequence;		// 0 if nothing is cached for this slot
+	usercmd_t	cmd;			// the command it was predicted with
+	qbool		onground;
+	int			groundent;
+	int			waterlevel;
+	int			watertype;
+} predframe_t;
+
+// everything besides the commands the predicted frames depend on
+typedef struct predbase_s {
+	int			servercount;
+	int			playernum;
+	int			validsequence;
+	int			parsecount;
+	int			z_ext;
+	int			nopred_weapon;
+	float		entgravity;
+	float		maxspeed;
+	float		bunnyspeedcap;
+	movevars_t	movevars;
+} predbase_t;
+
+static struct {
+	predbase_t	base;
+	int			numphysent;
+	physent_t	physents[MAX_PHYSENTS];
+	predframe_t	frames[UPDATE_BACKUP];
+} predcache;
+
 void CL_InitWepSounds(void)
 {
 	cl_sfx_jump = S_PrecacheSound("player/plyrjmp8.wav");
@@ -501,10 +538,109 @@ void CL_PlayEvents(void)
 	pmove.effect_frame = threshold;
 }
 
+// Frees the predicted events, keeping those of frames keepfrom to keepto - 1.
+static void CL_PrunePredictionEvents (int keepfrom, int keepto)
+{
+	prediction_event_sound_t **s_link = &p_event_sound, *s_event;
+	prediction_event_fakeproj_t **p_link = &p_event_fakeproj, *p_event;
+
+	while ((s_event = *s_link) != NULL) {
+		if (s_event->frame_num >= keepfrom && s_event->frame_num < keepto) {
+			s_link = &s_event->next;
+			continue;
+		}
+		*s_link = s_event->next;
+		free(s_event);
+	}
+
+	while ((p_event = *p_link) != NULL) {
+		if (p_event->frame_num >= keepfrom && p_event->frame_num < keepto) {
+			p_link = &p_event->next;
+			continue;
+		}
+		*p_link = p_event->next;
+		free(p_event);
+	}
+}
+
+// Sets up the solid players for prediction, from the cache unless a new server frame
+// came or anything else the cached frames depend on changed.
+static void CL_PredictCacheBegin (void)
+{
+	predbase_t base;
+
+	memset(&base, 0, sizeof(base));
+	base.servercount = cl.servercount;
+	base.playernum = cl.playernum;
+	base.validsequence = cl.validsequence;
+	base.parsecount = cl.parsecount;
+	base.z_ext = cl.z_ext;
+	base.nopred_weapon = pmove_nopred_weapon;
+	base.entgravity = cl.entgravity;
+	base.maxspeed = cl.maxspeed;
+	base.bunnyspeedcap = cl.bunnyspeedcap;
+	base.movevars = movevars;
+	// CL_PredictUsercmd sets these from cl
+	base.movevars.entgravity = base.movevars.maxspeed = base.movevars.bunnyspeedcap = 0;
+
+	if (!memcmp(&base, &predcache.base, sizeof(base))) {
+		memcpy(pmove.physents + pmove.numphysent, predcache.physents, predcache.numphysent * sizeof(physent_t));
+		pmove.numphysent += predcache.numphysent;
+		return;
+	}
+
+	predcache.base = base;
+	memset(predcache.frames, 0, sizeof(predcache.frames));
+
+	predcache.numphysent = pmove.numphysent;
+	CL_SetSolidPlayers(cl.playernum);
+	predcache.numphysent = pmove.numphysent - predcache.numphysent;
+	memcpy(predcache.physents, pmove.physents + pmove.numphysent - predcache.numphysent, predcache.numphysent * sizeof(physent_t));
+}
+
+static predframe_t *CL_PredictCacheFrame (int sequence)
+{
+	predframe_t *cached = &predcache.frames[sequence & UPDATE_MASK];
+
+	if (cached->sequence != sequence || memcmp(&cached->cmd, &cl.frames[sequence & UPDATE_MASK].cmd, sizeof(usercmd_t)))
+		return NULL;
+
+	return cached;
+}
+
+static void CL_PredictCacheStore (int sequence)
+{
+	predframe_t *cached = &predcache.frames[sequence & UPDATE_MASK];
+
+	cached->sequence = sequence;
+	memcpy(&cached->cmd, &cl.frames[sequence & UPDATE_MASK].cmd, sizeof(usercmd_t));
+	cached->onground = pmove.onground;
+	cached->groundent = pmove.groundent;
+	cached->waterlevel = pmove.waterlevel;
+	cached->watertype = pmove.watertype;
+}
+
+// Puts pmove back the way predicting the frame left it.
+static void CL_PredictCacheRestore (predframe_t *cached, player_state_t *state)
+{
+	VectorCopy(state->origin, pmove.origin);
+	VectorCopy(state->velocity, pmove.velocity);
+	VectorCopy(state->viewangles, pmove.angles);
+	pmove.onground = cached->onground;
+	pmove.groundent = cached->groundent;
+	pmove.waterlevel = cached->waterlevel;
+	pmove.watertype = cached->watertype;
+	pmove.client_time = state->client_time;
+	pmove.weapon = state->weapon;
+	pmove.weaponframe = state->weaponframe;
+}
+
 void CL_PredictMove (qbool physframe) {
 	int i, oldphysent;
 	frame_t *from = NULL, *to;
 	qbool angles_lerp = false;
+	int first;
+	qbool incremental;
 
 	if (cl.paused && !CL_MultiviewEnabled())
 		return;
@@ -563,39 +699,50 @@ void CL_PredictMove (qbool physframe) {
 	else if (physframe || !cl_independentPhysics.value)
 	{
 		oldphysent = pmove.numphysent;
-		CL_SetSolidPlayers (cl.playernum);
 
 		pmove_playeffects = false;
 		pmove_nopred_weapon = (cl_nopred_weapon.integer || pmove.client_predflags == PRDFL_FORCEOFF || cl.spectator);
 
-		///*
-		// cleanup all pred events
-		while (p_event_sound != NULL)
-		{
-			prediction_event_sound_t *s_event = p_event_sound;
-			p_event_sound = NULL;// s_event->next;
-			free(s_event);
+		incremental = cl_predict_incremental.integer;
+#ifdef JSS_CAM
+		incremental = incremental && !cam_lockdir.value;
+#endif
+		if (incremental) {
+			CL_PredictCacheBegin();
+		}
+		else {
+			CL_SetSolidPlayers (cl.playernum);
+			predcache.base.servercount = -1;
 		}
 
-		while (p_event_fakeproj != NULL)
-		{
-			prediction_event_fakeproj_t *p_event = p_event_fakeproj;
-			p_event_fakeproj = NULL;// p_event->next;
-			free(p_event);
+		// find the first frame whose command changed since it was predicted
+		first = 1;
+		if (incremental) {
+			while (first < UPDATE_BACKUP - 1 && cl.validsequence + first < cls.netchan.outgoing_sequence
+				&& CL_PredictCacheFrame(cl.validsequence + first))
+				first++;
 		}
-		//*/
 
+		// cleanup the pred events of the frames that will be predicted again
+		CL_PrunePredictionEvents(cl.validsequence + 1, cl.validsequence + first);
 
 		// run frames
 		for (i = 1; i < UPDATE_BACKUP - 1 && cl.validsequence + i < cls.netchan.outgoing_sequence; i++) {
 
+			from = to;
+			to = &cl.frames[(cl.validsequence + i) & UPDATE_MASK];
+
+			if (i < first)
+				continue;	// same as last time
+
 			pmove.frame_current = (cl.validsequence + i);
 			if (cl.validsequence + i >= cls.netchan.outgoing_sequence - 1)
 				pmove_playeffects = true;
 
-			from = to;
-			to = &cl.frames[(cl.validsequence + i) & UPDATE_MASK];
 			CL_PredictUsercmd (&from->playerstate[cl.playernum], &to->playerstate[cl.playernum], &to->cmd, true);
+			if (incremental) {
+				CL_PredictCacheStore(cl.validsequence + i);
+			}
 
 			if ((cl.validsequence + i) == cl.simerr_frame)
 			{
@@ -616,6 +763,11 @@ void CL_PredictMove (qbool physframe) {
 			}
 		}
 
+		// nothing needed predicting, so pmove has to be given back the results of the last frame
+		if (first == i) {
+			CL_PredictCacheRestore(CL_PredictCacheFrame(cl.validsequence + i - 1), &to->playerstate[cl.playernum]);
+		}
+
 		CL_PlayEvents();
 
 		pmove.numphysent = oldphysent;
@@ -718,6 +870,7 @@ void CL_InitPrediction(void)
 	Cvar_Register(&cl_predict_projectiles);
 	Cvar_Register(&cl_predict_jump);
 	Cvar_Register(&cl_predict_buffer);
+	Cvar_Register(&cl_predict_incremental);
 	Cvar_ResetCurrentGroup();
 
 	CL_InitWepSounds();
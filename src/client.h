@@ -492,6 +492,7 @@ typedef struct
 	int			downloadpercent;
 	int			downloadrate;
 	double		downloadstarttime;
+	qbool		downloadbench;			///< dlbench: report the rate and throw the file away
 #ifdef FTE_PEXT_CHUNKEDDOWNLOADS
 	enum {DL_NONE = 0, DL_QW, DL_QWCHUNKS} downloadmethod;
 #else
@@ -982,6 +983,9 @@ void NQD_LinkEntities (void);
 void NQD_ReadPackets (void);
 void NQD_SetSpectatorFlags (void);
 
+// demo_analyze.c
+void DemoAnalyze_Main (void);
+
 // cl_demo.c
 qbool CL_GetDemoMessage (void);
 void CL_WriteDemoCmd (usercmd_t *pcmd);
@@ -1098,6 +1102,8 @@ void CL_StopUpload(void);
 void CL_StartFileUpload(void);
 
 void CL_ParseClientdata (void);
+int CL_ParseProtocolVersion (void);
+void CL_ParseBaseline (entity_state_t *es);
 
 void CL_FinishDownload(void);
 
@@ -1105,8 +1111,8 @@ void CL_FinishDownload(void);
 
 void	CL_ParseChunkedDownload(void);
 void	CL_Parse_OOB_ChunkedDownload(void);
-int		CL_RequestADownloadChunk(void);
 void	CL_SendChunkDownloadReq(void);
+void	CL_DownloadBenchReport(void);
 
 #endif // FTE_PEXT_CHUNKEDDOWNLOADS
 
@@ -1155,6 +1161,8 @@ void CL_SetUpPlayerPrediction(qbool dopred);
 void CL_EmitEntities (void);
 void CL_ClearProjectiles (void);
 void CL_ParsePacketEntities (qbool delta);
+void CL_ParseDelta (entity_state_t *from, entity_state_t *to, int bits);
+void FlushEntityPacket (void);
 #ifdef MVD_PEXT1_SIMPLEPROJECTILE
 void CL_ParsePacketSimpleProjectiles(void);
 #endif
@@ -1282,7 +1290,7 @@ extern cvar_t cl_delay_packet;
 extern cvar_t cl_delay_packet_target;
 extern cvar_t cl_delay_packet_dev;
 
-#define CL_MAX_DELAYED_PACKETS 16 /* 13 * 16 = 208 ms, should be enough */
+#define CL_MAX_DELAYED_PACKETS 128 /* 208 ms of game packets at 13 ms each, plus room for download bursts */
 #define CL_MAX_PACKET_DELAY 75 /* total delay two times more */
 #define CL_MAX_PACKET_DELAY_DEVIATION 5
 #define CL_MAX_PACKET_DELAY_TARGET 155
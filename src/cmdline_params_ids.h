@@ -1,6 +1,9 @@
 
 CMDLINE_DEF(client_nosound, "-nosound"),
 CMDLINE_DEF(client_democache, "-democache"),
+CMDLINE_DEF(client_demoanalyze, "-demoanalyze"),
+CMDLINE_DEF(client_demoanalyze_jobs, "-demoanalyze-jobs"),
+CMDLINE_DEF(client_demoanalyze_out, "-demoanalyze-out"),
 CMDLINE_DEF(client_norjscripts, "-norjscripts"),
 CMDLINE_DEF(client_noscripts, "-noscripts"),
 CMDLINE_DEF(client_noindphys, "-noindphys"),
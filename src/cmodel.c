@@ -366,6 +366,84 @@ trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 	return htl.trace;
 }
 
+// bumped whenever the hulls may have changed, so cached traces are dropped
+static unsigned int map_generation = 1;
+
+static unsigned int CM_HashTrace (hull_t *hull, const vec3_t start, const vec3_t end)
+{
+	unsigned int h = 2166136261u, bits[6];
+	int i;
+
+	memcpy(bits, start, sizeof(vec3_t));
+	memcpy(bits + 3, end, sizeof(vec3_t));
+
+	h = (h ^ (unsigned int)(uintptr_t)hull) * 16777619u;
+	for (i = 0; i < 6; i++) {
+		h = (h ^ bits[i]) * 16777619u;
+	}
+
+	return h ^ (h >> 15);
+}
+
+// bit exact comparison, so -0 and 0 or two NaNs are told apart as they may trace differently
+static qbool CM_SameTrace (const trace_t *a, const trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->inopen == b->inopen && a->inwater == b->inwater
+		&& !memcmp(&a->fraction, &b->fraction, sizeof(a->fraction))
+		&& !memcmp(a->endpos, b->endpos, sizeof(a->endpos))
+		&& !memcmp(a->plane.normal, b->plane.normal, sizeof(a->plane.normal))
+		&& !memcmp(&a->plane.dist, &b->plane.dist, sizeof(a->plane.dist))
+		&& a->physicsnormal == b->physicsnormal;
+}
+
+/*
+==================
+CM_HullTraceCached
+
+Same result as CM_HullTrace, bit for bit, as the trace only depends on the hull
+and the exact end points. The box hull is rebuilt for every entity, so it is
+never cached. With verify set a hit is traced again and checked against.
+==================
+*/
+trace_t CM_HullTraceCached (hulltracecache_t *cache, hull_t *hull, vec3_t start, vec3_t end, qbool verify)
+{
+	hulltracecacheentry_t *entry;
+	trace_t trace;
+
+	if (hull == &box_hull) {
+		return CM_HullTrace(hull, start, end);
+	}
+
+	if (cache->generation != map_generation) {
+		memset(cache->entries, 0, sizeof(cache->entries));
+		cache->generation = map_generation;
+	}
+
+	entry = &cache->entries[CM_HashTrace(hull, start, end) & (HULLTRACE_CACHE_SIZE - 1)];
+	if (entry->hull == hull && !memcmp(entry->start, start, sizeof(vec3_t)) && !memcmp(entry->end, end, sizeof(vec3_t))) {
+		cache->hits++;
+		if (verify) {
+			trace = CM_HullTrace(hull, start, end);
+			if (!CM_SameTrace(&trace, &entry->trace)) {
+				cache->mismatches++;
+				Con_DPrintf("CM_HullTraceCached: cached trace differs (%f != %f)\n", entry->trace.fraction, trace.fraction);
+				entry->trace = trace;
+			}
+		}
+		return entry->trace;
+	}
+
+	cache->misses++;
+	trace = CM_HullTrace(hull, start, end);
+	entry->hull = hull;
+	memcpy(entry->start, start, sizeof(vec3_t));
+	memcpy(entry->end, end, sizeof(vec3_t));
+	entry->trace = trace;
+
+	return trace;
+}
+
 //===========================================================================
 
 int	CM_NumInlineModels (void)
@@ -384,6 +462,11 @@ int CM_Leafnum (const cleaf_t *leaf)
 	return leaf - map_leafs;
 }
 
+int CM_NumLeafs (void)
+{
+	return numleafs;
+}
+
 int	CM_LeafAmbientLevel (const cleaf_t *leaf, int ambient_channel)
 {
 	assert ((unsigned)ambient_channel <= NUM_AMBIENTS);
@@ -452,11 +535,9 @@ crosses a waterline.
 =============================================================================
 */
 
-static int	fatbytes;
 static byte	fatpvs[MAX_MAP_LEAFS/8];
-static vec3_t	fatpvs_org;
 
-static void AddToFatPVS_r (cnode_t *node)
+static void AddToFatPVS_r (cnode_t *node, const vec3_t org, byte *fat, int fatbytes)
 {
 	int i;
 	float d;
@@ -471,20 +552,20 @@ static void AddToFatPVS_r (cnode_t *node)
 			{
 				pvs = CM_LeafPVS ( (cleaf_t *)node);
 				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
+					fat[i] |= pvs[i];
 			}
 			return;
 		}
 
 		plane = node->plane;
-		d = DotProduct (fatpvs_org, plane->normal) - plane->dist;
+		d = DotProduct (org, plane->normal) - plane->dist;
 		if (d > 8)
 			node = node->children[0];
 		else if (d < -8)
 			node = node->children[1];
 		else
 		{ // go down both
-			AddToFatPVS_r (node->children[0]);
+			AddToFatPVS_r (node->children[0], org, fat, fatbytes);
 			node = node->children[1];
 		}
 	}
@@ -500,12 +581,24 @@ given point.
 */
 byte *CM_FatPVS (vec3_t org)
 {
-	VectorCopy (org, fatpvs_org);
+	return CM_FatPVSBuffer (org, fatpvs);
+}
+
+/*
+=============
+CM_FatPVSBuffer
+
+Same as CM_FatPVS, but into a caller supplied buffer of MAX_MAP_LEAFS/8 bytes,
+so it can be used from more than one thread at a time.
+=============
+*/
+byte *CM_FatPVSBuffer (vec3_t org, byte *buffer)
+{
+	int fatbytes = (visleafs+31)>>3;
 
-	fatbytes = (visleafs+31)>>3;
-	memset (fatpvs, 0, fatbytes);
-	AddToFatPVS_r (map_nodes);
-	return fatpvs;
+	memset (buffer, 0, fatbytes);
+	AddToFatPVS_r (map_nodes, org, buffer, fatbytes);
+	return buffer;
 }
 
 
@@ -1247,6 +1340,7 @@ static void CM_BuildPHS (void)
 void CM_InvalidateMap (void)
 {
 	map_name[0] = 0;
+	map_generation++;
 
 	// null out the pointers to turn up any attempt to call CM functions
 	map_planes = NULL;
@@ -1470,6 +1564,7 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 		CM_BuildPHS ();
 
 	strlcpy (map_name, name, sizeof(map_name));
+	map_generation++;
 
 	// Flush temp zone to leave as much heap available to mods as possible.
 	Hunk_TempFlush();
@@ -92,16 +92,36 @@ typedef struct {
 	hull_t	hulls[MAX_MAP_HULLS];
 } cmodel_t;
 
+// Remembers the results of hull traces by hull and exact start and end points,
+// for callers that repeat the same traces (movement prediction replaying commands).
+// Owned by the caller, so CM_HullTrace stays thread safe; emptied when the map changes.
+#define HULLTRACE_CACHE_SIZE	1024	// power of two
+
+typedef struct hulltracecacheentry_s {
+	hull_t	*hull;
+	vec3_t	start, end;
+	trace_t	trace;
+} hulltracecacheentry_t;
+
+typedef struct hulltracecache_s {
+	unsigned int	generation;
+	unsigned int	hits, misses, mismatches;
+	hulltracecacheentry_t entries[HULLTRACE_CACHE_SIZE];
+} hulltracecache_t;
+
 hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs);
 int CM_HullPointContents (hull_t *hull, int num, vec3_t p);
 int CM_CachedHullPointContents(hull_t* hull, int num, vec3_t p, float* min_dist);
 trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end);
+trace_t CM_HullTraceCached (hulltracecache_t *cache, hull_t *hull, vec3_t start, vec3_t end, qbool verify);
 struct cleaf_s *CM_PointInLeaf (const vec3_t p);
 int CM_Leafnum (const struct cleaf_s *leaf);
+int CM_NumLeafs (void);
 int CM_LeafAmbientLevel (const struct cleaf_s *leaf, int ambient_channel);
 byte *CM_LeafPVS (const struct cleaf_s *leaf);
 byte *CM_LeafPHS (const struct cleaf_s *leaf); // only for the server
 byte *CM_FatPVS (vec3_t org);
+byte *CM_FatPVSBuffer (vec3_t org, byte *buffer);
 int CM_FindTouchedLeafs (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, int *topnode);
 char *CM_EntityString (void);
 int CM_NumInlineModels (void);
@@ -0,0 +1,923 @@
+/*
+Copyright (C) 2026 unezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// demo_analyze.c -- headless demo statistics (-demoanalyze)
+//
+// Started with "ezquake -demoanalyze [-demoanalyze-jobs N] [-demoanalyze-out file] demo1.mvd demo2.mvd.gz ..."
+// this reads every demo given on the command line and writes one JSON document
+// with the statistics mvd_xmlstats.c exports (kills and teamkills per weapon,
+// deaths, items taken and lost, runs and powerup runs), then exits.
+// No video, sound, HUD or filesystem is initialised.
+//
+// The statistics are gathered by MVD_Stats_Frame() from the cl/cls state, the
+// same as during playback. Demos are opened through the VFS, gzipped ones
+// through the gzip VFS, and the messages are read from net_message with the
+// client's own parsing functions wherever those only touch that state:
+// CL_ParseProtocolVersion, CL_ParseClientdata, CL_ParsePlayerinfo,
+// CL_ParseBaseline, CL_ParseDelta and FlushEntityPacket.
+// CL_ParseServerMessage() itself can't be used, it loads models and sounds
+// and feeds the renderer, so the message loop below updates the state the
+// statistics depend on the way it does and reads past everything else.
+//
+// All of that is global state, so every demo is analysed in a process of its
+// own: demos run in parallel and a demo the parser gives up on doesn't take
+// the others with it. There's no fork() on Windows, demos are analysed one
+// after another there.
+//
+// Like during playback only MVDs get statistics, QWDs give the scoreboard.
+
+#include "quakedef.h"
+#include "vfs.h"
+#include "mvd_utils.h"
+#include "mvd_utils_common.h"
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+typedef struct da_demo_s
+{
+	const char  *path;
+	qbool       mvd;
+	char        gamedir[MAX_QPATH];
+	double      matchstart;                     // when MVD_GameStart() ran, 0 if the demo has no countdown
+	int         messages;
+	int         skipped;                        // messages we stopped reading before their end
+	char        error[128];
+} da_demo_t;
+
+static byte da_message_buffer[MSG_BUF_SIZE];
+static da_demo_t *da;                           // the demo being analysed
+
+static void DA_ClearState(void)
+{
+	MVD_Stats_Cleanup();
+
+	memset(&cl, 0, sizeof(cl));
+	memset(cl_entities, 0, sizeof(cl_entities));
+	memset(&cls.netchan, 0, sizeof(cls.netchan));
+
+	cls.state = ca_disconnected;
+	cls.demoplayback = true;
+	cls.mvdplayback = da->mvd;
+	cls.demopackettime = 0;
+	cls.lastto = cls.lasttype = 0;
+
+	SZ_Init(&net_message, da_message_buffer, sizeof(da_message_buffer));
+	msg_coordsize = 2;
+	msg_anglesize = 1;
+}
+
+//=============================================================================
+//                              P A R S I N G
+//=============================================================================
+
+// The parts of CL_ProcessServerInfo() the statistics depend on.
+static void DA_ProcessServerInfo(void)
+{
+	char *p = Info_ValueForKey(cl.serverinfo, "status");
+	qbool standby = !strcasecmp(p, "standby");
+	qbool countdown = !strcasecmp(p, "countdown");
+
+	if ((cl.standby || cl.countdown) && !(standby || countdown) && cls.mvdplayback) {
+		MVD_GameStart();
+		da->matchstart = cls.demopackettime;
+	}
+
+	cl.standby = standby;
+	cl.countdown = countdown;
+	cl.deathmatch = atoi(Info_ValueForKey(cl.serverinfo, "deathmatch"));
+	cl.timelimit = atoi(Info_ValueForKey(cl.serverinfo, "timelimit"));
+}
+
+// The parts of CL_ProcessUserInfo() and CL_UpdateUserinfo() the statistics depend on.
+static void DA_ProcessUserInfo(int slot)
+{
+	player_info_t *player = &cl.players[slot];
+	qbool was_empty_slot = !player->name[0];
+
+	strlcpy(player->name, Info_ValueForKey(player->userinfo, "name"), sizeof(player->name));
+	strlcpy(player->team, Info_ValueForKey(player->userinfo, "team"), sizeof(player->team));
+	player->spectator = atoi(Info_ValueForKey(player->userinfo, "*spectator")) != 0;
+
+	if (was_empty_slot != !player->name[0]) {
+		MVD_Init_Info(slot);
+	}
+}
+
+static void DA_ParseServerData(void)
+{
+	int i;
+
+	cl.protoversion = CL_ParseProtocolVersion();
+	cl.servercount = MSG_ReadLong();
+	strlcpy(da->gamedir, MSG_ReadString(), sizeof(da->gamedir));
+
+	if (cls.mvdplayback) {
+		MSG_ReadFloat();
+		cl.playernum = MAX_CLIENTS - 1;
+		cl.spectator = true;
+	}
+	else {
+		cl.playernum = MSG_ReadByte();
+		cl.spectator = (cl.playernum & 128) != 0;
+		cl.playernum &= ~128;
+	}
+
+	strlcpy(cl.levelname, MSG_ReadString(), sizeof(cl.levelname));
+
+	// movevars
+	if (cl.protoversion >= 25) {
+		for (i = 0; i < 10; i++) {
+			MSG_ReadFloat();
+		}
+	}
+}
+
+static void DA_ParseStufftext(char *s)
+{
+	Cmd_TokenizeString(s);
+
+	if (!strcmp(Cmd_Argv(0), "fullserverinfo") && Cmd_Argc() == 2) {
+		strlcpy(cl.serverinfo, Cmd_Argv(1), sizeof(cl.serverinfo));
+		DA_ProcessServerInfo();
+	}
+}
+
+static void DA_ReadCoords(int count)
+{
+	while (count-- > 0) {
+		MSG_ReadCoord();
+	}
+}
+
+static void DA_ReadAngles(int count)
+{
+	while (count-- > 0) {
+		MSG_ReadAngle();
+	}
+}
+
+static void DA_ParseTempEntity(void)
+{
+	switch (MSG_ReadByte()) {
+	case TE_LIGHTNING1:
+	case TE_LIGHTNING2:
+	case TE_LIGHTNING3:
+		MSG_ReadShort();
+		DA_ReadCoords(6);
+		break;
+	case TE_GUNSHOT:
+	case TE_BLOOD:
+		MSG_ReadByte();
+		DA_ReadCoords(3);
+		break;
+	case TE_LIGHTNINGBLOOD:
+	case TE_SPIKE:
+	case TE_SUPERSPIKE:
+	case TE_EXPLOSION:
+	case TE_TAREXPLOSION:
+	case TE_WIZSPIKE:
+	case TE_KNIGHTSPIKE:
+	case TE_LAVASPLASH:
+	case TE_TELEPORT:
+		DA_ReadCoords(3);
+		break;
+	default:
+		msg_badread = true;
+		break;
+	}
+}
+
+// Returns false at the end of the demo.
+static qbool DA_ParseServerMessage(void)
+{
+	entity_state_t nullst, es;
+	char key[MAX_INFO_STRING];
+	int cmd, i, j;
+
+	CL_ParseClientdata();
+
+	while (!msg_badread) {
+		if ((cmd = MSG_ReadByte()) == -1) {
+			msg_badread = false;
+			return true;
+		}
+
+		switch (cmd) {
+		case svc_nop:
+		case svc_killedmonster:
+		case svc_foundsecret:
+		case svc_sellscreen:
+		case svc_smallkick:
+		case svc_bigkick:
+			break;
+
+		case svc_disconnect:
+			return false;
+
+		case nq_svc_time:
+		case svc_maxspeed:
+		case svc_entgravity:
+			MSG_ReadFloat();
+			break;
+
+		case svc_print:
+			MSG_ReadByte();
+			MSG_ReadString();
+			break;
+
+		case svc_centerprint:
+		case svc_finale:
+			MSG_ReadString();
+			break;
+
+		case svc_stufftext:
+			DA_ParseStufftext(MSG_ReadString());
+			break;
+
+		case svc_damage:
+			MSG_ReadShort();
+			DA_ReadCoords(3);
+			break;
+
+		case svc_serverdata:
+			DA_ParseServerData();
+			break;
+
+		case svc_setangle:
+			if (cls.mvdplayback || (cls.mvdprotocolextensions1 & MVD_PEXT1_HIGHLAGTELEPORT)) {
+				MSG_ReadByte();
+			}
+			DA_ReadAngles(3);
+			break;
+
+		case svc_lightstyle:
+			MSG_ReadByte();
+			MSG_ReadString();
+			break;
+
+		case svc_sound:
+			i = MSG_ReadShort();
+			if (i & SND_VOLUME) {
+				MSG_ReadByte();
+			}
+			if (i & SND_ATTENUATION) {
+				MSG_ReadByte();
+			}
+			MSG_ReadByte();
+			DA_ReadCoords(3);
+			break;
+
+		case svc_stopsound:
+			MSG_ReadShort();
+			break;
+
+		case svc_updatefrags:
+			i = MSG_ReadByte();
+			j = MSG_ReadShort();
+			if (i >= 0 && i < MAX_CLIENTS) {
+				cl.players[i].frags = j;
+			}
+			break;
+
+		case svc_updateping:
+			MSG_ReadByte();
+			MSG_ReadShort();
+			break;
+
+		case svc_updatepl:
+			MSG_ReadByte();
+			MSG_ReadByte();
+			break;
+
+		case svc_updateentertime:
+			MSG_ReadByte();
+			MSG_ReadFloat();
+			break;
+
+		case svc_spawnbaseline:
+			i = MSG_ReadShort();
+			CL_ParseBaseline(i >= 0 && i < CL_MAX_EDICTS ? &cl_entities[i].baseline : &es);
+			break;
+
+		case svc_spawnstatic:
+			CL_ParseBaseline(&es);
+			break;
+
+#if defined (PROTOCOL_VERSION_FTE) && defined (FTE_PEXT_SPAWNSTATIC2)
+		case svc_fte_spawnbaseline2:
+		case svc_fte_spawnstatic2:
+			memset(&nullst, 0, sizeof(nullst));
+			CL_ParseDelta(&nullst, &es, MSG_ReadShort());
+			break;
+#endif
+
+		case svc_temp_entity:
+			DA_ParseTempEntity();
+			break;
+
+		// CL_SetStat(), without the HUD
+		case svc_updatestat:
+		case svc_updatestatlong:
+			i = MSG_ReadByte();
+			j = cmd == svc_updatestat ? MSG_ReadByte() : MSG_ReadLong();
+			if (i >= 0 && i < MAX_CL_STATS) {
+				if (cls.mvdplayback) {
+					cl.players[cls.lastto].stats[i] = j;
+				}
+				cl.stats[i] = j;
+			}
+			break;
+
+		case svc_spawnstaticsound:
+			DA_ReadCoords(3);
+			MSG_ReadByte();
+			MSG_ReadByte();
+			MSG_ReadByte();
+			break;
+
+		case svc_cdtrack:
+		case svc_chokecount:
+		case svc_setpause:
+			MSG_ReadByte();
+			break;
+
+		case svc_intermission:
+			DA_ReadCoords(3);
+			DA_ReadAngles(3);
+			break;
+
+		case svc_muzzleflash:
+			MSG_ReadShort();
+			break;
+
+		case svc_updateuserinfo:
+			i = MSG_ReadByte();
+			j = MSG_ReadLong();
+			strlcpy(key, MSG_ReadString(), sizeof(key));
+			// as CL_Demo_SkipMessage(), personal copies of userinfo in MVDs can be stale
+			if (i < 0 || i >= MAX_CLIENTS || (cls.mvdplayback && (cls.lasttype == dem_multiple || cls.lasttype == dem_single))) {
+				break;
+			}
+			cl.players[i].userid = j;
+			strlcpy(cl.players[i].userinfo, key, sizeof(cl.players[i].userinfo));
+			DA_ProcessUserInfo(i);
+			break;
+
+		case svc_setinfo:
+			i = MSG_ReadByte();
+			strlcpy(key, MSG_ReadString(), sizeof(key));
+			if (i >= 0 && i < MAX_CLIENTS) {
+				Info_SetValueForStarKey(cl.players[i].userinfo, key, MSG_ReadString(), MAX_INFO_STRING);
+				DA_ProcessUserInfo(i);
+			}
+			else {
+				MSG_ReadString();
+			}
+			break;
+
+		case svc_serverinfo:
+			strlcpy(key, MSG_ReadString(), sizeof(key));
+			Info_SetValueForKey(cl.serverinfo, key, MSG_ReadString(), MAX_SERVERINFO_STRING);
+			DA_ProcessServerInfo();
+			break;
+
+		case svc_playerinfo:
+			CL_ParsePlayerinfo();
+			break;
+
+		case svc_nails:
+		case svc_nails2:
+			i = MSG_ReadByte();
+			for (j = i * (cmd == svc_nails2 ? 7 : 6); j > 0 && !msg_badread; j--) {
+				MSG_ReadByte();
+			}
+			break;
+
+		case svc_modellist:
+#if defined (PROTOCOL_VERSION_FTE) && defined (FTE_PEXT_MODELDBL)
+		case svc_fte_modellistshort:
+#endif
+		case svc_soundlist:
+			if (cmd == svc_modellist || cmd == svc_soundlist) {
+				MSG_ReadByte();
+			}
+			else {
+				MSG_ReadShort();
+			}
+			while (MSG_ReadString()[0] && !msg_badread)
+				;
+			MSG_ReadByte();
+			break;
+
+		case svc_deltapacketentities:
+			MSG_ReadByte();
+			// fall through
+		case svc_packetentities:
+			FlushEntityPacket();
+			break;
+
+		default:
+			// downloads, voice chat, projectiles and anything unknown:
+			// drop the rest of this message
+			da->skipped++;
+			return true;
+		}
+	}
+
+	da->skipped++;
+	return true;
+}
+
+//=============================================================================
+//                            D E M O   F I L E
+//=============================================================================
+
+// The demo type, for gzipped demos the extension under the .gz
+static const char *DA_DemoType(const char *path)
+{
+	static char inner[MAX_OSPATH];
+
+	if (strcasecmp(COM_FileExtension(path), "gz")) {
+		return COM_FileExtension(path);
+	}
+	COM_StripExtension(path, inner, sizeof(inner));
+	return COM_FileExtension(inner);
+}
+
+static vfsfile_t *DA_Open(const char *path)
+{
+	vfsfile_t *file;
+
+	if (!(file = VFSOS_Open((char *)path, "rb"))) {
+		return NULL;
+	}
+
+	if (!strcasecmp(COM_FileExtension(path), "gz")) {
+#ifdef WITH_ZLIB
+		file = VFSGZIP_Open(file, path);
+#else
+		VFS_CLOSE(file);
+		file = NULL;
+#endif
+	}
+
+	return file;
+}
+
+static qbool DA_Read(vfsfile_t *file, void *buf, int bytes)
+{
+	vfserrno_t err;
+
+	return VFS_READ(file, buf, bytes, &err) == bytes;
+}
+
+// The demo loop of CL_GetDemoMessage() without the timing.
+static void DA_Run(vfsfile_t *file)
+{
+	byte c, scratch[sizeof(usercmd_t) + 12];
+	int len;
+	qbool playing = true;
+
+	while (playing) {
+		// time
+		if (cls.mvdplayback) {
+			byte msec;
+
+			if (!DA_Read(file, &msec, 1)) {
+				break;
+			}
+			if (msec) {
+				MVD_Stats_Frame();
+				cls.netchan.incoming_sequence++;
+				cls.netchan.incoming_acknowledged++;
+			}
+			cls.demopackettime += msec * 0.001;
+		}
+		else {
+			float t;
+
+			if (!DA_Read(file, &t, 4)) {
+				break;
+			}
+			cls.demopackettime = LittleFloat(t);
+		}
+
+		if (!DA_Read(file, &c, 1)) {
+			break;
+		}
+
+		switch (c & 7) {
+		case dem_cmd:
+			if (cls.mvdplayback) {
+				strlcpy(da->error, "dem_cmd in mvd", sizeof(da->error));
+				playing = false;
+				break;
+			}
+			playing = DA_Read(file, scratch, sizeof(scratch));
+			break;
+
+		case dem_set:
+			playing = DA_Read(file, scratch, 8);
+			break;
+
+		case dem_multiple:
+			if (!DA_Read(file, &len, 4)) {
+				playing = false;
+				break;
+			}
+			cls.lastto = LittleLong(len);
+			cls.lasttype = dem_multiple;
+			goto read;
+
+		case dem_single:
+		case dem_stats:
+			cls.lastto = c >> 3;
+			cls.lasttype = c & 7;
+			goto read;
+
+		case dem_all:
+			cls.lastto = 0;
+			cls.lasttype = dem_all;
+			goto read;
+
+		case dem_read:
+read:
+			if (!DA_Read(file, &len, 4)) {
+				playing = false;
+				break;
+			}
+			len = LittleLong(len);
+			if (len < 0 || len > net_message.maxsize || !DA_Read(file, net_message.data, len)) {
+				strlcpy(da->error, "truncated message", sizeof(da->error));
+				playing = false;
+				break;
+			}
+			net_message.cursize = len;
+			MSG_BeginReading();
+
+			// connectionless packets, and messages to no-one
+			if (len >= 4 && *(int *)net_message.data == -1) {
+				break;
+			}
+			if (cls.mvdplayback && cls.lasttype == dem_multiple && cls.lastto == 0) {
+				break;
+			}
+
+			// netchan header, as Netchan_Process()
+			if (!cls.mvdplayback) {
+				cls.netchan.incoming_sequence = MSG_ReadLong() & ~(1 << 31);
+				cls.netchan.incoming_acknowledged = MSG_ReadLong() & ~(1 << 31);
+			}
+
+			da->messages++;
+			playing = DA_ParseServerMessage();
+			break;
+
+		default:
+			strlcpy(da->error, "corrupted demo", sizeof(da->error));
+			playing = false;
+			break;
+		}
+	}
+
+	if (cls.mvdplayback) {
+		MVD_Stats_Frame();
+	}
+}
+
+static void DA_Analyze(da_demo_t *d)
+{
+	const char *ext = DA_DemoType(d->path);
+	vfsfile_t *file;
+
+	da = d;
+	DA_ClearState();
+
+	if (!d->mvd && strcasecmp(ext, "qwd")) {
+		snprintf(d->error, sizeof(d->error), "unsupported demo type \"%s\"", ext);
+	}
+	else if (!(file = DA_Open(d->path))) {
+		strlcpy(d->error, "couldn't open file", sizeof(d->error));
+	}
+	else {
+		DA_Run(file);
+		VFS_CLOSE(file);
+	}
+}
+
+//=============================================================================
+//                                O U T P U T
+//=============================================================================
+
+static void DA_JSON_String(FILE *f, const char *s)
+{
+	char buf[256];
+	unsigned char *p;
+
+	// names use the quake charset, print them the way the console log does
+	strlcpy(buf, s, sizeof(buf));
+	Q_normalizetext(buf);
+
+	fputc('"', f);
+	for (p = (unsigned char *)buf; *p; p++) {
+		if (*p == '"' || *p == '\\') {
+			fprintf(f, "\\%c", *p);
+		}
+		else if (*p < 32 || *p >= 127) {
+			fprintf(f, "\\u%04x", *p);
+		}
+		else {
+			fputc(*p, f);
+		}
+	}
+	fputc('"', f);
+}
+
+// Same as mvd_s_p() in mvd_xmlstats.c.
+static void DA_JSON_Player(FILE *f, const mvd_new_info_t *p)
+{
+	const mvd_info_t *info = &p->mvdinfo;
+	int x, y, all;
+
+	fprintf(f, ",\n\t\t\t\t\"kills\": {");
+	for (all = 0, x = AXE_INFO; x <= LG_INFO; x++) {
+		fprintf(f, "\"%s\": %i, ", mvd_wp_info[x].name, info->killstats.normal[x].kills);
+		all += info->killstats.normal[x].kills;
+	}
+	fprintf(f, "\"spawn\": %i, \"all\": %i}", info->spawntelefrags, all + info->spawntelefrags);
+
+	fprintf(f, ",\n\t\t\t\t\"teamkills\": {");
+	for (all = 0, x = AXE_INFO; x <= LG_INFO; x++) {
+		fprintf(f, "\"%s\": %i, ", mvd_wp_info[x].name, info->killstats.normal[x].teamkills);
+		all += info->killstats.normal[x].teamkills;
+	}
+	fprintf(f, "\"spawn\": %i, \"all\": %i}", info->teamspawntelefrags, all + info->teamspawntelefrags);
+
+	fprintf(f, ",\n\t\t\t\t\"deaths\": %i", info->das.deathcount);
+
+	fprintf(f, ",\n\t\t\t\t\"took\": {");
+	for (x = SSG_INFO; x <= MH_INFO; x++) {
+		fprintf(f, "%s\"%s\": %i", x == SSG_INFO ? "" : ", ", mvd_wp_info[x].name, info->itemstats[x].count);
+	}
+	fprintf(f, "}");
+
+	fprintf(f, ",\n\t\t\t\t\"lost\": {");
+	for (x = SSG_INFO; x <= MH_INFO; x++) {
+		fprintf(f, "%s\"%s\": %i", x == SSG_INFO ? "" : ", ", mvd_wp_info[x].name, info->itemstats[x].lost);
+	}
+	fprintf(f, "}");
+
+	fprintf(f, ",\n\t\t\t\t\"runs\": [");
+	for (x = 0; x < info->run; x++) {
+		fprintf(f, "%s{\"time\": %.3f, \"frags\": %i, \"teamfrags\": %i}", x ? ", " : "",
+			info->runs[x].time, info->runs[x].frags, info->runs[x].teamfrags);
+	}
+	fprintf(f, "]");
+
+	for (y = RING_INFO; y <= PENT_INFO; y++) {
+		if (!info->itemstats[y].run) {
+			continue;
+		}
+		fprintf(f, ",\n\t\t\t\t\"%s_runs\": [", mvd_wp_info[y].name);
+		for (x = 0; x < info->itemstats[y].run; x++) {
+			fprintf(f, "%s{\"time\": %.3f, \"frags\": %i, \"teamfrags\": %i}", x ? ", " : "",
+				info->itemstats[y].runs[x].time, info->itemstats[y].runs[x].frags, info->itemstats[y].runs[x].teamfrags);
+		}
+		fprintf(f, "]");
+	}
+}
+
+static void DA_JSON_Demo(FILE *f, const da_demo_t *d)
+{
+	int i, count;
+
+	fprintf(f, "\t{\n\t\t\"file\": ");
+	DA_JSON_String(f, d->path);
+	fprintf(f, ",\n\t\t\"type\": \"%s\"", d->mvd ? "mvd" : "qwd");
+	if (d->error[0]) {
+		fprintf(f, ",\n\t\t\"error\": ");
+		DA_JSON_String(f, d->error);
+	}
+	fprintf(f, ",\n\t\t\"map\": ");
+	DA_JSON_String(f, Info_ValueForKey(cl.serverinfo, "map"));
+	fprintf(f, ",\n\t\t\"levelname\": ");
+	DA_JSON_String(f, cl.levelname);
+	fprintf(f, ",\n\t\t\"hostname\": ");
+	DA_JSON_String(f, Info_ValueForKey(cl.serverinfo, "hostname"));
+	fprintf(f, ",\n\t\t\"gamedir\": ");
+	DA_JSON_String(f, d->gamedir);
+	fprintf(f, ",\n\t\t\"deathmatch\": %i,\n\t\t\"teamplay\": %i,\n\t\t\"timelimit\": %i",
+		cl.deathmatch, atoi(Info_ValueForKey(cl.serverinfo, "teamplay")), cl.timelimit);
+	if (mvd_cg_info.pcount) {
+		fprintf(f, ",\n\t\t\"gametype\": \"%s\"", mvd_gt_info[mvd_cg_info.gametype].name);
+	}
+	fprintf(f, ",\n\t\t\"duration\": %.3f,\n\t\t\"matchtime\": %.3f",
+		cls.demopackettime, cls.demopackettime - d->matchstart);
+	fprintf(f, ",\n\t\t\"messages\": %i,\n\t\t\"skipped\": %i", d->messages, d->skipped);
+
+	fprintf(f, ",\n\t\t\"players\": [\n");
+	for (i = count = 0; i < MAX_CLIENTS; i++) {
+		player_info_t *player = &cl.players[i];
+		mvd_new_info_t *stats;
+
+		if (!player->name[0] || player->spectator) {
+			continue;
+		}
+		if (count++) {
+			fprintf(f, ",\n");
+		}
+
+		fprintf(f, "\t\t\t{\n\t\t\t\t\"id\": %i,\n\t\t\t\t\"userid\": %i,\n\t\t\t\t\"nick\": ", i, player->userid);
+		DA_JSON_String(f, player->name);
+		fprintf(f, ",\n\t\t\t\t\"team\": ");
+		DA_JSON_String(f, player->team);
+		fprintf(f, ",\n\t\t\t\t\"frags\": %i", player->frags);
+		if ((stats = MVD_StatsForPlayer(player)) && stats->mvdinfo.initialized) {
+			DA_JSON_Player(f, stats);
+		}
+		fprintf(f, "\n\t\t\t}");
+	}
+	fprintf(f, "%s\t\t]\n\t}", count ? "\n" : "");
+}
+
+#ifndef _WIN32
+// For demos whose analysis never got to write anything.
+static void DA_JSON_Failed(FILE *f, da_demo_t *d)
+{
+	da = d;
+	DA_ClearState();
+	if (!d->error[0]) {
+		strlcpy(d->error, "analysis aborted", sizeof(d->error));
+	}
+	DA_JSON_Demo(f, d);
+}
+#endif
+
+//=============================================================================
+//                             W O R K E R S
+//=============================================================================
+
+#ifndef _WIN32
+// Analyses every demo in a child process, up to num_jobs at a time. Each child
+// writes its JSON into its own temporary file, which is returned in results[]
+// (NULL if the child didn't finish).
+static void DA_RunJobs(da_demo_t *demos, int count, int num_jobs, FILE **results)
+{
+	pid_t *pids = Q_calloc(count, sizeof(pids[0]));
+	int next = 0, running = 0, status, i;
+	pid_t pid;
+
+	while (next < count || running) {
+		if (next < count && running < num_jobs) {
+			results[next] = tmpfile();
+			fflush(NULL);
+
+			if (!results[next] || (pid = fork()) < 0) {
+				// no process for it, analyse it here; every analysis starts
+				// from DA_ClearState() so this doesn't disturb later ones
+				if (!results[next]) {
+					results[next] = tmpfile();
+				}
+				if (results[next]) {
+					DA_Analyze(&demos[next]);
+					DA_JSON_Demo(results[next], &demos[next]);
+				}
+				next++;
+				continue;
+			}
+
+			if (pid == 0) {
+				DA_Analyze(&demos[next]);
+				DA_JSON_Demo(results[next], &demos[next]);
+				_exit(fclose(results[next]) ? EXIT_FAILURE : EXIT_SUCCESS);
+			}
+
+			pids[next++] = pid;
+			running++;
+			continue;
+		}
+
+		if ((pid = wait(&status)) < 0) {
+			break;
+		}
+		for (i = 0; i < count; i++) {
+			if (pids[i] == pid) {
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+					fclose(results[i]);
+					results[i] = NULL;
+				}
+				pids[i] = 0;
+				running--;
+				break;
+			}
+		}
+	}
+
+	Q_free(pids);
+}
+#endif
+
+// Runs from Host_Init() before anything else is set up when -demoanalyze is
+// given, and never returns.
+void DemoAnalyze_Main(void)
+{
+	da_demo_t *demos;
+	FILE **results;
+	FILE *out = stdout;
+	int parm, count, i;
+#ifndef _WIN32
+	int num_jobs;
+#endif
+	char buf[4096];
+	size_t len;
+
+	demos = Q_calloc(COM_Argc(), sizeof(demos[0]));
+	results = Q_calloc(COM_Argc(), sizeof(results[0]));
+
+	// demos are the arguments which aren't options or option values
+	parm = COM_CheckParm(cmdline_param_client_demoanalyze);
+	for (count = 0, i = parm + 1; i < COM_Argc(); i++) {
+		const char *arg = COM_Argv(i);
+
+		if (arg[0] == '-' || arg[0] == '+') {
+			if (!strcmp(arg, Cmd_CommandLineParamName(cmdline_param_client_demoanalyze_jobs))
+					|| !strcmp(arg, Cmd_CommandLineParamName(cmdline_param_client_demoanalyze_out))) {
+				i++;
+			}
+			continue;
+		}
+		demos[count].path = arg;
+		demos[count++].mvd = !strcasecmp(DA_DemoType(arg), "mvd");
+	}
+
+	if (!count) {
+		fprintf(stderr, "Usage: %s [-demoanalyze-jobs <n>] [-demoanalyze-out <file>] <demo> [<demo> ...]\n",
+			Cmd_CommandLineParamName(cmdline_param_client_demoanalyze));
+		exit(EXIT_FAILURE);
+	}
+
+	if ((parm = COM_CheckParm(cmdline_param_client_demoanalyze_out)) && parm + 1 < COM_Argc()) {
+		if (!(out = fopen(COM_Argv(parm + 1), "w"))) {
+			fprintf(stderr, "Couldn't open %s for writing\n", COM_Argv(parm + 1));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	fprintf(out, "[\n");
+
+#ifndef _WIN32
+	num_jobs = SDL_GetCPUCount();
+	if ((parm = COM_CheckParm(cmdline_param_client_demoanalyze_jobs)) && parm + 1 < COM_Argc()) {
+		num_jobs = Q_atoi(COM_Argv(parm + 1));
+	}
+	DA_RunJobs(demos, count, bound(1, num_jobs, count), results);
+#endif
+
+	for (i = 0; i < count; i++) {
+		if (results[i]) {
+			rewind(results[i]);
+			while ((len = fread(buf, 1, sizeof(buf), results[i])) > 0) {
+				fwrite(buf, 1, len, out);
+			}
+			fclose(results[i]);
+		}
+#ifndef _WIN32
+		else {
+			DA_JSON_Failed(out, &demos[i]);
+		}
+#else
+		else {
+			DA_Analyze(&demos[i]);
+			DA_JSON_Demo(out, &demos[i]);
+		}
+#endif
+		fprintf(out, "%s\n", i < count - 1 ? "," : "");
+	}
+
+	fprintf(out, "]\n");
+
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	exit(EXIT_SUCCESS);
+}
@@ -113,6 +113,7 @@ void FS_Locate_f (void);
 
 // VFS-FIXME: Debug file for trying to open files
 static void FS_DiffFile_f(void);
+static void FS_HashBenchmark_f(void);
 
 
 //============================================================================
@@ -414,6 +415,75 @@ byte *FS_LoadHeapFile (const char *path, int *len)
 	return FS_LoadFile (path, 5, len);
 }
 
+/*
+================
+FS_MapFile
+
+Gives read-only access to the whole file, pointing straight into the mapped
+loose file or pak/pk3 when possible and falling back to a heap copy otherwise.
+Release with FS_UnmapFile.
+================
+*/
+qbool FS_MapFile(const char *path, fs_mappedfile_t *file)
+{
+	char osname[MAX_OSPATH];
+	flocation_t loc;
+	vfserrno_t err;
+	int len;
+
+	memset(file, 0, sizeof(*file));
+
+	if (Sys_PathProtection(path))
+		return false;
+
+	len = FS_FLocateFile(path, FSLFRT_LENGTH, &loc);
+	if (!loc.search) {
+		// not in the search paths, let FS_LoadFile try the other places
+		if (!(file->copy = FS_LoadHeapFile(path, &file->len)))
+			return false;
+		file->data = file->copy;
+		return true;
+	}
+
+	if (loc.search->funcs == &osfilefuncs) {
+		snprintf(osname, sizeof(osname), "%s/%s", (char *)loc.search->handle, loc.rawname);
+		if (Sys_MapFile(osname, &file->osmap) && file->osmap.size == (size_t)len) {
+			file->data = file->osmap.data;
+			file->len = len;
+			return true;
+		}
+		Sys_UnmapFile(&file->osmap);
+	}
+
+	if (!(file->vfs = loc.search->funcs->OpenVFS(loc.search->handle, &loc, "rb")))
+		return false;
+
+	file->len = VFS_GETLEN(file->vfs);
+	if ((file->data = VFS_GETDATA(file->vfs)))
+		return true;
+
+	file->copy = Q_malloc_named(file->len + 1, path);
+	file->copy[file->len] = 0;
+	if (VFS_READ(file->vfs, file->copy, file->len, &err) != file->len) {
+		FS_UnmapFile(file);
+		return false;
+	}
+	VFS_CLOSE(file->vfs);
+	file->vfs = NULL;
+	file->data = file->copy;
+
+	return true;
+}
+
+void FS_UnmapFile(fs_mappedfile_t *file)
+{
+	if (file->vfs)
+		VFS_CLOSE(file->vfs);
+	Sys_UnmapFile(&file->osmap);
+	Q_free(file->copy);
+	memset(file, 0, sizeof(*file));
+}
+
 // QW262 -->
 /*
 ================
@@ -667,6 +737,9 @@ char *FS_NextPath (char *prevpath)
 
 void FS_ShutDown( void ) {
 
+	// the index lives next to the current com_homedir/com_basedir
+	FSIndex_Shutdown();
+
 	// free data
 	while (fs_searchpaths)	{
 		searchpath_t  *next;
@@ -967,6 +1040,11 @@ qbool VFS_COPYPROTECTED(struct vfsfile_s *vf) {
 	return vf->copyprotected;
 }
 
+const byte *VFS_GETDATA(struct vfsfile_s *vf) {
+	assert(vf);
+	return vf->GetData ? vf->GetData(vf) : NULL;
+}
+
 //
 // some general function to open VFS file, except VFSTCP
 //
@@ -1960,11 +2038,13 @@ void FS_InitModuleFS (void)
 	Cmd_AddCommand("fs_locate", FS_Locate_f);
 	Cmd_AddLegacyCommand("locate", "fs_locate");
 	Cmd_AddCommand("fs_search", FS_ListFiles_f);
+	Cmd_AddCommand("fs_hashbench", FS_HashBenchmark_f);
 
 	Cvar_SetCurrentGroup(CVAR_GROUP_FILESYSTEM);
 	Cvar_Register(&fs_cache);
 	Cvar_Register(&fs_savegame_home);
 	Cvar_ResetCurrentGroup();
+	FSIndex_Init();
 
 	Com_Printf("Initialising quake VFS filesystem\n");
 }
@@ -2191,6 +2271,9 @@ void FS_RebuildFSHash(void)
 
 	filesystemchanged = false;
 
+	// archives scanned since the last rebuild are remembered for next time
+	FSIndex_Save();
+
 	Com_DPrintf("%i unique files, %i duplicates\n", fs_hash_files, fs_hash_dups);
 }
 
@@ -3072,24 +3155,207 @@ void FS_ListFiles_f(void)
 		Com_Printf("Can't search, fs_cache must be turned on\n");
 	}
 	else {
-		int i;
+		int cursor = 0;
 		char *ext = Cmd_Argv(1);
 		size_t ext_len = strlen(ext);
+		const char *key;
 
-		for (i = 0; i < filesystemhash->numbuckets; i++) {
-			bucket_t *b = filesystemhash->bucket[i];
-			while (b) {
-				char *key = b->keystring;
-				size_t len = strlen(key);
-				if (strcmp(key+len-ext_len, ext) == 0) {
-					Com_Printf("%s\n", b->keystring);
-				}
-				b = b->next;
+		while (Hash_Enumerate(filesystemhash, &cursor, &key)) {
+			size_t len = strlen(key);
+			if (len >= ext_len && strcmp(key+len-ext_len, ext) == 0) {
+				Com_Printf("%s\n", key);
 			}
 		}
 	}
 }
 
+// The chained table hash.c used before it switched to open addressing,
+// kept only so fs_hashbench can time both on the same keys
+typedef struct fs_oldbucket_s {
+	void *data;
+	char *keystring;
+	struct fs_oldbucket_s *next;
+} fs_oldbucket_t;
+
+typedef struct fs_oldhash_s {
+	int numbuckets;
+	fs_oldbucket_t **bucket;
+} fs_oldhash_t;
+
+static int FS_OldHashKey(const char *name, int modulus)
+{
+	unsigned int key;
+
+	for (key = 5381; *name; name++)
+		key = ((key << 5) + key) + tolower(*name); /* key * 33 + c */
+
+	return (int) (key % modulus);
+}
+
+static fs_oldhash_t *FS_OldHashInit(int numbuckets)
+{
+	fs_oldhash_t *table = Q_malloc(sizeof(*table));
+
+	table->bucket = (fs_oldbucket_t **) Q_calloc(numbuckets, sizeof(fs_oldbucket_t *));
+	table->numbuckets = numbuckets;
+
+	return table;
+}
+
+static void FS_OldHashShutdown(fs_oldhash_t *table)
+{
+	fs_oldbucket_t *buck, *next;
+	int i;
+
+	for (i = 0; i < table->numbuckets; i++) {
+		for (buck = table->bucket[i]; buck; buck = next) {
+			next = buck->next;
+			Q_free(buck->keystring);
+			Q_free(buck);
+		}
+	}
+
+	Q_free(table->bucket);
+	Q_free(table);
+}
+
+static void FS_OldHashAdd(fs_oldhash_t *table, const char *name, void *data)
+{
+	int bucknum = FS_OldHashKey(name, table->numbuckets);
+	fs_oldbucket_t *buck = Q_malloc(sizeof(*buck));
+
+	buck->data = data;
+	buck->keystring = Q_strdup(name);
+	buck->next = table->bucket[bucknum];
+	table->bucket[bucknum] = buck;
+}
+
+static void *FS_OldHashGet(fs_oldhash_t *table, const char *name)
+{
+	fs_oldbucket_t *buck;
+
+	for (buck = table->bucket[FS_OldHashKey(name, table->numbuckets)]; buck; buck = buck->next) {
+		if (!strcasecmp(name, buck->keystring))
+			return buck->data;
+	}
+
+	return NULL;
+}
+
+// times get-then-add the way FS_RebuildFSHash fills the table, then hits,
+// case folded hits and misses, ns per operation for each go into ns
+static void FS_HashBenchmarkRun(qbool old, char **names, char **upper, char **missing, int numnames, int passes, double *ns)
+{
+	hashtable_t *table = NULL;
+	fs_oldhash_t *oldtable = NULL;
+	char **keys[3];
+	double start;
+	int i, j, k, found = 0;
+
+	start = Sys_DoubleTime();
+	for (j = 0; j < passes; j++) {
+		if (old) {
+			if (oldtable)
+				FS_OldHashShutdown(oldtable);
+			oldtable = FS_OldHashInit(1024);
+			for (i = 0; i < numnames; i++)
+				if (!FS_OldHashGet(oldtable, names[i]))
+					FS_OldHashAdd(oldtable, names[i], names[i]);
+		}
+		else {
+			if (table)
+				Hash_ShutdownTable(table);
+			table = Hash_InitTable(1024);
+			for (i = 0; i < numnames; i++)
+				if (!Hash_GetInsensitive(table, names[i]))
+					Hash_AddInsensitive(table, names[i], names[i]);
+		}
+	}
+	ns[0] = (Sys_DoubleTime() - start) * 1e9 / ((double)numnames * passes);
+
+	keys[0] = names;
+	keys[1] = upper;
+	keys[2] = missing;
+	for (k = 0; k < 3; k++) {
+		start = Sys_DoubleTime();
+		for (j = 0; j < passes; j++) {
+			if (old) {
+				for (i = 0; i < numnames; i++)
+					found += (FS_OldHashGet(oldtable, keys[k][i]) != NULL);
+			}
+			else {
+				for (i = 0; i < numnames; i++)
+					found += (Hash_GetInsensitive(table, keys[k][i]) != NULL);
+			}
+		}
+		ns[k + 1] = (Sys_DoubleTime() - start) * 1e9 / ((double)numnames * passes);
+	}
+	Com_DPrintf("%i found\n", found);
+
+	if (old)
+		FS_OldHashShutdown(oldtable);
+	else
+		Hash_ShutdownTable(table);
+}
+
+// DEBUG FUNCTION
+// Times the old chained and the current filesystem hash table side by side on
+// the names from the loaded search paths
+static void FS_HashBenchmark_f(void)
+{
+	static const char *labels[] = { "add", "get", "get (nocase)", "get (miss)" };
+	int i, cursor = 0, numnames = 0, passes = 20;
+	const char *key;
+	char **names, **upper, **missing;
+	double oldns[4], newns[4];
+
+	if (Cmd_Argc() > 1 && atoi(Cmd_Argv(1)) > 0)
+		passes = atoi(Cmd_Argv(1));
+
+	if (!filesystemhash || filesystemchanged)
+		FS_RebuildFSHash();
+
+	while (Hash_Enumerate(filesystemhash, &cursor, &key))
+		numnames++;
+	if (!numnames) {
+		Com_Printf("No files in the search paths\n");
+		return;
+	}
+
+	names = Q_malloc(numnames * sizeof(*names));
+	upper = Q_malloc(numnames * sizeof(*upper));
+	missing = Q_malloc(numnames * sizeof(*missing));
+	for (cursor = i = 0; Hash_Enumerate(filesystemhash, &cursor, &key); i++) {
+		names[i] = Q_strdup(key);
+		upper[i] = Q_strdup(key);
+		Q_strupr(upper[i]);
+		// a trailing slash can't name a file, keep adding them until it's really not there
+		missing[i] = Q_strdup(va("%s/", key));
+		while (Hash_GetInsensitive(filesystemhash, missing[i])) {
+			char *longer = Q_strdup(va("%s/", missing[i]));
+			Q_free(missing[i]);
+			missing[i] = longer;
+		}
+	}
+
+	FS_HashBenchmarkRun(true, names, upper, missing, numnames, passes, oldns);
+	FS_HashBenchmarkRun(false, names, upper, missing, numnames, passes, newns);
+
+	Com_Printf("%i names, %i passes, ns per operation\n", numnames, passes);
+	Com_Printf("%-14s %8s %8s\n", "", "old", "new");
+	for (i = 0; i < 4; i++)
+		Com_Printf("%-14s %8.1f %8.1f\n", labels[i], oldns[i], newns[i]);
+
+	for (i = 0; i < numnames; i++) {
+		Q_free(names[i]);
+		Q_free(upper[i]);
+		Q_free(missing[i]);
+	}
+	Q_free(names);
+	Q_free(upper);
+	Q_free(missing);
+}
+
 void FS_EnumerateFiles (char *match, int (*func)(char *, int, void *), void *parm)
 {
 	searchpath_t *search;
@@ -3224,6 +3490,7 @@ void FS_Shutdown(void)
 
 	Hash_ShutdownTable(filesystemhash);
 	filesystemhash = NULL;
+	FSIndex_Shutdown();
 
 	for (path = fs_searchpaths; path; path = next) {
 		path->funcs->ClosePath(path->handle);
@@ -55,6 +55,7 @@ typedef struct vfsfile_s {
 	unsigned long (*GetLen) (struct vfsfile_s *file);	// Could give some lag
 	void (*Close) (struct vfsfile_s *file);
 	void (*Flush) (struct vfsfile_s *file);
+	const byte *(*GetData) (struct vfsfile_s *file);	// Optional, whole file contents if they are already in memory
 	qbool seekingisabadplan;
 	qbool copyprotected;							// File found was in a pak
 } vfsfile_t;
@@ -86,6 +87,7 @@ void			VFS_TICK   (void);  // fill in/out our internall buffers
 									// (do read/write on socket)
 vfsfile_t      *VFS_Filter(const char *filename, vfsfile_t *handle);
 qbool			VFS_COPYPROTECTED(struct vfsfile_s *vf);
+const byte	   *VFS_GETDATA(struct vfsfile_s *vf);	// NULL if the file contents aren't resident in memory
 
 // some general function to open VFS file, except TCP
 vfsfile_t *FS_OpenVFS(const char *filename, char *mode,relativeto_t relativeto);
@@ -93,6 +95,22 @@ vfsfile_t *FS_OpenVFS(const char *filename, char *mode,relativeto_t relativeto);
 // TCP VFS file
 vfsfile_t *FS_OpenTCP(char *name);
 
+// Read-only access to a whole file without copying it when possible (loose files and
+// uncompressed pak/pk3 entries come straight from the mapped file).
+// The data is NOT null terminated and must not be modified.
+typedef struct fs_mappedfile_s {
+	const byte *data;
+	int len;
+
+	// private
+	vfsfile_t *vfs;			// keeps the archive the data points into alive
+	sys_mapping_t osmap;	// loose file mapped directly
+	byte *copy;				// fallback, file had to be read into the heap
+} fs_mappedfile_t;
+
+qbool FS_MapFile(const char *path, fs_mappedfile_t *file);
+void FS_UnmapFile(fs_mappedfile_t *file);
+
 typedef enum {
 	FS_LOAD_NONE     = 1,
 	FS_LOAD_FILE_PAK = 2,
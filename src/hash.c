@@ -33,41 +33,91 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_SSE2
+#endif
+
+#define HASH_MIN_SLOTS		16
+#define HASH_ARENA_SIZE		8192
+#define HASH_FNV_BASIS		2166136261u
+#define HASH_FNV_PRIME		16777619u
+
+// keys copied by Hash_Add*, freed all at once
+struct hasharena_s {
+	hasharena_t *next;
+	int used;
+	int size;
+	char data[1];
+};
+
+// marks a removed slot, probing has to continue past it
+static const char hash_tombstone[] = "";
+
+typedef enum {
+	HASH_MATCH_CASE,
+	HASH_MATCH_NOCASE,
+	HASH_MATCH_POINTER
+} hashmatch_t;
+
 hashtable_t *Hash_InitTable(int numbucks)
 {
 	hashtable_t *table;
+	int numslots = HASH_MIN_SLOTS;
 
-	table = Q_malloc(sizeof(*table));
+	while (numslots < numbucks)
+		numslots <<= 1;
 
-	table->bucket = (bucket_t**)Q_calloc(numbucks, sizeof(bucket_t *));
-	table->numbuckets = numbucks;
+	table = Q_calloc(1, sizeof(*table));
+
+	table->slots = (hashslot_t *)Q_calloc(numslots, sizeof(hashslot_t));
+	table->numbuckets = numslots;
 
 	return table;
 }
 
-void Hash_ShutdownTable(hashtable_t* table)
+static void Hash_FreeArenas(hasharena_t *arena)
 {
-	int i;
+	hasharena_t *next;
+
+	for (; arena; arena = next) {
+		next = arena->next;
+		Q_free(arena);
+	}
+}
 
+void Hash_ShutdownTable(hashtable_t* table)
+{
 	if (!table) {
 		return;
 	}
 
-	for (i = 0; i < table->numbuckets; ++i) {
-		bucket_t* list = table->bucket[i];
+	Hash_FreeArenas(table->arena);
+	Q_free(table->slots);
+	Q_free(table);
+}
 
-		while (list) {
-			bucket_t* next = list->next;
-			if (list->flags & HASH_BUCKET_KEYSTRING_OWNED) {
-				Q_free(list->keystring);
-			}
-			Q_free(list);
-			list = next;
-		}
+static const char *Hash_CopyKey(hashtable_t *table, const char *name)
+{
+	int len = strlen(name) + 1;
+	hasharena_t *arena = table->arena;
+	char *key;
+
+	if (!arena || arena->size - arena->used < len) {
+		int size = max(HASH_ARENA_SIZE, len);
+
+		arena = Q_malloc(sizeof(*arena) + size);
+		arena->next = table->arena;
+		arena->used = 0;
+		arena->size = size;
+		table->arena = arena;
 	}
 
-	Q_free(table->bucket);
-	Q_free(table);
+	key = arena->data + arena->used;
+	memcpy(key, name, len);
+	arena->used += len;
+
+	return key;
 }
 
 /* http://www.cse.yorku.ca/~oz/hash.html
@@ -87,326 +137,315 @@ int Hash_Key(char *name, int modulus) {
 	return (int) (key % modulus);
 }
 
-int Hash_KeyInsensitive(const char *name, int modulus) {
-	unsigned int key = 5381;
-
-	for (key = 5381; *name; name++)
-		key = ((key << 5) + key) + tolower(*name); /* key * 33 + c */
-
-	return (int) (key % modulus);
+// final avalanche from MurmurHash3, fnv-1a leaves the low bits we index with weak
+static unsigned int Hash_Mix(unsigned int hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash;
 }
 
-#if 0
-int Hash_Key(char *name, int modulus)
-{	//fixme: optimize.
-	unsigned int key;
-	for (key=0;*name; name++)
-		key += ((key<<3) + (key>>28) + *name);
-		
-	return (int)(key%modulus);
-}
-int Hash_KeyInsensitive(char *name, int modulus)
-{	//fixme: optimize.
-	unsigned int key;
-	for (key=0;*name; name++)
-	{
-		if (*name >= 'A' && *name <= 'Z')
-			key += ((key<<3) + (key>>28) + (*name-'A'+'a'));
-		else
-			key += ((key<<3) + (key>>28) + *name);
+static unsigned int Hash_Bytes(unsigned int hash, const unsigned char *s, size_t len)
+{
+	while (len--) {
+		hash ^= *s++;
+		hash *= HASH_FNV_PRIME;
 	}
-		
-	return (int)(key%modulus);
+	return hash;
 }
-#endif
 
-void *Hash_Get(hashtable_t *table, char *name)
+unsigned int Hash_String(const char *name)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;
-
-	buck = table->bucket[bucknum];
+	return Hash_Mix(Hash_Bytes(HASH_FNV_BASIS, (const unsigned char *)name, strlen(name)));
+}
 
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
+// Same as Hash_String on the lowercased name, so lowercase keys hash the same both ways
+unsigned int Hash_StringInsensitive(const char *name)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	size_t len = strlen(name);
+	unsigned int hash = HASH_FNV_BASIS;
+	unsigned char c;
+#ifdef HASH_SSE2
+	unsigned char folded[16];
+	const __m128i before_a = _mm_set1_epi8('A' - 1);
+	const __m128i after_z = _mm_set1_epi8('Z' + 1);
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+
+	// fold 16 chars at a time, bytes above 127 compare negative and are left alone
+	for (; len >= 16; len -= 16, s += 16) {
+		__m128i chars = _mm_loadu_si128((const __m128i *)s);
+		__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(chars, before_a), _mm_cmplt_epi8(chars, after_z));
+
+		_mm_storeu_si128((__m128i *)folded, _mm_or_si128(chars, _mm_and_si128(upper, case_bit)));
+		hash = Hash_Bytes(hash, folded, sizeof(folded));
+	}
+#endif
 
-		buck = buck->next;
+	for (; len; len--, s++) {
+		c = *s;
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		hash ^= c;
+		hash *= HASH_FNV_PRIME;
 	}
-	return NULL;
+
+	return Hash_Mix(hash);
 }
 
-void *Hash_GetInsensitive(hashtable_t *table, const char *name)
+static unsigned int Hash_Pointer(const void *key)
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
-	bucket_t *buck;
+	uintptr_t p = (uintptr_t)key;
 
-	buck = table->bucket[bucknum];
-
-	while(buck)
-	{
-		if (!strcasecmp(name, buck->keystring))
-			return buck->data;
+	return Hash_Mix((unsigned int)(p ^ (p >> 31 >> 1)));
+}
 
-		buck = buck->next;
+static qbool Hash_SlotMatches(const hashslot_t *slot, unsigned int hash, const char *name, hashmatch_t match)
+{
+	if (!(slot->flags & HASH_SLOT_USED) || slot->hash != hash)
+		return false;
+
+	switch (match) {
+	case HASH_MATCH_POINTER:
+		return (slot->flags & HASH_SLOT_KEYPTR) && slot->keystring == name;
+	case HASH_MATCH_NOCASE:
+		return !(slot->flags & HASH_SLOT_KEYPTR) && !strcasecmp(name, slot->keystring);
+	default:
+		return !(slot->flags & HASH_SLOT_KEYPTR) && !STRCMP(name, slot->keystring);
 	}
-	return NULL;
 }
 
-void *Hash_GetKey(hashtable_t *table, char *key)
+// Probes from the home slot of hash, or from the slot after 'after' when walking duplicates
+static hashslot_t *Hash_Find(hashtable_t *table, unsigned int hash, const char *name, hashmatch_t match, hashslot_t *after)
 {
-	int bucknum = ((uintptr_t) key) % table->numbuckets;
-	bucket_t *buck;
-
-	buck = table->bucket[bucknum];
+	unsigned int mask = table->numbuckets - 1;
+	unsigned int i = after ? (unsigned int)(after - table->slots) + 1 : hash;
+	unsigned int probes;
 
-	while(buck)
-	{
-		if (buck->keystring == key)
-			return buck->data;
+	for (probes = 0; probes < (unsigned int)table->numbuckets; probes++, i++) {
+		hashslot_t *slot = &table->slots[i & mask];
 
-		buck = buck->next;
+		if (!slot->keystring)
+			return NULL;
+		if (Hash_SlotMatches(slot, hash, name, match))
+			return slot;
 	}
+
 	return NULL;
 }
 
-void *Hash_GetNext(hashtable_t *table, char *name, void *old)
+// Looks for the slot holding old, then the next duplicate after it
+static hashslot_t *Hash_FindNext(hashtable_t *table, unsigned int hash, const char *name, hashmatch_t match, void *old)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;
-
-	buck = table->bucket[bucknum];
-
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-		{
-			if (buck->data == old)	//found the old one
-				break;
-		}
+	hashslot_t *slot = NULL;
 
-		buck = buck->next;
+	while ((slot = Hash_Find(table, hash, name, match, slot))) {
+		if (slot->data == old)
+			return Hash_Find(table, hash, name, match, slot);
 	}
-	if (!buck)
-		return NULL;
 
-	buck = buck->next;//don't return old
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
-
-		buck = buck->next;
-	}
 	return NULL;
 }
 
-void *Hash_GetNextInsensitive(hashtable_t *table, char *name, void *old)
+static void Hash_Insert(hashslot_t *slots, int numslots, const hashslot_t *from)
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
-	bucket_t *buck;
-
-	buck = table->bucket[bucknum];
+	unsigned int mask = numslots - 1;
+	unsigned int i = from->hash;
 
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-		{
-			if (buck->data == old)	//found the old one
-				break;
-		}
+	while (slots[i & mask].flags & HASH_SLOT_USED)
+		i++;
+	slots[i & mask] = *from;
+}
 
-		buck = buck->next;
+// Rehashes into a table that is at most half full, repacking the key
+// arenas too when removed keys take up most of them.
+static void Hash_Resize(hashtable_t *table, int count)
+{
+	hashslot_t *old = table->slots;
+	hasharena_t *oldarena = NULL, *arena;
+	int numslots = HASH_MIN_SLOTS, arenabytes = 0, i;
+
+	while (numslots < count * 2)
+		numslots <<= 1;
+
+	for (arena = table->arena; arena; arena = arena->next)
+		arenabytes += arena->used;
+	if (table->arena_dead > arenabytes / 2) {
+		oldarena = table->arena;
+		table->arena = NULL;
+		table->arena_dead = 0;
 	}
-	if (!buck)
-		return NULL;
-
-	buck = buck->next;//don't return old
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
 
-		buck = buck->next;
+	table->slots = (hashslot_t *)Q_calloc(numslots, sizeof(hashslot_t));
+	for (i = 0; i < table->numbuckets; i++) {
+		if (!(old[i].flags & HASH_SLOT_USED))
+			continue;
+		if (oldarena && !(old[i].flags & HASH_SLOT_KEYPTR))
+			old[i].keystring = Hash_CopyKey(table, old[i].keystring);
+		Hash_Insert(table->slots, numslots, &old[i]);
 	}
-	return NULL;
+
+	Hash_FreeArenas(oldarena);
+	Q_free(old);
+	table->numbuckets = numslots;
+	table->tombstones = 0;
 }
 
-void *Hash_Add(hashtable_t *table, char *name, void *data) 
+static void Hash_AddSlot(hashtable_t *table, unsigned int hash, const char *key, void *data, int flags)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-
-	bucket_t *buck = (bucket_t *) Q_malloc(sizeof(bucket_t));
-	char *keystring = Q_strdup(name);
-
-	buck->data = data;
-	buck->keystring = keystring;
-	buck->next = table->bucket[bucknum];
-	buck->flags = HASH_BUCKET_KEYSTRING_OWNED;
-	table->bucket[bucknum] = buck;
-
-	return buck;
+	hashslot_t slot;
+	unsigned int mask, i;
+
+	// keep it below 70% full, tombstones count as they lengthen probes too
+	if ((table->count + table->tombstones + 1) * 10 > table->numbuckets * 7)
+		Hash_Resize(table, table->count + 1);
+
+	slot.hash = hash;
+	slot.flags = flags | HASH_SLOT_USED;
+	slot.keystring = (flags & HASH_SLOT_KEYPTR) ? key : Hash_CopyKey(table, key);
+	slot.data = data;
+
+	mask = table->numbuckets - 1;
+	for (i = hash; table->slots[i & mask].flags & HASH_SLOT_USED; i++)
+		;
+	if (table->slots[i & mask].keystring)
+		table->tombstones--;
+	table->slots[i & mask] = slot;
+	table->count++;
 }
 
-void *Hash_AddInsensitive(hashtable_t *table, char *name, void *data) 
+static void Hash_RemoveSlot(hashtable_t *table, hashslot_t *slot)
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
-
-	bucket_t *buck = (bucket_t *) Q_malloc(sizeof(bucket_t));
-	char *keystring = Q_strdup(name);
+	if (!slot)
+		return;
 
-	buck->data = data;
-	buck->keystring = keystring;
-	buck->next = table->bucket[bucknum];
-	buck->flags = HASH_BUCKET_KEYSTRING_OWNED;
-	table->bucket[bucknum] = buck;
+	if (!(slot->flags & HASH_SLOT_KEYPTR))
+		table->arena_dead += strlen(slot->keystring) + 1;
 
-	return buck;
+	slot->flags = 0;
+	slot->keystring = hash_tombstone;
+	slot->data = NULL;
+	table->count--;
+	table->tombstones++;
 }
 
-void *Hash_AddKey(hashtable_t *table, char *key, void *data, bucket_t *buck)
+void *Hash_Get(hashtable_t *table, char *name)
 {
-	int bucknum = ((uintptr_t) key) % table->numbuckets;
-
-	buck->data = data;
-	buck->keystring = key;
-	buck->next = table->bucket[bucknum];
-	table->bucket[bucknum] = buck;
+	hashslot_t *slot = Hash_Find(table, Hash_String(name), name, HASH_MATCH_CASE, NULL);
 
-	return buck;
+	return slot ? slot->data : NULL;
 }
 
-void Hash_Remove(hashtable_t *table, char *name)
+void *Hash_GetInsensitive(hashtable_t *table, const char *name)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck, *to_remove;
+	hashslot_t *slot = Hash_Find(table, Hash_StringInsensitive(name), name, HASH_MATCH_NOCASE, NULL);
 
-	buck = table->bucket[bucknum];
+	return slot ? slot->data : NULL;
+}
 
-	if (!STRCMP(name, buck->keystring))
-	{
-		table->bucket[bucknum] = buck->next;
-		Q_free(buck->keystring);
-		Q_free(buck);
-		return;
-	}
+void *Hash_GetKey(hashtable_t *table, char *key)
+{
+	hashslot_t *slot = Hash_Find(table, Hash_Pointer(key), key, HASH_MATCH_POINTER, NULL);
 
+	return slot ? slot->data : NULL;
+}
 
-	while(buck->next)
-	{
-		if (!STRCMP(name, buck->next->keystring))
-		{
-			to_remove = buck->next;
-			buck->next = to_remove->next;
-			Q_free(to_remove->keystring);
-			Q_free(to_remove);
-			return;
-		}
+void *Hash_GetNext(hashtable_t *table, char *name, void *old)
+{
+	hashslot_t *slot = Hash_FindNext(table, Hash_String(name), name, HASH_MATCH_CASE, old);
 
-		buck = buck->next;
-	}
-	return;
+	return slot ? slot->data : NULL;
 }
 
-void Hash_RemoveData(hashtable_t *table, char *name, void *data)
+void *Hash_GetNextInsensitive(hashtable_t *table, char *name, void *old)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;	
+	hashslot_t *slot = Hash_FindNext(table, Hash_StringInsensitive(name), name, HASH_MATCH_NOCASE, old);
 
-	buck = table->bucket[bucknum];
+	return slot ? slot->data : NULL;
+}
 
-	if (buck->data == data)
-		if (!STRCMP(name, buck->keystring))
-		{
-			table->bucket[bucknum] = buck->next;
-			Q_free(buck->keystring);
-			Q_free(buck);
-			return;
-		}
+void *Hash_Add(hashtable_t *table, char *name, void *data) 
+{
+	Hash_AddSlot(table, Hash_String(name), name, data, 0);
 
+	return data;
+}
 
-	while(buck->next)
-	{
-		if (buck->next->data == data)
-			if (!STRCMP(name, buck->next->keystring))
-			{
-				buck->next = buck->next->next;
-				Q_free(buck->next->keystring);
-				Q_free(buck->next);
-				return;
-			}
+void *Hash_AddInsensitive(hashtable_t *table, char *name, void *data) 
+{
+	Hash_AddSlot(table, Hash_StringInsensitive(name), name, data, 0);
 
-		buck = buck->next;
-	}
-	return;
+	return data;
 }
 
-void Hash_RemoveKey(hashtable_t *table, char *key)
+// key is matched by pointer and not copied, buck isn't needed any more
+void *Hash_AddKey(hashtable_t *table, char *key, void *data, bucket_t *buck)
 {
-	int bucknum = ((uintptr_t) key) % table->numbuckets;
-	bucket_t *buck, *to_remove;
+	Hash_AddSlot(table, Hash_Pointer(key), key, data, HASH_SLOT_KEYPTR);
 
-	buck = table->bucket[bucknum];
+	return buck;
+}
 
-	if (buck->keystring == key)
-	{
-		table->bucket[bucknum] = buck->next;
-		Q_free(buck->keystring);
-		Q_free(buck);
-		return;
-	}
+void Hash_Remove(hashtable_t *table, char *name)
+{
+	Hash_RemoveSlot(table, Hash_Find(table, Hash_String(name), name, HASH_MATCH_CASE, NULL));
+}
 
+void Hash_RemoveData(hashtable_t *table, char *name, void *data)
+{
+	unsigned int hash = Hash_String(name);
+	hashslot_t *slot = NULL;
 
-	while(buck->next)
-	{
-		if (buck->next->keystring == key)
-		{
-			to_remove = buck->next;
-			buck->next = to_remove->next;
-			Q_free(to_remove->keystring);
-			Q_free(to_remove);
+	while ((slot = Hash_Find(table, hash, name, HASH_MATCH_CASE, slot))) {
+		if (slot->data == data) {
+			Hash_RemoveSlot(table, slot);
 			return;
 		}
-
-		buck = buck->next;
 	}
-	return;
+}
+
+void Hash_RemoveKey(hashtable_t *table, char *key)
+{
+	Hash_RemoveSlot(table, Hash_Find(table, Hash_Pointer(key), key, HASH_MATCH_POINTER, NULL));
 }
 
 void Hash_Flush(hashtable_t *table) 
 {
-	int i;
-	for (i = 0; i < table->numbuckets; i++)
-	{
-		bucket_t *bucket, *next;
-		bucket = table->bucket[i];
-		table->bucket[i] = NULL;
-		
-		while (bucket)
-		{
-			next = bucket->next;
-			Q_free(bucket->keystring);
-			Q_free(bucket);
-			bucket = next;
+	memset(table->slots, 0, table->numbuckets * sizeof(hashslot_t));
+	Hash_FreeArenas(table->arena);
+	table->arena = NULL;
+	table->arena_dead = 0;
+	table->count = 0;
+	table->tombstones = 0;
+}
+
+void *Hash_Enumerate(hashtable_t *table, int *cursor, const char **key)
+{
+	while (*cursor < table->numbuckets) {
+		hashslot_t *slot = &table->slots[(*cursor)++];
+
+		if (slot->flags & HASH_SLOT_USED) {
+			if (key)
+				*key = slot->keystring;
+			return slot->data;
 		}
 	}
-	return;
+
+	return NULL;
 }
 
 #if 0
 void Hash_BucketStats(hashtable_t *table)
 {
 	int i;
-	bucket_t *buck;	
-	int bucket_count;
 
 	for (i = 0; i < table->numbuckets; i++) {
-		bucket_count = 0;
-		for (buck = table->bucket[i]; buck; buck = buck->next) {
-			bucket_count++;
+		if (table->slots[i].flags & HASH_SLOT_USED) {
+			printf("table[%d] = home %d\n", i, (int)(table->slots[i].hash & (table->numbuckets - 1)));
 		}
-		printf("table[%d] = %d\n", i, bucket_count);
 	}
 }
 #endif
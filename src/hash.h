@@ -23,6 +23,33 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define __HASH_H__
 
 #define STRCMP(s1,s2) (((*s1)!=(*s2)) || strcmp(s1+1,s2+1))	//saves about 2-6 out of 120 - expansion of idea from fastqcc
+
+// Open addressing with linear probing, every slot keeps the full 32 bit hash so
+// probing only touches key strings on a real hash match. The table doubles
+// when it gets 70% full, copied keys live in arenas owned by the table.
+// Duplicate keys are allowed, Hash_GetNext walks them.
+typedef struct hashslot_s {
+	unsigned int hash;
+	int flags;
+	const char *keystring;	// NULL if the slot was never used
+	void *data;
+} hashslot_t;
+
+#define HASH_SLOT_USED		1
+#define HASH_SLOT_KEYPTR	2	// added by Hash_AddKey, matched by pointer
+
+typedef struct hasharena_s hasharena_t;
+
+typedef struct hashtable_s {
+	int numbuckets;			// number of slots, always a power of two
+	int count;				// slots in use
+	int tombstones;			// removed slots still breaking probe chains
+	hashslot_t *slots;
+	hasharena_t *arena;
+	int arena_dead;			// bytes of arena taken by removed keys
+} hashtable_t;
+
+// kept so old Hash_AddKey callers still compile, the table doesn't use it
 typedef struct bucket_s {
 	void *data;
 	char *keystring;
@@ -30,16 +57,11 @@ typedef struct bucket_s {
 	int flags;
 } bucket_t;
 
-#define HASH_BUCKET_KEYSTRING_OWNED 1
-
-typedef struct hashtable_s {
-	int numbuckets;
-	bucket_t **bucket;
-} hashtable_t;
-
 hashtable_t *Hash_InitTable(int numbucks);
 void Hash_ShutdownTable(hashtable_t* table);
 
+unsigned int Hash_String(const char *name);
+unsigned int Hash_StringInsensitive(const char *name);
 int Hash_Key(char *name, int modulus);
 void *Hash_Get(hashtable_t *table, char *name);
 void *Hash_GetInsensitive(hashtable_t *table, const char *name);
@@ -54,6 +76,9 @@ void Hash_RemoveKey(hashtable_t *table, char *key);
 void *Hash_AddKey(hashtable_t *table, char *key, void *data, bucket_t *buck);
 void Hash_Flush(hashtable_t *table);
 
+// walk every entry, start with *cursor = 0, returns NULL when done
+void *Hash_Enumerate(hashtable_t *table, int *cursor, const char **key);
+
 #if 0
 /* Print some stats on the bucket distrubution */
 void Hash_BucketStats(hashtable_t *table);
@@ -656,6 +656,10 @@ void Host_Init (int argc, char **argv, int default_memsize)
 	}
 	atexit(SDL_Quit);
 
+	// headless demo statistics, doesn't return
+	if (COM_CheckParm(cmdline_param_client_demoanalyze))
+		DemoAnalyze_Main();
+
 	Host_InitMemory (default_memsize);
 
 	Cbuf_Init ();
@@ -705,6 +709,7 @@ void Host_Init (int argc, char **argv, int default_memsize)
 	Sys_Init ();
 	Sys_CvarInit();
 	CM_Init ();
+	PM_Init ();
 	Mod_Init ();
 	VersionCheck_Init();
 
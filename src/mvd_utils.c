@@ -1325,6 +1325,106 @@ void MVD_Stats_Cleanup(void)
 	fixed_ordering = 0;
 }
 
+//
+// Demo keyframes: the item clocks and per-player stats are accumulated while
+// the demo is parsed, so they have to be stored along with each snapshot.
+//
+typedef struct mvd_stats_state_s {
+	mvd_new_info_t        new_info[MAX_CLIENTS];
+	mvd_cg_info_s         cg_info;
+	double                quad_time;
+	double                pent_time;
+	double                gamestart_time;
+	qbool                 quad_is_active;
+	qbool                 pent_is_active;
+	powerup_cam_status_id powerup_cam_status;
+	qbool                 powerup_cam_active[4];
+	qbool                 was_standby;
+	int                   fixed_ordering;
+	int                   numclocks;
+} mvd_stats_state_t;
+
+// Size of the buffer MVD_Stats_SaveState() will fill.
+int MVD_Stats_StateSize(void)
+{
+	mvd_clock_t* c;
+	int numclocks = 0;
+
+	for (c = mvd_clocklist; c; c = c->next) {
+		numclocks++;
+	}
+
+	return sizeof(mvd_stats_state_t) + numclocks * sizeof(mvd_clock_t);
+}
+
+void MVD_Stats_SaveState(byte* buf)
+{
+	mvd_stats_state_t* state = (mvd_stats_state_t*)buf;
+	mvd_clock_t* clocks = (mvd_clock_t*)(state + 1);
+	mvd_clock_t* c;
+
+	memcpy(state->new_info, mvd_new_info, sizeof(state->new_info));
+	state->cg_info = mvd_cg_info;
+	state->quad_time = quad_time;
+	state->pent_time = pent_time;
+	state->gamestart_time = gamestart_time;
+	state->quad_is_active = quad_is_active;
+	state->pent_is_active = pent_is_active;
+	state->powerup_cam_status = powerup_cam_status;
+	memcpy(state->powerup_cam_active, powerup_cam_active, sizeof(state->powerup_cam_active));
+	state->was_standby = was_standby;
+	state->fixed_ordering = fixed_ordering;
+	state->numclocks = 0;
+
+	for (c = mvd_clocklist; c; c = c->next) {
+		clocks[state->numclocks++] = *c;
+	}
+}
+
+qbool MVD_Stats_RestoreState(const byte* buf, int size)
+{
+	const mvd_stats_state_t* state = (const mvd_stats_state_t*)buf;
+	const mvd_clock_t* clocks = (const mvd_clock_t*)(state + 1);
+	mvd_clock_t* last = NULL;
+	int i;
+
+	if (size < (int)sizeof(*state) || size != (int)(sizeof(*state) + state->numclocks * sizeof(mvd_clock_t))) {
+		return false;
+	}
+
+	MVD_Stats_Cleanup();
+
+	memcpy(mvd_new_info, state->new_info, sizeof(mvd_new_info));
+	mvd_cg_info = state->cg_info;
+	quad_time = state->quad_time;
+	pent_time = state->pent_time;
+	gamestart_time = state->gamestart_time;
+	quad_is_active = state->quad_is_active;
+	pent_is_active = state->pent_is_active;
+	powerup_cam_status = state->powerup_cam_status;
+	memcpy(powerup_cam_active, state->powerup_cam_active, sizeof(powerup_cam_active));
+	was_standby = state->was_standby;
+	fixed_ordering = state->fixed_ordering;
+
+	// The list was saved in order, so rebuild it by appending.
+	for (i = 0; i < state->numclocks; i++) {
+		mvd_clock_t* c = (mvd_clock_t*)Q_malloc(sizeof(mvd_clock_t));
+
+		*c = clocks[i];
+		c->prev = last;
+		c->next = NULL;
+		if (last) {
+			last->next = c;
+		}
+		else {
+			mvd_clocklist = c;
+		}
+		last = c;
+	}
+
+	return true;
+}
+
 void MVD_Set_Armor_Stats(int z, int i) {
 	switch (z) {
 	case GA_INFO:
@@ -1917,12 +2017,18 @@ qbool MVD_MatchStarted(void) {
 	return false;
 }
 
-void MVD_Mainhook(void) {
+// Per frame statistics update, also used by the headless demo analysis
+void MVD_Stats_Frame(void)
+{
 	if (MVD_MatchStarted()) {
 		MVD_Init_Info(MAX_CLIENTS);
 	}
 
 	MVD_Stats_Gather();
+}
+
+void MVD_Mainhook(void) {
+	MVD_Stats_Frame();
 	MVD_Stats_CalcAvgRuns();
 	MVD_AutoTrack();
 	MVD_ClockList_RemoveExpired();
@@ -28,7 +28,11 @@ void MVD_Screen (void);
 // initialize the module, add variables and commands
 void MVD_Utils_Init(void); 
 void MVD_Mainhook(void);
+void MVD_Stats_Frame(void);
 void MVD_Stats_Cleanup(void);
+int MVD_Stats_StateSize(void);
+void MVD_Stats_SaveState(byte* buf);
+qbool MVD_Stats_RestoreState(const byte* buf, int size);
 void MVD_ClockList_TopItems_Draw(double time_limit, int style, int x, int y, float scale, int filter, qbool backpacks, qbool proportional);
 void MVD_ClockList_TopItems_DimensionsGet(double time_limit, int style, int *width, int *height, float scale, qbool backpacks, qbool proportional);
 
@@ -20,6 +20,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // net.c
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg(), sendmmsg()
+#endif
+
 #ifdef SERVERONLY
 #include "qwsvdef.h"
 #else
@@ -88,6 +92,50 @@ netadr_t	net_local_sv_ipadr;
 netadr_t	net_local_sv_tcpipadr;
 
 cvar_t		sv_local_addr = {"sv_local_addr", "", CVAR_ROM};
+
+//
+// Batched UDP I/O of the server socket.
+// SV_ReadPackets still gets one packet per NET_GetPacket(), but they are read from the
+// socket up to sv_net_batch at a time with recvmmsg(). Between NET_SV_BeginSendBatch()
+// and NET_SV_FlushSendBatch() the server packets are queued and sent with sendmmsg().
+// Where these calls don't exist, the same code does one recvfrom()/sendto() per packet.
+//
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define NET_HAVE_MMSG
+#endif
+
+#define NET_SV_MAX_BATCH	64
+
+static void sv_net_batch_changed(cvar_t *var, char *value, qbool *cancel);
+static cvar_t sv_net_batch = {"sv_net_batch", "32", 0, sv_net_batch_changed};
+
+static struct
+{
+	byte					data[NET_SV_MAX_BATCH][MSG_BUF_SIZE];
+	int						len[NET_SV_MAX_BATCH];
+	struct sockaddr_storage	addr[NET_SV_MAX_BATCH];
+	int						count;
+	int						next;		// next packet NET_GetPacket returns
+} sv_recvbatch;
+
+static struct
+{
+	byte					data[NET_SV_MAX_BATCH][MAX_UDP_PACKET];
+	int						len[NET_SV_MAX_BATCH];
+	struct sockaddr_storage	addr[NET_SV_MAX_BATCH];
+	int						count;
+	qbool					active;
+} sv_sendbatch;
+
+// shown by sv_netstats
+static struct
+{
+	unsigned int	recvcalls;
+	unsigned int	recvpackets;
+	unsigned int	sendcalls;
+	unsigned int	sendpackets;
+} sv_netstats;
 #endif
 
 netadr_t	net_from;
@@ -114,7 +162,7 @@ extern int do_stdin;
 // LOOPBACK defs.
 //
 
-#define MAX_LOOPBACK 4 // must be a power of two
+#define MAX_LOOPBACK 64 // must be a power of two, a local download sends bursts of chunks
 
 typedef struct {
 	byte	data[MAX_UDP_PACKET];
@@ -588,9 +636,118 @@ int sv_tcp_connection_count(void)
 
 //=============================================================================
 
+static void NET_RecvError (int err, const netadr_t *from_adr)
+{
+	if (err == EWOULDBLOCK)
+		return; // common error, does not spam in logs.
+
+	if (err == EMSGSIZE)
+	{
+		Con_DPrintf ("Warning: Oversize packet from %s\n", NET_AdrToString (*from_adr));
+		return;
+	}
+
+	if (err == ECONNABORTED || err == ECONNRESET)
+	{
+		Con_DPrintf ("Connection lost or aborted\n");
+		return;
+	}
+
+	Con_Printf ("NET_GetPacket: recvfrom: (%i): %s\n", err, strerror(err));
+}
+
+#ifndef CLIENTONLY
+// Refills sv_recvbatch from the server socket, returns the number of packets read.
+static int NET_SV_RecvBatch (int socket)
+{
+	netadr_t from_adr;
+	socklen_t fromlen;
+	int ret;
+#ifdef NET_HAVE_MMSG
+	struct mmsghdr msgs[NET_SV_MAX_BATCH];
+	struct iovec iov[NET_SV_MAX_BATCH];
+	int i, batch = bound(1, (int) sv_net_batch.value, NET_SV_MAX_BATCH);
+
+	if (batch > 1)
+	{
+		memset(msgs, 0, batch * sizeof(msgs[0]));
+		for (i = 0; i < batch; i++)
+		{
+			iov[i].iov_base = sv_recvbatch.data[i];
+			iov[i].iov_len = sizeof(sv_recvbatch.data[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &sv_recvbatch.addr[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(sv_recvbatch.addr[i]);
+		}
+
+		sv_netstats.recvcalls++;
+		ret = recvmmsg(socket, msgs, batch, MSG_DONTWAIT, NULL);
+		if (ret == -1)
+		{
+			memset(&from_adr, 0, sizeof(from_adr));
+			NET_RecvError(qerrno, &from_adr);
+			return 0;
+		}
+
+		for (i = 0; i < ret; i++)
+			sv_recvbatch.len[i] = msgs[i].msg_len;
+
+		sv_netstats.recvpackets += ret;
+		sv_recvbatch.count = ret;
+		return ret;
+	}
+#endif
+
+	memset(&sv_recvbatch.addr[0], 0, sizeof(sv_recvbatch.addr[0]));
+	fromlen = sizeof(sv_recvbatch.addr[0]);
+	sv_netstats.recvcalls++;
+	ret = recvfrom (socket, (char *)sv_recvbatch.data[0], sizeof(sv_recvbatch.data[0]), 0, (struct sockaddr *)&sv_recvbatch.addr[0], &fromlen);
+	if (ret == -1)
+	{
+		SockadrToNetadr (&sv_recvbatch.addr[0], &from_adr);
+		NET_RecvError(qerrno, &from_adr);
+		return 0;
+	}
+
+	sv_recvbatch.len[0] = ret;
+	sv_netstats.recvpackets++;
+	sv_recvbatch.count = 1;
+	return 1;
+}
+
+static qbool NET_GetUDPPacket_SV (int socket, netadr_t *from_adr, sizebuf_t *message)
+{
+	int i;
+
+	while (true)
+	{
+		if (sv_recvbatch.next == sv_recvbatch.count)
+		{
+			sv_recvbatch.next = sv_recvbatch.count = 0;
+			if (!NET_SV_RecvBatch(socket))
+				return false;
+		}
+
+		i = sv_recvbatch.next++;
+		SockadrToNetadr (&sv_recvbatch.addr[i], from_adr);
+
+		if (sv_recvbatch.len[i] < message->maxsize)
+			break;
+
+		Con_Printf ("Oversize packet from %s\n", NET_AdrToString (*from_adr));
+	}
+
+	memcpy(message->data, sv_recvbatch.data[i], sv_recvbatch.len[i]);
+	message->cursize = sv_recvbatch.len[i];
+
+	return message->cursize;
+}
+#endif
+
 qbool NET_GetUDPPacket (netsrc_t netsrc, netadr_t *from_adr, sizebuf_t *message)
 {
-	int ret, err;
+	int ret;
 	struct sockaddr_storage from = {0};
 	socklen_t fromlen;
 	int socket = NET_GetSocket(netsrc, false);
@@ -598,30 +755,18 @@ qbool NET_GetUDPPacket (netsrc_t netsrc, netadr_t *from_adr, sizebuf_t *message)
 	if (socket == INVALID_SOCKET)
 		return false;
 
+#ifndef CLIENTONLY
+	if (netsrc == NS_SERVER)
+		return NET_GetUDPPacket_SV(socket, from_adr, message);
+#endif
+
 	fromlen = sizeof(from);
 	ret = recvfrom (socket, (char *)message->data, message->maxsize, 0, (struct sockaddr *)&from, &fromlen);
 	SockadrToNetadr (&from, from_adr);
 
 	if (ret == -1)
 	{
-		err = qerrno;
-
-		if (err == EWOULDBLOCK)
-			return false; // common error, does not spam in logs.
-
-		if (err == EMSGSIZE)
-		{
-			Con_DPrintf ("Warning: Oversize packet from %s\n", NET_AdrToString (*from_adr));
-			return false;
-		}
-
-		if (err == ECONNABORTED || err == ECONNRESET)
-		{
-			Con_DPrintf ("Connection lost or aborted\n");
-			return false;
-		}
-
-		Con_Printf ("NET_GetPacket: recvfrom: (%i): %s\n", err, strerror(err));
+		NET_RecvError(qerrno, from_adr);
 		return false;
 	}
 
@@ -954,6 +1099,87 @@ qbool NET_SendTCPPacket_SV (netsrc_t netsrc, int length, void *data, netadr_t to
 }
 #endif
 
+static void NET_SendError (int err, int socket)
+{
+	if (err == EWOULDBLOCK || err == ECONNREFUSED || err == EADDRNOTAVAIL)
+		; // nothing
+	else
+		Con_Printf ("NET_SendPacket: sendto: (%i): %s %i\n", err, strerror(err), socket);
+}
+
+#ifndef CLIENTONLY
+// Sends out everything queued in sv_sendbatch.
+static void NET_SV_SendBatch (void)
+{
+	int i, ret;
+	int socket = NET_GetSocket(NS_SERVER, false);
+#ifdef NET_HAVE_MMSG
+	struct mmsghdr msgs[NET_SV_MAX_BATCH];
+	struct iovec iov[NET_SV_MAX_BATCH];
+	int sent = 0;
+#endif
+
+	if (!sv_sendbatch.count || socket == INVALID_SOCKET)
+	{
+		sv_sendbatch.count = 0;
+		return;
+	}
+
+#ifdef NET_HAVE_MMSG
+	memset(msgs, 0, sv_sendbatch.count * sizeof(msgs[0]));
+	for (i = 0; i < sv_sendbatch.count; i++)
+	{
+		iov[i].iov_base = sv_sendbatch.data[i];
+		iov[i].iov_len = sv_sendbatch.len[i];
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &sv_sendbatch.addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	}
+
+	while (sent < sv_sendbatch.count)
+	{
+		sv_netstats.sendcalls++;
+		ret = sendmmsg(socket, msgs + sent, sv_sendbatch.count - sent, 0);
+		if (ret == -1)
+		{
+			// the first packet failed, drop it like sendto() would and carry on with the rest
+			NET_SendError(qerrno, socket);
+			sent++;
+			continue;
+		}
+
+		sv_netstats.sendpackets += ret;
+		sent += ret;
+	}
+#else
+	for (i = 0; i < sv_sendbatch.count; i++)
+	{
+		sv_netstats.sendcalls++;
+		ret = sendto (socket, (char *)sv_sendbatch.data[i], sv_sendbatch.len[i], 0, (struct sockaddr *)&sv_sendbatch.addr[i], sizeof(struct sockaddr_in));
+		if (ret == -1)
+			NET_SendError(qerrno, socket);
+		else
+			sv_netstats.sendpackets++;
+	}
+#endif
+
+	sv_sendbatch.count = 0;
+}
+
+// Queue server packets from now on, SV_SendClientMessages wraps its loop over the clients with these.
+void NET_SV_BeginSendBatch (void)
+{
+	sv_sendbatch.active = (sv_net_batch.value > 1);
+}
+
+void NET_SV_FlushSendBatch (void)
+{
+	NET_SV_SendBatch();
+	sv_sendbatch.active = false;
+}
+#endif
+
 qbool NET_SendUDPPacket (netsrc_t netsrc, int length, void *data, netadr_t to)
 {
 	struct sockaddr_storage addr;
@@ -963,18 +1189,42 @@ qbool NET_SendUDPPacket (netsrc_t netsrc, int length, void *data, netadr_t to)
 	if (socket == INVALID_SOCKET)
 		return false;
 
+#ifndef CLIENTONLY
+	if (netsrc == NS_SERVER && sv_sendbatch.active)
+	{
+		if (sv_sendbatch.count >= bound(1, (int) sv_net_batch.value, NET_SV_MAX_BATCH))
+			NET_SV_SendBatch();
+
+		if (length <= MAX_UDP_PACKET)
+		{
+			NetadrToSockadr (&to, &sv_sendbatch.addr[sv_sendbatch.count]);
+			memcpy(sv_sendbatch.data[sv_sendbatch.count], data, length);
+			sv_sendbatch.len[sv_sendbatch.count++] = length;
+			return true;
+		}
+
+		NET_SV_SendBatch(); // keep the order
+	}
+#endif
+
 	NetadrToSockadr (&to, &addr);
 
+#ifndef CLIENTONLY
+	if (netsrc == NS_SERVER)
+		sv_netstats.sendcalls++;
+#endif
+
 	ret = sendto (socket, data, length, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
 	if (ret == -1)
 	{
-		int err = qerrno;
-
-		if (err == EWOULDBLOCK || err == ECONNREFUSED || err == EADDRNOTAVAIL)
-			; // nothing
-		else
-			Con_Printf ("NET_SendPacket: sendto: (%i): %s %i\n", err, strerror(err), socket);
+		NET_SendError(qerrno, socket);
+	}
+#ifndef CLIENTONLY
+	else if (netsrc == NS_SERVER)
+	{
+		sv_netstats.sendpackets++;
 	}
+#endif
 
 	return true;
 }
@@ -1406,6 +1656,8 @@ void NET_Init (void)
 
 #ifndef CLIENTONLY
 	Cvar_Register (&sv_local_addr);
+	Cvar_Register (&sv_net_batch);
+	Cmd_AddCommand ("sv_netstats", NET_SV_Stats_f);
 
 	svs.socketip = INVALID_SOCKET;
 // TCPCONNECT -->
@@ -1563,10 +1815,13 @@ void NET_CloseClient (void)
 
 qbool CL_QueInputPacket(void)
 {
-	if (!NET_GetPacketEx(NS_CLIENT, false))
-		return false;
+	qbool queued = false;
+
+	// take everything that's waiting, a download brings in many packets at once
+	while (NET_GetPacketEx(NS_CLIENT, false))
+		queued |= NET_PacketQueueAdd(&delay_queue_get, net_message.data, net_message.cursize, net_from);
 
-	return NET_PacketQueueAdd(&delay_queue_get, net_message.data, net_message.cursize, net_from);
+	return queued;
 }
 
 void CL_ClearQueuedPackets(void)
@@ -1655,6 +1910,10 @@ void NET_CloseServer (void)
 		svs.socketip = INVALID_SOCKET;
 	}
 
+	// packets read for or queued on the old socket
+	sv_recvbatch.count = sv_recvbatch.next = 0;
+	sv_sendbatch.count = 0;
+
 	net_local_sv_ipadr.type = NA_LOOPBACK; // FIXME: why not NA_INVALID?
 
 // TCPCONNECT -->
@@ -1663,6 +1922,38 @@ void NET_CloseServer (void)
 }
 #endif
 
+#ifndef CLIENTONLY
+static void sv_net_batch_changed(cvar_t *var, char *value, qbool *cancel)
+{
+	int batch = Q_atoi(value);
+
+	if (batch < 1 || batch > NET_SV_MAX_BATCH)
+	{
+		Con_Printf("%s must be between 1 and %d\n", var->name, NET_SV_MAX_BATCH);
+		*cancel = true;
+	}
+}
+
+void NET_SV_Stats_f (void)
+{
+	if (Cmd_Argc() > 1 && !strcasecmp(Cmd_Argv(1), "reset"))
+	{
+		memset(&sv_netstats, 0, sizeof(sv_netstats));
+		return;
+	}
+
+#ifdef NET_HAVE_MMSG
+	Con_Printf("UDP batching: recvmmsg/sendmmsg, %d packets per call\n", (int) sv_net_batch.value);
+#else
+	Con_Printf("UDP batching: not available, one packet per call\n");
+#endif
+	Con_Printf("received: %u packets in %u calls, %.2f per call\n", sv_netstats.recvpackets, sv_netstats.recvcalls,
+		sv_netstats.recvcalls ? (double)sv_netstats.recvpackets / sv_netstats.recvcalls : 0);
+	Con_Printf("sent    : %u packets in %u calls, %.2f per call\n", sv_netstats.sendpackets, sv_netstats.sendcalls,
+		sv_netstats.sendcalls ? (double)sv_netstats.sendpackets / sv_netstats.sendcalls : 0);
+}
+#endif
+
 static void cl_portpingprobe_probes_changed(cvar_t *var, char *val, qbool *cancel)
 {
 	int probes = Q_atoi(val);
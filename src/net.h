@@ -200,6 +200,13 @@ int		NET_GetSocket(netsrc_t netsrc, qbool tcp);
 // open server TCP socket.
 void	NET_InitServer_TCP(unsigned short int port);
 
+// queue server UDP packets and send them with as few syscalls as possible.
+void	NET_SV_BeginSendBatch (void);
+// send the queued server UDP packets and stop queueing.
+void	NET_SV_FlushSendBatch (void);
+// print packets per syscall of the server socket.
+void	NET_SV_Stats_f (void);
+
 // UTILITY: set KEEPALIVE option on TCP socket (useful for faster timeout detection).
 qbool 	TCP_Set_KEEPALIVE(int sock);
 // UTILITY: open TCP socket for remove address (useful for client connection).
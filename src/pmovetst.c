@@ -29,6 +29,44 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 extern	vec3_t player_mins;
 extern	vec3_t player_maxs;
 
+// prediction replays the same commands from the same position until the server
+// acknowledges more of them, so most world and brush model traces repeat exactly
+cvar_t	pm_tracecache = {"pm_tracecache", "1"};
+cvar_t	pm_tracecache_verify = {"pm_tracecache_verify", "0"};
+
+static hulltracecache_t pm_traces;
+
+static trace_t PM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
+{
+	if (!pm_tracecache.value) {
+		return CM_HullTrace(hull, start, end);
+	}
+
+	return CM_HullTraceCached(&pm_traces, hull, start, end, pm_tracecache_verify.value != 0);
+}
+
+static void PM_TraceStats_f (void)
+{
+	unsigned int total = pm_traces.hits + pm_traces.misses;
+
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+		pm_traces.hits = pm_traces.misses = pm_traces.mismatches = 0;
+		return;
+	}
+
+	Con_Printf("movement traces: %u, %u cached (%.1f%%)\n", total, pm_traces.hits, total ? 100.0 * pm_traces.hits / total : 0);
+	if (pm_tracecache_verify.value || pm_traces.mismatches) {
+		Con_Printf("verify mismatches: %u\n", pm_traces.mismatches);
+	}
+}
+
+void PM_Init (void)
+{
+	Cvar_Register(&pm_tracecache);
+	Cvar_Register(&pm_tracecache_verify);
+	Cmd_AddCommand("pm_tracestats", PM_TraceStats_f);
+}
+
 
 static void PM_TraceBounds (vec3_t start, vec3_t end, vec3_t boxmins, vec3_t boxmaxs)
 {
@@ -116,19 +154,32 @@ qbool PM_TestPlayerPosition (vec3_t pos)
 	int       i;
 	physent_t *pe;
 	vec3_t    mins, maxs, offset, test;
+	vec3_t    posmins, posmaxs;
 	hull_t    *hull;
 
+	PM_TraceBounds(pos, pos, posmins, posmaxs);
+
 	for (i = 0; i < pmove.numphysent; i++) {
 		pe = &pmove.physents[i];
 		// get the clipping hull
 		if (pe->model) {
 			hull = &pmove.physents[i].model->hulls[1];
+
+			if (i > 0 && PM_CullTraceBox(posmins, posmaxs, pe->origin, pe->model->mins, pe->model->maxs, hull->clip_mins, hull->clip_maxs)) {
+				continue;
+			}
+
 			VectorSubtract(hull->clip_mins, player_mins, offset);
 			VectorAdd(offset, pe->origin, offset);
 		}
 		else {
 			VectorSubtract(pe->mins, player_maxs, mins);
 			VectorSubtract(pe->maxs, player_mins, maxs);
+
+			if (PM_CullTraceBox(posmins, posmaxs, pe->origin, mins, maxs, vec3_origin, vec3_origin)) {
+				continue;
+			}
+
 			hull = CM_HullForBox(mins, maxs);
 			VectorCopy(pe->origin, offset);
 		}
@@ -196,7 +247,7 @@ trace_t PM_PlayerTrace (vec3_t start, vec3_t end)
 		VectorSubtract(end, offset, end_l);
 
 		// trace a line through the appropriate clipping hull
-		trace = CM_HullTrace(hull, start_l, end_l);
+		trace = PM_HullTrace(hull, start_l, end_l);
 
 		// fix trace up by the offset
 		VectorAdd(trace.endpos, offset, trace.endpos);
@@ -229,6 +280,7 @@ trace_t PM_TraceLine (vec3_t start, vec3_t end)
 	hull_t *hull;
 	physent_t *pe;
 	vec3_t offset, start_l, end_l;
+	vec3_t tracemins, tracemaxs;
 	trace_t trace, total;
 
 	// fill in a default trace
@@ -237,6 +289,8 @@ trace_t PM_TraceLine (vec3_t start, vec3_t end)
 	total.e.entnum = -1;
 	VectorCopy (end, total.endpos);
 
+	PM_TraceBounds(start, end, tracemins, tracemaxs);
+
 	for (i = 0; i < pmove.numphysent; i++) {
 		pe = &pmove.physents[i];
 
@@ -246,6 +300,12 @@ trace_t PM_TraceLine (vec3_t start, vec3_t end)
 		}
 #endif
 
+		if (i > 0 && (pe->model
+				? PM_CullTraceBox(tracemins, tracemaxs, pe->origin, pe->model->mins, pe->model->maxs, vec3_origin, vec3_origin)
+				: PM_CullTraceBox(tracemins, tracemaxs, pe->origin, pe->mins, pe->maxs, vec3_origin, vec3_origin))) {
+			continue;
+		}
+
 		// get the clipping hull
 		hull = (pe->model) ? (&pmove.physents[i].model->hulls[0]) : (CM_HullForBox(pe->mins, pe->maxs));
 
@@ -256,7 +316,7 @@ trace_t PM_TraceLine (vec3_t start, vec3_t end)
 		VectorSubtract(end, offset, end_l);
 
 		// trace a line through the appropriate clipping hull
-		trace = CM_HullTrace(hull, start_l, end_l);
+		trace = PM_HullTrace(hull, start_l, end_l);
 
 		// fix trace up by the offset
 		VectorAdd(trace.endpos, offset, trace.endpos);
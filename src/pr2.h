@@ -24,6 +24,8 @@
 
 
 intptr_t PR2_GameSystemCalls( intptr_t *args );
+const char *PR2_SyscallName( int num );
+const char *PR2_GameExportName( int num );
 extern cvar_t sv_progtype;
 extern vm_t* sv_vm;
 
@@ -69,6 +69,32 @@ struct
 	{"GetExtFieldPtr",	EXT_GetExtFieldPtr},
 };
 ext_syscall_t ext_syscall_tbl[256];
+static char *ext_syscall_names[ARRAY_LEN(ext_syscall_tbl)];
+
+// in gameImport_t order, for the profiler
+static const char *pr2_syscall_names[] =
+{
+	"G_GETAPIVERSION", "G_DPRINT", "G_ERROR", "G_GetEntityToken", "G_SPAWN_ENT",
+	"G_REMOVE_ENT", "G_PRECACHE_SOUND", "G_PRECACHE_MODEL", "G_LIGHTSTYLE",
+	"G_SETORIGIN", "G_SETSIZE", "G_SETMODEL", "G_BPRINT", "G_SPRINT",
+	"G_CENTERPRINT", "G_AMBIENTSOUND", "G_SOUND", "G_TRACELINE", "G_CHECKCLIENT",
+	"G_STUFFCMD", "G_LOCALCMD", "G_CVAR", "G_CVAR_SET", "G_FINDRADIUS",
+	"G_WALKMOVE", "G_DROPTOFLOOR", "G_CHECKBOTTOM", "G_POINTCONTENTS",
+	"G_NEXTENT", "G_AIM", "G_MAKESTATIC", "G_SETSPAWNPARAMS", "G_CHANGELEVEL",
+	"G_LOGFRAG", "G_GETINFOKEY", "G_MULTICAST", "G_DISABLEUPDATES", "G_WRITEBYTE",
+	"G_WRITECHAR", "G_WRITESHORT", "G_WRITELONG", "G_WRITEANGLE", "G_WRITECOORD",
+	"G_WRITESTRING", "G_WRITEENTITY", "G_FLUSHSIGNON", "g_memset", "g_memcpy",
+	"g_strncpy", "g_sin", "g_cos", "g_atan2", "g_sqrt", "g_floor", "g_ceil",
+	"g_acos", "G_CMD_ARGC", "G_CMD_ARGV", "G_TraceCapsule", "G_FSOpenFile",
+	"G_FSCloseFile", "G_FSReadFile", "G_FSWriteFile", "G_FSSeekFile",
+	"G_FSTellFile", "G_FSGetFileList", "G_CVAR_SET_FLOAT", "G_CVAR_STRING",
+	"G_Map_Extension", "G_strcmp", "G_strncmp", "G_stricmp", "G_strnicmp",
+	"G_Find", "G_executecmd", "G_conprint", "G_readcmd", "G_redirectcmd",
+	"G_Add_Bot", "G_Remove_Bot", "G_SetBotUserInfo", "G_SetBotCMD",
+	"G_QVMstrftime", "G_CMD_ARGS", "G_CMD_TOKENIZE", "g_strlcpy", "g_strlcat",
+	"G_MAKEVECTORS", "G_NEXTCLIENT", "G_PRECACHE_VWEP_MODEL", "G_SETPAUSE",
+	"G_SETUSERINFO", "G_MOVETOGOAL", "G_VISIBLETO",
+};
 
 int NUM_FOR_GAME_EDICT(byte *e)
 {
@@ -2095,6 +2121,7 @@ intptr_t PF2_Map_Extension(char *name, int mapto)
 		if (!strcmp(ext_syscalls[i].extname, name))
 		{
 			ext_syscall_tbl[mapto - G_EXTENSIONS_FIRST] = ext_syscalls[i].fun;
+			ext_syscall_names[mapto - G_EXTENSIONS_FIRST] = ext_syscalls[i].extname;
 			return mapto;
 		}
 	}
@@ -2516,7 +2543,7 @@ void PF2_VisibleTo(int viewer, int first, int len, byte *visible)
 
 #define VMV(x) _vmf(args[x]), _vmf(args[(x) + 1]), _vmf(args[(x) + 2])
 #define VME(x) EDICT_NUM(args[x])
-intptr_t PR2_GameSystemCalls(intptr_t *args) {
+static intptr_t PR2_SystemCall(intptr_t *args) {
 	switch (args[0]) {
 	case G_GETAPIVERSION:
 		return GAME_API_VERSION;
@@ -2819,6 +2846,28 @@ intptr_t PR2_GameSystemCalls(intptr_t *args) {
 	return 0;
 }
 
+intptr_t PR2_GameSystemCalls(intptr_t *args)
+{
+	intptr_t ret;
+
+	if (!pr_prof_active)
+		return PR2_SystemCall(args);
+
+	PR_ProfEnter(PROF_SYSCALL, args[0], NULL);
+	ret = PR2_SystemCall(args);
+	PR_ProfLeave();
+	return ret;
+}
+
+const char *PR2_SyscallName(int num)
+{
+	if (num >= 0 && num < ARRAY_LEN(pr2_syscall_names))
+		return pr2_syscall_names[num];
+	if (num >= G_EXTENSIONS_FIRST && num < G_EXTENSIONS_FIRST + ARRAY_LEN(ext_syscall_names) && ext_syscall_names[num - G_EXTENSIONS_FIRST])
+		return ext_syscall_names[num - G_EXTENSIONS_FIRST];
+	return NULL;
+}
+
 #endif /* USE_PR2 */
 
 #endif // !CLIENTONLY
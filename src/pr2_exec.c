@@ -35,11 +35,24 @@ cvar_t sv_progtype = { "sv_progtype","0" };
 // 0 = standard, 1 = pr2 mods set string_t fields as byte offsets to location of actual strings
 cvar_t sv_pr2references = {"sv_pr2references", "0"};
 
+// in gameExport_t order, for the profiler
+static const char *pr2_export_names[] =
+{
+	"GAME_INIT", "GAME_LOADENTS", "GAME_SHUTDOWN", "GAME_CLIENT_CONNECT",
+	"GAME_PUT_CLIENT_IN_SERVER", "GAME_CLIENT_USERINFO_CHANGED",
+	"GAME_CLIENT_DISCONNECT", "GAME_CLIENT_COMMAND", "GAME_CLIENT_PRETHINK",
+	"GAME_CLIENT_THINK", "GAME_CLIENT_POSTTHINK", "GAME_START_FRAME",
+	"GAME_SETCHANGEPARMS", "GAME_SETNEWPARMS", "GAME_CONSOLE_COMMAND",
+	"GAME_EDICT_TOUCH", "GAME_EDICT_THINK", "GAME_EDICT_BLOCKED", "GAME_CLIENT_SAY",
+	"GAME_PAUSED_TIC", "GAME_CLEAR_EDICT",
+};
+
 void ED2_PrintEdicts (void);
 void PR2_Profile_f (void);
 void ED2_PrintEdict_f (void);
 void ED_Count (void);
 void VM_VmInfo_f( void );
+void VM_Conformance_f( void );
 
 void PR2_Init(void)
 {
@@ -49,6 +62,8 @@ void PR2_Init(void)
 	Cvar_Register(&sv_progsname);
 	Cvar_Register(&sv_pr2references);
 	Cvar_Register(&vm_rtChecks);
+	Cvar_Register(&pr_threaded);
+	Cvar_Register(&pr_profile);
 #ifdef WITH_NQPROGS
 	Cvar_Register(&sv_forcenqprogs);
 #endif
@@ -71,9 +86,18 @@ void PR2_Init(void)
 	Cmd_AddCommand ("mod", PR2_GameConsoleCommand);
 
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f);
+	Cmd_AddCommand ("vm_conformance", VM_Conformance_f);
+	PR_ProfInit();
 	memset(pr_newstrtbl, 0, sizeof(pr_newstrtbl));
 }
 
+const char *PR2_GameExportName(int num)
+{
+	if (num >= 0 && num < ARRAY_LEN(pr2_export_names))
+		return pr2_export_names[num];
+	return NULL;
+}
+
 void PR2_Profile_f(void)
 {
 	if(!sv_vm)
@@ -428,7 +452,7 @@ void PR2_LoadProgs(void)
 
 	if ( sv_vm )
 	{
-		; // nothing.
+		PR_ProfProgsChanged();
 	}
 	else
 	{
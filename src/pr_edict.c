@@ -1216,6 +1216,8 @@ void PR1_LoadProgs (void)
 		pr_statements[i].b = LittleShort(pr_statements[i].b);
 		pr_statements[i].c = LittleShort(pr_statements[i].c);
 	}
+	PR_ThreadedReset ();
+	PR_ProfProgsChanged ();
 
 	for (i = 0; i < progs->numfunctions; i++)
 	{
@@ -1263,6 +1265,8 @@ PR1_Init
 void PR1_Init (void)
 {
 	Cvar_Register(&sv_progsname);
+	Cvar_Register(&pr_threaded);
+	Cvar_Register(&pr_profile);
 #ifdef WITH_NQPROGS
 	Cvar_Register(&sv_forcenqprogs);
 #endif
@@ -1271,6 +1275,7 @@ void PR1_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	PR_ProfInit ();
 
 	memset(pr_newstrtbl, 0, sizeof(pr_newstrtbl));
 }
@@ -319,6 +319,8 @@ int PR_EnterFunction (dfunction_t *f)
 	}
 
 	pr_xfunction = f;
+	if (pr_prof_active)
+		PR_ProfEnter (PROF_QC, f - pr_functions, PR1_GetString (f->s_name));
 	return f->first_statement - 1; // offset the s++
 }
 
@@ -334,6 +336,9 @@ int PR_LeaveFunction (void)
 	if (pr_depth <= 0)
 		SV_Error ("prog stack underflow");
 
+	if (pr_prof_active)
+		PR_ProfLeave ();
+
 	// restore locals from the stack
 	c = pr_xfunction->locals;
 	localstack_used -= c;
@@ -377,6 +382,12 @@ void PR_ExecuteProgram (func_t fnum)
 
 	f = &pr_functions[fnum];
 
+	if (pr_threaded.value)
+	{
+		PR_ExecuteThreaded (f);
+		return;
+	}
+
 	runaway = 100000;
 	pr_trace = false;
 
@@ -632,7 +643,16 @@ void PR_ExecuteProgram (func_t fnum)
 				i = -newf->first_statement;
 				if (i >= pr_numbuiltins)
 					PR_RunError ("Bad builtin call number");
-				pr_builtins[i] ();
+				if (pr_prof_active)
+				{
+					PR_ProfEnter (PROF_BUILTIN, a->function, PR1_GetString (newf->s_name));
+					pr_builtins[i] ();
+					PR_ProfLeave ();
+				}
+				else
+				{
+					pr_builtins[i] ();
+				}
 				break;
 			}
 
@@ -872,6 +892,8 @@ void PR1_UnLoadProgs(void)
 #endif
 		progs = NULL;
 	}
+
+	PR_ThreadedReset ();
 }
 
 #endif // !CLIENTONLY
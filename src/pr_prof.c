@@ -0,0 +1,461 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// pr_prof.c - wall time profiler for the game code
+//
+// Between prof_start and prof_stop every QuakeC function and builtin, every
+// vmMain call and game system call, and every QVM function run by the
+// interpreter is timed. Time is gathered into a call tree, so each distinct
+// call stack gets its own node, and every call is also kept as a trace event
+// until the event buffer fills up.
+//
+// The call tree is written as collapsed stacks for flamegraph.pl and similar
+// tools, the events as a Chrome trace for chrome://tracing or Perfetto.
+
+#ifndef CLIENTONLY
+#include "qwsvdef.h"
+#ifdef USE_PR2
+#include "vm_local.h"
+#endif
+
+#define PROF_MAX_DEPTH		256
+#define PROF_MAX_EVENTS		(256 * 1024)
+#define PROF_NAME_HASH		1024
+
+// names are kept once each, so the flat report can sum them up by pointer
+typedef struct profname_s
+{
+	struct profname_s	*next;
+	profkind_t			kind;
+	double				self, total;	// flat report scratch
+	int					calls;
+	char				name[1];		// variable sized
+} profname_t;
+
+// node 0 is the root, so 0 also means no child or no sibling
+typedef struct
+{
+	profkind_t	kind;
+	int			generation;
+	intptr_t	id;
+	profname_t	*name;
+	int			parent, child, sibling;
+	int			calls;
+	double		total, self;
+} profnode_t;
+
+typedef struct
+{
+	int		node;
+	double	start, duration;
+} profevent_t;
+
+typedef struct
+{
+	int		node;
+	double	start, children;
+} profframe_t;
+
+qbool			pr_prof_active;
+
+static profname_t	*prof_names[PROF_NAME_HASH];
+static profnode_t	*prof_nodes;
+static int			prof_numnodes, prof_maxnodes;
+static profevent_t	*prof_events;
+static int			prof_numevents, prof_droppedevents;
+static profframe_t	prof_stack[PROF_MAX_DEPTH];
+static int			prof_depth;
+static int			prof_generation;
+static double		prof_starttime, prof_stoptime;
+
+static const char *prof_categories[PROF_NUMKINDS] = { "qc", "builtin", "vmmain", "qvm", "syscall" };
+
+static profname_t *PR_ProfName (profkind_t kind, const char *name)
+{
+	unsigned int h = Com_HashKey (name) % PROF_NAME_HASH;
+	profname_t *n;
+
+	for (n = prof_names[h]; n; n = n->next)
+		if (n->kind == kind && !strcmp (n->name, name))
+			return n;
+
+	n = (profname_t *) Q_malloc (sizeof(*n) + strlen (name));
+	strcpy (n->name, name);
+	n->kind = kind;
+	n->next = prof_names[h];
+	prof_names[h] = n;
+	return n;
+}
+
+static const char *PR_ProfDefaultName (profkind_t kind, intptr_t id)
+{
+#ifdef USE_PR2
+	const char *name = NULL;
+
+	if (kind == PROF_VMMAIN)
+		name = PR2_GameExportName ((int) id);
+	else if (kind == PROF_SYSCALL)
+		name = PR2_SyscallName ((int) id);
+	else if (kind == PROF_QVM && currentVM && currentVM->numSymbols)
+		name = VM_ValueToSymbol (currentVM, (int) id);
+	if (name)
+		return name;
+#endif
+	return va ("%s%ld", kind == PROF_QVM ? "qvm@" : "#", (long) id);
+}
+
+static int PR_ProfNewNode (int parent, profkind_t kind, intptr_t id, const char *name)
+{
+	profnode_t *n;
+
+	if (prof_numnodes == prof_maxnodes)
+	{
+		prof_maxnodes = prof_maxnodes ? prof_maxnodes * 2 : 4096;
+		prof_nodes = (profnode_t *) Q_realloc (prof_nodes, prof_maxnodes * sizeof(*prof_nodes));
+	}
+
+	n = &prof_nodes[prof_numnodes];
+	memset (n, 0, sizeof(*n));
+	n->kind = kind;
+	n->generation = prof_generation;
+	n->id = id;
+	n->name = PR_ProfName (kind, name ? name : PR_ProfDefaultName (kind, id));
+	n->parent = parent;
+	n->sibling = prof_nodes[parent].child;
+	prof_nodes[parent].child = prof_numnodes;
+
+	return prof_numnodes++;
+}
+
+void PR_ProfEnter (profkind_t kind, intptr_t id, const char *name)
+{
+	profframe_t *frame;
+	int parent, n;
+
+	if (prof_depth >= PROF_MAX_DEPTH)
+	{
+		prof_depth++;	// not recorded, but PR_ProfLeave must still match up
+		return;
+	}
+
+	parent = prof_depth ? prof_stack[prof_depth - 1].node : 0;
+	for (n = prof_nodes[parent].child; n; n = prof_nodes[n].sibling)
+	{
+		if (prof_nodes[n].id == id && prof_nodes[n].kind == kind && prof_nodes[n].generation == prof_generation)
+			break;
+	}
+	if (!n)
+		n = PR_ProfNewNode (parent, kind, id, name);
+
+	frame = &prof_stack[prof_depth++];
+	frame->node = n;
+	frame->children = 0;
+	frame->start = Sys_DoubleTime ();
+}
+
+void PR_ProfLeave (void)
+{
+	profframe_t *frame;
+	profnode_t *node;
+	double duration;
+
+	if (!prof_depth)
+		return;	// the profiler was started from inside this call
+	if (--prof_depth >= PROF_MAX_DEPTH)
+		return;
+
+	frame = &prof_stack[prof_depth];
+	duration = Sys_DoubleTime () - frame->start;
+
+	node = &prof_nodes[frame->node];
+	node->calls++;
+	node->total += duration;
+	node->self += duration - frame->children;
+	if (prof_depth)
+		prof_stack[prof_depth - 1].children += duration;
+
+	if (prof_numevents < PROF_MAX_EVENTS)
+	{
+		prof_events[prof_numevents].node = frame->node;
+		prof_events[prof_numevents].start = frame->start;
+		prof_events[prof_numevents].duration = duration;
+		prof_numevents++;
+	}
+	else
+	{
+		prof_droppedevents++;
+	}
+}
+
+// Forgets the calls still open, called where no game code can be running, so
+// after an error has longjmp'ed out of it.
+void PR_ProfUnwind (void)
+{
+	prof_depth = 0;
+}
+
+// Function and instruction numbers mean something else in new progs, so nodes
+// made so far stop matching. They are still reported.
+void PR_ProfProgsChanged (void)
+{
+	prof_generation++;
+	prof_depth = 0;
+}
+
+static void PR_ProfClear (void)
+{
+	profname_t *n, *next;
+	int i;
+
+	for (i = 0; i < PROF_NAME_HASH; i++)
+	{
+		for (n = prof_names[i]; n; n = next)
+		{
+			next = n->next;
+			Q_free (n);
+		}
+		prof_names[i] = NULL;
+	}
+
+	Q_free (prof_nodes);
+	Q_free (prof_events);
+	prof_numnodes = prof_maxnodes = 0;
+	prof_numevents = prof_droppedevents = 0;
+	prof_depth = 0;
+	prof_starttime = prof_stoptime = 0;
+}
+
+static double PR_ProfElapsed (void)
+{
+	return (pr_prof_active ? Sys_DoubleTime () : prof_stoptime) - prof_starttime;
+}
+
+static void PR_ProfStart_f (void)
+{
+	PR_ProfClear ();
+
+	prof_events = (profevent_t *) Q_malloc (PROF_MAX_EVENTS * sizeof(*prof_events));
+	PR_ProfNewNode (0, PROF_QC, 0, "");	// the root, its own parent
+	prof_nodes[0].child = 0;
+
+	prof_starttime = Sys_DoubleTime ();
+	pr_prof_active = true;
+	Con_Printf ("Game code profiling started.\n");
+}
+
+static void PR_ProfStop_f (void)
+{
+	if (!pr_prof_active)
+	{
+		Con_Printf ("Game code profiling is not running.\n");
+		return;
+	}
+
+	pr_prof_active = false;
+	prof_stoptime = Sys_DoubleTime ();
+	Con_Printf ("Game code profiling stopped after %.1f seconds.\n", PR_ProfElapsed ());
+}
+
+static qbool PR_ProfHaveData (void)
+{
+	if (prof_numnodes > 1)
+		return true;
+
+	Con_Printf ("No profile recorded, use prof_start and prof_stop first.\n");
+	return false;
+}
+
+static int PR_ProfSortSelf (const void *a, const void *b)
+{
+	double sa = (*(profname_t **) a)->self, sb = (*(profname_t **) b)->self;
+
+	return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+// true if a caller of the node has the same name, its time is counted there
+static qbool PR_ProfRecursive (int node)
+{
+	int n;
+
+	for (n = prof_nodes[node].parent; n; n = prof_nodes[n].parent)
+		if (prof_nodes[n].name == prof_nodes[node].name)
+			return true;
+
+	return false;
+}
+
+static void PR_ProfReport_f (void)
+{
+	profname_t **sorted, *name;
+	double elapsed, gametime;
+	int i, count, numnames, shown;
+
+	if (!PR_ProfHaveData ())
+		return;
+
+	count = Cmd_Argc () > 1 ? Q_atoi (Cmd_Argv (1)) : 20;
+
+	for (i = 0; i < PROF_NAME_HASH; i++)
+		for (name = prof_names[i]; name; name = name->next)
+			name->self = name->total = name->calls = 0;
+
+	gametime = 0;
+	for (i = 1; i < prof_numnodes; i++)
+	{
+		name = prof_nodes[i].name;
+		name->self += prof_nodes[i].self;
+		name->calls += prof_nodes[i].calls;
+		if (!PR_ProfRecursive (i))
+			name->total += prof_nodes[i].total;
+		if (!prof_nodes[i].parent)
+			gametime += prof_nodes[i].total;
+	}
+
+	numnames = 0;
+	for (i = 0; i < PROF_NAME_HASH; i++)
+		for (name = prof_names[i]; name; name = name->next)
+			numnames++;
+
+	sorted = (profname_t **) Q_malloc (numnames * sizeof(*sorted));
+	numnames = 0;
+	for (i = 0; i < PROF_NAME_HASH; i++)
+		for (name = prof_names[i]; name; name = name->next)
+			if (name->calls)
+				sorted[numnames++] = name;
+	qsort (sorted, numnames, sizeof(*sorted), PR_ProfSortSelf);
+
+	elapsed = PR_ProfElapsed ();
+	Con_Printf ("%.1f s profiled, %.1f ms (%.1f%%) in game code\n", elapsed, gametime * 1000,
+		elapsed > 0 ? 100 * gametime / elapsed : 0);
+	Con_Printf ("  self ms  total ms     calls  name\n");
+	for (shown = 0; shown < numnames && shown < count; shown++)
+	{
+		name = sorted[shown];
+		Con_Printf ("%9.2f %9.2f %9i  %s%s\n", name->self * 1000, name->total * 1000, name->calls,
+			name->name, name->kind == PROF_BUILTIN || name->kind == PROF_SYSCALL ? " (engine)" : "");
+	}
+
+	Q_free (sorted);
+}
+
+static FILE *PR_ProfOpen (const char *defaultname, char *path, int pathsize)
+{
+	const char *name = Cmd_Argc () > 1 ? Cmd_Argv (1) : defaultname;
+	FILE *f;
+
+	if (FS_UnsafeFilename (name))
+	{
+		Con_Printf ("Invalid file name %s\n", name);
+		return NULL;
+	}
+
+	snprintf (path, pathsize, "%s/%s", fs_gamedir, name);
+	if (!(f = fopen (path, "wb")))
+		Con_Printf ("Couldn't open %s\n", path);
+
+	return f;
+}
+
+// Writes the call stack of every node with its own time in microseconds, one
+// line each: "StartFrame;CheckRules;find 1234".
+static void PR_ProfFlamegraph_f (void)
+{
+	char path[MAX_OSPATH];
+	int stack[PROF_MAX_DEPTH];
+	int i, j, depth, n, lines = 0;
+	FILE *f;
+
+	if (!PR_ProfHaveData ())
+		return;
+	if (!(f = PR_ProfOpen ("prof.folded", path, sizeof(path))))
+		return;
+
+	for (i = 1; i < prof_numnodes; i++)
+	{
+		if (prof_nodes[i].self * 1000000 < 1)
+			continue;
+
+		depth = 0;
+		for (n = i; n && depth < PROF_MAX_DEPTH; n = prof_nodes[n].parent)
+			stack[depth++] = n;
+
+		for (j = depth - 1; j >= 0; j--)
+			fprintf (f, "%s%s", prof_nodes[stack[j]].name->name, j ? ";" : "");
+		fprintf (f, " %.0f\n", prof_nodes[i].self * 1000000);
+		lines++;
+	}
+
+	fclose (f);
+	Con_Printf ("Wrote %i stacks to %s\n", lines, path);
+}
+
+static void PR_ProfJSONString (FILE *f, const char *s)
+{
+	fputc ('"', f);
+	for ( ; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			fprintf (f, "\\%c", *s);
+		else if ((unsigned char) *s < ' ')
+			fprintf (f, "\\u%04x", (unsigned char) *s);
+		else
+			fputc (*s, f);
+	}
+	fputc ('"', f);
+}
+
+// Chrome trace event format, every call a complete ("X") event in microseconds.
+static void PR_ProfTrace_f (void)
+{
+	char path[MAX_OSPATH];
+	profnode_t *node;
+	int i;
+	FILE *f;
+
+	if (!PR_ProfHaveData ())
+		return;
+	if (!(f = PR_ProfOpen ("prof.json", path, sizeof(path))))
+		return;
+
+	fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (i = 0; i < prof_numevents; i++)
+	{
+		node = &prof_nodes[prof_events[i].node];
+		fprintf (f, "{\"name\":");
+		PR_ProfJSONString (f, node->name->name);
+		fprintf (f, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+			prof_categories[node->kind], (prof_events[i].start - prof_starttime) * 1000000,
+			prof_events[i].duration * 1000000, i < prof_numevents - 1 ? "," : "");
+	}
+	fprintf (f, "]}\n");
+
+	fclose (f);
+	Con_Printf ("Wrote %i events to %s\n", prof_numevents, path);
+	if (prof_droppedevents)
+		Con_Printf ("%i later calls did not fit in the trace\n", prof_droppedevents);
+}
+
+void PR_ProfInit (void)
+{
+	Cmd_AddCommand ("prof_start", PR_ProfStart_f);
+	Cmd_AddCommand ("prof_stop", PR_ProfStop_f);
+	Cmd_AddCommand ("prof_report", PR_ProfReport_f);
+	Cmd_AddCommand ("prof_flamegraph", PR_ProfFlamegraph_f);
+	Cmd_AddCommand ("prof_trace", PR_ProfTrace_f);
+}
+
+#endif // !CLIENTONLY
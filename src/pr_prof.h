@@ -0,0 +1,40 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef __PR_PROF_H__
+#define __PR_PROF_H__
+
+// what a profiler frame stands for, also the category in a chrome trace
+typedef enum
+{
+	PROF_QC,		// QuakeC function, id is the function number
+	PROF_BUILTIN,	// QuakeC builtin, id is the number of the function calling it
+	PROF_VMMAIN,	// vmMain of a QVM or native game, id is the command
+	PROF_QVM,		// QVM function, only seen by the interpreter, id is the instruction
+	PROF_SYSCALL,	// game system call, id is the call number
+	PROF_NUMKINDS
+} profkind_t;
+
+extern qbool pr_prof_active;
+
+void PR_ProfInit (void);
+void PR_ProfEnter (profkind_t kind, intptr_t id, const char *name);
+void PR_ProfLeave (void);
+void PR_ProfUnwind (void);
+void PR_ProfProgsChanged (void);
+
+#endif /* !__PR_PROF_H__ */
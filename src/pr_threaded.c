@@ -0,0 +1,614 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// pr_threaded.c -- pre-decoded QuakeC interpreter, used when pr_threaded is set
+//
+// The statements are decoded once per progs load: the global pointers are
+// resolved, branch offsets become pointers and a few common pairs of statements
+// are fused into one instruction. With gcc and clang instructions are dispatched
+// with computed goto, elsewhere with a switch.
+//
+// Counting for the profile command and pr_trace go through a second dispatch
+// table which does the bookkeeping and then runs the statement unfused, so the
+// fast path does neither. The runaway counter is charged a whole straight run of
+// statements at a time, whenever control is transferred.
+
+#ifndef CLIENTONLY
+#include "qwsvdef.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PR_COMPUTED_GOTO
+#endif
+
+cvar_t	pr_threaded = {"pr_threaded", "1"};
+cvar_t	pr_profile = {"pr_profile", "0"};
+
+// fused instructions, numbered after the opcodes
+enum {
+	PRT_ADDRESS_STOREP = OP_BITOR + 1,	// ADDRESS into a temp, then STOREP_F/S/ENT/FLD/FNC through it
+	PRT_ADDRESS_STOREP_V,				// ADDRESS into a temp, then STOREP_V through it
+	PRT_IF_GOTO,						// IF a, 2; GOTO
+	PRT_IFNOT_GOTO,						// IFNOT a, 2; GOTO
+	PRT_STORE_CALL,						// STORE_F/S/ENT/FLD/FNC, then CALLn
+	PRT_STORE_V_CALL,					// STORE_V, then CALLn
+	PRT_BAD,							// unknown opcode or branch out of the statements
+	PRT_NUMOPS
+};
+
+typedef struct prinstr_s
+{
+	unsigned short	op;			// opcode or fused instruction
+	unsigned short	baseop;		// the statement's own opcode, or PRT_BAD
+	int				runlen;		// statements up to and including the next transfer of control
+	eval_t			*a, *b, *c;
+	struct prinstr_s *target;	// where IF, IFNOT and GOTO go
+} prinstr_t;
+
+static prinstr_t	*pr_code;
+
+static qbool PR_IsTransfer (int op)
+{
+	return op == OP_IF || op == OP_IFNOT || op == OP_GOTO || op == OP_RETURN || op == OP_DONE
+		|| (op >= OP_CALL0 && op <= OP_CALL8);
+}
+
+static qbool PR_IsStoreInt (int op)
+{
+	return op == OP_STORE_F || op == OP_STORE_S || op == OP_STORE_ENT || op == OP_STORE_FLD || op == OP_STORE_FNC;
+}
+
+static qbool PR_IsStorePInt (int op)
+{
+	return op == OP_STOREP_F || op == OP_STOREP_S || op == OP_STOREP_ENT || op == OP_STOREP_FLD || op == OP_STOREP_FNC;
+}
+
+/*
+====================
+PR_DecodeStatements
+====================
+*/
+static void PR_DecodeStatements (void)
+{
+	int i, target, n = progs->numstatements;
+	dstatement_t *st, *next;
+	prinstr_t *in;
+
+	pr_code = (prinstr_t *) Q_malloc (max(n, 1) * sizeof(*pr_code));
+
+	for (i = n - 1; i >= 0; i--)
+	{
+		st = &pr_statements[i];
+		in = &pr_code[i];
+
+		in->op = in->baseop = (st->op <= OP_BITOR ? st->op : PRT_BAD);
+		in->a = (eval_t *)&pr_globals[st->a];
+		in->b = (eval_t *)&pr_globals[st->b];
+		in->c = (eval_t *)&pr_globals[st->c];
+		in->runlen = (PR_IsTransfer(st->op) || i == n - 1) ? 1 : pr_code[i + 1].runlen + 1;
+
+		if (st->op == OP_IF || st->op == OP_IFNOT || st->op == OP_GOTO)
+		{
+			target = i + (st->op == OP_GOTO ? st->a : st->b);
+			if (target < 0 || target >= n)
+				in->op = in->baseop = PRT_BAD;
+			else
+				in->target = &pr_code[target];
+		}
+	}
+
+	for (i = 0; i < n - 1; i++)
+	{
+		st = &pr_statements[i];
+		next = st + 1;
+		in = &pr_code[i];
+
+		if (st->op == OP_ADDRESS && next->b == st->c && PR_IsStorePInt(next->op))
+			in->op = PRT_ADDRESS_STOREP;
+		else if (st->op == OP_ADDRESS && next->b == st->c && next->op == OP_STOREP_V)
+			in->op = PRT_ADDRESS_STOREP_V;
+		else if ((st->op == OP_IF || st->op == OP_IFNOT) && st->b == 2 && in->baseop != PRT_BAD
+			&& i + 1 < n && in[1].baseop == OP_GOTO)
+			// an IF whose skip lands past the last statement stays PRT_BAD
+			in->op = (st->op == OP_IF ? PRT_IF_GOTO : PRT_IFNOT_GOTO);
+		else if (PR_IsStoreInt(st->op) && next->op >= OP_CALL0 && next->op <= OP_CALL8)
+			in->op = PRT_STORE_CALL;
+		else if (st->op == OP_STORE_V && next->op >= OP_CALL0 && next->op <= OP_CALL8)
+			in->op = PRT_STORE_V_CALL;
+	}
+}
+
+/*
+====================
+PR_ThreadedReset
+
+The statements are decoded again on the next call
+====================
+*/
+void PR_ThreadedReset (void)
+{
+	Q_free (pr_code);
+}
+
+#define A	(ip->a)
+#define B	(ip->b)
+#define C	(ip->c)
+
+// charge the run of statements starting at ip
+#define CHARGE() \
+	if ((runaway -= ip->runlen) <= 0) \
+	{ \
+		pr_xstatement = ip - pr_code; \
+		PR_RunError ("runaway loop error"); \
+	}
+
+#define INSTRUMENT() \
+	pr_xstatement = ip - pr_code; \
+	pr_xfunction->profile++; \
+	if (pr_trace) \
+		PR_PrintStatement (pr_statements + pr_xstatement);
+
+#ifdef PR_COMPUTED_GOTO
+#define OPCODE(x)	L_##x:
+#define NEXT()		goto *table[ip->op]
+#define SELECT()	table = ((pr_trace || pr_profile.value) ? instrumented : fast)
+#define SET(x)		fast[x] = &&L_##x
+#else
+#define OPCODE(x)	case x:
+#define NEXT()		goto dispatch
+#define SELECT()	instrumented = (pr_trace || pr_profile.value)
+#endif
+
+/*
+====================
+PR_ExecuteThreaded
+
+Runs f like PR_ExecuteProgram
+====================
+*/
+void PR_ExecuteThreaded (dfunction_t *f)
+{
+	prinstr_t *ip, *callip;
+	dfunction_t *newf;
+	edict_t *ed;
+	eval_t *ptr;
+	int runaway, exitdepth, i, s;
+#ifdef PR_COMPUTED_GOTO
+	static const void *fast[PRT_NUMOPS], *instrumented[PRT_NUMOPS];
+	const void **table;
+
+	if (!fast[0])
+	{
+		for (i = 0; i < PRT_NUMOPS; i++)
+		{
+			fast[i] = &&L_PRT_BAD;
+			instrumented[i] = &&L_instrumented;
+		}
+
+		SET(OP_DONE); SET(OP_RETURN);
+		SET(OP_MUL_F); SET(OP_MUL_V); SET(OP_MUL_FV); SET(OP_MUL_VF); SET(OP_DIV_F);
+		SET(OP_ADD_F); SET(OP_ADD_V); SET(OP_SUB_F); SET(OP_SUB_V);
+		SET(OP_EQ_F); SET(OP_EQ_V); SET(OP_EQ_S); SET(OP_EQ_E); SET(OP_EQ_FNC);
+		SET(OP_NE_F); SET(OP_NE_V); SET(OP_NE_S); SET(OP_NE_E); SET(OP_NE_FNC);
+		SET(OP_LE); SET(OP_GE); SET(OP_LT); SET(OP_GT);
+		SET(OP_LOAD_F); SET(OP_LOAD_V); SET(OP_LOAD_S); SET(OP_LOAD_ENT); SET(OP_LOAD_FLD); SET(OP_LOAD_FNC);
+		SET(OP_ADDRESS);
+		SET(OP_STORE_F); SET(OP_STORE_V); SET(OP_STORE_S); SET(OP_STORE_ENT); SET(OP_STORE_FLD); SET(OP_STORE_FNC);
+		SET(OP_STOREP_F); SET(OP_STOREP_V); SET(OP_STOREP_S); SET(OP_STOREP_ENT); SET(OP_STOREP_FLD); SET(OP_STOREP_FNC);
+		SET(OP_NOT_F); SET(OP_NOT_V); SET(OP_NOT_S); SET(OP_NOT_ENT); SET(OP_NOT_FNC);
+		SET(OP_IF); SET(OP_IFNOT); SET(OP_GOTO);
+		SET(OP_CALL0); SET(OP_CALL1); SET(OP_CALL2); SET(OP_CALL3); SET(OP_CALL4);
+		SET(OP_CALL5); SET(OP_CALL6); SET(OP_CALL7); SET(OP_CALL8);
+		SET(OP_STATE); SET(OP_AND); SET(OP_OR); SET(OP_BITAND); SET(OP_BITOR);
+		SET(PRT_ADDRESS_STOREP); SET(PRT_ADDRESS_STOREP_V); SET(PRT_IF_GOTO); SET(PRT_IFNOT_GOTO);
+		SET(PRT_STORE_CALL); SET(PRT_STORE_V_CALL);
+	}
+#else
+	qbool instrumented;
+#endif
+
+	if (!pr_code)
+		PR_DecodeStatements ();
+
+	runaway = 100000;
+	pr_trace = false;
+	SELECT();
+
+	// make a stack frame
+	exitdepth = pr_depth;
+
+	ip = pr_code + PR_EnterFunction (f) + 1;
+	CHARGE();
+
+#ifdef PR_COMPUTED_GOTO
+	NEXT();
+
+L_instrumented:
+	INSTRUMENT();
+	goto *fast[ip->baseop];
+#else
+dispatch:
+	if (instrumented)
+	{
+		INSTRUMENT();
+	}
+
+	switch (instrumented ? ip->baseop : ip->op)
+	{
+#endif
+
+	OPCODE(OP_ADD_F)
+		C->_float = A->_float + B->_float;
+		ip++; NEXT();
+	OPCODE(OP_ADD_V)
+		C->vector[0] = A->vector[0] + B->vector[0];
+		C->vector[1] = A->vector[1] + B->vector[1];
+		C->vector[2] = A->vector[2] + B->vector[2];
+		ip++; NEXT();
+
+	OPCODE(OP_SUB_F)
+		C->_float = A->_float - B->_float;
+		ip++; NEXT();
+	OPCODE(OP_SUB_V)
+		C->vector[0] = A->vector[0] - B->vector[0];
+		C->vector[1] = A->vector[1] - B->vector[1];
+		C->vector[2] = A->vector[2] - B->vector[2];
+		ip++; NEXT();
+
+	OPCODE(OP_MUL_F)
+		C->_float = A->_float * B->_float;
+		ip++; NEXT();
+	OPCODE(OP_MUL_V)
+		C->_float = A->vector[0]*B->vector[0]
+		            + A->vector[1]*B->vector[1]
+		            + A->vector[2]*B->vector[2];
+		ip++; NEXT();
+	OPCODE(OP_MUL_FV)
+		C->vector[0] = A->_float * B->vector[0];
+		C->vector[1] = A->_float * B->vector[1];
+		C->vector[2] = A->_float * B->vector[2];
+		ip++; NEXT();
+	OPCODE(OP_MUL_VF)
+		C->vector[0] = B->_float * A->vector[0];
+		C->vector[1] = B->_float * A->vector[1];
+		C->vector[2] = B->_float * A->vector[2];
+		ip++; NEXT();
+
+	OPCODE(OP_DIV_F)
+		C->_float = A->_float / B->_float;
+		ip++; NEXT();
+
+	OPCODE(OP_BITAND)
+		C->_float = (int)A->_float & (int)B->_float;
+		ip++; NEXT();
+	OPCODE(OP_BITOR)
+		C->_float = (int)A->_float | (int)B->_float;
+		ip++; NEXT();
+
+	OPCODE(OP_GE)
+		C->_float = A->_float >= B->_float;
+		ip++; NEXT();
+	OPCODE(OP_LE)
+		C->_float = A->_float <= B->_float;
+		ip++; NEXT();
+	OPCODE(OP_GT)
+		C->_float = A->_float > B->_float;
+		ip++; NEXT();
+	OPCODE(OP_LT)
+		C->_float = A->_float < B->_float;
+		ip++; NEXT();
+	OPCODE(OP_AND)
+		C->_float = A->_float && B->_float;
+		ip++; NEXT();
+	OPCODE(OP_OR)
+		C->_float = A->_float || B->_float;
+		ip++; NEXT();
+
+	OPCODE(OP_NOT_F)
+		C->_float = !A->_float;
+		ip++; NEXT();
+	OPCODE(OP_NOT_V)
+		C->_float = !A->vector[0] && !A->vector[1] && !A->vector[2];
+		ip++; NEXT();
+	OPCODE(OP_NOT_S)
+		C->_float = !A->string || !*PR1_GetString(A->string);
+		ip++; NEXT();
+	OPCODE(OP_NOT_FNC)
+		C->_float = !A->function;
+		ip++; NEXT();
+	OPCODE(OP_NOT_ENT)
+		C->_float = (PROG_TO_EDICT(A->edict) == sv.edicts);
+		ip++; NEXT();
+
+	OPCODE(OP_EQ_F)
+		C->_float = A->_float == B->_float;
+		ip++; NEXT();
+	OPCODE(OP_EQ_V)
+		C->_float = (A->vector[0] == B->vector[0]) &&
+		            (A->vector[1] == B->vector[1]) &&
+		            (A->vector[2] == B->vector[2]);
+		ip++; NEXT();
+	OPCODE(OP_EQ_S)
+		C->_float = !strcmp(PR1_GetString(A->string), PR1_GetString(B->string));
+		ip++; NEXT();
+	OPCODE(OP_EQ_E)
+		C->_float = A->_int == B->_int;
+		ip++; NEXT();
+	OPCODE(OP_EQ_FNC)
+		C->_float = A->function == B->function;
+		ip++; NEXT();
+
+	OPCODE(OP_NE_F)
+		C->_float = A->_float != B->_float;
+		ip++; NEXT();
+	OPCODE(OP_NE_V)
+		C->_float = (A->vector[0] != B->vector[0]) ||
+		            (A->vector[1] != B->vector[1]) ||
+		            (A->vector[2] != B->vector[2]);
+		ip++; NEXT();
+	OPCODE(OP_NE_S)
+		C->_float = strcmp(PR1_GetString(A->string), PR1_GetString(B->string));
+		ip++; NEXT();
+	OPCODE(OP_NE_E)
+		C->_float = A->_int != B->_int;
+		ip++; NEXT();
+	OPCODE(OP_NE_FNC)
+		C->_float = A->function != B->function;
+		ip++; NEXT();
+
+	//==================
+	OPCODE(OP_STORE_F)
+	OPCODE(OP_STORE_ENT)
+	OPCODE(OP_STORE_FLD)		// integers
+	OPCODE(OP_STORE_S)
+	OPCODE(OP_STORE_FNC)		// pointers
+		B->_int = A->_int;
+		ip++; NEXT();
+	OPCODE(OP_STORE_V)
+		B->vector[0] = A->vector[0];
+		B->vector[1] = A->vector[1];
+		B->vector[2] = A->vector[2];
+		ip++; NEXT();
+
+	OPCODE(OP_STOREP_F)
+	OPCODE(OP_STOREP_ENT)
+	OPCODE(OP_STOREP_FLD)		// integers
+	OPCODE(OP_STOREP_S)
+	OPCODE(OP_STOREP_FNC)		// pointers
+		ptr = (eval_t *)((byte *)sv.game_edicts + B->_int);
+		ptr->_int = A->_int;
+		ip++; NEXT();
+	OPCODE(OP_STOREP_V)
+		ptr = (eval_t *)((byte *)sv.game_edicts + B->_int);
+		ptr->vector[0] = A->vector[0];
+		ptr->vector[1] = A->vector[1];
+		ptr->vector[2] = A->vector[2];
+		ip++; NEXT();
+
+	OPCODE(OP_ADDRESS)
+		ed = PROG_TO_EDICT(A->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = ip - pr_code;
+			PR_RunError ("assignment to world entity");
+		}
+		C->_int = (byte *)((int *)ed->v + PR_FIELDOFS(B->_int)) - (byte *)sv.game_edicts;
+		ip++; NEXT();
+
+	OPCODE(PRT_ADDRESS_STOREP)
+		ed = PROG_TO_EDICT(A->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = ip - pr_code;
+			PR_RunError ("assignment to world entity");
+		}
+		C->_int = (byte *)((int *)ed->v + PR_FIELDOFS(B->_int)) - (byte *)sv.game_edicts;
+		ip++;
+		ptr = (eval_t *)((byte *)sv.game_edicts + B->_int);
+		ptr->_int = A->_int;
+		ip++; NEXT();
+	OPCODE(PRT_ADDRESS_STOREP_V)
+		ed = PROG_TO_EDICT(A->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = ip - pr_code;
+			PR_RunError ("assignment to world entity");
+		}
+		C->_int = (byte *)((int *)ed->v + PR_FIELDOFS(B->_int)) - (byte *)sv.game_edicts;
+		ip++;
+		ptr = (eval_t *)((byte *)sv.game_edicts + B->_int);
+		ptr->vector[0] = A->vector[0];
+		ptr->vector[1] = A->vector[1];
+		ptr->vector[2] = A->vector[2];
+		ip++; NEXT();
+
+	OPCODE(OP_LOAD_F)
+	OPCODE(OP_LOAD_FLD)
+	OPCODE(OP_LOAD_ENT)
+	OPCODE(OP_LOAD_S)
+	OPCODE(OP_LOAD_FNC)
+		ed = PROG_TO_EDICT(A->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		//need for checking 'cmd mmode player N', if N >= 0x10000000 =(signed)=> negative
+		if (B->_int >= 0)
+		{
+			ptr = (eval_t *)((int *)ed->v + PR_FIELDOFS(B->_int));
+			C->_int = ptr->_int;
+		}
+		else
+			C->_int = 0;
+		ip++; NEXT();
+
+	OPCODE(OP_LOAD_V)
+		ed = PROG_TO_EDICT(A->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+		ptr = (eval_t *)((int *)ed->v + PR_FIELDOFS(B->_int));
+		C->vector[0] = ptr->vector[0];
+		C->vector[1] = ptr->vector[1];
+		C->vector[2] = ptr->vector[2];
+		ip++; NEXT();
+
+	//==================
+
+	OPCODE(OP_IFNOT)
+		ip = (!A->_int ? ip->target : ip + 1);
+		CHARGE();
+		NEXT();
+
+	OPCODE(OP_IF)
+		ip = (A->_int ? ip->target : ip + 1);
+		CHARGE();
+		NEXT();
+
+	OPCODE(OP_GOTO)
+		ip = ip->target;
+		CHARGE();
+		NEXT();
+
+	OPCODE(PRT_IF_GOTO)
+		if (A->_int)
+		{
+			ip += 2;
+		}
+		else
+		{
+			ip = ip[1].target;
+			runaway--;	// the GOTO
+		}
+		CHARGE();
+		NEXT();
+
+	OPCODE(PRT_IFNOT_GOTO)
+		if (!A->_int)
+		{
+			ip += 2;
+		}
+		else
+		{
+			ip = ip[1].target;
+			runaway--;	// the GOTO
+		}
+		CHARGE();
+		NEXT();
+
+	OPCODE(PRT_STORE_CALL)
+		B->_int = A->_int;
+		callip = ip + 1;
+		goto call;
+	OPCODE(PRT_STORE_V_CALL)
+		B->vector[0] = A->vector[0];
+		B->vector[1] = A->vector[1];
+		B->vector[2] = A->vector[2];
+		callip = ip + 1;
+		goto call;
+
+	OPCODE(OP_CALL0)
+	OPCODE(OP_CALL1)
+	OPCODE(OP_CALL2)
+	OPCODE(OP_CALL3)
+	OPCODE(OP_CALL4)
+	OPCODE(OP_CALL5)
+	OPCODE(OP_CALL6)
+	OPCODE(OP_CALL7)
+	OPCODE(OP_CALL8)
+		callip = ip;
+call:
+		pr_argc = callip->baseop - OP_CALL0;
+		pr_xstatement = callip - pr_code;
+		if (!callip->a->function)
+			PR_RunError ("NULL function");
+
+		newf = &pr_functions[callip->a->function];
+
+		if (newf->first_statement < 0)
+		{	// negative statements are built in functions
+			i = -newf->first_statement;
+			if (i >= pr_numbuiltins)
+				PR_RunError ("Bad builtin call number");
+			if (pr_prof_active)
+			{
+				PR_ProfEnter (PROF_BUILTIN, callip->a->function, PR1_GetString (newf->s_name));
+				pr_builtins[i] ();
+				PR_ProfLeave ();
+			}
+			else
+			{
+				pr_builtins[i] ();
+			}
+
+			// the builtin may have turned on pr_trace
+			SELECT();
+			ip = callip + 1;
+			CHARGE();
+			NEXT();
+		}
+
+		ip = pr_code + PR_EnterFunction (newf) + 1;
+		CHARGE();
+		NEXT();
+
+	OPCODE(OP_DONE)
+	OPCODE(OP_RETURN)
+		pr_globals[OFS_RETURN] = A->vector[0];
+		pr_globals[OFS_RETURN+1] = A->vector[1];
+		pr_globals[OFS_RETURN+2] = A->vector[2];
+
+		s = PR_LeaveFunction ();
+		if (pr_depth == exitdepth)
+			return;		// all done
+		ip = pr_code + s + 1;
+		CHARGE();
+		NEXT();
+
+	OPCODE(OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v->nextthink = pr_global_struct->time + 0.1;
+		if (A->_float != ed->v->frame)
+		{
+			ed->v->frame = A->_float;
+		}
+		ed->v->think = B->function;
+		ip++; NEXT();
+
+#ifndef PR_COMPUTED_GOTO
+	default:
+#endif
+	OPCODE(PRT_BAD)
+		pr_xstatement = ip - pr_code;
+		if (pr_statements[pr_xstatement].op > OP_BITOR)
+			PR_RunError ("Bad opcode %i", pr_statements[pr_xstatement].op);
+		PR_RunError ("Branch out of range");
+#ifndef PR_COMPUTED_GOTO
+	}
+#endif
+}
+
+#endif // !CLIENTONLY
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "pr_comp.h" // defs shared with qcc
 #include "progdefs.h" // generated by program cdefs
+#include "pr_prof.h"
 
 typedef union eval_s
 {
@@ -34,23 +35,16 @@ typedef union eval_s
 	int		edict;
 } eval_t;
 
-struct edict_s; // forward referecnce for link_t
-
-typedef struct link_s
-{
-	struct edict_s *ed;
-
-	struct link_s	*prev, *next;
-} link_t;
-
-#define	EDICT_FROM_AREA(l)	((l)->ed)
+struct areanode_s;
 
 #define	MAX_ENT_LEAFS	16
 
 typedef struct sv_edict_s
 {
 	qbool		free;
-	link_t		area;			// linked to a division node or leaf
+	struct areanode_s	*area;	// division node or leaf the edict is linked to, NULL if none
+	int			arealist;		// AREA_SOLID or AREA_TRIGGERS
+	int			areaindex;		// slot in that node's edict array
 
 	int         entnum;
 
@@ -124,6 +118,16 @@ void PR_Init (void);
 void PR_ExecuteProgram (func_t fnum);
 void PR_InitPatchTables (void);	// NQ progs support
 
+int PR_EnterFunction (dfunction_t *f);
+int PR_LeaveFunction (void);
+void PR_PrintStatement (dstatement_t *s);
+extern	int		pr_depth;
+
+void PR_ExecuteThreaded (dfunction_t *f);
+void PR_ThreadedReset (void);
+extern	cvar_t	pr_threaded;
+extern	cvar_t	pr_profile;
+
 void PR_Profile_f (void);
 
 void ED_ClearEdict (edict_t *e);
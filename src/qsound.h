@@ -101,7 +101,6 @@ void S_LocalSound (char *s);
 void S_LocalSoundWithVol(char *sound, float volume);
 sfxcache_t *S_LoadSound (sfx_t *s);
 
-void SND_InitScaletable (void);
 int SND_Rate(int rate);
 
 void SND_ResampleStream(void *in, int inrate, int inwidth, int inchannels, int insamps,
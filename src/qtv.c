@@ -79,6 +79,8 @@ void QTV_Init(void)
 	Cmd_AddCommand("qtvusers", Qtvusers_f);
 	Cmd_AddCommand("+qtv_delay", QtvStartDelay_f);
 	Cmd_AddCommand("-qtv_delay", QtvEndDelay_f);
+
+	QTV_Streams_Init();
 }
 
 //=================================================
@@ -94,6 +94,17 @@ extern cvar_t qtv_event_changename;
 
 void QTV_Init(void);
 
+//======================================
+// several streams connected at once, qtv_streams.c
+
+extern cvar_t qtv_stream_maxmem;
+
+void		QTV_Streams_Init(void);
+void		QTV_Streams_Poll(void);
+void		QTV_Streams_Shutdown(void);
+
+qbool		CL_QTVAuthRequest(const char *authmethod, const char *challenge, const char *password, const char *source, char *connrequest, size_t size);
+
 //======================================
 
 #define		dem_mask	(7)
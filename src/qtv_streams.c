@@ -0,0 +1,909 @@
+/*
+Copyright (C) 2011 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// qtv_streams.c - several QTV streams kept connected at once
+//
+// qtvplay talks to one proxy at a time, and watching another game means a new
+// connection, the proxy sending the gamestate again and the client buffering from
+// scratch. Streams added with qtv_stream_add instead stay connected in the background:
+// one reader thread does the socket work for all of them and cuts what arrives into
+// mvd messages, keeping each stream's data from the start of its current level along
+// with the time it has played since.
+//
+// There is only one cl/cls, and mvd entity and player updates are deltas, so only the
+// stream being watched can be parsed into the game state; a stream can't be joined
+// half way through a level either. qtv_stream_switch therefore plays the stream from
+// its level start out of memory and seeks to qtv_buffertime behind the newest data it
+// has, the seek runs through the backlog without drawing or sound, so the switch takes
+// a frame or two instead of a reconnect and a rebuffer. The stream switched away from
+// stays connected and keeps its level, so switching back is just as quick.
+
+#include "quakedef.h"
+#include <SDL.h>
+#include "qtv.h"
+
+#define MAX_QTV_STREAMS		8
+
+typedef enum
+{
+	QTVS_FREE,
+	QTVS_CONNECTING,	// waiting for the reader thread to connect
+	QTVS_HANDSHAKE,		// connected, the main thread parses the proxy's reply
+	QTVS_STREAMING,
+	QTVS_CLOSED			// the connection is gone, error tells why
+} qtvstream_state_t;
+
+typedef struct qtvstream_s
+{
+	vfsfile_t			vfs;			// playbackfile while this stream is watched
+
+	// main thread only
+	char				address[256];	// as given to qtv_stream_add, [stream@]host[:port]
+	char				password[128];
+	char				source[256];	// SOURCE line of the request, empty for the default stream
+	float				svversion;
+	int					ezquake_ext;
+	qbool				reported;		// error printed
+	qbool				begun;			// the proxy started the stream
+
+	// the rest is shared with the reader thread, under qtvstreams.mutex
+	qtvstream_state_t	state;
+	char				host[256];
+	int					sock;			// only the reader thread opens and closes it
+	qbool				remove;			// the reader thread frees the stream
+	qbool				stale;			// level dropped to stay under qtv_stream_maxmem, reconnect to watch it
+
+	byte				*data;
+	int					datasize, datamax;
+	int					framed;			// data up to here is whole mvd messages
+	int					levelstart;		// offset of the current level's svc_serverdata, -1 if we have none
+	int					levelms;		// time played since the level start
+	int					readpos;		// how far playback has read, -1 if not watched
+
+	byte				*out;			// to be sent to the proxy
+	int					outsize, outmax;
+
+	char				error[256];
+} qtvstream_t;
+
+static struct
+{
+	SDL_mutex			*mutex;
+	qtvstream_t			streams[MAX_QTV_STREAMS];
+	qbool				running;		// reader thread started and not finished
+	qbool				stop;
+	qtvstream_t			*seeking;		// just switched to, seek once the client is active
+	qtvstream_t			*switchto;		// asked for before it was ready
+} qtvstreams;
+
+cvar_t qtv_stream_maxmem = { "qtv_stream_maxmem", "64" };
+
+extern vfsfile_t *playbackfile;
+
+void CL_QTVPlay (vfsfile_t *newf, void *buf, int buflen);
+
+#define QTVS_LOCK()		SDL_LockMutex(qtvstreams.mutex)
+#define QTVS_UNLOCK()	SDL_UnlockMutex(qtvstreams.mutex)
+
+static int QTVS_StreamNum(qtvstream_t *s)
+{
+	return (int)(s - qtvstreams.streams) + 1;
+}
+
+static void QTVS_Append(byte **buf, int *size, int *max, const void *data, int len)
+{
+	if (*size + len > *max)
+	{
+		*max = max(*max * 2, *size + len + 65536);
+		*buf = (byte *) Q_realloc(*buf, *max);
+	}
+
+	memcpy(*buf + *size, data, len);
+	*size += len;
+}
+
+//=================================================
+// reader thread
+//=================================================
+
+// the reader thread closes the socket on its next pass
+static void QTVS_Close(qtvstream_t *s, const char *fmt, ...)
+{
+	va_list argptr;
+
+	if (s->state == QTVS_CLOSED)
+		return;
+
+	va_start(argptr, fmt);
+	vsnprintf(s->error, sizeof(s->error), fmt, argptr);
+	va_end(argptr);
+
+	s->state = QTVS_CLOSED;
+}
+
+static void QTVS_Free(qtvstream_t *s)
+{
+	if (s->sock != INVALID_SOCKET)
+		closesocket(s->sock);
+
+	Q_free(s->data);
+	Q_free(s->out);
+	memset(&s->state, 0, sizeof(*s) - offsetof(qtvstream_t, state));
+	s->sock = INVALID_SOCKET;
+	s->state = QTVS_FREE;
+}
+
+// does the message start a level, svc_serverdata is always first in its message
+static qbool QTVS_LevelStart(const byte *msg, int len)
+{
+	int type = msg[1] & dem_mask;
+	int lengthofs = (type == dem_multiple ? 6 : 2);
+
+	if (type == dem_set || type == dem_cmd)
+		return false;
+
+	return len > lengthofs + 4 && msg[lengthofs + 4] == svc_serverdata;
+}
+
+// drops data nobody can use any more, has to be called with the lock held
+static void QTVS_Trim(qtvstream_t *s)
+{
+	int maxmem = (int) (bound(1, qtv_stream_maxmem.value, 1024) * 1024 * 1024);
+	int keep;
+
+	if (s->datasize > maxmem && s->levelstart >= 0)
+	{
+		// can't keep the level, the next one or a reconnect will give us a start again
+		s->levelstart = -1;
+		s->stale = true;
+	}
+
+	if (s->levelstart >= 0)
+		keep = (s->readpos >= 0 ? min(s->levelstart, s->readpos) : s->levelstart);
+	else
+		keep = (s->readpos >= 0 ? s->readpos : s->framed);
+
+	// wait for a decent chunk, so we don't move the buffer around for every message
+	if (keep <= 0 || (keep < 65536 && keep < s->datasize / 2))
+		return;
+
+	s->datasize -= keep;
+	memmove(s->data, s->data + keep, s->datasize);
+	s->framed -= keep;
+	if (s->levelstart >= 0)
+		s->levelstart -= keep;
+	if (s->readpos >= 0)
+		s->readpos -= keep;
+}
+
+// cuts newly arrived data into mvd messages, has to be called with the lock held
+static void QTVS_Frame(qtvstream_t *s)
+{
+	int len, ms;
+
+	while ((len = ConsistantMVDDataEx(s->data + s->framed, s->datasize - s->framed, &ms, 1)))
+	{
+		if (QTVS_LevelStart(s->data + s->framed, len))
+		{
+			s->levelstart = s->framed;
+			s->levelms = 0;
+			s->stale = false;
+		}
+
+		if (s->levelstart >= 0)
+			s->levelms += ms;
+
+		s->framed += len;
+	}
+
+	QTVS_Trim(s);
+}
+
+static void QTVS_Connect(qtvstream_t *s)
+{
+	char host[sizeof(s->host)];
+	netadr_t adr = {0};
+	int sock = INVALID_SOCKET;
+
+	strlcpy(host, s->host, sizeof(host));
+
+	QTVS_UNLOCK();
+	if (NET_StringToAdr(host, &adr))
+		sock = TCP_OpenStream(adr);
+	QTVS_LOCK();
+
+	if (s->remove || s->state != QTVS_CONNECTING)
+	{
+		if (sock != INVALID_SOCKET)
+			closesocket(sock);
+		return;
+	}
+
+	if (sock == INVALID_SOCKET)
+	{
+		QTVS_Close(s, "couldn't connect to proxy %s", host);
+		return;
+	}
+
+	s->sock = sock;
+	s->state = QTVS_HANDSHAKE;
+}
+
+static void QTVS_Send(qtvstream_t *s)
+{
+	int len = send(s->sock, (char *) s->out, s->outsize, 0);
+
+	if (len > 0)
+	{
+		s->outsize -= len;
+		memmove(s->out, s->out + len, s->outsize);
+	}
+	else if (len < 0 && qerrno != EWOULDBLOCK)
+	{
+		QTVS_Close(s, "send error (%i): %s", qerrno, strerror(qerrno));
+	}
+}
+
+static void QTVS_Recv(qtvstream_t *s, const byte *buf, int len, int error)
+{
+	if (len > 0)
+	{
+		QTVS_Append(&s->data, &s->datasize, &s->datamax, buf, len);
+
+		if (s->state == QTVS_STREAMING)
+			QTVS_Frame(s);
+	}
+	else if (len == 0)
+	{
+		QTVS_Close(s, "proxy closed the connection");
+	}
+	else if (error != EWOULDBLOCK)
+	{
+		QTVS_Close(s, "connection lost (%i): %s", error, strerror(error));
+	}
+}
+
+static int QTVS_ReaderProc(void *ignored)
+{
+	static byte buf[65536];
+	qtvstream_t *s;
+	struct timeval tv;
+	fd_set readset, writeset;
+	int i, maxsock, active, len, error;
+
+	QTVS_LOCK();
+
+	while (true)
+	{
+		FD_ZERO(&readset);
+		FD_ZERO(&writeset);
+		maxsock = -1;
+		active = 0;
+
+		for (i = 0, s = qtvstreams.streams; i < MAX_QTV_STREAMS; i++, s++)
+		{
+			if (s->remove)
+				QTVS_Free(s);
+
+			// closed, or the main thread asked for a new connection
+			if (s->sock != INVALID_SOCKET && (s->state == QTVS_CLOSED || s->state == QTVS_CONNECTING))
+			{
+				closesocket(s->sock);
+				s->sock = INVALID_SOCKET;
+			}
+
+			if (s->state == QTVS_CONNECTING)
+				QTVS_Connect(s);
+
+			if (s->state != QTVS_FREE)
+				active++;
+
+			if (s->sock == INVALID_SOCKET)
+				continue;
+
+			FD_SET(s->sock, &readset);
+			if (s->outsize)
+				FD_SET(s->sock, &writeset);
+			maxsock = max(maxsock, s->sock);
+		}
+
+		if (!active || qtvstreams.stop)
+			break;
+
+		QTVS_UNLOCK();
+
+		if (maxsock < 0)
+		{
+			Sys_MSleep(10);
+			QTVS_LOCK();
+			continue;
+		}
+
+		tv.tv_sec = 0;
+		tv.tv_usec = 10000;
+		if (select(maxsock + 1, &readset, &writeset, NULL, &tv) <= 0)
+		{
+			QTVS_LOCK();
+			continue;
+		}
+
+		// nobody else closes the sockets, so they are still the ones select() looked at,
+		// and the read goes to our own buffer, which keeps the lock out of the recv()
+		for (i = 0, s = qtvstreams.streams; i < MAX_QTV_STREAMS; i++, s++)
+		{
+			int sock = s->sock;
+
+			if (sock == INVALID_SOCKET)
+				continue;
+
+			if (FD_ISSET(sock, &readset))
+			{
+				len = recv(sock, (char *) buf, sizeof(buf), 0);
+				error = (len < 0 ? qerrno : 0);
+
+				QTVS_LOCK();
+				if (s->state == QTVS_HANDSHAKE || s->state == QTVS_STREAMING)
+					QTVS_Recv(s, buf, len, error);
+				QTVS_UNLOCK();
+			}
+
+			if (FD_ISSET(sock, &writeset))
+			{
+				QTVS_LOCK();
+				if ((s->state == QTVS_HANDSHAKE || s->state == QTVS_STREAMING) && s->outsize)
+					QTVS_Send(s);
+				QTVS_UNLOCK();
+			}
+		}
+
+		QTVS_LOCK();
+	}
+
+	qtvstreams.running = false;
+	QTVS_UNLOCK();
+
+	return 0;
+}
+
+//=================================================
+// playback, the stream as a vfsfile_t
+//=================================================
+
+static int QTVS_VFS_ReadBytes(struct vfsfile_s *file, void *buffer, int bytestoread, vfserrno_t *err)
+{
+	qtvstream_t *s = (qtvstream_t *) file;
+	int len = 0;
+
+	QTVS_LOCK();
+
+	if (s->readpos >= 0)
+	{
+		len = bound(0, s->framed - s->readpos, bytestoread);
+
+		if (buffer && len)
+		{
+			memcpy(buffer, s->data + s->readpos, len);
+			s->readpos += len;
+		}
+		else
+		{
+			len = 0;
+		}
+	}
+
+	if (err)
+		*err = (!len && (s->readpos < 0 || s->state == QTVS_CLOSED) ? VFSERR_EOF : VFSERR_NONE);
+
+	QTVS_UNLOCK();
+
+	return len;
+}
+
+static int QTVS_VFS_WriteBytes(struct vfsfile_s *file, const void *buffer, int bytestowrite)
+{
+	qtvstream_t *s = (qtvstream_t *) file;
+
+	QTVS_LOCK();
+	if (s->state == QTVS_STREAMING && bytestowrite > 0)
+		QTVS_Append(&s->out, &s->outsize, &s->outmax, buffer, bytestowrite);
+	QTVS_UNLOCK();
+
+	return bytestowrite;
+}
+
+static int QTVS_VFS_Seek(struct vfsfile_s *file, unsigned long pos, int whence)
+{
+	return -1;
+}
+
+static unsigned long QTVS_VFS_Tell(struct vfsfile_s *file)
+{
+	return 0;
+}
+
+static unsigned long QTVS_VFS_GetLen(struct vfsfile_s *file)
+{
+	return 0;
+}
+
+// playback is done with it, the stream itself stays connected
+static void QTVS_VFS_Close(struct vfsfile_s *file)
+{
+	qtvstream_t *s = (qtvstream_t *) file;
+
+	QTVS_LOCK();
+	s->readpos = -1;
+	if (qtvstreams.seeking == s)
+		qtvstreams.seeking = NULL;
+	QTVS_UNLOCK();
+}
+
+//=================================================
+// main thread
+//=================================================
+
+// sends the request, like qtvplay does, and has the reader thread connect,
+// has to be called with the lock held
+static void QTVS_Request(qtvstream_t *s)
+{
+	char *connrequest;
+
+	s->outsize = 0;
+	s->datasize = s->framed = s->levelms = 0;
+	s->levelstart = -1;
+	if (s->readpos > 0)
+		s->readpos = 0; // watched, the new game state comes to the client like a map change
+	s->stale = false;
+	s->error[0] = 0;
+	s->reported = s->begun = false;
+
+	connrequest = QTV_CL_HEADER(QTV_VERSION, QTV_EZQUAKE_EXT_NUM);
+	QTVS_Append(&s->out, &s->outsize, &s->outmax, connrequest, strlen(connrequest));
+	QTVS_Append(&s->out, &s->outsize, &s->outmax, s->source, strlen(s->source));
+	connrequest = va("USERINFO: %s\n", cls.userinfo);
+	QTVS_Append(&s->out, &s->outsize, &s->outmax, connrequest, strlen(connrequest));
+
+	if (s->password[0])
+	{
+		connrequest =
+						"AUTH: SHA3_512\n"
+						"AUTH: MD4\n"
+						"AUTH: CCITT\n"
+						"AUTH: PLAIN\n"
+						"AUTH: NONE\n";
+		QTVS_Append(&s->out, &s->outsize, &s->outmax, connrequest, strlen(connrequest));
+	}
+
+	QTVS_Append(&s->out, &s->outsize, &s->outmax, "\n", 1);
+
+	s->state = QTVS_CONNECTING;
+
+	if (!qtvstreams.running)
+	{
+		qtvstreams.running = true;
+		qtvstreams.stop = false;
+
+		if (Sys_CreateDetachedThread(QTVS_ReaderProc, NULL) < 0)
+		{
+			qtvstreams.running = false;
+			QTVS_Close(s, "couldn't create the reader thread");
+		}
+	}
+}
+
+// the proxy's reply to our request, same as CL_QTVPoll does it for qtvplay,
+// has to be called with the lock held
+static void QTVS_Handshake(qtvstream_t *s)
+{
+	char QTVSV[] = "QTVSV ";
+	int	 QTVSVLEN = sizeof(QTVSV)-1;
+
+	char challenge[128] = {0};
+	char authmethod[128] = {0};
+	char *header, *start, *end, *colon;
+	qbool streamavailable = false;
+	int headersize;
+
+	if (s->datasize < QTVSVLEN)
+		return;
+
+	if (strncmp((char *) s->data, QTVSV, QTVSVLEN))
+	{
+		QTVS_Close(s, "server is not a QTV server (or is incompatible)");
+		return;
+	}
+
+	// wait for the whole header, "\n\n" ends it
+	for (headersize = 1; headersize < s->datasize; headersize++)
+	{
+		if (s->data[headersize - 1] == '\n' && s->data[headersize] == '\n')
+			break;
+	}
+
+	if (headersize >= s->datasize)
+		return;
+
+	headersize++;
+
+	header = (char *) Q_malloc(headersize + 1);
+	memcpy(header, s->data, headersize);
+
+	s->datasize -= headersize;
+	memmove(s->data, s->data + headersize, s->datasize);
+
+	s->svversion = atof(header + QTVSVLEN);
+
+	// server sent float version, but we compare only major version number here
+	if ((int)s->svversion != (int)QTV_VERSION)
+	{
+		QTVS_Close(s, "QTV server doesn't support a compatible protocol version, returned %.2f, need %.2f", s->svversion, QTV_VERSION);
+		Q_free(header);
+		return;
+	}
+
+	for (start = end = header; *end; end++)
+	{
+		if (*end != '\n')
+			continue;
+
+		*end = '\0';
+
+		if ((colon = strchr(start, ':')))
+		{
+			*colon++ = '\0';
+
+			while (*colon == ' ')
+				colon++;
+
+			if (!strcmp(start, "PERROR") || !strcmp(start, "TERROR"))
+			{
+				// the proxy may hang up right after, and that's not what we want to say
+				Com_Printf("QTV stream %d error:\n%s\n", QTVS_StreamNum(s), colon);
+				QTVS_Close(s, "%s", colon);
+				s->reported = true;
+			}
+			else if (!strcmp(start, "PRINT"))
+				Com_Printf("QTV stream %d:\n%s\n", QTVS_StreamNum(s), colon);
+			else if (!strcmp(start, "AUTH"))
+				strlcpy(authmethod, colon, sizeof(authmethod));
+			else if (!strcmp(start, "CHALLENGE"))
+				strlcpy(challenge, colon, sizeof(challenge));
+			else if (!strcmp(start, "BEGIN"))
+				streamavailable = true;
+			else if (!strcmp(start, QTV_EZQUAKE_EXT))
+				s->ezquake_ext = atoi(colon);
+		}
+		else if (!strcmp(start, "BEGIN"))
+		{
+			streamavailable = true;
+		}
+
+		start = end + 1;
+	}
+
+	Q_free(header);
+
+	if (s->state == QTVS_CLOSED)
+		return;
+
+	if (streamavailable)
+	{
+		s->state = QTVS_STREAMING;
+		s->begun = true;
+		QTVS_Frame(s);
+	}
+	else if (authmethod[0])
+	{
+		char connrequest[2048];
+
+		if (CL_QTVAuthRequest(authmethod, challenge, s->password, s->source, connrequest, sizeof(connrequest)))
+			QTVS_Append(&s->out, &s->outsize, &s->outmax, connrequest, strlen(connrequest));
+		else
+			QTVS_Close(s, "can't authenticate with %s", authmethod);
+	}
+	else
+	{
+		QTVS_Close(s, "proxy didn't start the stream");
+	}
+}
+
+// plays the stream from its level start, the seek to the live game follows in QTV_Streams_Poll
+static void QTVS_Switch(qtvstream_t *s)
+{
+	// closes whatever is played now, this stream too if it's the one
+	CL_QTVPlay(&s->vfs, NULL, 0);
+	cls.qtv_svversion = s->svversion;
+	cls.qtv_ezquake_ext = s->ezquake_ext;
+	strlcpy(cls.qtv_source, s->source, sizeof(cls.qtv_source));
+
+	// mvd time starts counting at the level start we play from
+	cls.demopackettime = 0;
+
+	QTVS_LOCK();
+	s->readpos = s->levelstart;
+	qtvstreams.seeking = s;
+	QTVS_UNLOCK();
+}
+
+void QTV_Streams_Poll(void)
+{
+	qtvstream_t *s, *ready = NULL;
+	int i;
+
+	if (!qtvstreams.mutex)
+		return;
+
+	QTVS_LOCK();
+
+	for (i = 0, s = qtvstreams.streams; i < MAX_QTV_STREAMS; i++, s++)
+	{
+		if (s->state == QTVS_FREE || s->remove)
+			continue;
+
+		// the reply may be followed by the proxy hanging up, read it anyway
+		if (s->state == QTVS_HANDSHAKE || (s->state == QTVS_CLOSED && !s->reported && !s->begun))
+			QTVS_Handshake(s);
+
+		if (s->state == QTVS_CLOSED && !s->reported)
+		{
+			Com_Printf("QTV stream %d (%s): %s\n", i + 1, s->address, s->error);
+			s->reported = true;
+		}
+	}
+
+	if ((s = qtvstreams.switchto))
+	{
+		if (s->state == QTVS_STREAMING && s->levelstart >= 0)
+			ready = s;
+
+		if (ready || s->state == QTVS_CLOSED)
+			qtvstreams.switchto = NULL;
+	}
+
+	// switched to a stream, now go where it is live
+	s = qtvstreams.seeking;
+	if (s && cls.state >= ca_active)
+	{
+		double target = 0.001 * s->levelms - QTVBUFFERTIME;
+
+		if (target > cls.demotime)
+		{
+			cls.demotime = target;
+			cls.demoseeking = DST_SEEKING_NORMAL;
+		}
+
+		qtvstreams.seeking = NULL;
+	}
+
+	QTVS_UNLOCK();
+
+	if (ready)
+		QTVS_Switch(ready);
+}
+
+static qtvstream_t *QTVS_StreamForArg(int arg)
+{
+	int i = Q_atoi(Cmd_Argv(arg)) - 1;
+
+	if (i < 0 || i >= MAX_QTV_STREAMS || qtvstreams.streams[i].state == QTVS_FREE || qtvstreams.streams[i].remove)
+	{
+		Com_Printf("No QTV stream %s\n", Cmd_Argv(arg));
+		return NULL;
+	}
+
+	return &qtvstreams.streams[i];
+}
+
+static void QTV_Stream_Add_f(void)
+{
+	char *stream, *host;
+	qtvstream_t *s = NULL;
+	int i;
+
+	if (Cmd_Argc() < 2)
+	{
+		Com_Printf("Usage: %s [stream@]hostname[:port] [password]\n", Cmd_Argv(0));
+		return;
+	}
+
+	QTVS_LOCK();
+
+	for (i = 0; i < MAX_QTV_STREAMS; i++)
+	{
+		if (qtvstreams.streams[i].state == QTVS_FREE && !qtvstreams.streams[i].remove)
+		{
+			s = &qtvstreams.streams[i];
+			break;
+		}
+	}
+
+	if (!s)
+	{
+		QTVS_UNLOCK();
+		Com_Printf("Can't have more than %d QTV streams\n", MAX_QTV_STREAMS);
+		return;
+	}
+
+	strlcpy(s->address, Cmd_Argv(1), sizeof(s->address));
+	strlcpy(s->password, Cmd_Argv(2), sizeof(s->password));
+	s->readpos = -1;
+
+	// [stream@]hostname[:port], proxies can be chained so split at the last @
+	stream = s->host;
+	strlcpy(s->host, s->address, sizeof(s->host));
+	if ((host = strchrrev(stream, '@')))
+	{
+		*host++ = 0;
+		snprintf(s->source, sizeof(s->source), "SOURCE: %s\n", stream);
+		memmove(s->host, host, strlen(host) + 1);
+	}
+	else
+	{
+		s->source[0] = 0;
+	}
+
+	QTVS_Request(s);
+	QTVS_UNLOCK();
+
+	Com_Printf("QTV stream %d: connecting to %s\n", QTVS_StreamNum(s), s->address);
+}
+
+static void QTV_Stream_Remove_f(void)
+{
+	qtvstream_t *s;
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf("Usage: %s <stream>\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (!(s = QTVS_StreamForArg(1)))
+		return;
+
+	if (playbackfile == &s->vfs)
+		CL_Disconnect();
+
+	QTVS_LOCK();
+	s->remove = true;
+	if (qtvstreams.switchto == s)
+		qtvstreams.switchto = NULL;
+	QTVS_UNLOCK();
+}
+
+static void QTV_Stream_List_f(void)
+{
+	static const char *states[] = { "", "connecting", "handshake", "streaming", "closed" };
+	qtvstream_t *s;
+	int i, count = 0;
+
+	QTVS_LOCK();
+
+	for (i = 0, s = qtvstreams.streams; i < MAX_QTV_STREAMS; i++, s++)
+	{
+		if (s->state == QTVS_FREE || s->remove)
+			continue;
+
+		if (!count++)
+			Com_Printf("%2s %-32s %-10s %6s %8s\n", "id", "stream", "state", "level", "memory");
+
+		Com_Printf("%2d %-32.32s %-10s %3d:%02d %7dk%s\n", i + 1, s->address, states[s->state],
+			s->levelstart >= 0 ? s->levelms / 60000 : 0, s->levelstart >= 0 ? (s->levelms / 1000) % 60 : 0,
+			s->datasize / 1024, s->readpos >= 0 ? " watching" : "");
+	}
+
+	QTVS_UNLOCK();
+
+	if (!count)
+		Com_Printf("No QTV streams, add some with qtv_stream_add\n");
+}
+
+static void QTV_Stream_Switch_f(void)
+{
+	qtvstream_t *s;
+	qbool ready;
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf("Usage: %s <stream>\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (!(s = QTVS_StreamForArg(1)))
+		return;
+
+	QTVS_LOCK();
+	ready = (s->state == QTVS_STREAMING && s->levelstart >= 0);
+	qtvstreams.switchto = (ready ? NULL : s);
+
+	// a fresh connection gets the proxy to send the game state again
+	if (s->state == QTVS_CLOSED || (s->state == QTVS_STREAMING && s->stale))
+		QTVS_Request(s);
+	QTVS_UNLOCK();
+
+	if (!ready)
+	{
+		Com_Printf("QTV stream %d isn't ready yet, switching to it once it is\n", QTVS_StreamNum(s));
+		return;
+	}
+
+	QTVS_Switch(s);
+}
+
+void QTV_Streams_Init(void)
+{
+	int i;
+
+	qtvstreams.mutex = SDL_CreateMutex();
+
+	for (i = 0; i < MAX_QTV_STREAMS; i++)
+	{
+		qtvstream_t *s = &qtvstreams.streams[i];
+
+		s->sock = INVALID_SOCKET;
+		s->readpos = -1;
+		s->vfs.ReadBytes = QTVS_VFS_ReadBytes;
+		s->vfs.WriteBytes = QTVS_VFS_WriteBytes;
+		s->vfs.Seek = QTVS_VFS_Seek;
+		s->vfs.Tell = QTVS_VFS_Tell;
+		s->vfs.GetLen = QTVS_VFS_GetLen;
+		s->vfs.Close = QTVS_VFS_Close;
+		s->vfs.seekingisabadplan = true;
+	}
+
+	Cvar_SetCurrentGroup(CVAR_GROUP_QTV);
+	Cvar_Register(&qtv_stream_maxmem);
+	Cvar_ResetCurrentGroup();
+
+	Cmd_AddCommand("qtv_stream_add", QTV_Stream_Add_f);
+	Cmd_AddCommand("qtv_stream_remove", QTV_Stream_Remove_f);
+	Cmd_AddCommand("qtv_stream_list", QTV_Stream_List_f);
+	Cmd_AddCommand("qtv_stream_switch", QTV_Stream_Switch_f);
+}
+
+void QTV_Streams_Shutdown(void)
+{
+	int i;
+
+	if (!qtvstreams.mutex)
+		return;
+
+	QTVS_LOCK();
+	for (i = 0; i < MAX_QTV_STREAMS; i++)
+	{
+		if (qtvstreams.streams[i].state != QTVS_FREE)
+			qtvstreams.streams[i].remove = true;
+	}
+	qtvstreams.stop = true;
+	QTVS_UNLOCK();
+
+	// give the reader thread a moment to close the sockets
+	for (i = 0; i < 100; i++)
+	{
+		qbool running;
+
+		QTVS_LOCK();
+		running = qtvstreams.running;
+		QTVS_UNLOCK();
+
+		if (!running)
+			break;
+
+		Sys_MSleep(10);
+	}
+}
@@ -263,10 +263,13 @@ typedef struct client_s
 	client_frame_t	frames[UPDATE_BACKUP];		// updates can be deltad from here
 
 	vfsfile_t		*download;			// file being downloaded
+	struct sv_dlfile_s	*dlfile;		// download's data when it came from the download cache
 	int             dupe;               // duplicate packets requested
 #ifdef PROTOCOL_VERSION_FTE
 #ifdef FTE_PEXT_CHUNKEDDOWNLOADS
 	int				download_chunks_perframe;
+	double			download_chunk_tokens;	// chunks ranged nextdl may still send, refilled over time
+	double			download_chunk_refill;	// realtime of the last refill, 0 starts with a full budget
 #endif
 #endif
 	int				downloadsize;			// total bytes
@@ -455,7 +458,29 @@ typedef struct mvdpendingdest_s
 	struct mvdpendingdest_s *nextdest;
 } mvdpendingdest_t;
 
-typedef enum {DEST_NONE, DEST_FILE, DEST_BUFFEREDFILE, DEST_STREAM} desttype_t;
+typedef enum {DEST_NONE, DEST_FILE, DEST_BUFFEREDFILE, DEST_STREAM, DEST_COMPRESSEDFILE} desttype_t;
+
+// cache of a DEST_FILE dest, which is written out as soon as possible
+#define DEMO_FILE_CACHE_SIZE	0x100000
+
+// DEST_BUFFEREDFILE cache is written out when less than this is free
+#define DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS	65536
+
+// deflate output buffer of a DEST_COMPRESSEDFILE dest
+#define DEMO_COMPRESS_BUFFER_SIZE	0x10000
+
+// set in mvddest_t.syncpoint to ask for a Z_SYNC_FLUSH there
+#define DEMO_SYNC_FLUSH				0x40000000
+
+typedef struct mvddest_iostats_s
+{
+	SDL_atomic_t	writes;			// write()/send() calls done by the I/O thread
+	SDL_atomic_t	written;		// bytes written out by the I/O thread
+	int				lastwritten;	// written, as seen by the last DestFlush
+	int				peak;			// most bytes waiting in the cache
+	int				stalls;			// times the main thread had to wait for room in the cache
+	double			stalltime;		// total time spent waiting
+} mvddest_iostats_t;
 
 #define MAX_PROXY_INBUFFER		4096 /* qqshka: too small??? */
 
@@ -471,9 +496,23 @@ typedef struct mvddest_s
 	char name[MAX_QPATH];
 	char path[MAX_QPATH];
 
+	// ring buffer, filled by the main thread and written out by the demo I/O thread (sv_demo_io.c)
 	char *cache;
-	int cacheused;
 	int maxcachesize;
+	SDL_atomic_t cachehead;		// main thread writes here
+	SDL_atomic_t cachetail;		// I/O thread reads from here
+	SDL_atomic_t flushcache;	// ask the I/O thread to write a DEST_BUFFEREDFILE cache out now
+	SDL_atomic_t ioerror;		// set by the I/O thread, DestFlush turns it into error
+
+// { used by DEST_COMPRESSEDFILE, the deflate state belongs to the I/O thread while attached
+	z_stream *zstream;
+	byte *zbuffer;
+	SDL_atomic_t syncpoint;		// cachehead at the end of the last demo frame, maybe with DEMO_SYNC_FLUSH
+	double synctime;			// when DestFlush last asked for a sync flush
+	unsigned int compressedsize;
+// }
+
+	mvddest_iostats_t iostats;
 
 	unsigned int totalsize;
 
@@ -762,8 +801,29 @@ typedef struct
 	int			level;
 	double		time; // for ban expiration
 	ipfiltertype_t type;
+	int			order; // when it was added, the first added of several matching VIP filters wins
 } ipfilter_t;
 
+// sv_iptrie.c
+typedef struct iptrie_node_s
+{
+	unsigned int			prefix;		// host byte order, bits past len are zero
+	int						len;		// prefix length, 0-32
+	void					*data;		// NULL on nodes which only join two branches
+	struct iptrie_node_s	*child[2];
+} iptrie_node_t;
+
+typedef struct
+{
+	iptrie_node_t	*root;
+	int				count;
+} iptrie_t;
+
+void	IPTrie_Insert (iptrie_t *t, unsigned int prefix, int len, void *data);
+void	*IPTrie_Find (iptrie_t *t, unsigned int prefix, int len);
+void	IPTrie_Remove (iptrie_t *t, unsigned int prefix, int len);
+int		IPTrie_Match (iptrie_t *t, unsigned int addr, void **matches, int maxmatches);
+
 //bliP: penalty filters ->
 typedef enum {
 	ft_mute,
@@ -775,6 +835,7 @@ typedef struct
 	byte		ip[4];
 	double		time;
 	filtertype_t	type;
+	int			index;	// in penfilters
 } penfilter_t;
 //<-
 
@@ -794,6 +855,7 @@ qbool SV_StepDirection (edict_t *ent, float yaw, float dist);
 void SV_NewChaseDir (edict_t *actor, edict_t *enemy, float dist);
 
 void SV_WriteClientdataToMessage (client_t *client, sizebuf_t *msg);
+void SV_FinishClientDatagram (client_t *client, sizebuf_t *msg);
 
 void SV_MoveToGoal (void);
 
@@ -822,7 +884,6 @@ void SV_ListFiles_f (void);
 void SV_RemoveFile_f (void);
 void SV_RemoveDirectory_f (void);
 
-#define	MAX_PENFILTERS 512
 void SV_RemoveIPFilter (int i);
 //static qbool SV_IPCompare (byte *a, byte *b);
 //static void SV_IPCopy (byte *dest, byte *src);
@@ -902,6 +963,35 @@ void SV_VoiceInitClient(client_t *client);
 void SV_VoiceSendPacket(client_t *client, sizebuf_t *buf);
 #endif
 
+//
+// sv_dlcache.c
+//
+typedef struct sv_dlfile_s
+{
+	struct sv_dlfile_s	*next;
+	char			name[MAX_OSPATH];
+	relativeto_t	relativeto;
+
+	const byte		*data;
+	int				size;
+	qbool			copyprotected;		// came from a pak
+	vfsfile_t		*vfs;				// data points into the archive this is from
+	sys_mapping_t	map;				// or into the loose file, mapped
+	byte			*copy;				// or it was read into the heap
+
+	int				refcount;			// clients downloading it
+	int				hits;				// downloads that didn't have to load it
+	double			sent;				// bytes
+	double			lastused;
+} sv_dlfile_t;
+
+extern cvar_t	sv_downloadcachesize;
+
+void		SV_DownloadCache_Init (void);
+sv_dlfile_t	*SV_DownloadCache_Open (const char *name, relativeto_t relativeto);
+void		SV_DownloadCache_Release (sv_dlfile_t *f);
+void		SV_DownloadCache_Flush (void);
+
 //
 // sv_ccmds.c
 //
@@ -915,6 +1005,10 @@ void SV_KickClient(client_t* client, const char* reason);
 //
 void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder);
 void SV_SetVisibleEntitiesForBot (client_t* client);
+qbool SV_ParallelEntities_Begin (void);
+void SV_ParallelEntities_Queue (client_t *client);
+void SV_ParallelEntities_Run (void);
+void SV_ParallelEntities_Init (void);
 
 //
 // sv_nchan.c
@@ -966,6 +1060,19 @@ void		DestClose (mvddest_t *d, qbool destroyfiles);
 
 int DemoWriteDest (void *data, int len, mvddest_t *d);
 
+//
+// sv_demo_io.c
+//
+
+void	SV_DemoIO_Attach (mvddest_t *d);
+void	SV_DemoIO_Detach (mvddest_t *d);
+int		SV_DemoIO_Used (mvddest_t *d);
+qbool	SV_DemoIO_Write (mvddest_t *d, const void *data, int len);
+void	SV_DemoIO_Flush (qbool complete);
+qbool	SV_DemoIO_InitCompression (mvddest_t *d, int level);
+void	SV_DemoIO_FinishCompression (mvddest_t *d, qbool finish);
+void	SV_DemoIO_Stats_f (void);
+
 extern demo_t	demo; // server demo struct
 
 extern cvar_t	sv_demoUseCache;
@@ -1018,6 +1125,7 @@ void	SV_MVDInfoRemove_f (void);
 void	SV_MVDInfo_f (void);
 void	SV_LastScores_f (void);
 char*   SV_MVDName2Txt (const char *name);
+void    SV_MVDTxtPath (char *path, size_t size);
 void SV_MVDEmbedInfo_f(void);
 
 //
@@ -39,6 +39,7 @@ static void OnChange_s_desiredsamples (cvar_t *var, char *string, qbool *cancel)
 static void S_Play_f (void);
 static void S_MuteSound_f (void);
 static void S_SoundList_f (void);
+static void S_MixBench_f (void);
 static void S_Update_ (void);
 static void S_StopSoundScript_f(void);
 static void S_StopAllSounds_f (void);
@@ -58,9 +59,8 @@ qbool		snd_started = false;
 int		soundtime;
 
 static vec3_t	listener_origin;
-static vec3_t	listener_forward;
 static vec3_t	listener_right;
-static vec3_t	listener_up;
+static vec3_t	game_listener_origin;	// the game thread's copy from the last S_Update, listener_origin is the mixer's
 #define sound_nominal_clip_dist 1000.0
 
 // during registration it is possible to have more sounds
@@ -454,6 +454,7 @@ static void S_Register_RegularCvarsAndCommands(void)
 	Cmd_AddCommand("stopsound", S_StopAllSounds_f);
 	Cmd_AddCommand("stopsound_script", S_StopSoundScript_f);
 	Cmd_AddCommand("soundlist", S_SoundList_f);
+	Cmd_AddCommand("s_mixbench", S_MixBench_f);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
 	Cmd_AddCommand("s_listdrivers", S_ListDrivers);
 
@@ -493,7 +494,6 @@ void S_Init (void)
 
 	S_Register_RegularCvarsAndCommands();
 	S_Register_LatchCvars();
-	SND_InitScaletable ();
 
 	known_sfx = Q_malloc(MAX_SFX * sizeof(sfx_t));
 	num_sfx = 0;
@@ -560,6 +560,52 @@ sfx_t *S_PrecacheSound (char *name)
 	return sfx;
 }
 
+// =======================================================================
+// Mixer command queue
+// =======================================================================
+
+/*
+channels[] belongs to the mixer, which runs in the SDL audio callback (and in
+S_Update while a movie is captured). The game thread doesn't touch it: sounds
+are loaded first and then queued here, and the mixer applies the queue before
+every mix. A slow frame or a sound coming off the disk never holds up the
+audio device that way. One producer (the game thread), one consumer (whoever
+holds the mixer lock).
+*/
+
+#define MAX_SNDCMDS 1024
+
+typedef enum {
+	SNDCMD_START,		// S_StartSound
+	SNDCMD_STOP,		// S_StopSound
+	SNDCMD_STATIC,		// S_StaticSound
+	SNDCMD_LISTENER		// S_Update, where we are and what the ambients are up to
+} sndcmdtype_t;
+
+typedef struct sndcmd_s {
+	sndcmdtype_t	type;
+	int		entnum;			// the view entity for SNDCMD_LISTENER
+	int		entchannel;
+	sfx_t		*sfx;			// already loaded
+	vec3_t		origin;
+	vec3_t		right;			// SNDCMD_LISTENER only
+	float		vol;
+	float		attenuation;
+	int		ambient_vol[NUM_AMBIENTS];	// SNDCMD_LISTENER only, -1 = off
+} sndcmd_t;
+
+static sndcmd_t		sndcmds[MAX_SNDCMDS];
+static SDL_atomic_t	sndcmd_head;		// written by the game thread
+static SDL_atomic_t	sndcmd_tail;		// written by the mixer
+
+static int		listener_entnum;	// cl.playernum + 1 as of the last S_Update
+
+// the game thread's side of the ambient channels, the fade is worked out from these
+static int		ambient_vol[NUM_AMBIENTS];
+static qbool		ambient_on;
+
+static unsigned int	num_statics;		// queued since the last S_StopAllSounds
+
 //=============================================================================
 
 // picks a channel based on priorities, empty slots, number of channels
@@ -580,7 +626,7 @@ static channel_t *SND_PickChannel (int entnum, int entchannel)
 		}
 
 		// don't let monster sounds override player sounds
-		if (channels[ch_idx].entnum == cl.playernum+1 && entnum != cl.playernum+1 && channels[ch_idx].sfx)
+		if (channels[ch_idx].entnum == listener_entnum && entnum != listener_entnum && channels[ch_idx].sfx)
 			continue;
 
 		if (channels[ch_idx].end - shw->paintedtime < life_left) {
@@ -605,7 +651,7 @@ static void SND_Spatialize (channel_t *ch)
 	vec3_t source_vec;
 
 	// anything coming from the view entity will always be full volume
-	if ((ch->entnum == cl.playernum + 1) || (ch->entnum == SELF_SOUND_ENTITY)) {
+	if ((ch->entnum == listener_entnum) || (ch->entnum == SELF_SOUND_ENTITY)) {
 		ch->leftvol = ch->master_vol;
 		ch->rightvol = ch->master_vol;
 		return;
@@ -637,51 +683,30 @@ static void SND_Spatialize (channel_t *ch)
 		ch->leftvol = 0;
 }
 
-// =======================================================================
-// Start a sound effect
-// =======================================================================
-
-void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
+static void SND_StartChannel (const sndcmd_t *cmd)
 {
 	channel_t *target_chan, *check;
-	sfxcache_t *sc;
+	sfxcache_t *sc = (sfxcache_t *) cmd->sfx->buf;
 	int ch_idx, skip;
 
-	if (!shw || !sfx || s_nosound.value)
-		return;
-
-	S_LockMixer();
-
 	// pick a channel to play on
-	target_chan = SND_PickChannel(entnum, entchannel);
-	if (!target_chan) {
-		S_UnlockMixer();
+	target_chan = SND_PickChannel(cmd->entnum, cmd->entchannel);
+	if (!target_chan)
 		return;
-	}
 
 	// spatialize
 	memset (target_chan, 0, sizeof(*target_chan));
-	VectorCopy(origin, target_chan->origin);
-	target_chan->dist_mult = attenuation / sound_nominal_clip_dist;
-	target_chan->master_vol = (int) (fvol * 255);
-	target_chan->entnum = entnum;
-	target_chan->entchannel = entchannel;
+	VectorCopy(cmd->origin, target_chan->origin);
+	target_chan->dist_mult = cmd->attenuation / sound_nominal_clip_dist;
+	target_chan->master_vol = (int) (cmd->vol * 255);
+	target_chan->entnum = cmd->entnum;
+	target_chan->entchannel = cmd->entchannel;
 	SND_Spatialize(target_chan);
 
-	if (!target_chan->leftvol && !target_chan->rightvol) {
-		S_UnlockMixer();
+	if (!target_chan->leftvol && !target_chan->rightvol)
 		return; // not audible at all
-	}
-
-	// new channel
-	sc = S_LoadSound (sfx);
-	if (!sc) {
-		target_chan->sfx = NULL;
-		S_UnlockMixer();
-		return; // couldn't load the sound's data
-	}
 
-	target_chan->sfx = sfx;
+	target_chan->sfx = cmd->sfx;
 	target_chan->pos = 0.0;
 	target_chan->end = shw->paintedtime + (int) sc->total_length;
 
@@ -691,7 +716,7 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 	for (ch_idx=NUM_AMBIENTS; ch_idx < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS; ch_idx++, check++) {
 		if (check == target_chan)
 			continue;
-		if (check->sfx == sfx && !check->pos) {
+		if (check->sfx == cmd->sfx && !check->pos) {
 			skip = rand () % (int)(0.1 * shw->khz);
 			if (skip >= target_chan->end)
 				skip = target_chan->end - 1;
@@ -700,24 +725,206 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 			break;
 		}
 	}
-	S_UnlockMixer();
 }
 
-void S_StopSound (int entnum, int entchannel)
+static void SND_StopChannel (const sndcmd_t *cmd)
 {
 	unsigned int i;
 
-	S_LockMixer();
-
 	for (i = 0; i < MAX_DYNAMIC_CHANNELS; i++) {
-		if (channels[i].entnum == entnum && channels[i].entchannel == entchannel) {
+		if (channels[i].entnum == cmd->entnum && channels[i].entchannel == cmd->entchannel) {
 			channels[i].end = 0;
 			channels[i].sfx = NULL;
-			S_UnlockMixer();
 			return;
 		}
 	}
-	S_UnlockMixer();
+}
+
+static void SND_StaticChannel (const sndcmd_t *cmd)
+{
+	channel_t *ss;
+
+	if (total_channels == MAX_CHANNELS)
+		return;
+
+	ss = &channels[total_channels];
+	total_channels++;
+
+	ss->sfx = cmd->sfx;
+	VectorCopy (cmd->origin, ss->origin);
+	ss->master_vol = (int) cmd->vol;
+	ss->dist_mult = (cmd->attenuation/64) / sound_nominal_clip_dist;
+	ss->end = shw->paintedtime + (int) ((sfxcache_t *) cmd->sfx->buf)->total_length;
+
+	SND_Spatialize (ss);
+}
+
+static void SND_SetListener (const sndcmd_t *cmd)
+{
+	channel_t *chan;
+	int i;
+
+	VectorCopy(cmd->origin, listener_origin);
+	VectorCopy(cmd->right, listener_right);
+	listener_entnum = cmd->entnum;
+
+	for (i = 0, chan = channels; i < NUM_AMBIENTS; i++, chan++) {
+		if (cmd->ambient_vol[i] < 0) {
+			chan->sfx = NULL;
+			continue;
+		}
+
+		chan->sfx = ambient_sfx[i];
+		chan->master_vol = chan->leftvol = chan->rightvol = cmd->ambient_vol[i];
+	}
+}
+
+// applies whatever the game thread has queued, with the mixer lock held
+static void S_RunSoundCommands (void)
+{
+	int tail = SDL_AtomicGet(&sndcmd_tail);
+
+	while (tail != SDL_AtomicGet(&sndcmd_head)) {
+		sndcmd_t *cmd = &sndcmds[tail];
+
+		switch (cmd->type) {
+			case SNDCMD_START:
+				SND_StartChannel(cmd);
+				break;
+			case SNDCMD_STOP:
+				SND_StopChannel(cmd);
+				break;
+			case SNDCMD_STATIC:
+				SND_StaticChannel(cmd);
+				break;
+			case SNDCMD_LISTENER:
+				SND_SetListener(cmd);
+				break;
+		}
+
+		tail = (tail + 1) % MAX_SNDCMDS;
+		SDL_AtomicSet(&sndcmd_tail, tail);
+	}
+}
+
+static void S_QueueSoundCommand (const sndcmd_t *cmd)
+{
+	int head = SDL_AtomicGet(&sndcmd_head);
+	int next = (head + 1) % MAX_SNDCMDS;
+
+	if (next == SDL_AtomicGet(&sndcmd_tail)) {
+		// the mixer hasn't run in a while (it doesn't while capturing), catch it up from here
+		S_LockMixer();
+		S_RunSoundCommands();
+		S_UnlockMixer();
+	}
+
+	sndcmds[head] = *cmd;
+	SDL_AtomicSet(&sndcmd_head, next);
+}
+
+static void S_StartCommand (sndcmd_t *cmd, int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
+{
+	cmd->type = SNDCMD_START;
+	cmd->entnum = entnum;
+	cmd->entchannel = entchannel;
+	cmd->sfx = sfx;
+	VectorCopy(origin, cmd->origin);
+	cmd->vol = fvol;
+	cmd->attenuation = attenuation;
+}
+
+// respatializes static and dynamic sounds for the listener, before each mix
+static void S_SpatializeChannels (void)
+{
+	unsigned int i, j;
+	channel_t *ch, *combine;
+
+	combine = NULL;
+
+	ch = channels + NUM_AMBIENTS;
+	for (i = NUM_AMBIENTS; i < total_channels; i++, ch++) {
+		if (!ch->sfx)
+			continue;
+		SND_Spatialize(ch); // respatialize channel
+		if (!ch->leftvol && !ch->rightvol)
+			continue;
+
+		// try to combine static sounds with a previous channel of the same
+		// sound effect so we don't mix five torches every frame
+
+		if (i >= MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS) {
+			// see if it can just use the last one
+			if (combine && combine->sfx == ch->sfx) {
+				combine->leftvol += ch->leftvol;
+				combine->rightvol += ch->rightvol;
+				ch->leftvol = ch->rightvol = 0;
+				continue;
+			}
+			// search for one
+			combine = channels+MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;
+			for (j = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS; j < i; j++, combine++)
+				if (combine->sfx == ch->sfx)
+					break;
+
+			if (j == total_channels) {
+				combine = NULL;
+			} else {
+				if (combine != ch) {
+					combine->leftvol += ch->leftvol;
+					combine->rightvol += ch->rightvol;
+					ch->leftvol = ch->rightvol = 0;
+				}
+				continue;
+			}
+		}
+	}
+}
+
+// =======================================================================
+// Start a sound effect
+// =======================================================================
+
+// with s_silent_racing only the player you are or are tracking is heard in a race
+static qbool S_RacingMuted (int entnum)
+{
+	if (!cl.racing || !s_silent_racing.integer || entnum <= 0 || entnum > MAX_CLIENTS)
+		return false;
+
+	if (cl.spectator)
+		return Cam_TrackNum() < 0 || entnum - 1 != Cam_TrackNum();
+
+	return entnum - 1 != cl.playernum;
+}
+
+void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
+{
+	sndcmd_t cmd;
+
+	if (!shw || !sfx || s_nosound.value)
+		return;
+
+	if (S_RacingMuted(entnum))
+		return;
+
+	if (!S_LoadSound (sfx))
+		return; // couldn't load the sound's data
+
+	S_StartCommand(&cmd, entnum, entchannel, sfx, origin, fvol, attenuation);
+	S_QueueSoundCommand(&cmd);
+}
+
+void S_StopSound (int entnum, int entchannel)
+{
+	sndcmd_t cmd;
+
+	if (!shw)
+		return;
+
+	cmd.type = SNDCMD_STOP;
+	cmd.entnum = entnum;
+	cmd.entchannel = entchannel;
+	S_QueueSoundCommand(&cmd);
 }
 
 static void S_StopSoundScript_f(void) {
@@ -729,15 +936,21 @@ void S_StopAllSounds(void)
 	if (!shw)
 		return;
 
-	total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS; // no statics
-
 	S_LockMixer();
 
+	// whatever is still queued was for the sounds going away
+	SDL_AtomicSet(&sndcmd_tail, SDL_AtomicGet(&sndcmd_head));
+
+	total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS; // no statics
+
 	memset(channels, 0, MAX_CHANNELS * sizeof(channel_t));
 
 	shw->numwraps = shw->oldsamplepos = shw->paintedtime = shw->samplepos = shw->snd_sent = 0;
 
 	S_UnlockMixer();
+
+	num_statics = 0;
+	memset(ambient_vol, 0, sizeof(ambient_vol));
 }
 
 static void S_StopAllSounds_f(void)
@@ -747,55 +960,44 @@ static void S_StopAllSounds_f(void)
 
 void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 {
-	channel_t *ss;
+	sndcmd_t cmd;
 	sfxcache_t *sc;
 
 	if (!shw || !sfx || s_nosound.value)
 		return;
 
-	S_LockMixer();
-
-	if (total_channels == MAX_CHANNELS) {
+	if (MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS + num_statics == MAX_CHANNELS) {
 		Com_Printf ("total_channels == MAX_CHANNELS\n");
-		S_UnlockMixer();
 		return;
 	}
 
-	ss = &channels[total_channels];
-	total_channels++;
+	num_statics++;
 
 	sc = S_LoadSound (sfx);
-	if (!sc) {
-		S_UnlockMixer();
+	if (!sc)
 		return;
-	}
 
 	if (sc->loopstart == -1) {
 		Com_Printf ("Sound %s not looped\n", sfx->name);
-		S_UnlockMixer();
 		return;
 	}
 
-	ss->sfx = sfx;
-	VectorCopy (origin, ss->origin);
-	ss->master_vol = (int) vol;
-	ss->dist_mult = (attenuation/64) / sound_nominal_clip_dist;
-	ss->end = shw->paintedtime + (int) sc->total_length;
-
-	SND_Spatialize (ss);
-
-	S_UnlockMixer();
+	cmd.type = SNDCMD_STATIC;
+	cmd.sfx = sfx;
+	VectorCopy (origin, cmd.origin);
+	cmd.vol = vol;
+	cmd.attenuation = attenuation;
+	S_QueueSoundCommand(&cmd);
 }
 
 //=============================================================================
 
-static void S_UpdateAmbientSounds (void)
+static void S_UpdateAmbientSounds (vec3_t origin)
 {
 	static double last_adjusted = 0;
 	struct cleaf_s *leaf;
 	int vol;
 	int ambient_channel;
-	channel_t *chan;
 	double frametime = (last_adjusted ? cls.realtime - last_adjusted : cls.frametime);
 	int adjustment = Q_rint (frametime * s_ambientfade.value);
 
@@ -804,10 +1006,9 @@ static void S_UpdateAmbientSounds (void)
 		return;
 	}
 
-	leaf = CM_PointInLeaf (listener_origin);
+	leaf = CM_PointInLeaf (origin);
 	if (!CM_Leafnum(leaf) || !s_ambientlevel.value) {
-		for (ambient_channel = 0 ; ambient_channel< NUM_AMBIENTS ; ambient_channel++)
-			channels[ambient_channel].sfx = NULL;
+		ambient_on = false;
 		last_adjusted = cls.realtime;
 		return;
 	}
@@ -817,98 +1018,62 @@ static void S_UpdateAmbientSounds (void)
 	}
 
 	last_adjusted = cls.realtime;
+	ambient_on = true;
 
 	for (ambient_channel = 0 ; ambient_channel< NUM_AMBIENTS ; ambient_channel++) {
-		chan = &channels[ambient_channel];
-		chan->sfx = ambient_sfx[ambient_channel];
+		if (ambient_sfx[ambient_channel])
+			S_LoadSound (ambient_sfx[ambient_channel]);
 
 		vol = (int) (s_ambientlevel.value * CM_LeafAmbientLevel(leaf, ambient_channel));
 		if (vol < 8)
 			vol = 0;
 
 		// don't adjust volume too fast
-		if (chan->master_vol < vol) {
-			chan->master_vol += adjustment;
-			if (chan->master_vol > vol)
-				chan->master_vol = vol;
-		} else if (chan->master_vol > vol) {
-			chan->master_vol -= adjustment;
-			if (chan->master_vol < vol)
-				chan->master_vol = vol;
+		if (ambient_vol[ambient_channel] < vol) {
+			ambient_vol[ambient_channel] += adjustment;
+			if (ambient_vol[ambient_channel] > vol)
+				ambient_vol[ambient_channel] = vol;
+		} else if (ambient_vol[ambient_channel] > vol) {
+			ambient_vol[ambient_channel] -= adjustment;
+			if (ambient_vol[ambient_channel] < vol)
+				ambient_vol[ambient_channel] = vol;
 		}
-
-		chan->leftvol = chan->rightvol = chan->master_vol;
 	}
 }
 
 //Called once each time through the main loop
 void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 {
-	unsigned int i, j, total;
+	unsigned int i, total;
 	static unsigned int printed_total = 0;
-	channel_t *ch, *combine;
+	channel_t *ch;
+	sndcmd_t cmd;
 
 	if (!snd_initialized || !snd_started || !shw)
 		return;
 
-	S_LockMixer();
-
-	VectorCopy(origin, listener_origin);
-	VectorCopy(forward, listener_forward);
-	VectorCopy(right, listener_right);
-	VectorCopy(up, listener_up);
-
 	// update general area ambient sound sources
-	S_UpdateAmbientSounds ();
-
-	combine = NULL;
-
-	// update spatialization for static and dynamic sounds
-	ch = channels + NUM_AMBIENTS;
-	for (i = NUM_AMBIENTS; i < total_channels; i++, ch++) {
-		if (!ch->sfx)
-			continue;
-		SND_Spatialize(ch); // respatialize channel
-		if (!ch->leftvol && !ch->rightvol)
-			continue;
-
-		// try to combine static sounds with a previous channel of the same
-		// sound effect so we don't mix five torches every frame
-
-		if (i >= MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS) {
-			// see if it can just use the last one
-			if (combine && combine->sfx == ch->sfx) {
-				combine->leftvol += ch->leftvol;
-				combine->rightvol += ch->rightvol;
-				ch->leftvol = ch->rightvol = 0;
-				continue;
-			}
-			// search for one
-			combine = channels+MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;
-			for (j = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS; j < i; j++, combine++)
-				if (combine->sfx == ch->sfx)
-					break;
-
-			if (j == total_channels) {
-				combine = NULL;
-			} else {
-				if (combine != ch) {
-					combine->leftvol += ch->leftvol;
-					combine->rightvol += ch->rightvol;
-					ch->leftvol = ch->rightvol = 0;
-				}
-				continue;
-			}
-		}
-	}
+	S_UpdateAmbientSounds (origin);
+
+	// the mixer respatializes everything for this before its next mix
+	cmd.type = SNDCMD_LISTENER;
+	cmd.entnum = cl.playernum + 1;
+	VectorCopy(origin, cmd.origin);
+	VectorCopy(origin, game_listener_origin);
+	VectorCopy(right, cmd.right);
+	for (i = 0; i < NUM_AMBIENTS; i++)
+		cmd.ambient_vol[i] = ambient_on ? ambient_vol[i] : -1;
+	S_QueueSoundCommand(&cmd);
 
 	sound_spatialized = true;
 
 	// debugging output
 	if (s_show.value) {
 		total = 0;
-		ch = channels;
 
+		S_LockMixer();
+
+		ch = channels;
 		for (i = 0; i < total_channels; i++, ch++)
 			if (ch->sfx && (ch->leftvol || ch->rightvol)) {
 				if ((cl.standby || cls.demoplayback) && s_show.value == 2)
@@ -916,6 +1081,8 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 				total++;
 			}
 
+		S_UnlockMixer();
+
 		Print_flags[Print_current] |= PR_TR_SKIP;
 		
 		if (total != printed_total) { // This if statement is needed so we don't get spammed by the message
@@ -925,10 +1092,10 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	}
 
 	if (Movie_IsCapturing()) {
+		S_LockMixer();
 		Movie_MixFrameSound(S_Update_);
+		S_UnlockMixer();
 	}
-
-	S_UnlockMixer();
 }
 
 static void GetSoundtime(void)
@@ -960,6 +1127,10 @@ static void S_Update_(void)
 		return;
 	}
 
+	// catch up with the game thread first
+	S_RunSoundCommands();
+	S_SpatializeChannels();
+
 	// Updates soundtime
 	GetSoundtime();
 
@@ -1002,7 +1173,7 @@ static void S_Play_f (void)
 			continue;
 		}
 
-		VectorCopy(listener_origin, sound_origin);
+		VectorCopy(game_listener_origin, sound_origin);
 		COM_DefaultExtension (name, ".wav", sizeof(name));
 		sfx = S_PrecacheSound(name);
 		if (playvol)
@@ -1065,6 +1236,119 @@ static void S_SoundList_f (void)
 	S_UnlockMixer();
 }
 
+// a busy 4on4 for s_mixbench: weapon, hit and movement sounds on every dynamic
+// channel, started again as they end, over a map's worth of looped static sounds
+static char *mixbench_sounds[] = {
+	"weapons/rocket1i.wav", "weapons/r_exp3.wav", "weapons/sgun1.wav", "weapons/guncock.wav",
+	"weapons/spike2.wav", "weapons/lhit.wav", "weapons/lstart.wav", "weapons/grenade.wav",
+	"weapons/bounce.wav", "weapons/tink1.wav", "player/plyrjmp8.wav", "player/land.wav",
+	"player/pain2.wav", "player/udeath.wav", "items/damage3.wav", "items/r_item2.wav"
+};
+static char *mixbench_loops[] = {
+	"ambience/fire1.wav", "ambience/buzz1.wav", "ambience/hum1.wav", "ambience/drip1.wav"
+};
+#define MIXBENCH_STATICS	48
+#define MIXBENCH_SAMPLES	16384
+
+static void S_MixBench_f (void)
+{
+	static channel_t saved_channels[MAX_CHANNELS];
+	sfx_t *sounds[sizeof(mixbench_sounds) / sizeof(mixbench_sounds[0])];
+	sfx_t *loops[sizeof(mixbench_loops) / sizeof(mixbench_loops[0])];
+	int numsounds = 0, numloops = 0, numstatics, seconds, chunk, endtime;
+	unsigned int i, saved_total;
+	soundhw_t *saved_shw, bench;
+	double start, elapsed = 0;
+	sfxcache_t *sc;
+	channel_t *ch;
+	sfx_t *sfx;
+
+	if (!shw) {
+		Com_Printf ("sound system not started\n");
+		return;
+	}
+
+	if (Movie_IsCapturing()) {
+		Com_Printf ("s_mixbench: not while capturing\n");
+		return;
+	}
+
+	seconds = Cmd_Argc() > 1 ? bound(1, atoi(Cmd_Argv(1)), 600) : 10;
+
+	for (i = 0; i < sizeof(mixbench_sounds) / sizeof(mixbench_sounds[0]); i++) {
+		if ((sfx = S_PrecacheSound (mixbench_sounds[i])) && S_LoadSound (sfx))
+			sounds[numsounds++] = sfx;
+	}
+	for (i = 0; i < sizeof(mixbench_loops) / sizeof(mixbench_loops[0]); i++) {
+		if ((sfx = S_PrecacheSound (mixbench_loops[i])) && (sc = S_LoadSound (sfx)) && sc->loopstart >= 0)
+			loops[numloops++] = sfx;
+	}
+
+	if (!numsounds) {
+		Com_Printf ("s_mixbench: couldn't load any of the sounds\n");
+		return;
+	}
+
+	S_LockMixer();
+	S_RunSoundCommands();
+
+	// mix into a buffer of our own, with the game's channels put aside
+	memcpy (saved_channels, channels, sizeof(saved_channels));
+	saved_total = total_channels;
+	saved_shw = shw;
+
+	bench = *shw;
+	bench.numchannels = 2;
+	bench.samplebits = 16;
+	bench.samples = MIXBENCH_SAMPLES;
+	bench.buffer = Q_malloc (MIXBENCH_SAMPLES * sizeof(short));
+	bench.paintedtime = 0;
+	shw = &bench;
+
+	memset (channels, 0, sizeof(channels));
+	total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;
+	for (i = 0; i < MIXBENCH_STATICS && numloops; i++) {
+		ch = &channels[total_channels++];
+		ch->sfx = loops[i % numloops];
+		ch->end = ((sfxcache_t *) ch->sfx->buf)->total_length;
+		ch->leftvol = 16 + rand() % 96;
+		ch->rightvol = 16 + rand() % 96;
+	}
+
+	// 10 ms at a time, about what a client asks for between frames
+	chunk = max(1, bench.khz / 100);
+	endtime = seconds * bench.khz;
+
+	while (bench.paintedtime < endtime) {
+		for (i = NUM_AMBIENTS, ch = channels + NUM_AMBIENTS; i < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS; i++, ch++) {
+			if (!ch->sfx) {
+				ch->sfx = sounds[rand() % numsounds];
+				ch->pos = 0;
+				ch->end = bench.paintedtime + ((sfxcache_t *) ch->sfx->buf)->total_length;
+				ch->leftvol = 32 + rand() % 224;
+				ch->rightvol = 32 + rand() % 224;
+			}
+		}
+
+		start = Sys_DoubleTime();
+		S_PaintChannels (min(bench.paintedtime + chunk, endtime));
+		elapsed += Sys_DoubleTime() - start;
+	}
+
+	numstatics = total_channels - (MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS);
+
+	Q_free (bench.buffer);
+	shw = saved_shw;
+	memcpy (channels, saved_channels, sizeof(saved_channels));
+	total_channels = saved_total;
+
+	S_UnlockMixer();
+
+	Com_Printf ("mixed %i s at %i Hz, %i dynamic + %i static channels (%i sounds, %i loops): %.1f ms, %.0fx realtime\n",
+		seconds, bench.khz, MAX_DYNAMIC_CHANNELS, numstatics, numsounds, numloops,
+		elapsed * 1000, elapsed > 0 ? seconds / elapsed : 0);
+}
+
 void S_LocalSound (char *sound)
 {
 	sfx_t *sfx;
@@ -1204,6 +1488,7 @@ void S_RawAudio(int sourceid, byte *data, unsigned int speed, unsigned int sampl
 	streaming_t *	s;
 
 	S_LockMixer();
+	S_RunSoundCommands();
 
 	// search for free slot or re-use previous one with the same sourceid.
 	s = S_RawGetFreeStream(sourceid);
@@ -1374,8 +1659,12 @@ void S_RawAudio(int sourceid, byte *data, unsigned int speed, unsigned int sampl
 	}
 
 	//this one wasn't playing, lets start it then.
-	if (i == total_channels) {
-		S_StartSound(SELF_SOUND_ENTITY, 0, &s->sfx, r_origin, s_raw_volume.value, 0);
+	if (i == total_channels && !s_nosound.value) {
+		// we hold the mixer already, start it now so the next call finds it playing
+		sndcmd_t cmd;
+
+		S_StartCommand(&cmd, SELF_SOUND_ENTITY, 0, &s->sfx, r_origin, s_raw_volume.value, 0);
+		SND_StartChannel(&cmd);
 	}
 
 	S_UnlockMixer();
@@ -601,7 +601,7 @@ typedef struct sfviodata_s {
 	char *path;
 	int filesize;
 	int position;
-	unsigned char *data;
+	const unsigned char *data;
 } sfviodata_t;
 
 sf_count_t SFVIO_GetFilelen(void *user_data)
@@ -728,8 +728,7 @@ static qbool S_FindCuePointSampleLength(SNDFILE* sndfile, int cue_point_id, int*
 sfxcache_t *S_LoadSound (sfx_t *s)
 {
 	char namebuffer[256];
-	unsigned char *data;
-	int filesize;
+	fs_mappedfile_t file;
 	SF_VIRTUAL_IO sfvio;
 	SF_INFO sfinfo;
 	sfviodata_t sfviodata;
@@ -746,12 +745,12 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	// load it in
 	snprintf(namebuffer, sizeof(namebuffer), "sound/%s", s->name);
 
-	if (!(data = FS_LoadTempFile(namebuffer, &filesize))) {
+	if (!FS_MapFile(namebuffer, &file)) {
 		Com_Printf ("Couldn't load %s\n", namebuffer);
 		return NULL;
 	}
 
-	FMod_CheckModel(namebuffer, data, filesize);
+	FMod_CheckModel(namebuffer, file.data, file.len);
 
 	sfvio.get_filelen = SFVIO_GetFilelen;
 	sfvio.seek = SFVIO_Seek;
@@ -762,8 +761,8 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 	sfviodata.path = namebuffer;
 	sfviodata.position = 0;
-	sfviodata.data = data;
-	sfviodata.filesize = filesize;
+	sfviodata.data = file.data;
+	sfviodata.filesize = file.len;
 
 	sndfile = sf_open_virtual(&sfvio, SFM_READ, &sfinfo, &sfviodata);
 
@@ -788,6 +787,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	}
 
 	sf_close(sndfile);
+	FS_UnmapFile(&file);
 
 	if (sfinfo.channels < 1 || sfinfo.channels > 2) {
 		Com_Printf("%s has an unsupported number of channels (%i)\n", s->name, sfinfo.channels);
@@ -995,6 +995,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	// load it in
 	snprintf(namebuffer, sizeof(namebuffer), "sound/%s", s->name);
 
+	// the samples are biased/swapped in place below, so this needs a private copy
 	if (!(data = FS_LoadTempFile(namebuffer, &filesize))) {
 		Com_Printf ("Couldn't load %s\n", namebuffer);
 		return NULL;
@@ -25,51 +25,88 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qsound.h"
 #include "movie.h" // /demo_capture
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SND_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SND_NEON
+#endif
+
 
 #define PAINTBUFFER_SIZE 512
-typedef struct portable_samplepair_s {
-	int left;
-	int right;
-} portable_samplepair_t;
-portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
-int snd_scaletable[32][256];
-int snd_vol, *snd_p;
+
+// interleaved left/right, in 16 bit sample units
+static float paintbuffer[PAINTBUFFER_SIZE * 2];
+
+// channels that will be heard this S_PaintChannels call
+typedef struct mixchannel_s {
+	channel_t	*ch;
+	sfxcache_t	*sc;
+} mixchannel_t;
+
+static mixchannel_t mixchannels[MAX_CHANNELS];
 
 static int snd_linear_count;
 static short *snd_out;
 
-static void Snd_WriteLinearBlastStereo16 (int* input_buffer, short* output_buffer, int snd_vol)
+static int Snd_ClipSample (float f)
 {
-	int val, i;
-
-	for (i = 0; i < snd_linear_count; i += 2) {
-		val = (input_buffer[i]*snd_vol)>>8;
-		output_buffer[i] = bound (-32768, val, 32767);
-		val = (input_buffer[i+1]*snd_vol)>>8;
-		output_buffer[i+1] = bound (-32768, val, 32767);
-	}
+	return (int) bound(-32768.0f, f, 32767.0f);
 }
 
-static void Snd_WriteLinearBlastStereo16_SwapStereo (int* input_buffer, short* output_buffer, int snd_vol)
+// scales, clamps and truncates count floats from in to out, swapping every pair if swap is set
+static void Snd_WriteLinearBlastStereo16 (const float *in, short *out, int count, float vol, qbool swap)
 {
-	int val, i;
+	int i = 0, val;
+#if defined(SND_SSE2)
+	__m128 scale = _mm_set1_ps(vol);
+	__m128 lo = _mm_set1_ps(-32768), hi = _mm_set1_ps(32767);
+
+	for (; i + 8 <= count; i += 8) {
+		// clamp before converting, out of range floats become INT_MIN
+		__m128 a = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), hi), lo);
+		__m128 b = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), hi), lo);
+
+		if (swap) {
+			a = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+			b = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+		}
 
-	for (i = 0; i < snd_linear_count; i +=2 ) {
-		val = (input_buffer[i+1]*snd_vol)>>8;
-		output_buffer[i] = bound (-32768, val, 32767);
-		val = (input_buffer[i]*snd_vol)>>8;
-		output_buffer[i+1] = bound (-32768, val, 32767);
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+	}
+#elif defined(SND_NEON)
+	float32x4_t scale = vdupq_n_f32(vol);
+
+	for (; i + 8 <= count; i += 8) {
+		float32x4_t a = vmulq_f32(vld1q_f32(in + i), scale);
+		float32x4_t b = vmulq_f32(vld1q_f32(in + i + 4), scale);
+
+		if (swap) {
+			a = vrev64q_f32(a);
+			b = vrev64q_f32(b);
+		}
+
+		// vcvt saturates to the int range, vqmovn to the 16 bit range
+		vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))));
+	}
+#endif
+
+	for (; i < count; i += 2) {
+		val = Snd_ClipSample(in[i + swap] * vol);
+		out[i] = val;
+		val = Snd_ClipSample(in[i + !swap] * vol);
+		out[i + 1] = val;
 	}
 }
 
 static void S_TransferStereo16 (int endtime)
 {
-	int lpaintedtime, lpos, clientVolume;
+	int lpaintedtime, lpos;
+	float vol = s_volume.value * S_VoipVoiceTransmitVolume();
+	float *p = paintbuffer;
 	DWORD *pbuf;
 
-	clientVolume = snd_vol = (s_volume.value * S_VoipVoiceTransmitVolume()) * 256;
-
-	snd_p = (int *) paintbuffer;
 	lpaintedtime = shw->paintedtime;
 
 	pbuf = (DWORD *)shw->buffer;
@@ -86,16 +123,13 @@ static void S_TransferStereo16 (int endtime)
 		snd_linear_count <<= 1;
 
 		// write a linear blast of samples
-		if (s_swapstereo.value)
-			Snd_WriteLinearBlastStereo16_SwapStereo (snd_p, snd_out, clientVolume);
-		else
-			Snd_WriteLinearBlastStereo16 (snd_p, snd_out, clientVolume);
+		Snd_WriteLinearBlastStereo16 (p, snd_out, snd_linear_count, vol, s_swapstereo.value != 0);
 
 		if (Movie_IsCapturing()) {
 			Movie_TransferSound (snd_out, snd_linear_count);
 		}
 
-		snd_p += snd_linear_count;
+		p += snd_linear_count;
 		lpaintedtime += (snd_linear_count>>1);
 	}
 }
@@ -103,49 +137,41 @@ static void S_TransferStereo16 (int endtime)
 static void S_TransferPaintBuffer(int endtime)
 {
 	DWORD *pbuf;
-	int *p;
+	float *p;
 	int out_idx;
 	int out_mask;
 	int count;
 	int step;
 	int val;
-	int snd_vol;
+	float vol;
 
 	if (shw->samplebits == 16 && shw->numchannels == 2) {
 		S_TransferStereo16(endtime);
 		return;
 	}
 
-	p = (int *) paintbuffer;
+	p = paintbuffer;
 	count = (endtime - shw->paintedtime) * shw->numchannels;
 	out_mask = shw->samples - 1;
 	out_idx = shw->paintedtime * shw->numchannels & out_mask;
 	step = 3 - shw->numchannels;
-	snd_vol = (s_volume.value * S_VoipVoiceTransmitVolume()) * 256;
+	vol = s_volume.value * S_VoipVoiceTransmitVolume();
 
 	pbuf = (DWORD *)shw->buffer;
 
 	if (shw->samplebits == 16) {
 		short *out = (short *) pbuf;
 		while (count--) {
-			val = (*p * snd_vol) >> 8;
+			val = Snd_ClipSample(*p * vol);
 			p+= step;
-			if (val > 0x7fff)
-				val = 0x7fff;
-			else if (val < (int)0x8000)
-				val = (int)0x8000;
 			out[out_idx] = val;
 			out_idx = (out_idx + 1) & out_mask;
 		}
 	} else if (shw->samplebits == 8) {
 		unsigned char *out = (unsigned char *) pbuf;
 		while (count--) {
-			val = (*p * snd_vol) >> 8;
+			val = Snd_ClipSample(*p * vol);
 			p+= step;
-			if (val > 0x7fff)
-				val = 0x7fff;
-			else if (val < (int)0x8000)
-				val = (int)0x8000;
 			out[out_idx] = (val>>8) + 128;
 			out_idx = (out_idx + 1) & out_mask;
 		}
@@ -159,66 +185,126 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count)
+// channel volumes are 0-255, where 256 would be full scale
+
+// 8 bit samples are mixed as 16 bit ones, scaled by 256
+static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, float *paint, int count)
 {
-	int data, i;
-	int *lscale, *rscale;
-	unsigned char *sfx;
-
-	if (ch->leftvol > 255)
-		ch->leftvol = 255;
-	if (ch->rightvol > 255)
-		ch->rightvol = 255;
-
-	lscale = snd_scaletable[ch->leftvol >> 3];
-	rscale = snd_scaletable[ch->rightvol >> 3];
-	sfx = (unsigned char *) ((signed char *)sc->data + ch->pos);
-
-	for (i = 0; i < count ;i++) {
-		data = sfx[i];
-		paintbuffer[i].left += lscale[data];
-		paintbuffer[i].right += rscale[data];
+	float lvol = min(ch->leftvol, 255) / 256.0f, rvol = min(ch->rightvol, 255) / 256.0f;
+	signed char *sfx = (signed char *)sc->data + ch->pos;
+	int i = 0;
+#if defined(SND_SSE2)
+	__m128 gain = _mm_setr_ps(lvol, rvol, lvol, rvol);
+	__m128i zero = _mm_setzero_si128();
+
+	for (; i + 4 <= count; i += 4, paint += 8) {
+		int packed;
+		__m128i data;
+		__m128 f;
+
+		memcpy(&packed, sfx + i, sizeof(packed));
+		// bytes into the high half of each word is the sample times 256
+		data = _mm_unpacklo_epi8(zero, _mm_cvtsi32_si128(packed));
+		f = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(data, data), 16));
+
+		_mm_storeu_ps(paint, _mm_add_ps(_mm_loadu_ps(paint), _mm_mul_ps(_mm_unpacklo_ps(f, f), gain)));
+		_mm_storeu_ps(paint + 4, _mm_add_ps(_mm_loadu_ps(paint + 4), _mm_mul_ps(_mm_unpackhi_ps(f, f), gain)));
+	}
+#elif defined(SND_NEON)
+	float gains[4] = { lvol, rvol, lvol, rvol };
+	float32x4_t gain = vld1q_f32(gains);
+
+	for (; i + 8 <= count; i += 8, paint += 16) {
+		int16x8_t data = vshlq_n_s16(vmovl_s8(vld1_s8(sfx + i)), 8);
+		float32x4x2_t lo = vzipq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(data))), vcvtq_f32_s32(vmovl_s16(vget_low_s16(data))));
+		float32x4x2_t hi = vzipq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(data))), vcvtq_f32_s32(vmovl_s16(vget_high_s16(data))));
+
+		vst1q_f32(paint, vmlaq_f32(vld1q_f32(paint), lo.val[0], gain));
+		vst1q_f32(paint + 4, vmlaq_f32(vld1q_f32(paint + 4), lo.val[1], gain));
+		vst1q_f32(paint + 8, vmlaq_f32(vld1q_f32(paint + 8), hi.val[0], gain));
+		vst1q_f32(paint + 12, vmlaq_f32(vld1q_f32(paint + 12), hi.val[1], gain));
+	}
+#endif
+
+	for (; i < count; i++, paint += 2) {
+		float data = sfx[i] * 256;
+
+		paint[0] += data * lvol;
+		paint[1] += data * rvol;
 	}
 
 	ch->pos += count;
 }
 
-static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count)
+static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, float *paint, int count)
 {
-	int data, left, right, leftvol, rightvol, i;
-	signed short *sfx;
-
-	leftvol = ch->leftvol;
-	rightvol = ch->rightvol;
-	sfx = (signed short *)sc->data + ch->pos;
-
-	for (i = 0; i < count ;i++) {
-		data = sfx[i];
-		left = (data * leftvol) >> 8;
-		right = (data * rightvol) >> 8;
-		paintbuffer[i].left += left;
-		paintbuffer[i].right += right;
+	float lvol = ch->leftvol / 256.0f, rvol = ch->rightvol / 256.0f;
+	signed short *sfx = (signed short *)sc->data + ch->pos;
+	int i = 0;
+#if defined(SND_SSE2)
+	__m128 gain = _mm_setr_ps(lvol, rvol, lvol, rvol);
+
+	for (; i + 4 <= count; i += 4, paint += 8) {
+		__m128i data = _mm_loadl_epi64((const __m128i *)(sfx + i));
+		__m128 f = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(data, data), 16));
+
+		_mm_storeu_ps(paint, _mm_add_ps(_mm_loadu_ps(paint), _mm_mul_ps(_mm_unpacklo_ps(f, f), gain)));
+		_mm_storeu_ps(paint + 4, _mm_add_ps(_mm_loadu_ps(paint + 4), _mm_mul_ps(_mm_unpackhi_ps(f, f), gain)));
+	}
+#elif defined(SND_NEON)
+	float gains[4] = { lvol, rvol, lvol, rvol };
+	float32x4_t gain = vld1q_f32(gains);
+
+	for (; i + 4 <= count; i += 4, paint += 8) {
+		float32x4_t f = vcvtq_f32_s32(vmovl_s16(vld1_s16(sfx + i)));
+		float32x4x2_t pairs = vzipq_f32(f, f);
+
+		vst1q_f32(paint, vmlaq_f32(vld1q_f32(paint), pairs.val[0], gain));
+		vst1q_f32(paint + 4, vmlaq_f32(vld1q_f32(paint + 4), pairs.val[1], gain));
+	}
+#endif
+
+	for (; i < count; i++, paint += 2) {
+		paint[0] += sfx[i] * lvol;
+		paint[1] += sfx[i] * rvol;
 	}
 
 	ch->pos += count;
 }
 
-void SND_InitScaletable (void)
+// collects the channels with something to play, so the chunks below don't have to
+// look at every static sound again
+static int S_GatherMixChannels (void)
 {
-	int i, j;
+	int count = 0;
+	unsigned int i;
+	sfxcache_t *sc;
+	channel_t *ch;
 
-	for (i = 0 ; i < 32; i++)
-		for (j = 0; j < 256; j++)
-			snd_scaletable[i][j] = ((j < 128) ? j : j - 0xff) * i * 8;
+	for (i = 0, ch = channels; i < total_channels; i++, ch++) {
+		if (!ch->sfx)
+			continue;
+		if (!ch->leftvol && !ch->rightvol)
+			continue;
+		if (!(sc = (sfxcache_t *) ch->sfx->buf))
+			continue; // the game thread loads sounds before it queues them, the mixer never does
+
+		mixchannels[count].ch = ch;
+		mixchannels[count].sc = sc;
+		count++;
+	}
+
+	return count;
 }
 
 void S_PaintChannels(int endtime)
 {
-	int ltime, count, end;
-	unsigned int i;
+	int ltime, count, end, nummix, i;
+	mixchannel_t *mix;
 	sfxcache_t *sc;
 	channel_t *ch;
-	extern cvar_t s_silent_racing;
+
+	nummix = S_GatherMixChannels ();
 
 	while (shw->paintedtime < endtime) {
 		// if paintbuffer is smaller than DMA buffer
@@ -227,34 +313,14 @@ void S_PaintChannels(int endtime)
 			end = shw->paintedtime + PAINTBUFFER_SIZE;
 
 		// clear the paint buffer
-		memset (paintbuffer, 0, (end - shw->paintedtime) * sizeof(portable_samplepair_t));
+		memset (paintbuffer, 0, (end - shw->paintedtime) * 2 * sizeof(float));
 
 		// paint in the channels.
-		ch = channels;
-		for (i = 0; i < total_channels; i++, ch++) {
+		for (i = 0, mix = mixchannels; i < nummix; i++, mix++) {
+			ch = mix->ch;
+			sc = mix->sc;
 			if (!ch->sfx)
-				continue;
-			if (!ch->leftvol && !ch->rightvol)
-				continue;
-			if (cl.racing && s_silent_racing.integer && ch->entnum > 0 && ch->entnum <= MAX_CLIENTS) {
-				if (cl.spectator) {
-					if (Cam_TrackNum() < 0) {
-						// silence all racers
-						continue;
-					}
-					else if (ch->entnum - 1 != Cam_TrackNum()) {
-						// not the tracked player
-						continue;
-					}
-				}
-				else if (ch->entnum - 1 != cl.playernum) {
-					// a different player
-					continue;
-				}
-			}
-			sc = S_LoadSound (ch->sfx);
-			if (!sc)
-				continue;
+				continue; // stopped in an earlier chunk
 
 			ltime = shw->paintedtime;
 
@@ -262,10 +328,12 @@ void S_PaintChannels(int endtime)
 				count = (ch->end < end) ? (ch->end - ltime) : (end - ltime);
 
 				if (count > 0) {
+					float *paint = paintbuffer + (ltime - shw->paintedtime) * 2;
+
 					if (sc->format.width == 1)
-						SND_PaintChannelFrom8(ch, sc, count);
+						SND_PaintChannelFrom8(ch, sc, paint, count);
 					else
-						SND_PaintChannelFrom16(ch, sc, count);
+						SND_PaintChannelFrom16(ch, sc, paint, count);
 
 					ltime += count;
 				}
@@ -1054,7 +1054,6 @@ void SV_Mute_f (void)
 
 void SV_RemovePenalty_f (void)
 {
-	int     i;
 	int     num;
 	extern int numpenfilters;
 
@@ -1066,14 +1065,11 @@ void SV_RemovePenalty_f (void)
 
 	num = Q_atoi(Cmd_Argv(1));
 
-	for (i = 0; i < numpenfilters; i++)
+	if (num >= 0 && num < numpenfilters)
 	{
-		if (i == num)
-		{
-			SV_RemoveIPFilter (i);
-			Con_Printf ("Removed.\n");
-			return;
-		}
+		SV_RemoveIPFilter (num);
+		Con_Printf ("Removed.\n");
+		return;
 	}
 	Con_Printf ("Didn't find penalty filter %i.\n", num);
 }
@@ -1084,7 +1080,7 @@ void SV_ListPenalty_f (void)
 	int     i;
 	char		s[8];
 	extern int numpenfilters;
-	extern penfilter_t penfilters[MAX_PENFILTERS];
+	extern penfilter_t **penfilters;
 
 	Con_Printf ("Active Penalty List:\n");
 	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
@@ -1105,18 +1101,18 @@ void SV_ListPenalty_f (void)
 	Con_Printf ("Saved Penalty List:\n");
 	for (i = 0; i < numpenfilters; i++)
 	{
-		switch (penfilters[i].type)
+		switch (penfilters[i]->type)
 		{
 		case ft_mute: strlcpy(s, "Mute", sizeof(s)); break;
 		case ft_cuff: strlcpy(s, "Cuff", sizeof(s)); break;
 		default: strlcpy(s, "Unknown", sizeof(s)); break;
 		}
 		Con_Printf ("%i: %s for %i.%i.%i.%i (remaining: %d)\n", i, s,
-		            penfilters[i].ip[0],
-		            penfilters[i].ip[1],
-		            penfilters[i].ip[2],
-		            penfilters[i].ip[3],
-		            (penfilters[i].time) ? (int)(penfilters[i].time - realtime) : 0);
+		            penfilters[i]->ip[0],
+		            penfilters[i]->ip[1],
+		            penfilters[i]->ip[2],
+		            penfilters[i]->ip[3],
+		            (penfilters[i]->time) ? (int)(penfilters[i]->time - realtime) : 0);
 	}
 }
 //<-
@@ -25,9 +25,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // minimal cache which can be used for demos, must be few times greater than DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS
 #define DEMO_CACHE_MIN_SIZE 0x1000000
 
-// flush demo cache if we have less than this free bytes
-#define DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS	65536
-
 
 static void sv_demoDir_OnChange(cvar_t *cvar, char *value, qbool *cancel);
 
@@ -42,6 +39,9 @@ cvar_t  sv_demoIdlefps      = {"sv_demoIdlefps",    "10"};
 cvar_t  sv_demoPings        = {"sv_demopings",      "3"};
 cvar_t  sv_demoMaxSize      = {"sv_demoMaxSize",    "20480"};
 cvar_t  sv_demoExtraNames   = {"sv_demoExtraNames", "0"};
+cvar_t  sv_demoCompress     = {"sv_demoCompress",   "0"};
+cvar_t  sv_demoCompressLevel = {"sv_demoCompressLevel", "6"};
+cvar_t  sv_demoCompressSync = {"sv_demoCompressSync", "1"};
 
 cvar_t	sv_demoPrefix		= {"sv_demoPrefix",		""};
 cvar_t	sv_demoSuffix		= {"sv_demoSuffix",		""};
@@ -139,6 +139,9 @@ void DestClose (mvddest_t *d, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
 
+	SV_DemoIO_Detach(d); // the I/O thread must be done with it before we close anything
+	SV_DemoIO_FinishCompression(d, !destroyfiles);
+
 	if (d->cache)
 		Q_free(d->cache);
 	if (d->file)
@@ -152,7 +155,7 @@ void DestClose (mvddest_t *d, qbool destroyfiles)
 	{
 		snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, d->path, d->name);
 		Sys_remove(path);
-		strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+		SV_MVDTxtPath(path, sizeof(path));
 		Sys_remove(path);
 
 		// force cache rebuild.
@@ -163,11 +166,10 @@ void DestClose (mvddest_t *d, qbool destroyfiles)
 }
 
 //
-// complete - just force flush for cached dests (dest->desttype == DEST_BUFFEREDFILE)
+// complete - also wait until cached file dests are written out
 //
 void DestFlush (qbool complete)
 {
-	int len;
 	mvddest_t *d, *t;
 
 	if (!demo.dest)
@@ -187,30 +189,40 @@ void DestFlush (qbool complete)
 		}
 	}
 
+	// the writing itself is done by the demo I/O thread, see sv_demo_io.c
 	for (d = demo.dest; d; d = d->nextdest)
 	{
 		switch(d->desttype)
 		{
-		case DEST_FILE:
-			fflush (d->file);
-			break;
+		case DEST_COMPRESSEDFILE:
+			// demo frames end here, let the I/O thread deflate up to this point
+			if (complete || d->synctime + sv_demoCompressSync.value <= Sys_DoubleTime())
+			{
+				d->synctime = Sys_DoubleTime();
+				SDL_AtomicSet(&d->syncpoint, SDL_AtomicGet(&d->cachehead) | DEMO_SYNC_FLUSH);
+			}
+			else if (!(SDL_AtomicGet(&d->syncpoint) & DEMO_SYNC_FLUSH)) // don't lose a pending sync flush
+			{
+				SDL_AtomicSet(&d->syncpoint, SDL_AtomicGet(&d->cachehead));
+			}
+			// fall through
 
+		case DEST_FILE:
 		case DEST_BUFFEREDFILE:
-			if (d->cacheused + DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS > d->maxcachesize || complete)
+			if (SDL_AtomicGet(&d->ioerror) && !d->error)
 			{
-				len = (int)fwrite(d->cache, 1, d->cacheused, d->file);
-				if (len != d->cacheused)
-				{
-					Sys_Printf("DestFlush: fwrite() error\n");
-					d->error = true;
-				}
-				fflush(d->file);
-
-				d->cacheused = 0;
+				Sys_Printf("DestFlush: fwrite() error\n");
+				d->error = true;
 			}
 			break;
 
 		case DEST_STREAM:
+			if (SDL_AtomicGet(&d->iostats.written) != d->iostats.lastwritten)
+			{
+				d->iostats.lastwritten = SDL_AtomicGet(&d->iostats.written);
+				d->io_time = Sys_DoubleTime(); // update IO activity
+			}
+
 			if (d->io_time + qtv_streamtimeout.value <= Sys_DoubleTime())
 			{
 				// problem what send() have internal buffer, so send() success some time even peer side does't read,
@@ -219,31 +231,10 @@ void DestFlush (qbool complete)
 				d->error = true;
 			}
 
-			if (d->cacheused && !d->error)
+			if (SDL_AtomicGet(&d->ioerror) && !d->error)
 			{
-				len = send(d->socket, d->cache, d->cacheused, 0);
-
-				if (len == 0) //client died
-				{
-//					d->error = true;
-					// man says: The calls return the number of characters sent, or -1 if an error occurred.   
-					// so 0 is legal or what?
-				}
-				else if (len > 0) //we put some data through
-				{ //move up the buffer
-					d->cacheused -= len;
-					memmove(d->cache, d->cache+len, d->cacheused);
-
-					d->io_time = Sys_DoubleTime(); // update IO activity
-				}
-				else
-				{ //error of some kind. would block or something
-					if (qerrno != EWOULDBLOCK && qerrno != EAGAIN)
-					{
-						Sys_Printf("DestFlush: error on stream\n");
-						d->error = true;
-					}
-				}
+				Sys_Printf("DestFlush: error on stream\n");
+				d->error = true;
 			}
 			break;
 
@@ -269,6 +260,8 @@ void DestFlush (qbool complete)
 			DestClose(t, false);
 		}
 	}
+
+	SV_DemoIO_Flush(complete);
 }
 
 // if param "mvdonly" == true then close only demos, not QTV's steams
@@ -312,8 +305,6 @@ static int DestCloseAllFlush (qbool destroyfiles, qbool mvdonly)
 
 int DemoWriteDest (void *data, int len, mvddest_t *d)
 {
-	int ret;
-
 	if (d->error)
 		return 0;
 
@@ -322,25 +313,15 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 	switch(d->desttype)
 	{
 		case DEST_FILE:
-			ret = (int)fwrite(data, 1, len, d->file);
-			if (ret != len)
-			{
-				Sys_Printf("DemoWriteDest: fwrite() error\n");
-				d->error = true;
-				return 0;
-			}
-
-			break;
-		case DEST_BUFFEREDFILE:	//these write to a cache, which is flushed later
-		case DEST_STREAM:
-			if (d->cacheused + len > d->maxcachesize)
+		case DEST_BUFFEREDFILE:
+		case DEST_COMPRESSEDFILE:
+		case DEST_STREAM:	//these write to a cache, which the I/O thread writes out
+			if (!SV_DemoIO_Write(d, data, len))
 			{
-				Sys_Printf("DemoWriteDest: cache overflow %d > %d\n", d->cacheused + len, d->maxcachesize);
+				Sys_Printf("DemoWriteDest: cache overflow %d > %d\n", SV_DemoIO_Used(d) + len, d->maxcachesize);
 				d->error = true;
 				return 0;
 			}
-			memcpy(d->cache + d->cacheused, data, len);
-			d->cacheused += len;
 
 			break;
 		case DEST_NONE:
@@ -817,6 +798,14 @@ static mvddest_t *SV_InitRecordFile (char *name)
 	FILE *file;
 
 	char path[MAX_OSPATH];
+	char gzname[MAX_OSPATH];
+
+	// compressed demos are plain gzip files, so just add .gz to the name
+	if ((int)sv_demoCompress.value)
+	{
+		snprintf(gzname, sizeof(gzname), "%s.gz", name);
+		name = gzname;
+	}
 
 	Con_DPrintf("SV_InitRecordFile: Demo name: \"%s\"\n", name);
 	file = fopen (name, "wb");
@@ -828,11 +817,28 @@ static mvddest_t *SV_InitRecordFile (char *name)
 
 	dst = (mvddest_t*) Q_malloc (sizeof(mvddest_t));
 
-	if (!(int)sv_demoUseCache.value)
+	if ((int)sv_demoCompress.value)
+	{
+		if (!SV_DemoIO_InitCompression(dst, (int)sv_demoCompressLevel.value))
+		{
+			Con_Printf ("ERROR: couldn't init compression for \"%s\"\n", name);
+			fclose(file);
+			Sys_remove(name);
+			Q_free(dst);
+			return NULL;
+		}
+
+		dst->desttype = DEST_COMPRESSEDFILE;
+		dst->file = file;
+		dst->maxcachesize = DEMO_FILE_CACHE_SIZE;
+		dst->cache = (char *) Q_malloc (dst->maxcachesize);
+	}
+	else if (!(int)sv_demoUseCache.value)
 	{
 		dst->desttype = DEST_FILE;
 		dst->file = file;
-		dst->maxcachesize = 0;
+		dst->maxcachesize = DEMO_FILE_CACHE_SIZE;
+		dst->cache = (char *) Q_malloc (dst->maxcachesize);
 	}
 	else
 	{
@@ -847,13 +853,15 @@ static mvddest_t *SV_InitRecordFile (char *name)
 	strlcpy(dst->name, s+1, sizeof(dst->name));
 	strlcpy(dst->path, sv_demoDir.string, sizeof(dst->path));
 
+	SV_DemoIO_Attach(dst);
+
 	if ( !sv_silentrecord.value )
 		SV_BroadcastPrintf (PRINT_CHAT, "Server starts recording (%s):\n%s\n",
 		                    (dst->desttype == DEST_BUFFEREDFILE) ? "memory" : "disk", s+1);
 	Cvar_SetROM(&serverdemo, dst->name);
 
 	strlcpy(path, name, MAX_OSPATH);
-	strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+	SV_MVDTxtPath(path, sizeof(path));
 
 	if ((int)sv_demotxt.value)
 	{
@@ -1840,6 +1848,9 @@ static void MVD_Init (void)
 	Cvar_Register (&sv_ondemoremove);
 	Cvar_Register (&sv_demotxt);
 	Cvar_Register (&sv_demoExtraNames);
+	Cvar_Register (&sv_demoCompress);
+	Cvar_Register (&sv_demoCompressLevel);
+	Cvar_Register (&sv_demoCompressSync);
 	Cvar_Register (&sv_demoRegexp);
 	Cvar_Register (&sv_silentrecord);
 
@@ -1942,6 +1953,7 @@ void SV_MVDInit(void)
 #endif
 
 	Cmd_AddCommand ("sv_usercmdtrace",  SV_UserCmdTrace_f);
+	Cmd_AddCommand ("sv_demoiostats",   SV_DemoIO_Stats_f);
 
 	SV_QTV_Init();
 }
@@ -0,0 +1,533 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// sv_demo_io.c - demo and QTV output thread
+//
+// The main thread only copies demo data into the ring buffer of each dest
+// (SV_DemoIO_Write) and wakes this thread once per demo frame. Disk writes and
+// socket sends are done here, so a slow disk or a slow QTV proxy can't stall the
+// server frame, and a partially sent stream just advances the ring tail instead
+// of moving the whole cache down.
+//
+// Each ring has a single producer (main thread, owns cachehead) and a single
+// consumer (I/O thread, owns cachetail), so filling it needs no locking. The
+// mutex only protects the list of dests and which one the thread is busy with,
+// it is never held across a write or send. The thread takes a copy of the list
+// for each pass and marks the dest it works on, SV_DemoIO_Detach waits for that
+// mark to go away, so once it returns the thread is done with the dest.
+//
+// DEST_COMPRESSEDFILE dests are deflated here too, into a gzip file. The thread
+// only takes data up to the syncpoint the main thread sets at the end of each demo
+// frame, and when the syncpoint asks for it does a Z_SYNC_FLUSH there, so whatever
+// is on disk always decompresses to whole frames, even while still recording.
+
+#ifndef CLIENTONLY
+#include "qwsvdef.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+// how long the thread sleeps when nobody wakes it
+#define DEMO_IO_IDLE_MS			10
+
+// how long the main thread waits for room in a file cache before dropping the dest
+#define DEMO_IO_STALL_TIMEOUT	1.0
+
+// how long a complete flush waits for the file caches to be written
+#define DEMO_IO_FLUSH_TIMEOUT	10.0
+
+static struct
+{
+	SDL_Thread		*thread;
+	SDL_mutex		*lock;
+	SDL_cond		*drained;		// signalled after every pass
+	SDL_sem			*wake;
+
+	mvddest_t		**dests;
+	int				numdests;
+	int				maxdests;
+
+	mvddest_t		*busy;			// dest the thread is writing out right now
+} demoio;
+
+int SV_DemoIO_Used (mvddest_t *d)
+{
+	int used = SDL_AtomicGet(&d->cachehead) - SDL_AtomicGet(&d->cachetail);
+
+	return used < 0 ? used + d->maxcachesize : used;
+}
+
+// Contiguous parts of the ring waiting to be written, returns how many there are.
+static int SV_DemoIO_Segments (mvddest_t *d, char **data, int *len)
+{
+	int head = SDL_AtomicGet(&d->cachehead);
+	int tail = SDL_AtomicGet(&d->cachetail);
+
+	if (head == tail)
+		return 0;
+
+	data[0] = d->cache + tail;
+	if (head > tail)
+	{
+		len[0] = head - tail;
+		return 1;
+	}
+
+	len[0] = d->maxcachesize - tail;
+	data[1] = d->cache;
+	len[1] = head;
+	return head ? 2 : 1;
+}
+
+static void SV_DemoIO_Consumed (mvddest_t *d, int len)
+{
+	SDL_AtomicSet(&d->cachetail, (SDL_AtomicGet(&d->cachetail) + len) % d->maxcachesize);
+	SDL_AtomicAdd(&d->iostats.written, len);
+}
+
+static void SV_DemoIO_WriteFile (mvddest_t *d)
+{
+	char *data[2];
+	int len[2], count, i;
+
+	// DEST_BUFFEREDFILE is meant to keep the disk quiet, only write it when it's nearly full
+	if (d->desttype == DEST_BUFFEREDFILE && !SDL_AtomicGet(&d->flushcache)
+		&& SV_DemoIO_Used(d) + DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS <= d->maxcachesize)
+		return;
+
+	count = SV_DemoIO_Segments(d, data, len);
+
+#ifdef _WIN32
+	for (i = 0; i < count; i++)
+	{
+		SDL_AtomicIncRef(&d->iostats.writes);
+		if ((int)fwrite(data[i], 1, len[i], d->file) != len[i])
+		{
+			SDL_AtomicSet(&d->ioerror, 1);
+			return;
+		}
+		SV_DemoIO_Consumed(d, len[i]);
+	}
+	if (count)
+		fflush(d->file);
+#else
+	{
+		struct iovec iov[2];
+		int fd = fileno(d->file);
+		ssize_t ret;
+
+		for (i = 0; i < count; i++)
+		{
+			iov[i].iov_base = data[i];
+			iov[i].iov_len = len[i];
+		}
+
+		// both parts of the ring in one call, carry on after partial writes
+		i = 0;
+		while (i < count)
+		{
+			SDL_AtomicIncRef(&d->iostats.writes);
+			ret = writev(fd, iov + i, count - i);
+			if (ret < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				SDL_AtomicSet(&d->ioerror, 1);
+				return;
+			}
+
+			SV_DemoIO_Consumed(d, (int)ret);
+			while (i < count && ret >= (ssize_t)iov[i].iov_len)
+				ret -= iov[i++].iov_len;
+			if (i < count)
+			{
+				iov[i].iov_base = (char *)iov[i].iov_base + ret;
+				iov[i].iov_len -= ret;
+			}
+		}
+	}
+#endif
+
+	if (!SV_DemoIO_Used(d))
+		SDL_AtomicSet(&d->flushcache, 0);
+}
+
+// Deflates len bytes into the file, with Z_SYNC_FLUSH or Z_FINISH everything
+// given so far is written out.
+static qbool SV_DemoIO_Deflate (mvddest_t *d, char *data, int len, int flush)
+{
+	z_stream *zs = d->zstream;
+	int have;
+
+	zs->next_in = (Bytef *) data;
+	zs->avail_in = len;
+	do
+	{
+		zs->next_out = d->zbuffer;
+		zs->avail_out = DEMO_COMPRESS_BUFFER_SIZE;
+		if (deflate(zs, flush) == Z_STREAM_ERROR)
+			return false;
+
+		have = DEMO_COMPRESS_BUFFER_SIZE - zs->avail_out;
+		if (have)
+		{
+			SDL_AtomicIncRef(&d->iostats.writes);
+			if ((int)fwrite(d->zbuffer, 1, have, d->file) != have)
+				return false;
+			d->compressedsize += have;
+		}
+	} while (!zs->avail_out);
+
+	return true;
+}
+
+static void SV_DemoIO_WriteCompressed (mvddest_t *d)
+{
+	char *data[2];
+	int len[2], count, i, sync, pos, todo;
+
+	sync = SDL_AtomicGet(&d->syncpoint);
+	pos = sync & ~DEMO_SYNC_FLUSH;
+
+	// everything from the tail up to the end of the last whole frame
+	todo = pos - SDL_AtomicGet(&d->cachetail);
+	if (todo < 0)
+		todo += d->maxcachesize;
+
+	count = SV_DemoIO_Segments(d, data, len);
+	for (i = 0; i < count && todo > 0; i++)
+	{
+		len[i] = min(len[i], todo);
+		if (!SV_DemoIO_Deflate(d, data[i], len[i], Z_NO_FLUSH))
+		{
+			SDL_AtomicSet(&d->ioerror, 1);
+			return;
+		}
+		SV_DemoIO_Consumed(d, len[i]);
+		todo -= len[i];
+	}
+
+	if (sync & DEMO_SYNC_FLUSH)
+	{
+		if (!SV_DemoIO_Deflate(d, NULL, 0, Z_SYNC_FLUSH) || fflush(d->file))
+		{
+			SDL_AtomicSet(&d->ioerror, 1);
+			return;
+		}
+		SDL_AtomicCAS(&d->syncpoint, sync, pos); // unless the main thread has moved it already
+	}
+}
+
+static void SV_DemoIO_WriteStream (mvddest_t *d)
+{
+	char *data[2];
+	int len[2], count, i, ret;
+
+	count = SV_DemoIO_Segments(d, data, len);
+	for (i = 0; i < count; i++)
+	{
+		SDL_AtomicIncRef(&d->iostats.writes);
+		ret = send(d->socket, data[i], len[i], 0);
+
+		if (ret < 0)
+		{
+			// error of some kind. would block or something
+			if (qerrno != EWOULDBLOCK && qerrno != EAGAIN)
+				SDL_AtomicSet(&d->ioerror, 1);
+			return;
+		}
+
+		SV_DemoIO_Consumed(d, ret);
+		if (ret < len[i])
+			return; // socket buffer is full, try again next pass
+	}
+}
+
+// Marks d busy if it is still attached, so SV_DemoIO_Detach waits for us.
+static qbool SV_DemoIO_Claim (mvddest_t *d)
+{
+	int i;
+
+	SDL_LockMutex(demoio.lock);
+	for (i = 0; i < demoio.numdests; i++)
+	{
+		if (demoio.dests[i] == d)
+		{
+			demoio.busy = d;
+			break;
+		}
+	}
+	SDL_UnlockMutex(demoio.lock);
+
+	return i < demoio.numdests;
+}
+
+static int SV_DemoIO_Thread (void *unused)
+{
+	mvddest_t **pass = NULL, *d;
+	int numpass = 0, maxpass = 0;
+	int i;
+
+	while (true)
+	{
+		SDL_SemWaitTimeout(demoio.wake, DEMO_IO_IDLE_MS);
+
+		SDL_LockMutex(demoio.lock);
+		if (demoio.numdests > maxpass)
+		{
+			maxpass = demoio.maxdests;
+			pass = (mvddest_t **) Q_realloc(pass, maxpass * sizeof(pass[0]));
+		}
+		numpass = demoio.numdests;
+		memcpy(pass, demoio.dests, numpass * sizeof(pass[0]));
+		SDL_UnlockMutex(demoio.lock);
+
+		for (i = 0; i < numpass; i++)
+		{
+			// it may have been detached (and freed) since we took the copy
+			if (!SV_DemoIO_Claim(d = pass[i]))
+				continue;
+
+			if (!SDL_AtomicGet(&d->ioerror))
+			{
+				if (d->desttype == DEST_STREAM)
+					SV_DemoIO_WriteStream(d);
+				else if (d->desttype == DEST_COMPRESSEDFILE)
+					SV_DemoIO_WriteCompressed(d);
+				else
+					SV_DemoIO_WriteFile(d);
+			}
+
+			SDL_LockMutex(demoio.lock);
+			demoio.busy = NULL;
+			SDL_CondBroadcast(demoio.drained);
+			SDL_UnlockMutex(demoio.lock);
+		}
+	}
+
+	return 0;
+}
+
+void SV_DemoIO_Attach (mvddest_t *d)
+{
+	if (!demoio.thread)
+	{
+		demoio.lock = SDL_CreateMutex();
+		demoio.drained = SDL_CreateCond();
+		demoio.wake = SDL_CreateSemaphore(0);
+		demoio.thread = SDL_CreateThread(SV_DemoIO_Thread, "demoio", NULL);
+		if (!demoio.thread)
+			Sys_Error("SV_DemoIO_Attach: couldn't create demo I/O thread: %s", SDL_GetError());
+	}
+
+	SDL_LockMutex(demoio.lock);
+	if (demoio.numdests == demoio.maxdests)
+	{
+		demoio.maxdests += 8;
+		demoio.dests = (mvddest_t **) Q_realloc(demoio.dests, demoio.maxdests * sizeof(demoio.dests[0]));
+	}
+	demoio.dests[demoio.numdests++] = d;
+	SDL_UnlockMutex(demoio.lock);
+}
+
+void SV_DemoIO_Detach (mvddest_t *d)
+{
+	int i;
+
+	if (!demoio.thread)
+		return;
+
+	SDL_LockMutex(demoio.lock);
+	for (i = 0; i < demoio.numdests; i++)
+	{
+		if (demoio.dests[i] == d)
+		{
+			demoio.dests[i] = demoio.dests[--demoio.numdests];
+			break;
+		}
+	}
+	while (demoio.busy == d)
+		SDL_CondWait(demoio.drained, demoio.lock);
+	SDL_UnlockMutex(demoio.lock);
+}
+
+// Waits for the I/O thread to make room for len more bytes in a file cache.
+// Streams never wait, a lagging QTV proxy is dropped rather than slowing down the server.
+static qbool SV_DemoIO_WaitForRoom (mvddest_t *d, int len)
+{
+	double start, elapsed = 0;
+
+	if (d->desttype == DEST_STREAM || len >= d->maxcachesize)
+		return false;
+
+	start = Sys_DoubleTime();
+	d->iostats.stalls++;
+
+	SDL_LockMutex(demoio.lock);
+	SDL_AtomicSet(&d->flushcache, 1);
+	if (d->desttype == DEST_COMPRESSEDFILE)
+		SDL_AtomicSet(&d->syncpoint, SDL_AtomicGet(&d->cachehead)); // let it take the unfinished frame too
+	SDL_SemPost(demoio.wake);
+	while (SV_DemoIO_Used(d) + len >= d->maxcachesize && !SDL_AtomicGet(&d->ioerror) && elapsed < DEMO_IO_STALL_TIMEOUT)
+	{
+		SDL_CondWaitTimeout(demoio.drained, demoio.lock, DEMO_IO_IDLE_MS);
+		elapsed = Sys_DoubleTime() - start;
+	}
+	SDL_UnlockMutex(demoio.lock);
+
+	d->iostats.stalltime += Sys_DoubleTime() - start;
+
+	return SV_DemoIO_Used(d) + len < d->maxcachesize;
+}
+
+qbool SV_DemoIO_Write (mvddest_t *d, const void *data, int len)
+{
+	int head, part, used;
+
+	if (SV_DemoIO_Used(d) + len >= d->maxcachesize && !SV_DemoIO_WaitForRoom(d, len))
+		return false;
+
+	head = SDL_AtomicGet(&d->cachehead);
+	part = min(len, d->maxcachesize - head);
+	memcpy(d->cache + head, data, part);
+	memcpy(d->cache, (const char *)data + part, len - part);
+	SDL_AtomicSet(&d->cachehead, (head + len) % d->maxcachesize);
+
+	used = SV_DemoIO_Used(d);
+	if (used > d->iostats.peak)
+		d->iostats.peak = used;
+
+	return true;
+}
+
+// Called once per demo frame by DestFlush. With complete, waits until every file cache is on disk.
+void SV_DemoIO_Flush (qbool complete)
+{
+	double start;
+	qbool pending;
+	int i;
+
+	if (!demoio.thread)
+		return;
+
+	if (!complete)
+	{
+		if (!SDL_SemValue(demoio.wake))
+			SDL_SemPost(demoio.wake);
+		return;
+	}
+
+	start = Sys_DoubleTime();
+
+	SDL_LockMutex(demoio.lock);
+	for (i = 0; i < demoio.numdests; i++)
+		SDL_AtomicSet(&demoio.dests[i]->flushcache, 1);
+	SDL_SemPost(demoio.wake);
+
+	do
+	{
+		pending = false;
+		for (i = 0; i < demoio.numdests; i++)
+		{
+			mvddest_t *d = demoio.dests[i];
+
+			if (d->desttype == DEST_STREAM || SDL_AtomicGet(&d->ioerror))
+				continue;
+
+			if (SV_DemoIO_Used(d) || (d->desttype == DEST_COMPRESSEDFILE && (SDL_AtomicGet(&d->syncpoint) & DEMO_SYNC_FLUSH)))
+				pending = true;
+		}
+
+		if (pending)
+			SDL_CondWaitTimeout(demoio.drained, demoio.lock, DEMO_IO_IDLE_MS);
+	} while (pending && Sys_DoubleTime() - start < DEMO_IO_FLUSH_TIMEOUT);
+	SDL_UnlockMutex(demoio.lock);
+}
+
+qbool SV_DemoIO_InitCompression (mvddest_t *d, int level)
+{
+	d->zstream = (z_stream *) Q_malloc(sizeof(z_stream));
+
+	// 15 + 16 window bits makes zlib write a gzip header and trailer
+	if (deflateInit2(d->zstream, bound(1, level, 9), Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		Q_free(d->zstream);
+		return false;
+	}
+
+	d->zbuffer = (byte *) Q_malloc(DEMO_COMPRESS_BUFFER_SIZE);
+	return true;
+}
+
+// Must be called after SV_DemoIO_Detach. With finish, deflates whatever is still
+// in the cache and writes the gzip trailer.
+void SV_DemoIO_FinishCompression (mvddest_t *d, qbool finish)
+{
+	char *data[2];
+	int len[2], count, i;
+
+	if (!d->zstream)
+		return;
+
+	if (finish && !SDL_AtomicGet(&d->ioerror))
+	{
+		count = SV_DemoIO_Segments(d, data, len);
+		for (i = 0; i < count; i++)
+		{
+			if (!SV_DemoIO_Deflate(d, data[i], len[i], Z_NO_FLUSH))
+				break;
+			SV_DemoIO_Consumed(d, len[i]);
+		}
+
+		if (i < count || !SV_DemoIO_Deflate(d, NULL, 0, Z_FINISH))
+			Sys_Printf("SV_DemoIO_FinishCompression: fwrite() error\n");
+	}
+
+	deflateEnd(d->zstream);
+	Q_free(d->zstream);
+	Q_free(d->zbuffer);
+}
+
+void SV_DemoIO_Stats_f (void)
+{
+	mvddest_t *d;
+	char *name;
+
+	if (!demo.dest)
+	{
+		Con_Printf("No demo or QTV destinations\n");
+		return;
+	}
+
+	Con_Printf("%-20s %8s %8s %10s %8s %6s %8s\n", "dest", "queued", "peak", "written", "writes", "stalls", "stalltime");
+	for (d = demo.dest; d; d = d->nextdest)
+	{
+		if (d->desttype == DEST_STREAM)
+			name = va("qtv %d %s", d->id, d->qtvname);
+		else
+			name = d->name;
+
+		Con_Printf("%-20.20s %7dk %7dk %9dk %8d %6d %8.3f\n", name,
+			SV_DemoIO_Used(d) / 1024, d->iostats.peak / 1024,
+			(int)((unsigned int)SDL_AtomicGet(&d->iostats.written) / 1024),
+			SDL_AtomicGet(&d->iostats.writes),
+			d->iostats.stalls, d->iostats.stalltime);
+	}
+}
+
+#endif // !CLIENTONLY
@@ -182,12 +182,25 @@ qbool SV_DirSizeCheck (void)
 	return true;
 }
 
+// "demos/foo.mvd" or "demos/foo.mvd.gz" -> "demos/foo.txt", unlike SV_MVDName2Txt
+// this doesn't depend on sv_demoRegexp, so it works for the demo we just recorded.
+void SV_MVDTxtPath (char *path, size_t size)
+{
+	size_t len = strlen(path);
+
+	if (len > 3 && !strcasecmp(path + len - 3, ".gz"))
+		path[len -= 3] = 0;
+
+	if (len >= 3)
+		strlcpy(path + len - 3, "txt", size - len + 3);
+}
+
 void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *dest_path, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
 
 	snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, dest_path, dest_name);
-	strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+	SV_MVDTxtPath(path, sizeof(path));
 
 	if ((int)sv_demotxt.value && !destroyfiles) // dont keep txt's for deleted demos
 	{
@@ -218,6 +231,8 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 			*p = 0; // strip parameters
 	
 		strlcpy(path, dest_name, sizeof(path));
+		if (strlen(path) > 3 && !strcasecmp(path + strlen(path) - 3, ".gz"))
+			path[strlen(path) - 3] = 0; // script gets the same name for compressed demos
 #ifdef SERVERONLY
 		COM_StripExtension(path);
 #else
@@ -225,7 +240,8 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 #endif
 
 		sv_redirected = RD_NONE; // onrecord script is called always from the console
-		Cmd_TokenizeString(va("script %s \"%s\" \"%s\" %s", sv_onrecordfinish.string, dest_path, path, p != NULL ? p+1 : ""));
+		// the name as it is on disk, "foo.mvd" or "foo.mvd.gz", comes last so the parameters keep their places
+		Cmd_TokenizeString(va("script %s \"%s\" \"%s\" %s \"%s\"", sv_onrecordfinish.string, dest_path, path, p != NULL ? p+1 : "", dest_name));
 
 		if (p)
 			*p = ' '; // restore params
@@ -75,6 +75,8 @@ static mvddest_t *SV_InitStream (int socket1, netadr_t na, char *userinfo)
 	strlcpy(dst->qtvaddress, address, sizeof(dst->qtvaddress));
 	dst->qtvstreamid = streamid;
 
+	SV_DemoIO_Attach(dst);
+
 	if (dst->qtvname[0])
 		Con_Printf ("Connected to QTV(%s)\n", dst->qtvname);
 	else
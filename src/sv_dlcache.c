@@ -0,0 +1,217 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// sv_dlcache.c - files being downloaded, shared by every client downloading them
+//
+// When a fresh map comes up a bunch of players ask for the same .bsp, skins and
+// sounds at once. Rather than each of them getting a file handle of their own and
+// reading every chunk off the disk again, the first client brings the file into
+// memory and everybody else shares it, chunks are written into the netchan straight
+// from there. Files inside a pak/pk3 point into the archive, which is mapped already;
+// loose files are mapped too, so nothing is read up front and the server frame never
+// waits on the disk. Only loose files that can't be mapped are read into the heap,
+// and only those count against sv_downloadcachesize.
+//
+// Files nobody is downloading any more stay around for the next client until the
+// room is needed or the map changes, which is when files on disk tend to get
+// swapped, so a changed file is picked up at the latest on the next map.
+
+#ifndef CLIENTONLY
+#include "qwsvdef.h"
+
+cvar_t	sv_downloadcachesize = {"sv_downloadcachesize", "32"};
+
+static sv_dlfile_t	*dlfiles;
+static int			dlcache_used;	// heap bytes held by loose files
+
+static void SV_DownloadCache_Free (sv_dlfile_t **link)
+{
+	sv_dlfile_t *f = *link;
+
+	*link = f->next;
+
+	if (f->vfs)
+		VFS_CLOSE(f->vfs);
+	Sys_UnmapFile(&f->map);
+	if (f->copy)
+		dlcache_used -= f->size;
+
+	Q_free(f->copy);
+	Q_free(f);
+}
+
+// drops files nobody is downloading, least recently used first, until size more bytes fit
+static qbool SV_DownloadCache_MakeRoom (int size)
+{
+	int limit = (int)(bound(0, sv_downloadcachesize.value, 1024) * 1024 * 1024);
+	sv_dlfile_t **link, **oldest;
+
+	while (dlcache_used + size > limit)
+	{
+		oldest = NULL;
+		for (link = &dlfiles; *link; link = &(*link)->next)
+		{
+			if ((*link)->refcount || !(*link)->copy)
+				continue;
+			if (!oldest || (*link)->lastused < (*oldest)->lastused)
+				oldest = link;
+		}
+
+		if (!oldest)
+			return false;
+
+		SV_DownloadCache_Free(oldest);
+	}
+
+	return true;
+}
+
+/*
+==================
+SV_DownloadCache_Open
+
+Returns the file with a reference taken, NULL if the cache is off, the file
+doesn't exist or it doesn't fit, in which case the caller opens it the usual way.
+==================
+*/
+sv_dlfile_t *SV_DownloadCache_Open (const char *name, relativeto_t relativeto)
+{
+	sv_dlfile_t *f;
+	vfsfile_t *vfs;
+	const byte *data;
+	vfserrno_t err;
+	int size;
+
+	if (sv_downloadcachesize.value <= 0)
+		return NULL;
+
+	for (f = dlfiles; f; f = f->next)
+	{
+		if (f->relativeto == relativeto && !strcmp(f->name, name))
+		{
+			f->refcount++;
+			f->hits++;
+			f->lastused = realtime;
+			return f;
+		}
+	}
+
+	if (!(vfs = FS_OpenVFS(name, "rb", relativeto)))
+		return NULL;
+
+	size = VFS_GETLEN(vfs);
+
+	f = (sv_dlfile_t *) Q_malloc(sizeof(*f));
+	strlcpy(f->name, name, sizeof(f->name));
+	f->relativeto = relativeto;
+	f->size = size;
+	f->copyprotected = VFS_COPYPROTECTED(vfs);
+
+	if ((data = VFS_GETDATA(vfs)))
+	{
+		// keep the handle, it keeps the archive the data points into around
+		f->vfs = vfs;
+		f->data = data;
+	}
+	else if (VFSOS_MapFile(vfs, &f->map))
+	{
+		VFS_CLOSE(vfs);
+		f->data = f->map.data;
+	}
+	else
+	{
+		if (!SV_DownloadCache_MakeRoom(size))
+		{
+			VFS_CLOSE(vfs);
+			Q_free(f);
+			return NULL;
+		}
+
+		f->copy = (byte *) Q_malloc(size + 1);
+		if (VFS_READ(vfs, f->copy, size, &err) != size)
+		{
+			VFS_CLOSE(vfs);
+			Q_free(f->copy);
+			Q_free(f);
+			return NULL;
+		}
+
+		VFS_CLOSE(vfs);
+		f->data = f->copy;
+		dlcache_used += size;
+	}
+
+	f->refcount = 1;
+	f->lastused = realtime;
+	f->next = dlfiles;
+	dlfiles = f;
+
+	return f;
+}
+
+void SV_DownloadCache_Release (sv_dlfile_t *f)
+{
+	if (!f)
+		return;
+
+	f->refcount--;
+	f->lastused = realtime;
+}
+
+// forgets every file nobody is downloading
+void SV_DownloadCache_Flush (void)
+{
+	sv_dlfile_t **link = &dlfiles;
+
+	while (*link)
+	{
+		if ((*link)->refcount)
+			link = &(*link)->next;
+		else
+			SV_DownloadCache_Free(link);
+	}
+}
+
+static void SV_DownloadCache_f (void)
+{
+	sv_dlfile_t *f;
+	int files = 0;
+
+	if (Cmd_Argc() == 2 && !strcmp(Cmd_Argv(1), "flush"))
+	{
+		SV_DownloadCache_Flush();
+		return;
+	}
+
+	Con_Printf("%-32s %8s %5s %5s %10s %4s\n", "file", "size", "dls", "hits", "sent", "pak");
+	for (f = dlfiles; f; f = f->next, files++)
+	{
+		Con_Printf("%-32.32s %7dk %5d %5d %9.0fk %4s\n", f->name, f->size / 1024,
+			f->refcount, f->hits, f->sent / 1024, f->vfs ? "yes" : "no");
+	}
+
+	Con_Printf("%d files, %dk of %dk in memory\n", files, dlcache_used / 1024,
+		(int)(bound(0, sv_downloadcachesize.value, 1024) * 1024));
+}
+
+void SV_DownloadCache_Init (void)
+{
+	Cvar_Register (&sv_downloadcachesize);
+	Cmd_AddCommand ("sv_downloadcache", SV_DownloadCache_f);
+}
+
+#endif // !CLIENTONLY
@@ -28,8 +28,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // because there can be a lot of nails, there is a special
 // network protocol for them
 #define MAX_NAILS 32
-static edict_t *nails[MAX_NAILS];
-static int numnails;
 static int nailcount = 0;
 
 extern	int sv_nailmodel, sv_supernailmodel, sv_playermodel;
@@ -39,7 +37,37 @@ cvar_t	sv_nailhack	= {"sv_nailhack", "1"};
 // Maximum packet we will send - currently 256 if extension supported
 #define MAX_PACKETENTITIES_POSSIBLE 256
 
-static qbool SV_AddNailUpdate (edict_t *ent)
+// what SV_WriteEntitiesToClient works with while building one client frame,
+// kept apart so several frames can be built at once (see SV_ParallelEntities_Run)
+typedef struct entframe_s
+{
+	edict_t	*nails[MAX_NAILS];
+	int		numnails;
+
+	byte	pvs[MAX_MAP_LEAFS/8];
+
+	// if set, .visibility changes go here (ENTVIS_*, by edict number)
+	// instead of to the edicts, which all clients share
+	byte	*visibility;
+} entframe_t;
+
+#define ENTVIS_KEEP		0
+#define ENTVIS_CLEAR	1
+#define ENTVIS_SET		2
+
+static entframe_t sv_entframe;
+
+static void SV_SetEntityVisibility (entframe_t *ef, edict_t *ent, unsigned int client_flag, qbool visible)
+{
+	if (ef->visibility)
+		ef->visibility[ent->e.entnum] = visible ? ENTVIS_SET : ENTVIS_CLEAR;
+	else if (visible)
+		EdictFieldInt(ent, fofs_visibility) |= client_flag;
+	else
+		EdictFieldInt(ent, fofs_visibility) &= ~client_flag;
+}
+
+static qbool SV_AddNailUpdate (entframe_t *ef, edict_t *ent)
 {
 	if ((int)sv_nailhack.value)
 		return false;
@@ -50,22 +78,22 @@ static qbool SV_AddNailUpdate (edict_t *ent)
 	if (msg_coordsize != 2)
 		return false; // Do not allow nailhack in case of sv_bigcoords.
 
-	if (numnails == MAX_NAILS)
+	if (ef->numnails == MAX_NAILS)
 		return true;
 
-	nails[numnails] = ent;
-	numnails++;
+	ef->nails[ef->numnails] = ent;
+	ef->numnails++;
 	return true;
 }
 
-static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
+static void SV_EmitNailUpdate (entframe_t *ef, sizebuf_t *msg, qbool recorder)
 {
 	int x, y, z, p, yaw, n, i;
 	byte bits[6]; // [48 bits] xyzpy 12 12 12 4 8
 	edict_t *ent;
 
 
-	if (!numnails)
+	if (!ef->numnails)
 		return;
 
 	if (recorder)
@@ -73,11 +101,11 @@ static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
 	else
 		MSG_WriteByte (msg, svc_nails);
 
-	MSG_WriteByte (msg, numnails);
+	MSG_WriteByte (msg, ef->numnails);
 
-	for (n=0 ; n<numnails ; n++)
+	for (n=0 ; n<ef->numnails ; n++)
 	{
-		ent = nails[n];
+		ent = ef->nails[n];
 		if (recorder)
 		{
 			if (!ent->v->colormap)
@@ -544,7 +572,7 @@ SV_WritePlayersToClient
 */
 
 int SV_PMTypeForClient (client_t *cl);
-static void SV_WritePlayersToClient (client_t *client, client_frame_t *frame, byte *pvs, qbool disable_updates, sizebuf_t *msg)
+static void SV_WritePlayersToClient (client_t *client, client_frame_t *frame, byte *pvs, qbool disable_updates, sizebuf_t *msg, entframe_t *ef)
 {
 	int msec, pflags, pm_type = 0, pm_code = 0, i, j;
 	usercmd_t cmd;
@@ -573,7 +601,7 @@ static void SV_WritePlayersToClient (client_t *client, client_frame_t *frame, by
 
 		if (fofs_visibility) {
 			// Presume not visible
-			((eval_t *)((byte *)(cl->edict)->v + fofs_visibility))->_int &= ~(1 << (client - svs.clients));
+			SV_SetEntityVisibility (ef, cl->edict, 1 << (client - svs.clients), false);
 		}
 
 		if (cl->state != cs_spawned)
@@ -603,7 +631,7 @@ static void SV_WritePlayersToClient (client_t *client, client_frame_t *frame, by
 
 		if (fofs_visibility) {
 			// Update flags so mods can tell what was visible
-			((eval_t *)((byte *)(ent)->v + fofs_visibility))->_int |= (1 << (client - svs.clients));
+			SV_SetEntityVisibility (ef, ent, 1 << (client - svs.clients), true);
 		}
 
 		if (j == hideent - 1)
@@ -887,7 +915,7 @@ svc_playerinfo messages
 =============
 */
 
-void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
+static void SV_BuildEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder, entframe_t *ef)
 {
 	qbool disable_updates; // disables sending entities to the client
 	int e, i, max_packet_entities;
@@ -904,6 +932,8 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	float distance;
 	int position;
 	vec3_t org;
+	unsigned int candidates[MAX_EDICTS / 32];
+	qbool indexed;
 
 	if ( recorder )
 	{
@@ -949,7 +979,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 			VectorAdd (client->edict->v->origin, client->edict->v->view_ofs, org);
 		}
 
-		pvs = CM_FatPVS (org); // search some PVS
+		pvs = CM_FatPVSBuffer (org, ef->pvs); // search some PVS
 		max_packet_entities = (client->fteprotocolextensions & FTE_PEXT_256PACKETENTITIES) ? MAX_PEXT256_PACKET_ENTITIES : MAX_PACKET_ENTITIES;
 
 		if (client->disable_updates_stop > realtime)
@@ -972,13 +1002,13 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	if ( recorder )
 		SV_MVD_WritePlayersToClient (); // nice, no params at all!
 	else
-		SV_WritePlayersToClient (client, frame, pvs, disable_updates, msg);
+		SV_WritePlayersToClient (client, frame, pvs, disable_updates, msg, ef);
 
 	// put other visible entities into either a packet_entities or a nails message
 	pack = &frame->entities;
 	pack->num_entities = 0;
 
-	numnails = 0;
+	ef->numnails = 0;
 
 	if (!disable_updates)
 	{// Vladis, server flash
@@ -987,25 +1017,28 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 		// from ZQuake unless using protocol extensions.
 		// max_edicts = min(sv.num_edicts, MAX_EDICTS);
 
+		// edicts the leaf index doesn't put in the PVS can skip the leaf checks
+		indexed = pvs && SV_VisibleEdicts(pvs, candidates);
+
 		for (e = pr_nqprogs ? 1 : MAX_CLIENTS + 1, ent = EDICT_NUM(e); e < sv.num_edicts; e++, ent = NEXT_EDICT(ent))
 		{
-			if (!SV_EntityVisibleToClient(client, e, pvs)) {
+			if ((indexed && !(candidates[e >> 5] & (1u << (e & 31)))) || !SV_EntityVisibleToClient(client, e, pvs)) {
 				if (fofs_visibility) {
-					((eval_t *)((byte *)(ent)->v + fofs_visibility))->_int &= ~client_flag;
+					SV_SetEntityVisibility (ef, ent, client_flag, false);
 				}
 				continue;
 			}
 
 			if (fofs_visibility) {
 				// Don't include other filters in logic for setting this field
-				((eval_t *)((byte *)(ent)->v + fofs_visibility))->_int |= (1 << (client - svs.clients));
+				SV_SetEntityVisibility (ef, ent, client_flag, true);
 			}
 
 			if (e == hideent) {
 				continue;
 			}
 
-			if (SV_AddNailUpdate (ent))
+			if (SV_AddNailUpdate (ef, ent))
 				continue; // added to the special update list
 
 			if (clent) {
@@ -1082,7 +1115,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	SV_EmitPacketEntities (client, pack, msg);
 
 	// now add the specialized nail update
-	SV_EmitNailUpdate (msg, recorder);
+	SV_EmitNailUpdate (ef, msg, recorder);
 
 	// Translate NQ progs' EF_MUZZLEFLASH to svc_muzzleflash
 	if (pr_nqprogs)
@@ -1109,6 +1142,11 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	}
 }
 
+void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
+{
+	SV_BuildEntitiesToClient (client, msg, recorder, &sv_entframe);
+}
+
 /*
 ============
 SV_SetVisibleEntitiesForBot
@@ -1121,12 +1159,15 @@ void SV_SetVisibleEntitiesForBot (client_t* client)
 	unsigned int client_flag = 1 << (client - svs.clients);
 	vec3_t org;
 	byte* pvs = NULL;
+	unsigned int candidates[MAX_EDICTS / 32];
+	qbool indexed;
 
 	if (!fofs_visibility)
 		return;
 
 	VectorAdd (client->edict->v->origin, client->edict->v->view_ofs, org);
 	pvs = CM_FatPVS (org); // search some PVS
+	indexed = SV_VisibleEdicts(pvs, candidates);
 
 	// players first
 	for (j = 0; j < MAX_CLIENTS; j++)
@@ -1144,7 +1185,7 @@ void SV_SetVisibleEntitiesForBot (client_t* client)
 	{
 		edict_t* ent = EDICT_NUM (e);
 
-		if (SV_EntityVisibleToClient(client, e, pvs)) {
+		if ((!indexed || (candidates[e >> 5] & (1u << (e & 31)))) && SV_EntityVisibleToClient(client, e, pvs)) {
 			((eval_t *)((byte *)(ent)->v + fofs_visibility))->_int |= client_flag;
 		}
 		else {
@@ -1160,4 +1201,288 @@ qbool SV_SkipCommsBotMessage(client_t* client)
 	return sv_serveme_fix.value && client->spectator && !strcmp(client->name, "[ServeMe]");
 }
 
+//=============================================================================
+
+// Parallel client frames
+//
+// When sv_parallel_ents is set, SV_SendClientMessages writes only the clientdata
+// part of each datagram in its loop and queues the client here. The players and
+// packet entities of all queued clients are then built at once, on up to
+// sv_parallel_ents worker threads with the main thread helping out. After that the
+// datagrams are finished and sent in client order, as in the serial path.
+//
+// Nothing in the world changes while the jobs run. Each job writes into its own
+// sizebuf, sized to what the clientdata left of the datagram, so the space checks
+// in SV_WriteDelta come out the same as when writing to the datagram itself. The
+// fat PVS and the nail list are kept in the job. Clients share the .visibility
+// fields, so changes to them are recorded per job and applied afterwards. A job
+// that overflows its buffer is thrown away and redone on the main thread.
+//
+// Dropping a client runs game code in the middle of the send loop, and NQ progs
+// get their muzzleflash effects cleared while building frames. Frames where
+// either can happen take the serial path.
+
+#define MAX_ENTS_WORKERS	16
+
+cvar_t	sv_parallel_ents		= {"sv_parallel_ents", "0"};
+cvar_t	sv_parallel_ents_verify	= {"sv_parallel_ents_verify", "0"};
+
+typedef struct entjob_s
+{
+	client_t	*client;
+	qbool		build;				// false if the datagram gets no entities
+	byte		buf[MAX_DATAGRAM];	// the datagram, clientdata written when queued
+	sizebuf_t	msg;
+	byte		entsbuf[MAX_DATAGRAM];
+	sizebuf_t	ents;
+	byte		visibility[MAX_EDICTS];
+	entframe_t	frame;
+} entjob_t;
+
+static struct
+{
+	SDL_Thread		*threads[MAX_ENTS_WORKERS];
+	int				numthreads;
+	SDL_sem			*start;			// posted once for every worker wanted
+	SDL_sem			*done;			// posted by a worker when it runs out of jobs
+	SDL_atomic_t	next;			// next job to take
+
+	qbool			active;			// this frame's datagrams are being queued
+	int				workers;
+	entjob_t		jobs[MAX_CLIENTS];
+	int				numjobs;
+
+	unsigned int	frames, serialframes, verified, mismatches;
+} entpool;
+
+static void SV_ParallelEntities_Build (entjob_t *job)
+{
+	SZ_InitEx(&job->ents, job->entsbuf, job->msg.maxsize - job->msg.cursize, true);
+	memset(job->visibility, ENTVIS_KEEP, sv.num_edicts);
+	job->frame.visibility = job->visibility;
+
+	SV_BuildEntitiesToClient(job->client, &job->ents, false, &job->frame);
+}
+
+static void SV_ParallelEntities_Work (void)
+{
+	int i;
+
+	while ((i = SDL_AtomicAdd(&entpool.next, 1)) < entpool.numjobs)
+	{
+		if (entpool.jobs[i].build)
+			SV_ParallelEntities_Build(&entpool.jobs[i]);
+	}
+}
+
+static int SV_ParallelEntities_Thread (void *unused)
+{
+	while (1)
+	{
+		SDL_SemWait(entpool.start);
+		SV_ParallelEntities_Work();
+		SDL_SemPost(entpool.done);
+	}
+
+	return 0;
+}
+
+static void SV_ParallelEntities_ApplyVisibility (entjob_t *job)
+{
+	unsigned int client_flag = 1 << (job->client - svs.clients);
+	int e;
+
+	if (!fofs_visibility)
+		return;
+
+	for (e = 0; e < sv.num_edicts; e++)
+	{
+		if (job->visibility[e] == ENTVIS_SET)
+			EdictFieldInt(EDICT_NUM(e), fofs_visibility) |= client_flag;
+		else if (job->visibility[e] == ENTVIS_CLEAR)
+			EdictFieldInt(EDICT_NUM(e), fofs_visibility) &= ~client_flag;
+	}
+}
+
+// Builds the job again the serial way and compares. The serial result is what
+// gets sent, so the client frame always matches the bytes on the wire.
+static void SV_ParallelEntities_Verify (entjob_t *job)
+{
+	client_t *client = job->client;
+	packet_entities_t *pack = &client->frames[client->netchan.incoming_sequence & UPDATE_MASK].entities;
+	entity_state_t entities[MAX_PACKETENTITIES_POSSIBLE];
+	int num_entities = pack->num_entities;
+	unsigned int client_flag = 1 << (client - svs.clients);
+	qbool same;
+	byte buf[MAX_DATAGRAM];
+	sizebuf_t msg;
+	int e;
+
+	memcpy(entities, pack->entities, num_entities * sizeof(entities[0]));
+
+	SZ_InitEx(&msg, buf, job->ents.maxsize, true);
+	SV_WriteEntitiesToClient(client, &msg, false);
+
+	same = !msg.overflowed && msg.cursize == job->ents.cursize && !memcmp(msg.data, job->ents.data, msg.cursize)
+		&& pack->num_entities == num_entities && !memcmp(pack->entities, entities, num_entities * sizeof(entities[0]));
+
+	for (e = 0; e < sv.num_edicts && fofs_visibility && same; e++)
+	{
+		if (job->visibility[e] != ENTVIS_KEEP)
+			same = ((EdictFieldInt(EDICT_NUM(e), fofs_visibility) & client_flag) != 0) == (job->visibility[e] == ENTVIS_SET);
+	}
+
+	entpool.verified++;
+	if (!same)
+	{
+		entpool.mismatches++;
+		Con_Printf("WARNING: parallel entity update for %s differs from the serial one\n", client->name);
+	}
+
+	memcpy(job->ents.data, msg.data, msg.cursize);
+	job->ents.cursize = msg.cursize;
+}
+
+/*
+=============
+SV_ParallelEntities_Begin
+
+Called before the send loop, returns true if datagrams should be queued
+with SV_ParallelEntities_Queue this frame instead of sent right away.
+=============
+*/
+qbool SV_ParallelEntities_Begin (void)
+{
+	int i;
+
+	entpool.active = false;
+	entpool.numjobs = 0;
+	entpool.workers = bound(0, (int)sv_parallel_ents.value, MAX_ENTS_WORKERS);
+
+	if (!entpool.workers)
+		return false;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (svs.clients[i].state && (svs.clients[i].drop || svs.clients[i].netchan.message.overflowed))
+			break;
+	}
+
+	if (pr_nqprogs || i < MAX_CLIENTS)
+	{
+		entpool.serialframes++;
+		return false;
+	}
+
+	if (!entpool.start)
+	{
+		entpool.start = SDL_CreateSemaphore(0);
+		entpool.done = SDL_CreateSemaphore(0);
+	}
+
+	while (entpool.numthreads < entpool.workers)
+	{
+		entpool.threads[entpool.numthreads] = SDL_CreateThread(SV_ParallelEntities_Thread, "sv_ents", NULL);
+		if (!entpool.threads[entpool.numthreads])
+			Sys_Error("SV_ParallelEntities_Begin: couldn't create worker thread: %s", SDL_GetError());
+		entpool.numthreads++;
+	}
+
+	entpool.active = true;
+	return true;
+}
+
+/*
+=============
+SV_ParallelEntities_Queue
+
+Writes the clientdata for a spawned client and keeps the datagram
+for SV_ParallelEntities_Run.
+=============
+*/
+void SV_ParallelEntities_Queue (client_t *client)
+{
+	entjob_t *job = &entpool.jobs[entpool.numjobs++];
+
+	job->client = client;
+	job->build = !SV_SkipCommsBotMessage(client);
+	SZ_InitEx(&job->msg, job->buf, sizeof(job->buf), true);
+
+	if (job->build)
+		SV_WriteClientdataToMessage(client, &job->msg);
+}
+
+/*
+=============
+SV_ParallelEntities_Run
+
+Builds the entities of all queued datagrams, then finishes
+and sends them in the order they were queued.
+=============
+*/
+void SV_ParallelEntities_Run (void)
+{
+	int i, workers;
+	entjob_t *job;
+
+	if (!entpool.active)
+		return;
+	entpool.active = false;
+
+	// the main thread takes jobs too
+	workers = min(entpool.workers, entpool.numjobs - 1);
+
+	SDL_AtomicSet(&entpool.next, 0);
+	for (i = 0; i < workers; i++)
+		SDL_SemPost(entpool.start);
+	SV_ParallelEntities_Work();
+	for (i = 0; i < workers; i++)
+		SDL_SemWait(entpool.done);
+
+	entpool.frames++;
+
+	for (i = 0, job = entpool.jobs; i < entpool.numjobs; i++, job++)
+	{
+		if (job->build)
+		{
+			if (job->ents.overflowed)
+			{
+				// the serial path clears the whole datagram on overflow, do it that way
+				SV_WriteEntitiesToClient(job->client, &job->msg, false);
+			}
+			else
+			{
+				SV_ParallelEntities_ApplyVisibility(job);
+				if (sv_parallel_ents_verify.value)
+					SV_ParallelEntities_Verify(job);
+				SZ_Write(&job->msg, job->ents.data, job->ents.cursize);
+			}
+		}
+
+		SV_FinishClientDatagram(job->client, &job->msg);
+	}
+
+	entpool.numjobs = 0;
+}
+
+static void SV_ParallelEntities_Stats_f (void)
+{
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset"))
+	{
+		entpool.frames = entpool.serialframes = entpool.verified = entpool.mismatches = 0;
+		return;
+	}
+
+	Con_Printf("parallel entity frames: %u, %u serial fallbacks, %d worker threads\n", entpool.frames, entpool.serialframes, entpool.numthreads);
+	if (sv_parallel_ents_verify.value || entpool.mismatches)
+		Con_Printf("verified client updates: %u, %u mismatches\n", entpool.verified, entpool.mismatches);
+}
+
+void SV_ParallelEntities_Init (void)
+{
+	Cvar_Register(&sv_parallel_ents);
+	Cvar_Register(&sv_parallel_ents_verify);
+	Cmd_AddCommand("sv_parallel_ents_stats", SV_ParallelEntities_Stats_f);
+}
+
 #endif // !CLIENTONLY
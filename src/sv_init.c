@@ -187,14 +187,10 @@ static void SV_SaveSpawnparms (void)
 
 static unsigned SV_CheckModel(char *mdl)
 {
-	unsigned char *buf;
+	fs_mappedfile_t file;
 	unsigned short crc;
-	int filesize;
-	int mark;
 
-	mark = Hunk_LowMark ();
-	buf = (byte *) FS_LoadHunkFile (mdl, &filesize);
-	if (!buf)
+	if (!FS_MapFile (mdl, &file))
 	{
 		if (!strcmp (mdl, "progs/player.mdl"))
 			return 33168;
@@ -206,8 +202,8 @@ static unsigned SV_CheckModel(char *mdl)
 			SV_Error ("SV_CheckModel: could not load %s\n", mdl);
 	}
 
-	crc = CRC_Block (buf, filesize);
-	Hunk_FreeToLowMark (mark);
+	crc = CRC_Block ((byte *) file.data, file.len);
+	FS_UnmapFile (&file);
 
 	return crc;
 }
@@ -276,6 +272,9 @@ void SV_SpawnServer(char *mapname, qbool devmap, char* entityfile, qbool loading
 
 	svs.spawncount++; // any partially connected client will be restarted
 
+	// files on disk may be replaced between maps, don't keep serving old copies
+	SV_DownloadCache_Flush();
+
 #ifndef SERVERONLY
 	com_serveractive = false;
 #endif
@@ -370,7 +369,6 @@ void SV_SpawnServer(char *mapname, qbool devmap, char* entityfile, qbool loading
 	{
 		sv.edicts[i].v = (entvars_t *)((byte *)sv.game_edicts + i * pr_edict_size);
 		sv.edicts[i].e.entnum = i;
-		sv.edicts[i].e.area.ed = &sv.edicts[i]; // yeah, pretty funny, but this help to find which edict_t own this area (link_t)
 		PR_ClearEdict(&sv.edicts[i]);
 	}
 
@@ -629,6 +627,9 @@ void SV_SpawnServer(char *mapname, qbool devmap, char* entityfile, qbool loading
 	PR_LoadEnts(entitystring);
 	// ********* End of External Entity support code *********
 
+	// now that the map entities are known, size the area tree for them
+	SV_AreaRebuild ();
+
 	// look up some model indexes for specialized message compression
 	SV_FindModelNumbers ();
 
@@ -0,0 +1,165 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// sv_iptrie.c - binary radix trie of IPv4 prefixes, used by the ip filters
+//
+// Path compressed, so every node either holds data or joins two branches, and
+// a lookup visits at most 33 nodes however many filters there are. Prefixes and
+// addresses are in host byte order.
+
+#ifndef CLIENTONLY
+#include "qwsvdef.h"
+
+static unsigned int IPTrie_Mask (int len)
+{
+	return len ? 0xFFFFFFFFu << (32 - len) : 0;
+}
+
+// bit n counting from the top
+static int IPTrie_Bit (unsigned int addr, int n)
+{
+	return (addr >> (31 - n)) & 1;
+}
+
+static iptrie_node_t *IPTrie_NewNode (unsigned int prefix, int len, void *data)
+{
+	iptrie_node_t *n = (iptrie_node_t *) Q_malloc (sizeof(*n));
+
+	n->prefix = prefix;
+	n->len = len;
+	n->data = data;
+	return n;
+}
+
+void IPTrie_Insert (iptrie_t *t, unsigned int prefix, int len, void *data)
+{
+	iptrie_node_t **link = &t->root, *n, *fork;
+	unsigned int diff;
+	int common;
+
+	prefix &= IPTrie_Mask(len);
+
+	while ((n = *link))
+	{
+		diff = n->prefix ^ prefix;
+		for (common = 0; common < n->len && common < len && !IPTrie_Bit(diff, common); common++)
+			;
+
+		if (common < n->len)
+		{
+			// the new prefix ends or branches off inside this node's prefix
+			fork = IPTrie_NewNode(prefix & IPTrie_Mask(common), common, NULL);
+			fork->child[IPTrie_Bit(n->prefix, common)] = n;
+			if (common == len)
+				fork->data = data;
+			else
+				fork->child[IPTrie_Bit(prefix, common)] = IPTrie_NewNode(prefix, len, data);
+			*link = fork;
+			t->count++;
+			return;
+		}
+
+		if (n->len == len)
+		{
+			if (!n->data)
+				t->count++;
+			n->data = data;
+			return;
+		}
+
+		link = &n->child[IPTrie_Bit(prefix, n->len)];
+	}
+
+	*link = IPTrie_NewNode(prefix, len, data);
+	t->count++;
+}
+
+void *IPTrie_Find (iptrie_t *t, unsigned int prefix, int len)
+{
+	iptrie_node_t *n = t->root;
+
+	prefix &= IPTrie_Mask(len);
+
+	while (n && n->len <= len && (prefix & IPTrie_Mask(n->len)) == n->prefix)
+	{
+		if (n->len == len)
+			return n->data;
+		n = n->child[IPTrie_Bit(prefix, n->len)];
+	}
+
+	return NULL;
+}
+
+// Removes a node which has no data and less than two children.
+static void IPTrie_Prune (iptrie_node_t **link)
+{
+	iptrie_node_t *n = *link;
+
+	if (!n || n->data || (n->child[0] && n->child[1]))
+		return;
+
+	*link = n->child[0] ? n->child[0] : n->child[1];
+	Q_free(n);
+}
+
+void IPTrie_Remove (iptrie_t *t, unsigned int prefix, int len)
+{
+	iptrie_node_t **link = &t->root, **parentlink = NULL, *n;
+
+	prefix &= IPTrie_Mask(len);
+
+	while ((n = *link))
+	{
+		if (n->len > len || (prefix & IPTrie_Mask(n->len)) != n->prefix)
+			return;
+		if (n->len == len)
+			break;
+
+		parentlink = link;
+		link = &n->child[IPTrie_Bit(prefix, n->len)];
+	}
+
+	if (!n || !n->data)
+		return;
+
+	n->data = NULL;
+	t->count--;
+
+	IPTrie_Prune(link);
+	if (parentlink)
+		IPTrie_Prune(parentlink);
+}
+
+// Collects the data of every prefix which contains addr, shortest prefix first.
+int IPTrie_Match (iptrie_t *t, unsigned int addr, void **matches, int maxmatches)
+{
+	iptrie_node_t *n = t->root;
+	int count = 0;
+
+	while (n && (addr & IPTrie_Mask(n->len)) == n->prefix)
+	{
+		if (n->data && count < maxmatches)
+			matches[count++] = n->data;
+		if (n->len == 32)
+			break;
+		n = n->child[IPTrie_Bit(addr, n->len)];
+	}
+
+	return count;
+}
+
+#endif // !CLIENTONLY
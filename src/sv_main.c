@@ -399,6 +399,8 @@ void SV_DropClient(client_t* drop)
 		VFS_CLOSE(drop->download);
 		drop->download = NULL;
 	}
+	SV_DownloadCache_Release(drop->dlfile);
+	drop->dlfile = NULL;
 	if (drop->upload)
 	{
 		fclose (drop->upload);
@@ -1969,21 +1971,172 @@ If 0, then only addresses matching the list will be allowed.  This lets you easi
 } ipfilter_t;
 */
 
-#define	MAX_IPFILTERS	1024
+// Filters are kept in the order they were added, which is what listip, writeip and
+// the ban ids go by, and are indexed by prefix in a radix trie (sv_iptrie.c) so a
+// lookup doesn't depend on how many there are. A filter like "10.0.0.1" matches
+// 10.*.*.1, its mask is not a prefix, so these few are checked one by one instead.
+typedef struct
+{
+	ipfilter_t	**list;
+	int			count;
+	int			max;
+
+	iptrie_t	trie;
 
-ipfilter_t	ipfilters[MAX_IPFILTERS];
-int		numipfilters;
+	ipfilter_t	**sparse;
+	int			numsparse;
+	int			maxsparse;
 
-ipfilter_t	ipvip[MAX_IPFILTERS];
-int		numipvips;
+	int			nextorder;
+} ipfilterlist_t;
+
+static ipfilterlist_t	ipfilters;
+static ipfilterlist_t	ipvip;
 
 //bliP: cuff, mute ->
-penfilter_t	penfilters[MAX_PENFILTERS];
+penfilter_t	**penfilters;
 int		numpenfilters;
+static int		maxpenfilters;
+static iptrie_t	pentrie[ft_cuff + 1]; // by filtertype_t, /32 prefixes
 //<-
 
 cvar_t	filterban = {"filterban", "1"};
 
+// prefix length of the mask, -1 if it isn't a prefix
+static int IPF_PrefixLen (const ipfilter_t *f)
+{
+	unsigned int m = ntohl(f->mask);
+	int len = 0;
+
+	while (len < 32 && (m & (0x80000000u >> len)))
+		len++;
+
+	return (len < 32 && (m << len)) ? -1 : len;
+}
+
+static void IPF_AddSparse (ipfilterlist_t *l, ipfilter_t *f)
+{
+	if (l->numsparse == l->maxsparse)
+	{
+		l->maxsparse = l->maxsparse ? l->maxsparse * 2 : 16;
+		l->sparse = (ipfilter_t **) Q_realloc (l->sparse, l->maxsparse * sizeof(l->sparse[0]));
+	}
+	l->sparse[l->numsparse++] = f;
+}
+
+static ipfilter_t *IPF_Find (ipfilterlist_t *l, const ipfilter_t *f)
+{
+	int i, len = IPF_PrefixLen (f);
+
+	if (len >= 0)
+		return (ipfilter_t *) IPTrie_Find (&l->trie, ntohl(f->compare), len);
+
+	for (i = 0; i < l->numsparse; i++)
+		if (l->sparse[i]->mask == f->mask && l->sparse[i]->compare == f->compare)
+			return l->sparse[i];
+
+	return NULL;
+}
+
+// Adds the filter, or updates the one with the same address and mask.
+static void IPF_Add (ipfilterlist_t *l, const ipfilter_t *f)
+{
+	ipfilter_t *dst = IPF_Find (l, f);
+	int len;
+
+	if (dst)
+	{
+		int order = dst->order;
+
+		*dst = *f;
+		dst->order = order;
+		return;
+	}
+
+	dst = (ipfilter_t *) Q_malloc (sizeof(*dst));
+	*dst = *f;
+	dst->order = l->nextorder++;
+
+	if (l->count == l->max)
+	{
+		l->max = l->max ? l->max * 2 : 64;
+		l->list = (ipfilter_t **) Q_realloc (l->list, l->max * sizeof(l->list[0]));
+	}
+	l->list[l->count++] = dst;
+
+	if ((len = IPF_PrefixLen (dst)) >= 0)
+		IPTrie_Insert (&l->trie, ntohl(dst->compare), len, dst);
+	else
+		IPF_AddSparse (l, dst);
+}
+
+static void IPF_Remove (ipfilterlist_t *l, int i)
+{
+	ipfilter_t *f = l->list[i];
+	int j, len = IPF_PrefixLen (f);
+
+	if (len >= 0)
+	{
+		IPTrie_Remove (&l->trie, ntohl(f->compare), len);
+	}
+	else
+	{
+		for (j = 0; j < l->numsparse; j++)
+		{
+			if (l->sparse[j] == f)
+			{
+				memmove (l->sparse + j, l->sparse + j + 1, (--l->numsparse - j) * sizeof(l->sparse[0]));
+				break;
+			}
+		}
+	}
+
+	memmove (l->list + i, l->list + i + 1, (--l->count - i) * sizeof(l->list[0]));
+	Q_free (f);
+}
+
+// The first added filter which matches the address, with type < 0 any type will do.
+static ipfilter_t *IPF_Match (ipfilterlist_t *l, const byte *ip, int type)
+{
+	void *matches[33];
+	ipfilter_t *f, *best = NULL;
+	unsigned int in = *(unsigned *)ip;
+	int i, count;
+
+	count = IPTrie_Match (&l->trie, ntohl(in), matches, sizeof(matches) / sizeof(matches[0]));
+	for (i = 0; i < count; i++)
+	{
+		f = (ipfilter_t *) matches[i];
+		if ((type < 0 || f->type == type) && (!best || f->order < best->order))
+			best = f;
+	}
+
+	for (i = 0; i < l->numsparse; i++)
+	{
+		f = l->sparse[i];
+		if ((in & f->mask) == f->compare && (type < 0 || f->type == type) && (!best || f->order < best->order))
+			best = f;
+	}
+
+	return best;
+}
+
+// "a.b.c.d", or "a.b.c.d/len" when StringToFilter wouldn't get the mask from the address alone
+static char *IPF_ToString (const ipfilter_t *f)
+{
+	byte b[4], m[4];
+	int i;
+
+	*(unsigned *)b = f->compare;
+	*(unsigned *)m = f->mask;
+
+	for (i = 0; i < 4; i++)
+		if (m[i] != (b[i] ? 255 : 0))
+			return va("%i.%i.%i.%i/%i", b[0], b[1], b[2], b[3], IPF_PrefixLen (f));
+
+	return va("%i.%i.%i.%i", b[0], b[1], b[2], b[3]);
+}
+
 /*
 =================
 StringToFilter
@@ -1996,6 +2149,7 @@ qbool StringToFilter (char *s, ipfilter_t *f)
 	byte	b[4];
 	byte	m[4];
 
+	memset (f, 0, sizeof(*f));
 	for (i=0 ; i<4 ; i++)
 	{
 		b[i] = 0;
@@ -2011,7 +2165,7 @@ qbool StringToFilter (char *s, ipfilter_t *f)
 		}
 
 		j = 0;
-		while (*s >= '0' && *s <= '9')
+		while (*s >= '0' && *s <= '9' && j < (int)sizeof(num) - 1)
 		{
 			num[j++] = *s++;
 		}
@@ -2020,11 +2174,26 @@ qbool StringToFilter (char *s, ipfilter_t *f)
 		if (b[i] != 0)
 			m[i] = 255;
 
-		if (!*s)
+		if (!*s || *s == '/')
 			break;
 		s++;
 	}
 
+	// CIDR notation, "192.168.0.0/16"
+	if (*s == '/')
+	{
+		int len = Q_atoi(s + 1);
+
+		if (len < 0 || len > 32 || s[1] < '0' || s[1] > '9')
+			return false;
+
+		for (i = 0; i < 4; i++, len -= 8)
+		{
+			m[i] = len >= 8 ? 255 : len > 0 ? (byte)(0xFF << (8 - len)) : 0;
+			b[i] &= m[i];
+		}
+	}
+
 	f->mask = *(unsigned *)m;
 	f->compare = *(unsigned *)b;
 
@@ -2038,7 +2207,7 @@ SV_AddIPVIP_f
 */
 static void SV_AddIPVIP_f (void)
 {
-	int		i, l;
+	int		l;
 	ipfilter_t f;
 
 	if (!StringToFilter (Cmd_Argv(1), &f))
@@ -2051,22 +2220,8 @@ static void SV_AddIPVIP_f (void)
 
 	if (l < 1) l = 1;
 
-	for (i=0 ; i<numipvips ; i++)
-		if (ipvip[i].compare == 0xffffffff || (ipvip[i].mask == f.mask
-		                                       && ipvip[i].compare == f.compare))
-			break;		// free spot
-	if (i == numipvips)
-	{
-		if (numipvips == MAX_IPFILTERS)
-		{
-			Con_Printf ("VIP spectator IP list is full\n");
-			return;
-		}
-		numipvips++;
-	}
-
-	ipvip[i] = f;
-	ipvip[i].level = l;
+	f.level = l;
+	IPF_Add (&ipvip, &f);
 }
 
 /*
@@ -2077,20 +2232,18 @@ SV_RemoveIPVIP_f
 static void SV_RemoveIPVIP_f (void)
 {
 	ipfilter_t	f;
-	int		i, j;
+	int		i;
 
 	if (!StringToFilter (Cmd_Argv(1), &f))
 	{
 		Con_Printf ("Bad filter address: %s\n", Cmd_Argv(1));
 		return;
 	}
-	for (i=0 ; i<numipvips ; i++)
-		if (ipvip[i].mask == f.mask
-		        && ipvip[i].compare == f.compare)
+	for (i=0 ; i<ipvip.count ; i++)
+		if (ipvip.list[i]->mask == f.mask
+		        && ipvip.list[i]->compare == f.compare)
 		{
-			for (j=i+1 ; j<numipvips ; j++)
-				ipvip[j-1] = ipvip[j];
-			numipvips--;
+			IPF_Remove (&ipvip, i);
 			Con_Printf ("Removed.\n");
 			return;
 		}
@@ -2105,13 +2258,11 @@ SV_ListIP_f
 static void SV_ListIPVIP_f (void)
 {
 	int		i;
-	byte	b[4];
 
 	Con_Printf ("VIP list:\n");
-	for (i=0 ; i<numipvips ; i++)
+	for (i=0 ; i<ipvip.count ; i++)
 	{
-		*(unsigned *)b = ipvip[i].compare;
-		Con_Printf ("%3i.%3i.%3i.%3i   level %d\n", b[0], b[1], b[2], b[3], ipvip[i].level);
+		Con_Printf ("%-18s   level %d\n", IPF_ToString (ipvip.list[i]), ipvip.list[i]->level);
 	}
 }
 
@@ -2124,7 +2275,6 @@ static void SV_WriteIPVIP_f (void)
 {
 	FILE	*f;
 	char	name[MAX_OSPATH];
-	byte	b[4];
 	int		i;
 
 	snprintf (name, MAX_OSPATH, "%s/vip_ip.cfg", fs_gamedir);
@@ -2138,10 +2288,9 @@ static void SV_WriteIPVIP_f (void)
 		return;
 	}
 
-	for (i=0 ; i<numipvips ; i++)
+	for (i=0 ; i<ipvip.count ; i++)
 	{
-		*(unsigned *)b = ipvip[i].compare;
-		fprintf (f, "vip_addip %i.%i.%i.%i %d\n", b[0], b[1], b[2], b[3], ipvip[i].level);
+		fprintf (f, "vip_addip %s %d\n", IPF_ToString (ipvip.list[i]), ipvip.list[i]->level);
 	}
 
 	fclose (f);
@@ -2158,7 +2307,6 @@ SV_AddIP_f
 */
 static void SV_AddIP_f (void)
 {
-	int		i;
 	double	t = 0;
 	char	*s;
 	time_t	long_time = time(NULL);
@@ -2194,21 +2342,7 @@ static void SV_AddIP_f (void)
 	f.time = t;
 	f.type = ipft;
 
-	for (i=0 ; i<numipfilters ; i++)
-		if (ipfilters[i].compare == 0xffffffff || (ipfilters[i].mask == f.mask
-		        && ipfilters[i].compare == f.compare))
-			break;		// free spot
-	if (i == numipfilters)
-	{
-		if (numipfilters == MAX_IPFILTERS)
-		{
-			Con_Printf ("IP filter list is full\n");
-			return;
-		}
-		numipfilters++;
-	}
-
-	ipfilters[i] = f;
+	IPF_Add (&ipfilters, &f);
 }
 
 /*
@@ -2219,7 +2353,7 @@ SV_RemoveIP_f
 static void SV_RemoveIP_f (void)
 {
 	ipfilter_t	f;
-	int			i, j;
+	int			i;
 
 	if (!StringToFilter (Cmd_Argv(1), &f))
 	{
@@ -2227,13 +2361,11 @@ static void SV_RemoveIP_f (void)
 		return;
 	}
 
-	for (i=0 ; i<numipfilters ; i++)
-		if (ipfilters[i].mask == f.mask
-		        && ipfilters[i].compare == f.compare)
+	for (i=0 ; i<ipfilters.count ; i++)
+		if (ipfilters.list[i]->mask == f.mask
+		        && ipfilters.list[i]->compare == f.compare)
 		{
-			for (j=i+1 ; j<numipfilters ; j++)
-				ipfilters[j-1] = ipfilters[j];
-			numipfilters--;
+			IPF_Remove (&ipfilters, i);
 			Con_Printf ("Removed.\n");
 			return;
 		}
@@ -2249,20 +2381,20 @@ static void SV_ListIP_f (void)
 {
 	time_t	long_time = time(NULL);
 	int		i;
-	byte	b[4];
+	ipfilter_t *f;
 
 	Con_Printf ("Filter list:\n");
-	for (i=0 ; i<numipfilters ; i++)
+	for (i=0 ; i<ipfilters.count ; i++)
 	{
-		*(unsigned *)b = ipfilters[i].compare;
-		Con_Printf ("%3i.%3i.%3i.%3i | ", b[0], b[1], b[2], b[3]);
-		switch((int)ipfilters[i].type){
+		f = ipfilters.list[i];
+		Con_Printf ("%18s | ", IPF_ToString (f));
+		switch((int)f->type){
 			case ipft_ban:  Con_Printf (" ban"); break;
 			case ipft_safe: Con_Printf ("safe"); break;
 			default: Con_Printf ("unkn"); break;
 		}
-		if (ipfilters[i].time)
-			Con_Printf (" | %i s", (int)(ipfilters[i].time-long_time));
+		if (f->time)
+			Con_Printf (" | %i s", (int)(f->time-long_time));
 		Con_Printf ("\n");
 	}
 }
@@ -2276,7 +2408,6 @@ static void SV_WriteIP_f (void)
 {
 	FILE	*f;
 	char	name[MAX_OSPATH], *s;
-	byte	b[4];
 	int		i;
 
 	snprintf (name, MAX_OSPATH, "%s/listip.cfg", fs_gamedir);
@@ -2291,27 +2422,25 @@ static void SV_WriteIP_f (void)
 	}
 
 	// write safe filters first
-	for (i=0 ; i<numipfilters ; i++)
+	for (i=0 ; i<ipfilters.count ; i++)
 	{
-		if(ipfilters[i].type != ipft_safe)
+		if(ipfilters.list[i]->type != ipft_safe)
 			continue;
 
-		*(unsigned *)b = ipfilters[i].compare;
-		fprintf (f, "addip %i.%i.%i.%i safe %.0f\n", b[0], b[1], b[2], b[3], ipfilters[i].time);
+		fprintf (f, "addip %s safe %.0f\n", IPF_ToString (ipfilters.list[i]), ipfilters.list[i]->time);
 	}
 
-	for (i=0 ; i<numipfilters ; i++)
+	for (i=0 ; i<ipfilters.count ; i++)
 	{
-		if(ipfilters[i].type == ipft_safe)
+		if(ipfilters.list[i]->type == ipft_safe)
 			continue; // ignore safe, we already save it
 
-		switch((int)ipfilters[i].type){
+		switch((int)ipfilters.list[i]->type){
 			case ipft_ban:  s = " ban"; break;
 			case ipft_safe: s = "safe"; break;
 			default: s = "unkn"; break;
 		}
-		*(unsigned *)b = ipfilters[i].compare;
-		fprintf (f, "addip %i.%i.%i.%i %s %.0f\n", b[0], b[1], b[2], b[3], s, ipfilters[i].time);
+		fprintf (f, "addip %s %s %.0f\n", IPF_ToString (ipfilters.list[i]), s, ipfilters.list[i]->time);
 	}
 
 	fclose (f);
@@ -2320,6 +2449,68 @@ static void SV_WriteIP_f (void)
 	FS_FlushFSHash();
 }
 
+/*
+=================
+SV_LoadIP_f
+
+loadip <file>
+Reads a listip.cfg style file straight away instead of through the command
+buffer, so ban lists with thousands of entries are loaded in one go. Lines are
+addip or vip_addip commands, or a bare address (or a.b.c.d/len) to ban.
+=================
+*/
+static void SV_LoadIP_f (void)
+{
+	FILE	*f;
+	char	name[MAX_OSPATH], line[1024];
+	int		lines = 0;
+
+	if (Cmd_Argc () != 2)
+	{
+		Con_Printf ("Usage: %s <file>\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (FS_UnsafeFilename (Cmd_Argv(1)))
+	{
+		Con_Printf ("Bad file name: %s\n", Cmd_Argv(1));
+		return;
+	}
+
+	snprintf (name, MAX_OSPATH, "%s/%s", fs_gamedir, Cmd_Argv(1));
+
+	f = fopen (name, "rt");
+	if (!f)
+	{
+		Con_Printf ("Couldn't open %s\n", name);
+		return;
+	}
+
+	while (fgets (line, sizeof(line), f))
+	{
+		Cmd_TokenizeString (line);
+		if (!Cmd_Argc () || Cmd_Argv(0)[0] == '#' || !strncmp (Cmd_Argv(0), "//", 2))
+			continue;
+
+		if (Cmd_Argv(0)[0] >= '0' && Cmd_Argv(0)[0] <= '9')
+			Cmd_TokenizeString (va("addip %s", Cmd_Argv(0)));
+
+		if (!strcmp (Cmd_Argv(0), "addip"))
+			SV_AddIP_f ();
+		else if (!strcmp (Cmd_Argv(0), "vip_addip"))
+			SV_AddIPVIP_f ();
+		else
+			continue;
+
+		lines++;
+	}
+
+	fclose (f);
+
+	Con_Printf ("Loaded %d filters from %s, %d ip filters and %d VIP filters in total\n",
+		lines, name, ipfilters.count, ipvip.count);
+}
+
 /*
 =================
 SV_SendBan
@@ -2344,14 +2535,8 @@ SV_FilterPacket
 */
 qbool SV_FilterPacket (void)
 {
-	int		i;
-	unsigned	in;
-
-	in = *(unsigned *)net_from.ip;
-
-	for (i=0 ; i<numipfilters ; i++)
-		if ( ipfilters[i].type == ipft_ban && (in & ipfilters[i].mask) == ipfilters[i].compare )
-			return (int)filterban.value;
+	if (IPF_Match (&ipfilters, net_from.ip, ipft_ban))
+		return (int)filterban.value;
 
 	return !(int)filterban.value;
 }
@@ -2364,23 +2549,23 @@ void Do_BanList(ipfiltertype_t ipft)
 {
 	time_t	long_time = time(NULL);
 	int		i;
-	byte	b[4];
+	ipfilter_t *f;
 
-	for (i=0 ; i<numipfilters ; i++)
+	for (i=0 ; i<ipfilters.count ; i++)
 	{
-		if (ipfilters[i].type != ipft)
+		f = ipfilters.list[i];
+		if (f->type != ipft)
 			continue;
 
-		*(unsigned *)b = ipfilters[i].compare;
-		Con_Printf ("%3i|%3i.%3i.%3i.%3i", i, b[0], b[1], b[2], b[3]);
-		switch((int)ipfilters[i].type){
+		Con_Printf ("%3i|%18s", i, IPF_ToString (f));
+		switch((int)f->type){
 			case ipft_ban:  Con_Printf ("| ban"); break;
 			case ipft_safe: Con_Printf ("|safe"); break;
 			default: Con_Printf ("|unkn"); break;
 		}
 
-		if (ipfilters[i].time) {
-			long df = ipfilters[i].time-long_time;
+		if (f->time) {
+			long df = f->time-long_time;
 			long d, h, m, s;
 			d = df / (60*60*24);
 			df -= d * 60*60*24;
@@ -2407,15 +2592,15 @@ void SV_BanList (void)
 {
 	unsigned char blist[64] = "Ban list:", id[64] = "id", ipmask[64] = "ip mask", type[64] = "type", expire[64] = "expire";
 
-	if (numipfilters < 1) {
+	if (ipfilters.count < 1) {
 		Con_Printf ("Ban list: empty\n");
 		return;
 	}
 
 	Con_Printf ("%s\n"
 				"\235\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236"
-				"\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\237\n"
-				"%3.3s|%15.15s|%4.4s|%9.9s\n",
+				"\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\236\237\n"
+				"%3.3s|%18.18s|%4.4s|%9.9s\n",
 				Q_redtext(blist), Q_redtext(id), Q_redtext(ipmask), Q_redtext(type), Q_redtext(expire));
 
 	Do_BanList(ipft_safe);
@@ -2424,24 +2609,20 @@ void SV_BanList (void)
 
 qbool SV_CanAddBan (ipfilter_t *f)
 {
-	int i;
+	ipfilter_t *safe;
 
 	if (f->compare == 0)
 		return false;
 
-	for (i=0 ; i<numipfilters ; i++)
-		if (ipfilters[i].mask == f->mask && ipfilters[i].compare == f->compare && ipfilters[i].type == ipft_safe)
-			return false; // can't add filter f because present "safe" filter
+	if ((safe = IPF_Find (&ipfilters, f)) && safe->type == ipft_safe)
+		return false; // can't add filter f because present "safe" filter
 
 	return true;
 }
 
 void SV_RemoveBansIPFilter (int i)
 {
-	for (; i + 1 < numipfilters; i++)
-		ipfilters[i] = ipfilters[i + 1];
-
-	numipfilters--;
+	IPF_Remove (&ipfilters, i);
 }
 
 void SV_CleanBansIPList (void)
@@ -2452,9 +2633,9 @@ void SV_CleanBansIPList (void)
 	if (sv.state != ss_active)
 		return;
 
-	for (i = 0; i < numipfilters;)
+	for (i = 0; i < ipfilters.count;)
 	{
-		if (ipfilters[i].time && ipfilters[i].time <= long_time)
+		if (ipfilters.list[i]->time && ipfilters.list[i]->time <= long_time)
 		{
 			SV_RemoveBansIPFilter (i);
 		}
@@ -2633,7 +2814,6 @@ void SV_Cmd_Banremove_f(void)
 {
 	edict_t	*ent;
 	eval_t *val;
-	byte	b[4];
 	int		id;
 
 	// set up the edict
@@ -2658,18 +2838,17 @@ void SV_Cmd_Banremove_f(void)
 
 	id = Q_atoi(Cmd_Argv(1));
 
-	if (id < 0 || id >= numipfilters) {
+	if (id < 0 || id >= ipfilters.count) {
 		Con_Printf ("Wrong ban id: %d\n", id);
 		return;
 	}
 
-	if (ipfilters[id].type == ipft_safe) {
+	if (ipfilters.list[id]->type == ipft_safe) {
 		Con_Printf ("Can't remove such ban with id: %d\n", id);
 		return;
 	}
 
-	*(unsigned *)b = ipfilters[id].compare;
-	SV_BroadcastPrintf (PRINT_HIGH, "%3i.%3i.%3i.%3i was unbanned\n", b[0], b[1], b[2], b[3]);
+	SV_BroadcastPrintf (PRINT_HIGH, "%s was unbanned\n", IPF_ToString (ipfilters.list[id]));
 
 	SV_RemoveBansIPFilter (id);
 	Cbuf_AddText("writeip\n");
@@ -2684,16 +2863,9 @@ SV_VIPbyIP
 */
 int SV_VIPbyIP (netadr_t adr)
 {
-	int		i;
-	unsigned	in;
+	ipfilter_t *f = IPF_Match (&ipvip, adr.ip, -1);
 
-	in = *(unsigned *)adr.ip;
-
-	for (i=0 ; i<numipvips ; i++)
-		if ( (in & ipvip[i].mask) == ipvip[i].compare)
-			return ipvip[i].level;
-
-	return 0;
+	return f ? f->level : 0;
 }
 
 /*
@@ -2835,10 +3007,13 @@ void SV_Script_f (void)
 //bliP: cuff, mute ->
 void SV_RemoveIPFilter (int i)
 {
-	for (; i + 1 < numpenfilters; i++)
-		penfilters[i] = penfilters[i + 1];
+	penfilter_t *f = penfilters[i];
 
-	numpenfilters--;
+	IPTrie_Remove (&pentrie[f->type], ntohl(*(unsigned *)f->ip), 32);
+	// the last filter takes the free slot, nothing has to be shifted
+	penfilters[i] = penfilters[--numpenfilters];
+	penfilters[i]->index = i;
+	Q_free (f);
 }
 
 static void SV_CleanIPList (void)
@@ -2850,7 +3025,7 @@ static void SV_CleanIPList (void)
 
 	for (i = 0; i < numpenfilters;)
 	{
-		if (penfilters[i].time && (penfilters[i].time <= realtime))
+		if (penfilters[i]->time && (penfilters[i]->time <= realtime))
 		{
 			SV_RemoveIPFilter (i);
 		}
@@ -2859,70 +3034,119 @@ static void SV_CleanIPList (void)
 	}
 }
 
-static qbool SV_IPCompare (byte *a, byte *b)
-{
-	int i;
-
-	for (i = 0; i < 1; i++)
-		if (((unsigned int *)a)[i] != ((unsigned int *)b)[i])
-			return false;
-
-	return true;
-}
-
-static void SV_IPCopy (byte *dest, byte *src)
-{
-	int i;
-
-	for (i = 0; i < 1; i++)
-		((unsigned int *)dest)[i] = ((unsigned int *)src)[i];
-}
-
 void SV_SavePenaltyFilter (client_t *cl, filtertype_t type, double pentime)
 {
-	int i;
+	penfilter_t *f;
+	unsigned int ip = ntohl(*(unsigned *)cl->realip.ip);
 
 	if (pentime < curtime)   // no point
 		return;
 
-	for (i = 0; i < numpenfilters; i++)
-		if (SV_IPCompare (penfilters[i].ip, cl->realip.ip)	&& penfilters[i].type == type)
-		{
-			return;
-		}
+	if (IPTrie_Find (&pentrie[type], ip, 32))
+		return;
+
+	f = (penfilter_t *) Q_malloc (sizeof(*f));
+	memcpy (f->ip, cl->realip.ip, sizeof(f->ip));
+	f->time = pentime;
+	f->type = type;
 
-	if (numpenfilters == MAX_IPFILTERS)
+	if (numpenfilters == maxpenfilters)
 	{
-		return;
+		maxpenfilters = maxpenfilters ? maxpenfilters * 2 : 64;
+		penfilters = (penfilter_t **) Q_realloc (penfilters, maxpenfilters * sizeof(penfilters[0]));
 	}
+	f->index = numpenfilters;
+	penfilters[numpenfilters++] = f;
 
-	SV_IPCopy (penfilters[numpenfilters].ip, cl->realip.ip);
-	penfilters[numpenfilters].time = pentime;
-	penfilters[numpenfilters].type = type;
-	numpenfilters++;
+	IPTrie_Insert (&pentrie[type], ip, 32, f);
 }
 
 double SV_RestorePenaltyFilter (client_t *cl, filtertype_t type)
 {
-	int i;
+	penfilter_t *f;
 	double time1 = 0.0;
 
 	// search for existing penalty filter of same type
-	for (i = 0; i < numpenfilters; i++)
-	{
-		if (type == penfilters[i].type && SV_IPCompare (cl->realip.ip, penfilters[i].ip))
-		{
-			time1 = penfilters[i].time;
-			SV_RemoveIPFilter (i);
-			return time1;
-		}
-	}
+	if (!(f = (penfilter_t *) IPTrie_Find (&pentrie[type], ntohl(*(unsigned *)cl->realip.ip), 32)))
+		return time1;
+
+	time1 = f->time;
+	SV_RemoveIPFilter (f->index);
 	return time1;
 }
 //<-
 
 //============================================================================
 
+// SV_ReadPackets demux, (ip, qport) -> client.
+// Entries are checked against the client on every lookup and filled in from the old
+// linear scan on a miss, so nothing has to keep the table in sync when clients
+// connect, drop or get reused. Only live clients are looked up through the table:
+// a zombie may share its (ip, qport) with the same player connected again in
+// another slot, and must not shadow it.
+#define CLIENT_HASH_SIZE	256 // power of two, well above MAX_CLIENTS
+#define CLIENT_HASH_PROBES	4
+
+static client_t *sv_clienthash[CLIENT_HASH_SIZE];
+
+static unsigned int SV_ClientHashKey (const netadr_t *adr, int qport)
+{
+	unsigned int h;
+
+	h = (adr->ip[0] | (adr->ip[1] << 8) | (adr->ip[2] << 16) | ((unsigned int)adr->ip[3] << 24)) ^ ((unsigned int)qport * 0x9E3779B1);
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+
+	return h;
+}
+
+static qbool SV_ClientSentPacket (client_t *cl, int qport)
+{
+	return cl->state != cs_free && cl->netchan.qport == qport && NET_CompareBaseAdr (net_from, cl->netchan.remote_address);
+}
+
+static client_t *SV_ClientForPacket (int qport)
+{
+	unsigned int h = SV_ClientHashKey (&net_from, qport);
+	client_t *cl, **slot, *zombie = NULL;
+	int i;
+
+	for (i = 0; i < CLIENT_HASH_PROBES; i++)
+	{
+		cl = sv_clienthash[(h + i) & (CLIENT_HASH_SIZE - 1)];
+		if (cl && cl->state != cs_zombie && SV_ClientSentPacket (cl, qport))
+			return cl;
+	}
+
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+	{
+		if (!SV_ClientSentPacket (cl, qport))
+			continue;
+		if (cl->state != cs_zombie)
+			break;
+		if (!zombie)
+			zombie = cl;
+	}
+
+	// a zombie still gets its packets as before, it just isn't remembered
+	if (i == MAX_CLIENTS)
+		return zombie;
+
+	// take a free or stale slot, or the first one
+	for (i = 0; i < CLIENT_HASH_PROBES; i++)
+	{
+		slot = &sv_clienthash[(h + i) & (CLIENT_HASH_SIZE - 1)];
+		if (!*slot || (*slot)->state <= cs_zombie)
+			break;
+	}
+	if (i == CLIENT_HASH_PROBES)
+		slot = &sv_clienthash[h & (CLIENT_HASH_SIZE - 1)];
+	*slot = cl;
+
+	return cl;
+}
+
 /*
 =================
 SV_ReadPackets
@@ -2978,26 +3202,15 @@ static void SV_ReadPackets (void)
 		qport = MSG_ReadShort () & 0xffff;
 
 		// check which client sent this packet
-		for (i=0, cl=svs.clients ; i<MAX_CLIENTS ; i++,cl++)
-		{
-			if (cl->state == cs_free)
-				continue;
-			if (!NET_CompareBaseAdr (net_from, cl->netchan.remote_address))
-				continue;
-			if (cl->netchan.qport != qport)
-				continue;
-			if (cl->netchan.remote_address.port != net_from.port)
-			{
-				Con_DPrintf ("SV_ReadPackets: fixing up a translated port\n");
-				cl->netchan.remote_address.port = net_from.port;
-			}
+		if (!(cl = SV_ClientForPacket (qport)))
+			continue;
 
-			break;
+		if (cl->netchan.remote_address.port != net_from.port)
+		{
+			Con_DPrintf ("SV_ReadPackets: fixing up a translated port\n");
+			cl->netchan.remote_address.port = net_from.port;
 		}
 
-		if (i == MAX_CLIENTS)
-			continue;
-
 		// ok, we know who sent this packet, but do we need to delay executing it?
 		if (cl->delay > 0)
 		{
@@ -3231,6 +3444,9 @@ void SV_Frame (double time1)
 	start = Sys_DoubleTime ();
 	svs.stats.idle += start - end;
 
+	// no game code is running here, drop calls an error left open
+	PR_ProfUnwind ();
+
 	// keep the random time dependent
 	rand ();
 
@@ -3312,6 +3528,7 @@ void SV_Frame (double time1)
 		svs.stats.packets = 0;
 		svs.stats.count = 0;
 		svs.stats.demo = 0;
+		SV_AreaStats_Latch ();
 	}
 }
 
@@ -3405,6 +3622,7 @@ void SV_InitLocal (void)
 	Cvar_Register (&vip_values);
 
 	Cvar_Register (&sv_nailhack);
+	SV_ParallelEntities_Init ();
 
 	Cvar_Register (&sv_mintic);
 	Cvar_Register (&sv_maxtic);
@@ -3512,6 +3730,10 @@ void SV_InitLocal (void)
 
 	Cvar_Register (&sv_reliable_sound);
 
+	Cvar_Register (&sv_areadepth);
+	Cvar_Register (&sv_leafindex);
+	Cmd_AddCommand ("sv_areastats", SV_AreaStats_f);
+
 	Cvar_Register(&qws_name);
 	Cvar_Register(&qws_fullname);
 	Cvar_Register(&qws_version);
@@ -3540,6 +3762,7 @@ void SV_InitLocal (void)
 	Cmd_AddCommand ("removeip", SV_RemoveIP_f);
 	Cmd_AddCommand ("listip", SV_ListIP_f);
 	Cmd_AddCommand ("writeip", SV_WriteIP_f);
+	Cmd_AddCommand ("loadip", SV_LoadIP_f);
 	Cmd_AddCommand ("vip_addip", SV_AddIPVIP_f);
 	Cmd_AddCommand ("vip_removeip", SV_RemoveIPVIP_f);
 	Cmd_AddCommand ("vip_listip", SV_ListIPVIP_f);
@@ -3894,6 +4117,7 @@ void Host_Init (int argc, char **argv, int default_memsize)
 
 	Sys_Init ();
 	CM_Init ();
+	PM_Init ();
 
 	SV_Init ();
 
@@ -3975,6 +4199,7 @@ void SV_Init (void)
 	SV_InitLocal ();
 
 	SV_MVDInit ();
+	SV_DownloadCache_Init ();
 	Login_Init ();
 #ifndef SERVERONLY
 	server_cfg_done = true;
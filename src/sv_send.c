@@ -929,32 +929,45 @@ void SV_SendClientDatagram (client_t *client, int client_num)
 		// this will include clients, a packetentities, and
 		// possibly a nails update
 		SV_WriteEntitiesToClient(client, &msg, false);
+	}
+
+	SV_FinishClientDatagram(client, &msg);
+}
+
+/*
+=======================
+SV_FinishClientDatagram
 
+Adds what goes after the entities and sends the datagram
+=======================
+*/
+void SV_FinishClientDatagram (client_t *client, sizebuf_t *msg)
+{
 #ifdef FTE_PEXT2_VOICECHAT
-		SV_VoiceSendPacket(client, &msg);
+	if (!SV_SkipCommsBotMessage(client))
+		SV_VoiceSendPacket(client, msg);
 #endif
-	}
 
 	// copy the accumulated multicast datagram
 	// for this client out to the message
 	if (client->datagram.overflowed)
 		Con_Printf ("WARNING: datagram overflowed for %s\n", client->name);
 	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
+		SZ_Write (msg, client->datagram.data, client->datagram.cursize);
 	SZ_Clear (&client->datagram);
 
 	// send deltas over reliable stream
 	if (Netchan_CanReliable (&client->netchan))
 		SV_UpdateClientStats (client);
 
-	if (msg.overflowed)
+	if (msg->overflowed)
 	{
 		Con_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear (&msg);
+		SZ_Clear (msg);
 	}
 
 	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, buf);
+	Netchan_Transmit (&client->netchan, msg->cursize, msg->data);
 }
 
 /*
@@ -1087,6 +1100,7 @@ void SV_SendClientMessages (void)
 {
 	int			i, j;
 	client_t	*c;
+	qbool		parallel;
 
 	if (sv.state != ss_active)
 		return;
@@ -1100,6 +1114,12 @@ void SV_SendClientMessages (void)
 		}
 	}
 
+	// the packets of all clients go out together after the loop
+	NET_SV_BeginSendBatch ();
+
+	// entities for all clients are built together after the loop
+	parallel = SV_ParallelEntities_Begin ();
+
 	// build individual updates
 	for (i=0, c = svs.clients ; i<MAX_CLIENTS ; i++, c++)
 	{
@@ -1185,13 +1205,19 @@ void SV_SendClientMessages (void)
 			continue;		// bandwidth choke
 		}
 
-		if (c->state == cs_spawned)
+		if (c->state == cs_spawned && parallel)
+			SV_ParallelEntities_Queue (c);
+		else if (c->state == cs_spawned)
 			SV_SendClientDatagram (c, i);
 		else {
 			Netchan_Transmit (&c->netchan, c->datagram.cursize, c->datagram.data);	// just update reliable
 			c->datagram.cursize = 0;
 		}
 	}
+
+	SV_ParallelEntities_Run ();
+
+	NET_SV_FlushSendBatch ();
 }
 
 static void SV_BotWriteDamage(client_t* c, int i)
@@ -1132,12 +1132,76 @@ Cmd_NextDownload_f
 
 // qqshka: percent is optional, u can't relay on it
 
-void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_number)
-{
 #define CHUNKSIZE 1024
+#define MAX_CHUNK_RANGE 64	// most chunks one nextdl can ask for
+#define CHUNK_BURST 0.25	// seconds worth of ranged chunks a client can save up
+
+// sends the next chunk of the file, in the datagram or out of band
+static qbool SV_SendDownloadChunk(int chunknum, int chunked_download_number, qbool oob)
+{
 	char buffer[CHUNKSIZE];
+	byte data[1+ (sizeof("\\chunk")-1) + 4 + 1 + 4 + CHUNKSIZE]; // byte + (sizeof("\\chunk")-1) + long + byte + long + CHUNKSIZE
+	sv_dlfile_t *dlfile = sv_client->dlfile;
+	sizebuf_t *msg, msg_oob;
+	int i;
+
+	if (dlfile)
+		i = bound(0, dlfile->size - chunknum * CHUNKSIZE, CHUNKSIZE);
+	else
+		i = VFS_READ(sv_client->download, buffer, CHUNKSIZE, NULL);
+
+	if (i <= 0)
+		return false; // FIXME: EOF/READ ERROR
+
+	if (oob)
+	{
+		msg = &msg_oob;
+
+		SZ_Init (&msg_oob, data, sizeof(data));
+
+		MSG_WriteByte(msg, A2C_PRINT);
+		SZ_Write(msg, "\\chunk", sizeof("\\chunk")-1);
+		MSG_WriteLong(msg, chunked_download_number); // return back, so they sure what it proper chunk
+	}
+	else
+		msg = &sv_client->datagram;
+
+	MSG_WriteByte(msg, svc_download);
+	MSG_WriteLong(msg, chunknum);
+
+	if (dlfile)
+	{
+		// straight from the cached file, no copy on the way
+		SZ_Write(msg, dlfile->data + chunknum * CHUNKSIZE, i);
+		if (i != CHUNKSIZE)
+			memset(SZ_GetSpace(msg, CHUNKSIZE-i), 0, CHUNKSIZE-i);
+		dlfile->sent += i;
+	}
+	else
+	{
+		if (i != CHUNKSIZE)
+			memset(buffer+i, 0, CHUNKSIZE-i);
+		SZ_Write(msg, buffer, CHUNKSIZE);
+	}
+
+	if (oob)
+		Netchan_OutOfBand (NS_SERVER, sv_client->netchan.remote_address, msg->cursize, msg->data);
+
+	return true;
+}
+
+// count is our extension: clients that know about it ask for a run of chunks at once,
+// everybody else sends one nextdl per chunk and it's 0.
+// Those get sv_downloadchunksperframe chunks per client packet, as they always did, so
+// their rate follows their packet rate. Clients sending a count pace themselves with a
+// window, they get the same number per frame at maxfps but metered by time, so a 30 fps
+// client downloads as fast as a 250 fps one.
+void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_number, int count)
+{
 	int i;
 	int maxchunks = bound(1, (int)sv_downloadchunksperframe.value, 30);
+	double rate, burst;
+	qbool ranged = (count > 0);
 
 	sv_client->file_percent = bound(0, percent, 100); //bliP: file percent
 
@@ -1147,10 +1211,33 @@ void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_numb
 		return;
 	}
 
-	// Check if too much requests or client sent something wrong
-	if (sv_client->download_chunks_perframe >= maxchunks || chunked_download_number < 1)
+	if (chunked_download_number < 1)
 		return;
 
+	if (ranged)
+	{
+		rate = maxchunks * bound(1, sv_maxfps.value, 1000);
+		burst = max(rate * CHUNK_BURST, 1);
+		if (!sv_client->download_chunk_refill)
+			sv_client->download_chunk_tokens = burst;
+		else
+			sv_client->download_chunk_tokens = min(burst, sv_client->download_chunk_tokens + (realtime - sv_client->download_chunk_refill) * rate);
+		sv_client->download_chunk_refill = realtime;
+
+		// over the budget, the rest of the range is dropped
+		count = min(count, MAX_CHUNK_RANGE);
+		count = min(count, (int) sv_client->download_chunk_tokens);
+		if (count < 1)
+			return;
+	}
+	else
+	{
+		// Check if too much requests
+		if (sv_client->download_chunks_perframe >= maxchunks)
+			return;
+		count = 1;
+	}
+
 	if (!sv_client->download_chunks_perframe) // ignore "rate" if not first packet per frame
 		if (sv_client->datagram.cursize + CHUNKSIZE+5+50 > sv_client->datagram.maxsize)
 			return;	//choked!
@@ -1158,41 +1245,15 @@ void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_numb
 	if (VFS_SEEK(sv_client->download, chunknum*CHUNKSIZE, SEEK_SET))
 		return; // FIXME: ERROR of some kind
 
-	i = VFS_READ(sv_client->download, buffer, CHUNKSIZE, NULL);
-
-	if (i > 0)
+	// the first one of a frame goes with the datagram
+	for (i = 0; i < count; i++)
 	{
-		byte data[1+ (sizeof("\\chunk")-1) + 4 + 1 + 4 + CHUNKSIZE]; // byte + (sizeof("\\chunk")-1) + long + byte + long + CHUNKSIZE
-		sizebuf_t *msg, msg_oob;
-
-		if (sv_client->download_chunks_perframe)
-		{
-			msg = &msg_oob;
-
-			SZ_Init (&msg_oob, data, sizeof(data));
-
-			MSG_WriteByte(msg, A2C_PRINT);
-			SZ_Write(msg, "\\chunk", sizeof("\\chunk")-1);
-			MSG_WriteLong(msg, chunked_download_number); // return back, so they sure what it proper chunk
-		}
-		else
-			msg = &sv_client->datagram;
-
-		if (i != CHUNKSIZE)
-			memset(buffer+i, 0, CHUNKSIZE-i);
-
-		MSG_WriteByte(msg, svc_download);
-		MSG_WriteLong(msg, chunknum);
-		SZ_Write(msg, buffer, CHUNKSIZE);
-
-		if (sv_client->download_chunks_perframe)
-			Netchan_OutOfBand (NS_SERVER, sv_client->netchan.remote_address, msg->cursize, msg->data);
-	}
-	else {
-		; // FIXME: EOF/READ ERROR
+		if (!SV_SendDownloadChunk(chunknum + i, chunked_download_number, sv_client->download_chunks_perframe > 0))
+			break;
+		sv_client->download_chunks_perframe++;
+		if (ranged)
+			sv_client->download_chunk_tokens--;
 	}
-
-	sv_client->download_chunks_perframe++;
 }
 
 #endif
@@ -1200,6 +1261,7 @@ void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_numb
 static void Cmd_NextDownload_f (void)
 {
 	byte    buffer[FILE_TRANSFER_BUF_SIZE];
+	const byte *data = buffer;
 	int     r, tmp;
 	int     percent;
 	int     size;
@@ -1211,7 +1273,7 @@ static void Cmd_NextDownload_f (void)
 #ifdef FTE_PEXT_CHUNKEDDOWNLOADS
 	if (sv_client->fteprotocolextensions & FTE_PEXT_CHUNKEDDOWNLOADS)
 	{
-		SV_NextChunkedDownload(atoi(Cmd_Argv(1)), atoi(Cmd_Argv(2)), atoi(Cmd_Argv(3)));
+		SV_NextChunkedDownload(atoi(Cmd_Argv(1)), atoi(Cmd_Argv(2)), atoi(Cmd_Argv(3)), Cmd_Argc() > 4 ? max(1, atoi(Cmd_Argv(4))) : 0);
 		return;
 	}
 #endif
@@ -1235,7 +1297,13 @@ static void Cmd_NextDownload_f (void)
 		r = tmp;
 
 	Con_DPrintf("Downloading: %d", r);
-	r = VFS_READ(sv_client->download, buffer, r, NULL);
+	if (sv_client->dlfile)
+	{
+		data = sv_client->dlfile->data + sv_client->downloadcount;
+		sv_client->dlfile->sent += r;
+	}
+	else
+		r = VFS_READ(sv_client->download, buffer, r, NULL);
 	Con_DPrintf(" => %d, total: %d => %d", r, sv_client->downloadsize, sv_client->downloadcount);
 	ClientReliableWrite_Begin (sv_client, svc_download, 6 + r);
 	ClientReliableWrite_Short (sv_client, r);
@@ -1249,7 +1317,7 @@ static void Cmd_NextDownload_f (void)
 		percent = 100;
 	Con_DPrintf("; %d\n", percent);
 	ClientReliableWrite_Byte (sv_client, percent);
-	ClientReliableWrite_SZ (sv_client, buffer, r);
+	ClientReliableWrite_SZ (sv_client, (void *) data, r);
 	sv_client->file_percent = percent; //bliP: file percent
 
 	if (sv_client->downloadcount == sv_client->downloadsize)
@@ -1530,7 +1598,14 @@ static void Cmd_Download_f(void)
 #define CLIENT_DOWNLOAD_RELATIVE_BASE FS_BASE
 #endif
 
-	sv_client->download = FS_OpenVFS(name, "rb", CLIENT_DOWNLOAD_RELATIVE_BASE);
+	// demos are still being written to, everything else is shared with whoever else is downloading it
+	if (strncmp(Cmd_Argv(1), "demos/", 6) && (sv_client->dlfile = SV_DownloadCache_Open(name, CLIENT_DOWNLOAD_RELATIVE_BASE))) {
+		sv_client->download = FSMMAP_OpenView(sv_client->dlfile->data, sv_client->dlfile->size);
+		sv_client->download->copyprotected = sv_client->dlfile->copyprotected;
+	}
+	else {
+		sv_client->download = FS_OpenVFS(name, "rb", CLIENT_DOWNLOAD_RELATIVE_BASE);
+	}
 	if (!sv_client->download && alternative_path[0]) {
 		sv_client->download = FS_OpenVFS(alternative_path, "rb", CLIENT_DOWNLOAD_RELATIVE_BASE);
 	}
@@ -1568,6 +1643,7 @@ static void Cmd_Download_f(void)
 		ClientReliableWrite_Long (sv_client, -1);
 		ClientReliableWrite_Long (sv_client, sv_client->downloadsize);
 		ClientReliableWrite_String (sv_client, name);
+		sv_client->download_chunk_refill = 0;
 	}
 #endif
 
@@ -3395,10 +3471,10 @@ AddLinksToPmove
 */
 static void AddLinksToPmove ( areanode_t *node )
 {
-	link_t		*l, *next;
+	areaedicts_t	*list = &node->list[AREA_SOLID];
 	edict_t		*check;
 	int 		pl;
-	int 		i;
+	int 		i, j;
 	physent_t	*pe;
 	vec3_t		pmove_mins, pmove_maxs;
 
@@ -3411,10 +3487,9 @@ static void AddLinksToPmove ( areanode_t *node )
 	pl = EDICT_TO_PROG(sv_player);
 
 	// touch linked edicts
-	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
+	for (j = 0; j < list->count; j++)
 	{
-		next = l->next;
-		check = EDICT_FROM_AREA(l);
+		check = list->edicts[j];
 
 		if (check->v->owner == pl)
 			continue;		// player's own missile
@@ -4847,6 +4922,8 @@ static void SV_ClientDownloadComplete(client_t* cl)
 
 		VFS_CLOSE(cl->download);
 		cl->download = NULL;
+		SV_DownloadCache_Release(cl->dlfile);
+		cl->dlfile = NULL;
 		cl->file_percent = 0; //bliP: file percent
 		// set normal rate
 		val = Info_Get(&cl->_userinfo_ctx_, "rate");
@@ -107,36 +107,6 @@ ENTITY AREA CHECKING
 ===============================================================================
 */
 
-// ClearLink is used for new headnodes
-void ClearLink (link_t *l)
-{
-	l->prev = l->next = l;
-}
-
-void RemoveLink (link_t *l)
-{
-	l->next->prev = l->prev;
-	l->prev->next = l->next;
-}
-
-void InsertLinkBefore (link_t *l, link_t *before)
-{
-	l->next = before;
-	l->prev = before->prev;
-	l->prev->next = l;
-	l->next->prev = l;
-}
-void InsertLinkAfter (link_t *l, link_t *after)
-{
-	l->next = after->next;
-	l->prev = after;
-	l->prev->next = l;
-	l->next->prev = l;
-}
-
-//============================================================================
-
-// well, here should be all things related to world but atm it antilag only
 typedef struct world_s
 {
 // { sv_antilag related
@@ -148,8 +118,67 @@ typedef struct world_s
 
 static world_t w;
 
+/*
+The area tree is a kd tree over the world bounds, splitting along x or y. Every
+linked edict sits in the deepest node whose box contains it, so a query only
+looks at the nodes its box reaches. The depth follows the size of the map and,
+once the map entities are spawned, their number; sv_areadepth forces it.
+*/
+
+cvar_t	sv_areadepth = {"sv_areadepth", "0"};
+
+#define	AREA_LEAF_SIZE		512		// wanted leaf extent along x and y, in units
+#define	AREA_LEAF_EDICTS	8		// wanted number of edicts per leaf
+
+typedef struct areastats_s
+{
+	int		frames;
+	int		queries;	// SV_AreaEdicts calls
+	int		nodes;		// nodes visited by them
+	int		tested;		// edicts bbox tested
+	int		found;		// edicts returned
+	int		links;		// SV_LinkEdict calls that linked the edict to a node
+} areastats_t;
+
+static areastats_t areastats, areastats_latched;
+
 areanode_t sv_areanodes[AREA_NODES];
-int sv_numareanodes;
+static int sv_numareanodes;
+static int area_depth;
+
+/*
+===============
+SV_AreaDepth
+
+Splits the box the way SV_CreateAreaNode does until the leaves are small enough
+and numerous enough for numedicts
+===============
+*/
+static int SV_AreaDepth (vec3_t mins, vec3_t maxs, int numedicts)
+{
+	float	size[2];
+	int		depth;
+
+	if (sv_areadepth.value)
+		return bound(AREA_MIN_DEPTH, (int)sv_areadepth.value, AREA_MAX_DEPTH);
+
+	size[0] = maxs[0] - mins[0];
+	size[1] = maxs[1] - mins[1];
+
+	for (depth = 0; depth < AREA_MAX_DEPTH; depth++)
+	{
+		if (depth >= AREA_MIN_DEPTH && max(size[0], size[1]) <= AREA_LEAF_SIZE
+			&& (1 << depth) * AREA_LEAF_EDICTS >= numedicts)
+			break;
+
+		if (size[0] > size[1])
+			size[0] *= 0.5;
+		else
+			size[1] *= 0.5;
+	}
+
+	return depth;
+}
 
 /*
 ===============
@@ -165,10 +194,7 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	anode = &sv_areanodes[sv_numareanodes];
 	sv_numareanodes++;
 
-	ClearLink (&anode->trigger_edicts);
-	ClearLink (&anode->solid_edicts);
-
-	if (depth == AREA_DEPTH)
+	if (depth == area_depth)
 	{
 		anode->axis = -1;
 		anode->children[0] = anode->children[1] = NULL;
@@ -195,6 +221,33 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	return anode;
 }
 
+// Empties the tree and rebuilds it for the given depth, keeping the edict arrays.
+static void SV_BuildAreaTree (int depth)
+{
+	areaedicts_t	saved[AREA_NODES][2];
+	int				i;
+
+	for (i = 0; i < AREA_NODES; i++)
+	{
+		saved[i][AREA_SOLID] = sv_areanodes[i].list[AREA_SOLID];
+		saved[i][AREA_TRIGGERS] = sv_areanodes[i].list[AREA_TRIGGERS];
+		saved[i][AREA_SOLID].count = saved[i][AREA_TRIGGERS].count = 0;
+	}
+
+	memset (sv_areanodes, 0, sizeof(sv_areanodes));
+	sv_numareanodes = 0;
+	area_depth = depth;
+	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	for (i = 0; i < AREA_NODES; i++)
+	{
+		sv_areanodes[i].list[AREA_SOLID] = saved[i][AREA_SOLID];
+		sv_areanodes[i].list[AREA_TRIGGERS] = saved[i][AREA_TRIGGERS];
+	}
+}
+
+static void SV_ClearLeafIndex (void);
+
 /*
 ===============
 SV_ClearWorld
@@ -202,9 +255,75 @@ SV_ClearWorld
 */
 void SV_ClearWorld (void)
 {
-	memset (sv_areanodes, 0, sizeof(sv_areanodes));
-	sv_numareanodes = 0;
-	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+	SV_BuildAreaTree (SV_AreaDepth (sv.worldmodel->mins, sv.worldmodel->maxs, 0));
+	SV_ClearLeafIndex ();
+}
+
+static void SV_AreaAppend (areanode_t *node, int area, edict_t *ent)
+{
+	areaedicts_t *list = &node->list[area];
+
+	if (list->count == list->max)
+	{
+		list->max = max(16, list->max * 2);
+		list->edicts = (edict_t **) Q_realloc (list->edicts, list->max * sizeof(*list->edicts));
+	}
+
+	ent->e.area = node;
+	ent->e.arealist = area;
+	ent->e.areaindex = list->count;
+	list->edicts[list->count++] = ent;
+}
+
+// find the first node that the box crosses
+static areanode_t *SV_AreaNodeForBox (vec3_t absmin, vec3_t absmax)
+{
+	areanode_t *node = sv_areanodes;
+
+	while (node->axis != -1)
+	{
+		if (absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if (absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break; // crosses the node
+	}
+
+	return node;
+}
+
+/*
+===============
+SV_AreaRebuild
+===============
+*/
+void SV_AreaRebuild (void)
+{
+	edict_t	*ent;
+	int		i, depth, numlinked = 0;
+
+	for (i = 1; i < sv.num_edicts; i++)
+	{
+		if (EDICT_NUM(i)->e.area)
+			numlinked++;
+	}
+
+	depth = SV_AreaDepth (sv.worldmodel->mins, sv.worldmodel->maxs, numlinked);
+	if (depth == area_depth)
+		return;
+
+	SV_BuildAreaTree (depth);
+
+	// the boxes have not changed, so no need to go through SV_LinkEdict
+	for (i = 1; i < sv.num_edicts; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (ent->e.area)
+			SV_AreaAppend (SV_AreaNodeForBox (ent->v->absmin, ent->v->absmax), ent->e.arealist, ent);
+	}
+
+	Con_DPrintf ("Area tree: depth %i, %i nodes for %i edicts\n", area_depth, sv_numareanodes, numlinked);
 }
 
 
@@ -215,10 +334,19 @@ SV_UnlinkEdict
 */
 void SV_UnlinkEdict (edict_t *ent)
 {
-	if (!ent->e.area.prev)
+	areaedicts_t	*list;
+	edict_t			*last;
+
+	if (!ent->e.area)
 		return;		// not linked in anywhere
-	RemoveLink (&ent->e.area);
-	ent->e.area.prev = ent->e.area.next = NULL;
+
+	// move the last edict into the hole, the order within a node does not matter
+	list = &ent->e.area->list[ent->e.arealist];
+	last = list->edicts[--list->count];
+	list->edicts[ent->e.areaindex] = last;
+	last->e.areaindex = ent->e.areaindex;
+
+	ent->e.area = NULL;
 }
 
 /*
@@ -228,22 +356,24 @@ SV_AreaEdicts
 */
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area)
 {
-	link_t		*l, *start;
+	areaedicts_t	*list;
 	edict_t		*touch;
-	int			stackdepth = 0, count = 0;
-	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
+	int			i, stackdepth = 0, count = 0;
+	areanode_t	*localstack[AREA_MAX_DEPTH + 1], *node = sv_areanodes;
+
+	areastats.queries++;
 
 // touch linked edicts
 	while (1)
 	{
-		if (area == AREA_SOLID)
-			start = &node->solid_edicts;
-		else
-			start = &node->trigger_edicts;
+		list = &node->list[area];
 
-		for (l = start->next ; l != start ; l = l->next)
+		areastats.nodes++;
+		areastats.tested += list->count;
+
+		for (i = 0; i < list->count; i++)
 		{
-			touch = EDICT_FROM_AREA(l);
+			touch = list->edicts[i];
 			if (touch->v->solid == SOLID_NOT)
 				continue;
 
@@ -256,7 +386,7 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 				continue;
 
 			if (count == max_edicts)
-				return count;
+				goto done;
 			edicts[count++] = touch;
 		}
 
@@ -283,13 +413,69 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 
 checkstack:
 		if (!stackdepth)
-		return count;
+			break;
 		node = localstack[--stackdepth];
 	}
 
+done:
+	areastats.found += count;
 	return count;
 }
 
+/*
+====================
+SV_AreaStats_Latch
+
+Called every STATFRAMES server frames
+====================
+*/
+void SV_AreaStats_Latch (void)
+{
+	areastats.frames = STATFRAMES;
+	areastats_latched = areastats;
+	memset (&areastats, 0, sizeof(areastats));
+}
+
+/*
+====================
+SV_AreaStats_f
+====================
+*/
+void SV_AreaStats_f (void)
+{
+	areastats_t	*s = &areastats_latched;
+	int			i, j, linked = 0, fullest = 0, leaves = 0;
+
+	if (sv.state != ss_active)
+	{
+		Con_Printf ("Server is not running\n");
+		return;
+	}
+
+	for (i = 0; i < sv_numareanodes; i++)
+	{
+		if (sv_areanodes[i].axis == -1)
+			leaves++;
+		for (j = 0; j < 2; j++)
+		{
+			linked += sv_areanodes[i].list[j].count;
+			fullest = max(fullest, sv_areanodes[i].list[j].count);
+		}
+	}
+
+	Con_Printf ("area tree  : depth %i, %i nodes, %i leaves\n", area_depth, sv_numareanodes, leaves);
+	Con_Printf ("edicts     : %i linked, %i at the root, %i in the fullest list\n", linked,
+		sv_areanodes[0].list[AREA_SOLID].count + sv_areanodes[0].list[AREA_TRIGGERS].count, fullest);
+
+	if (!s->frames)
+		return;
+
+	Con_Printf ("per frame  : %.1f queries, %.1f links\n", (float)s->queries / s->frames, (float)s->links / s->frames);
+	if (s->queries)
+		Con_Printf ("per query  : %.1f nodes, %.1f edicts tested, %.1f found\n", (float)s->nodes / s->queries,
+			(float)s->tested / s->queries, (float)s->found / s->queries);
+}
+
 /*
 ====================
 SV_TouchLinks
@@ -325,6 +511,151 @@ static void SV_TouchLinks ( edict_t *ent, areanode_t *node )
 	}
 }
 
+/*
+===============================================================================
+
+LEAF INDEX
+
+Every edict linked to PVS leafs is also put in a list for each of those leafs,
+and a bitmask laid out like a PVS tells which leafs have anything in them.
+SV_VisibleEdicts ANDs a PVS with that mask and only walks the lists of the leafs
+that are left, instead of testing the leafs of every edict against the PVS.
+Edicts touching more than MAX_ENT_LEAFS leafs (num_leafs -1) are kept in a
+separate mask, they are visible from everywhere.
+
+The index can hold edicts that have since been cleared or freed, they are only
+taken out when linked again, so users still need to check the edicts they get.
+
+===============================================================================
+*/
+
+cvar_t	sv_leafindex = {"sv_leafindex", "1"};
+
+#define LEAFINDEX_LINKS		(MAX_EDICTS * MAX_ENT_LEAFS)	// MAX_ENT_LEAFS links for each edict
+
+static struct
+{
+	int				numleafs;		// PVS leafs, real leafnums minus one
+	int				*head;			// first link of each leaf, -1 if none
+	byte			*occupied;		// bit set for each leaf with links
+
+	int				next[LEAFINDEX_LINKS], prev[LEAFINDEX_LINKS];
+	int				leaf[LEAFINDEX_LINKS];
+	byte			numlinks[MAX_EDICTS];
+	unsigned int	everywhere[MAX_EDICTS / 32];
+} leafindex;
+
+static void SV_ClearLeafIndex (void)
+{
+	Q_free (leafindex.head);
+	Q_free (leafindex.occupied);
+
+	leafindex.numleafs = max(0, CM_NumLeafs () - 1);
+	leafindex.head = (int *) Q_malloc (max(1, leafindex.numleafs) * sizeof(*leafindex.head));
+	leafindex.occupied = (byte *) Q_malloc ((leafindex.numleafs + 7) >> 3);
+	memset (leafindex.head, -1, max(1, leafindex.numleafs) * sizeof(*leafindex.head));
+	memset (leafindex.numlinks, 0, sizeof(leafindex.numlinks));
+	memset (leafindex.everywhere, 0, sizeof(leafindex.everywhere));
+}
+
+static void SV_UnlinkFromLeafIndex (int e)
+{
+	int i, link, leafnum;
+
+	leafindex.everywhere[e >> 5] &= ~(1u << (e & 31));
+
+	for (i = 0, link = e * MAX_ENT_LEAFS; i < leafindex.numlinks[e]; i++, link++)
+	{
+		leafnum = leafindex.leaf[link];
+
+		if (leafindex.prev[link] != -1)
+			leafindex.next[leafindex.prev[link]] = leafindex.next[link];
+		else
+			leafindex.head[leafnum] = leafindex.next[link];
+
+		if (leafindex.next[link] != -1)
+			leafindex.prev[leafindex.next[link]] = leafindex.prev[link];
+
+		if (leafindex.head[leafnum] == -1)
+			leafindex.occupied[leafnum >> 3] &= ~(1 << (leafnum & 7));
+	}
+
+	leafindex.numlinks[e] = 0;
+}
+
+static void SV_LinkToLeafIndex (edict_t *ent)
+{
+	int i, link, leafnum, e = ent->e.entnum;
+
+	if (!leafindex.head || e < 0 || e >= MAX_EDICTS)
+		return;
+
+	SV_UnlinkFromLeafIndex (e);
+
+	if (ent->e.num_leafs < 0)
+	{
+		leafindex.everywhere[e >> 5] |= 1u << (e & 31);
+		return;
+	}
+
+	for (i = 0, link = e * MAX_ENT_LEAFS; i < ent->e.num_leafs; i++)
+	{
+		leafnum = ent->e.leafnums[i];
+		if (leafnum < 0 || leafnum >= leafindex.numleafs)
+		{
+			leafindex.everywhere[e >> 5] |= 1u << (e & 31);
+			continue;
+		}
+
+		leafindex.leaf[link] = leafnum;
+		leafindex.prev[link] = -1;
+		leafindex.next[link] = leafindex.head[leafnum];
+		if (leafindex.head[leafnum] != -1)
+			leafindex.prev[leafindex.head[leafnum]] = link;
+		leafindex.head[leafnum] = link;
+		leafindex.occupied[leafnum >> 3] |= 1 << (leafnum & 7);
+		link++;
+	}
+
+	leafindex.numlinks[e] = link - e * MAX_ENT_LEAFS;
+}
+
+/*
+====================
+SV_VisibleEdicts
+====================
+*/
+qbool SV_VisibleEdicts (const byte *pvs, unsigned int *visible)
+{
+	int i, leafnum, link, e, numbytes;
+	byte bits;
+
+	if (!sv_leafindex.value || !leafindex.head)
+		return false;
+
+	memcpy (visible, leafindex.everywhere, sizeof(leafindex.everywhere));
+
+	numbytes = (leafindex.numleafs + 7) >> 3;
+	for (i = 0; i < numbytes; i++)
+	{
+		bits = pvs[i] & leafindex.occupied[i];
+
+		for (leafnum = i << 3; bits; bits >>= 1, leafnum++)
+		{
+			if (!(bits & 1))
+				continue;
+
+			for (link = leafindex.head[leafnum]; link != -1; link = leafindex.next[link])
+			{
+				e = link / MAX_ENT_LEAFS;
+				visible[e >> 5] |= 1u << (e & 31);
+			}
+		}
+	}
+
+	return true;
+}
+
 /*
 ====================
 SV_LinkToLeafs
@@ -340,6 +671,8 @@ void SV_LinkToLeafs (edict_t *ent)
 		// ent->e.leafnums are real leafnum minus one (for pvs checks)
 		ent->e.leafnums[i] = leafnums[i] - 1;
 	}
+
+	SV_LinkToLeafIndex (ent);
 }
 
 
@@ -351,9 +684,7 @@ SV_LinkEdict
 */
 void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 {
-	areanode_t	*node;
-	
-	if (ent->e.area.prev)
+	if (ent->e.area)
 		SV_UnlinkEdict (ent);	// unlink from old position
 
 	if (ent == sv.edicts)
@@ -392,31 +723,18 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 	if (ent->v->modelindex)
 		SV_LinkToLeafs (ent);
 	else
+	{
 		ent->e.num_leafs = 0;
+		SV_LinkToLeafIndex (ent);
+	}
 
 	if (ent->v->solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if (ent->v->absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->v->absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break; // crosses the node
-	}
-	
-// link it in	
-
-	if (ent->v->solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->e.area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->e.area, &node->solid_edicts);
+// link it in to the first node that the ent's box crosses
+	SV_AreaAppend (SV_AreaNodeForBox (ent->v->absmin, ent->v->absmax),
+		ent->v->solid == SOLID_TRIGGER ? AREA_TRIGGERS : AREA_SOLID, ent);
+	areastats.links++;
 	
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
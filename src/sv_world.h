@@ -28,26 +28,39 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define MOVE_LAGGED		64	//trace touches current last-known-state, instead of actual ents (just affects players for now)
 // }
 
+#define AREA_SOLID	0
+#define AREA_TRIGGERS	1
+
+// contiguous array of the edicts linked to a node, unordered
+typedef struct areaedicts_s
+{
+	edict_t	**edicts;
+	int		count;
+	int		max;
+} areaedicts_t;
+
 typedef struct areanode_s
 {
 	int		axis;		// -1 = leaf node
 	float	dist;
 	struct areanode_s	*children[2];
-	link_t	trigger_edicts;
-	link_t	solid_edicts;
+	areaedicts_t	list[2];	// indexed by AREA_SOLID / AREA_TRIGGERS
 } areanode_t;
 
-#define AREA_SOLID	0
-#define AREA_TRIGGERS	1
-
-#define	AREA_DEPTH	4
-#define	AREA_NODES	32
+#define	AREA_MIN_DEPTH	4		// what the tree always used to be
+#define	AREA_MAX_DEPTH	8
+#define	AREA_NODES	(1 << (AREA_MAX_DEPTH + 1))
 
 extern	areanode_t	sv_areanodes[AREA_NODES];
+extern	cvar_t		sv_areadepth;
+extern	cvar_t		sv_leafindex;
 
 void SV_ClearWorld (void);
 // called after the world model has been loaded, before linking any entities
 
+void SV_AreaRebuild (void);
+// called once the map entities are spawned, resizes the area tree for their number
+
 void SV_UnlinkEdict (edict_t *ent);
 // call before removing an entity, and before trying to move one,
 // so it doesn't clip against itself
@@ -80,6 +93,13 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area);
 
+qbool SV_VisibleEdicts (const byte *pvs, unsigned int *visible);
+// sets the bit of every edict that may touch a leaf in pvs, at least all those
+// that do, in visible[MAX_EDICTS / 32]. returns false if sv_leafindex is off
+
 void SV_AntilagReset (edict_t *ent);
 
+void SV_AreaStats_Latch (void);
+void SV_AreaStats_f (void);
+
 #endif /* !__WORLD_H__ */
@@ -86,6 +86,22 @@ void Sys_mkdir (const char *path);
 int Sys_remove (char *path);
 int Sys_EnumerateFiles (char *gpath, char *match, int (*func)(char *, int, void *), void *parm);
 
+// read-only memory mapped files
+typedef struct sys_mapping_s
+{
+	unsigned char *data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+} sys_mapping_t;
+
+int   Sys_FileSizeTime (char *path, int *time1); // time1 is -1 if the file doesn't exist
+int   Sys_FileSizeTimeNs (const char *path, int *time1, int *nsec); // also the fraction of the second, 0 if the file system doesn't keep it
+qbool Sys_MapFile (const char *path, sys_mapping_t *map); // false if failed, map is left empty
+void  Sys_UnmapFile (sys_mapping_t *map);
+
 // an error will cause the entire program to exit
 void Sys_Error (char *error, ...);
 
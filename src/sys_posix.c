@@ -149,6 +149,43 @@ int Sys_rmdir(const char *path)
 	return rmdir(path);
 }
 
+qbool Sys_MapFile(const char *path, sys_mapping_t *map)
+{
+	struct stat buf;
+	void *data;
+	int fd;
+
+	memset(map, 0, sizeof(*map));
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return false;
+	}
+
+	if (fstat(fd, &buf) == -1 || buf.st_size <= 0 || (unsigned long long)buf.st_size > (size_t)-1) {
+		close(fd);
+		return false;
+	}
+
+	data = mmap(NULL, (size_t)buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// the mapping holds its own reference to the file
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	map->data = (unsigned char *)data;
+	map->size = (size_t)buf.st_size;
+	return true;
+}
+
+void Sys_UnmapFile(sys_mapping_t *map)
+{
+	if (map->data) {
+		munmap(map->data, map->size);
+	}
+	memset(map, 0, sizeof(*map));
+}
+
 int Sys_FileSizeTime(char *path, int *time1)
 {
 	struct stat buf;
@@ -164,6 +201,26 @@ int Sys_FileSizeTime(char *path, int *time1)
 	}
 }
 
+int Sys_FileSizeTimeNs(const char *path, int *time1, int *nsec)
+{
+	struct stat buf;
+
+	*nsec = 0;
+	if (stat(path, &buf) == -1)
+	{
+		*time1 = -1;
+		return 0;
+	}
+
+	*time1 = buf.st_mtime;
+#ifdef __APPLE__
+	*nsec = buf.st_mtimespec.tv_nsec;
+#else
+	*nsec = buf.st_mtim.tv_nsec;
+#endif
+	return buf.st_size;
+}
+
 /*
 ================
 Sys_listdir
@@ -26,6 +26,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <limits.h>
 #include <io.h>			// _open, etc
 #include <direct.h>		// _mkdir
+#include <sys/stat.h>		// _stat
 #include <conio.h>		// _putch
 #include <tchar.h>
 #include "keys.h"
@@ -261,6 +262,79 @@ int Sys_rmdir (const char *path)
 	return _rmdir(path);
 }
 
+int Sys_FileSizeTime (char *path, int *time1)
+{
+	struct _stat buf;
+
+	if (_stat(path, &buf) == -1) {
+		*time1 = -1;
+		return 0;
+	}
+
+	*time1 = (int)buf.st_mtime;
+	return (int)buf.st_size;
+}
+
+int Sys_FileSizeTimeNs (const char *path, int *time1, int *nsec)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	ULARGE_INTEGER t;
+	int size = Sys_FileSizeTime((char *)path, time1);
+
+	*nsec = 0;
+	if (*time1 != -1 && GetFileAttributesEx(path, GetFileExInfoStandard, &data)) {
+		t.LowPart = data.ftLastWriteTime.dwLowDateTime;
+		t.HighPart = data.ftLastWriteTime.dwHighDateTime;
+		*nsec = (int)(t.QuadPart % 10000000) * 100;	// FILETIME counts 100 ns
+	}
+
+	return size;
+}
+
+qbool Sys_MapFile (const char *path, sys_mapping_t *map)
+{
+	LARGE_INTEGER size;
+
+	memset(map, 0, sizeof(*map));
+
+	map->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (map->file == INVALID_HANDLE_VALUE) {
+		map->file = NULL;
+		return false;
+	}
+
+	if (!GetFileSizeEx(map->file, &size) || size.QuadPart <= 0 || (unsigned long long)size.QuadPart > (size_t)-1) {
+		Sys_UnmapFile(map);
+		return false;
+	}
+
+	map->mapping = CreateFileMapping(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!map->mapping) {
+		Sys_UnmapFile(map);
+		return false;
+	}
+
+	map->data = (unsigned char *)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!map->data) {
+		Sys_UnmapFile(map);
+		return false;
+	}
+
+	map->size = (size_t)size.QuadPart;
+	return true;
+}
+
+void Sys_UnmapFile (sys_mapping_t *map)
+{
+	if (map->data)
+		UnmapViewOfFile(map->data);
+	if (map->mapping)
+		CloseHandle(map->mapping);
+	if (map->file)
+		CloseHandle(map->file);
+	memset(map, 0, sizeof(*map));
+}
+
 // D-Kure: This is added for FTE vfs
 int Sys_EnumerateFiles (char *gpath, char *match, int (*func)(char *, int, void *), void *parm)
 {
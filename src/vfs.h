@@ -79,11 +79,14 @@ typedef struct {
 	vfsfile_t funcs; // <= must be at top/begining of struct
 
 	FILE *handle;
+	char *osname;	// NULL for temp files
 
 } vfsosfile_t;
 
 vfsfile_t *FS_OpenTemp(void);
 vfsfile_t *VFSOS_Open(char *osname, char *mode);
+qbool VFSOS_IsOSFile(vfsfile_t *file);
+qbool VFSOS_MapFile(vfsfile_t *file, sys_mapping_t *map);
 
 extern searchpathfuncs_t osfilefuncs;
 
@@ -101,6 +104,29 @@ typedef struct
 
 extern searchpathfuncs_t packfilefuncs;
 
+//=====================================
+// Archive directory index (fsindex.dat)
+//=====================================
+typedef struct fsindex_archive_s fsindex_archive_t;
+
+typedef struct {
+	int		name;			// offset into the archive's string pool
+	int		filepos, filelen;
+	int		csize;			// compressed size, same as filelen for stored files
+	int		method;			// compression method, 0 for stored files
+	int		flags;			// FSINDEX_*
+} fsindex_entry_t;
+
+#define FSINDEX_ENCRYPTED	1
+
+void FSIndex_Init(void);
+void FSIndex_Shutdown(void);
+void FSIndex_Save(void);
+fsindex_archive_t *FSIndex_Find(const char *archive, vfsfile_t *handle);
+int FSIndex_NumFiles(const fsindex_archive_t *arc);
+void FSIndex_GetFile(const fsindex_archive_t *arc, int index, packfile_t *file, fsindex_entry_t *extra);
+void FSIndex_Store(const char *archive, int numfiles, const packfile_t *files, const fsindex_entry_t *extra);
+
 //===========================
 // ZIP (*.zip, *.pk3) Support
 //===========================
@@ -125,6 +151,7 @@ vfsfile_t *FS_OpenTCP(char *name);
 //=====================
 #ifdef WITH_ZLIB
 extern searchpathfuncs_t gzipfilefuncs;
+vfsfile_t *VFSGZIP_Open(vfsfile_t *gziphandle, const char *desc);
 #endif // WITH_ZLIB
 
 //=====================
@@ -136,6 +163,7 @@ extern searchpathfuncs_t tarfilefuncs;
 // Memory Mapped files
 //=====================
 vfsfile_t *FSMMAP_OpenVFS(void *buf, size_t buf_len);
+vfsfile_t *FSMMAP_OpenView(const void *buf, size_t buf_len);
 qbool FSMMAP_IsMemoryMapped(vfsfile_t* file);
 
 //=====================
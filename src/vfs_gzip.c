@@ -318,6 +318,25 @@ fail:
 	return NULL;
 }
 
+// Opens the single file of a .gz for reading, the file takes over gziphandle.
+vfsfile_t *VFSGZIP_Open(vfsfile_t *gziphandle, const char *desc)
+{
+	gzipfile_t *gzip;
+	flocation_t loc;
+	vfsfile_t *file = NULL;
+
+	if (!(gzip = FSGZIP_LoadGZipFile(gziphandle, desc)))
+		return NULL;
+
+	memset(&loc, 0, sizeof(loc));
+	if (gzip->handle && FSGZIP_FLocate(gzip, &loc, gzip->file.name, NULL))
+		file = FSGZIP_OpenVFS(gzip, &loc, "rb");
+
+	// the opened file holds its own reference
+	FSGZIP_ClosePath(gzip);
+	return file;
+}
+
 searchpathfuncs_t gzipfilefuncs = {
 	FSGZIP_PrintPath,
 	FSGZIP_ClosePath,
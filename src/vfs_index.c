@@ -0,0 +1,410 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "quakedef.h"
+#include "hash.h"
+#include "common.h"
+#include "fs.h"
+#include "vfs.h"
+
+//=============================================================================
+//                 A R C H I V E   D I R E C T O R Y   I N D E X
+//=============================================================================
+// Remembers the directory of every pak/pk3 we have loaded, keyed by the full
+// path, size and modification time of the archive, so unchanged archives don't
+// need their directories read and parsed again on the next start or gamedir
+// switch. The modification time includes the fraction of the second, so an
+// archive rewritten at the same size within a second is still noticed on file
+// systems that keep it. The index file is mapped and used in place:
+//
+//   fsindex_header_t
+//   fsindex_diskarchive_t [numarchives]
+//   fsindex_entry_t       [numentries]
+//   string pool           [stringslen]  (NUL terminated names)
+//
+// Everything is stored little endian.
+
+#define FSINDEX_FILENAME	"fsindex.dat"
+#define FSINDEX_VERSION		2
+
+typedef struct {
+	char magic[4];				// "QFSI"
+	int version;
+	int numarchives;
+	int numentries;
+	int stringslen;
+} fsindex_header_t;
+
+typedef struct {
+	int path;					// offset into the string pool
+	int size, mtime, mtimensec;
+	int firstentry, numfiles;
+} fsindex_diskarchive_t;
+
+struct fsindex_archive_s {
+	char path[MAX_OSPATH];
+	int size, mtime, mtimensec;
+	int numfiles;
+	const fsindex_entry_t *entries;
+	const char *strings;
+	int stringslen;
+	byte *owned;				// entries + strings of a freshly scanned archive, NULL if they point into the index
+	struct fsindex_archive_s *next;
+};
+
+static cvar_t fs_index = {"fs_index", "1"};
+
+static fsindex_archive_t *fsindex_archives;
+static hashtable_t *fsindex_hash;
+static sys_mapping_t fsindex_map;
+static byte *fsindex_buffer;		// index we wrote ourselves, used instead of fsindex_map
+static char fsindex_path[MAX_OSPATH];
+static qbool fsindex_loaded;
+static qbool fsindex_dirty;
+
+static void FSIndex_Clear(void)
+{
+	fsindex_archive_t *arc, *next;
+
+	for (arc = fsindex_archives; arc; arc = next) {
+		next = arc->next;
+		Q_free(arc->owned);
+		Q_free(arc);
+	}
+	fsindex_archives = NULL;
+
+	Hash_ShutdownTable(fsindex_hash);
+	fsindex_hash = NULL;
+
+	Sys_UnmapFile(&fsindex_map);
+	Q_free(fsindex_buffer);
+	fsindex_dirty = false;
+}
+
+static fsindex_archive_t *FSIndex_AddArchive(const char *path)
+{
+	fsindex_archive_t *arc = Q_calloc(1, sizeof(*arc));
+
+	strlcpy(arc->path, path, sizeof(arc->path));
+	arc->next = fsindex_archives;
+	fsindex_archives = arc;
+	Hash_Add(fsindex_hash, arc->path, arc);
+
+	return arc;
+}
+
+// Sets up the archive list from an index image, anything that doesn't add up
+// makes us ignore the whole index, it is rebuilt as archives get loaded.
+static qbool FSIndex_Parse(const byte *data, size_t len)
+{
+	const fsindex_header_t *header = (const fsindex_header_t *)data;
+	const fsindex_diskarchive_t *disk;
+	const fsindex_entry_t *entries;
+	const char *strings;
+	int i, numarchives, numentries, stringslen;
+
+	if (len < sizeof(*header) || memcmp(header->magic, "QFSI", 4) || LittleLong(header->version) != FSINDEX_VERSION)
+		return false;
+
+	numarchives = LittleLong(header->numarchives);
+	numentries = LittleLong(header->numentries);
+	stringslen = LittleLong(header->stringslen);
+	if (numarchives < 0 || numentries < 0 || stringslen <= 0
+		|| (size_t)numarchives > len / sizeof(*disk) || (size_t)numentries > len / sizeof(*entries)
+		|| len != sizeof(*header) + numarchives * sizeof(*disk) + numentries * sizeof(*entries) + stringslen)
+		return false;
+
+	disk = (const fsindex_diskarchive_t *)(header + 1);
+	entries = (const fsindex_entry_t *)(disk + numarchives);
+	strings = (const char *)(entries + numentries);
+	if (strings[stringslen - 1])
+		return false;
+
+	for (i = 0; i < numentries; i++) {
+		int name = LittleLong(entries[i].name);
+		if (name < 0 || name >= stringslen)
+			return false;
+	}
+
+	for (i = 0; i < numarchives; i++) {
+		int path = LittleLong(disk[i].path);
+		int first = LittleLong(disk[i].firstentry);
+		int count = LittleLong(disk[i].numfiles);
+		fsindex_archive_t *arc;
+
+		if (path < 0 || path >= stringslen || first < 0 || count < 0 || count > numentries - first)
+			return false;
+
+		arc = FSIndex_AddArchive(strings + path);
+		arc->size = LittleLong(disk[i].size);
+		arc->mtime = LittleLong(disk[i].mtime);
+		arc->mtimensec = LittleLong(disk[i].mtimensec);
+		arc->numfiles = count;
+		arc->entries = entries + first;
+		arc->strings = strings;
+		arc->stringslen = stringslen;
+	}
+
+	return true;
+}
+
+static void FSIndex_Load(void)
+{
+	if (fsindex_loaded)
+		return;
+
+	fsindex_loaded = true;
+	fsindex_hash = Hash_InitTable(256);
+	snprintf(fsindex_path, sizeof(fsindex_path), "%s/%s", com_homedir[0] ? com_homedir : com_basedir, FSINDEX_FILENAME);
+
+	if (!Sys_MapFile(fsindex_path, &fsindex_map))
+		return;
+
+	if (!FSIndex_Parse(fsindex_map.data, fsindex_map.size)) {
+		Com_DPrintf("Ignoring invalid file index %s\n", fsindex_path);
+		FSIndex_Clear();
+		fsindex_hash = Hash_InitTable(256);
+	}
+}
+
+/*
+=================
+FSIndex_Find
+
+Returns the remembered directory of the archive, or NULL if we don't have it
+or the archive was changed since.
+=================
+*/
+fsindex_archive_t *FSIndex_Find(const char *archive, vfsfile_t *handle)
+{
+	fsindex_archive_t *arc;
+	int size, mtime, mtimensec;
+
+	if (!fs_index.value)
+		return NULL;
+
+	FSIndex_Load();
+
+	if (!(arc = Hash_Get(fsindex_hash, (char *)archive)))
+		return NULL;
+
+	size = Sys_FileSizeTimeNs(archive, &mtime, &mtimensec);
+	if (mtime == -1 || size != arc->size || mtime != arc->mtime || mtimensec != arc->mtimensec
+		|| (handle && (unsigned long)size != VFS_GETLEN(handle)))
+		return NULL;
+
+	return arc;
+}
+
+int FSIndex_NumFiles(const fsindex_archive_t *arc)
+{
+	return arc->numfiles;
+}
+
+// extra is optional, it gets the backend specific fields
+void FSIndex_GetFile(const fsindex_archive_t *arc, int index, packfile_t *file, fsindex_entry_t *extra)
+{
+	const fsindex_entry_t *entry = &arc->entries[index];
+
+	strlcpy(file->name, arc->strings + LittleLong(entry->name), sizeof(file->name));
+	file->filepos = LittleLong(entry->filepos);
+	file->filelen = LittleLong(entry->filelen);
+
+	if (extra) {
+		extra->name = 0;
+		extra->filepos = file->filepos;
+		extra->filelen = file->filelen;
+		extra->csize = LittleLong(entry->csize);
+		extra->method = LittleLong(entry->method);
+		extra->flags = LittleLong(entry->flags);
+	}
+}
+
+/*
+=================
+FSIndex_Store
+
+Remembers the directory of a freshly scanned archive, written out by the
+next FSIndex_Save. extra may be NULL for plain stored archives.
+=================
+*/
+void FSIndex_Store(const char *archive, int numfiles, const packfile_t *files, const fsindex_entry_t *extra)
+{
+	fsindex_archive_t *arc;
+	fsindex_entry_t *entries;
+	char *strings;
+	int i, size, mtime, mtimensec, stringslen = 0;
+
+	if (!fs_index.value)
+		return;
+
+	size = Sys_FileSizeTimeNs(archive, &mtime, &mtimensec);
+	if (mtime == -1)
+		return;	// nested archive, not a real file
+
+	FSIndex_Load();
+
+	for (i = 0; i < numfiles; i++)
+		stringslen += strlen(files[i].name) + 1;
+
+	if (!(arc = Hash_Get(fsindex_hash, (char *)archive)))
+		arc = FSIndex_AddArchive(archive);
+
+	Q_free(arc->owned);
+	arc->owned = Q_malloc(numfiles * sizeof(*entries) + stringslen + 1);
+	entries = (fsindex_entry_t *)arc->owned;
+	strings = (char *)(entries + numfiles);
+
+	stringslen = 0;
+	for (i = 0; i < numfiles; i++) {
+		int len = strlen(files[i].name) + 1;
+
+		memcpy(strings + stringslen, files[i].name, len);
+		entries[i].name = LittleLong(stringslen);
+		entries[i].filepos = LittleLong(files[i].filepos);
+		entries[i].filelen = LittleLong(files[i].filelen);
+		entries[i].csize = LittleLong(extra ? extra[i].csize : files[i].filelen);
+		entries[i].method = LittleLong(extra ? extra[i].method : 0);
+		entries[i].flags = LittleLong(extra ? extra[i].flags : 0);
+		stringslen += len;
+	}
+	strings[stringslen] = 0;
+
+	arc->size = size;
+	arc->mtime = mtime;
+	arc->mtimensec = mtimensec;
+	arc->numfiles = numfiles;
+	arc->entries = entries;
+	arc->strings = strings;
+	arc->stringslen = stringslen + 1;
+
+	fsindex_dirty = true;
+}
+
+/*
+=================
+FSIndex_Save
+
+Writes the index out if any archive was scanned since it was loaded.
+Archives that are gone from the disk are dropped.
+=================
+*/
+void FSIndex_Save(void)
+{
+	fsindex_header_t *header;
+	fsindex_diskarchive_t *disk;
+	fsindex_entry_t *entries;
+	fsindex_archive_t *arc;
+	char *strings, tmppath[MAX_OSPATH];
+	int numarchives = 0, numentries = 0, stringslen = 0;
+	int mtime, mtimensec, i;
+	size_t len;
+	byte *data;
+	FILE *f;
+
+	if (!fsindex_dirty)
+		return;
+
+	for (arc = fsindex_archives; arc; arc = arc->next) {
+		if (Sys_FileSizeTimeNs(arc->path, &mtime, &mtimensec) != arc->size || mtime != arc->mtime || mtimensec != arc->mtimensec) {
+			arc->numfiles = -1;	// gone or changed, leave it out
+			continue;
+		}
+		numarchives++;
+		numentries += arc->numfiles;
+		stringslen += strlen(arc->path) + 1;
+		for (i = 0; i < arc->numfiles; i++)
+			stringslen += strlen(arc->strings + LittleLong(arc->entries[i].name)) + 1;
+	}
+
+	len = sizeof(*header) + numarchives * sizeof(*disk) + numentries * sizeof(*entries) + stringslen;
+	data = Q_calloc(1, len);
+	header = (fsindex_header_t *)data;
+	disk = (fsindex_diskarchive_t *)(header + 1);
+	entries = (fsindex_entry_t *)(disk + numarchives);
+	strings = (char *)(entries + numentries);
+
+	memcpy(header->magic, "QFSI", 4);
+	header->version = LittleLong(FSINDEX_VERSION);
+	header->numarchives = LittleLong(numarchives);
+	header->numentries = LittleLong(numentries);
+	header->stringslen = LittleLong(stringslen);
+
+	numentries = stringslen = 0;
+	for (arc = fsindex_archives; arc; arc = arc->next) {
+		if (arc->numfiles < 0)
+			continue;
+
+		disk->path = LittleLong(stringslen);
+		disk->size = LittleLong(arc->size);
+		disk->mtime = LittleLong(arc->mtime);
+		disk->mtimensec = LittleLong(arc->mtimensec);
+		disk->firstentry = LittleLong(numentries);
+		disk->numfiles = LittleLong(arc->numfiles);
+		disk++;
+		strcpy(strings + stringslen, arc->path);
+		stringslen += strlen(arc->path) + 1;
+
+		for (i = 0; i < arc->numfiles; i++, numentries++) {
+			const char *name = arc->strings + LittleLong(arc->entries[i].name);
+
+			entries[numentries] = arc->entries[i];
+			entries[numentries].name = LittleLong(stringslen);
+			strcpy(strings + stringslen, name);
+			stringslen += strlen(name) + 1;
+		}
+	}
+
+	// the old index may still be mapped, which stops it being replaced on some systems
+	strlcpy(tmppath, fsindex_path, sizeof(tmppath));
+	FSIndex_Clear();
+	fsindex_hash = Hash_InitTable(256);
+
+	if (!FSIndex_Parse(data, len)) {
+		Q_free(data);
+		return;
+	}
+	fsindex_buffer = data;
+
+	FS_CreatePath(tmppath);
+	strlcat(tmppath, ".tmp", sizeof(tmppath));
+	if (!(f = fopen(tmppath, "wb"))) {
+		Com_DPrintf("Can't write file index %s\n", tmppath);
+		return;
+	}
+	i = (fwrite(data, 1, len, f) == len);
+	if (fclose(f) || !i) {
+		remove(tmppath);
+		return;
+	}
+	remove(fsindex_path);
+	rename(tmppath, fsindex_path);
+}
+
+void FSIndex_Shutdown(void)
+{
+	FSIndex_Save();
+	FSIndex_Clear();
+	fsindex_loaded = false;
+}
+
+void FSIndex_Init(void)
+{
+	Cvar_SetCurrentGroup(CVAR_GROUP_FILESYSTEM);
+	Cvar_Register(&fs_index);
+	Cvar_ResetCurrentGroup();
+}
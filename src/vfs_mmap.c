@@ -39,6 +39,7 @@ typedef struct {
 	byte *handle;
 	size_t position;
 	size_t len;
+	qbool view;		// handle points into memory we don't own (mapped file), never free/realloc it
 } vfsmmapfile_t;
 
 static int VFSMMAP_ReadBytes(vfsfile_t *file, void *buffer, int bytestoread_, vfserrno_t *err) 
@@ -139,7 +140,9 @@ static void VFSMMAP_Close(vfsfile_t *file)
 {
 	vfsmmapfile_t *intfile = (vfsmmapfile_t *)file;
 
-	Q_free(intfile->handle);
+	if (!intfile->view) {
+		Q_free(intfile->handle);
+	}
 	Q_free(intfile);
 }
 
@@ -151,6 +154,13 @@ static void VFSMMAP_Flush(vfsfile_t *file)
 	Sys_Error("VFSMMAP_Flush: Invalid operation\n");
 }
 
+static const byte *VFSMMAP_GetData(vfsfile_t *file)
+{
+	vfsmmapfile_t *intfile = (vfsmmapfile_t *)file;
+
+	return intfile->handle;
+}
+
 vfsfile_t *FSMMAP_OpenVFS(void *buf, size_t buf_len) 
 {
 	vfsmmapfile_t *mmapfile = Q_calloc(1, sizeof(*mmapfile));
@@ -164,6 +174,19 @@ vfsfile_t *FSMMAP_OpenVFS(void *buf, size_t buf_len)
 	mmapfile->funcs.GetLen     = VFSMMAP_GetLen;
 	mmapfile->funcs.Close      = VFSMMAP_Close;
 	mmapfile->funcs.Flush      = VFSMMAP_Flush;
+	mmapfile->funcs.GetData    = VFSMMAP_GetData;
+
+	return (vfsfile_t *)mmapfile;
+}
+
+// Read-only window into memory owned by someone else (for example a mapped archive),
+// the caller must keep the memory alive until the file is closed.
+vfsfile_t *FSMMAP_OpenView(const void *buf, size_t buf_len)
+{
+	vfsmmapfile_t *mmapfile = (vfsmmapfile_t *)FSMMAP_OpenVFS((void *)buf, buf_len);
+
+	mmapfile->view = true;
+	mmapfile->funcs.WriteBytes = NULL;
 
 	return (vfsfile_t *)mmapfile;
 }
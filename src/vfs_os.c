@@ -81,6 +81,7 @@ static void VFSOS_Close(vfsfile_t *file)
 {
 	vfsosfile_t *intfile = (vfsosfile_t*)file;
 	fclose(intfile->handle);
+	Q_free(intfile->osname);
 	Q_free(file);
 }
 
@@ -145,10 +146,36 @@ vfsfile_t *VFSOS_Open(char *osname, char *mode)
 	file->funcs.Close      = VFSOS_Close;
 
 	file->handle = f;
+	file->osname = Q_strdup(osname);
 
 	return (vfsfile_t*)file;
 }
 
+// True if the file is a plain file on disk, not something inside an archive.
+qbool VFSOS_IsOSFile(vfsfile_t *file)
+{
+	return file && file->ReadBytes == VFSOS_ReadBytes;
+}
+
+// Maps the whole file read-only. Fails for temp files and files that changed
+// size since they were opened, map is left empty then.
+qbool VFSOS_MapFile(vfsfile_t *file, sys_mapping_t *map)
+{
+	vfsosfile_t *intfile = (vfsosfile_t*)file;
+
+	memset(map, 0, sizeof(*map));
+
+	if (!VFSOS_IsOSFile(file) || !intfile->osname || !Sys_MapFile(intfile->osname, map))
+		return false;
+
+	if (map->size != VFSOS_GetSize(file)) {
+		Sys_UnmapFile(map);
+		return false;
+	}
+
+	return true;
+}
+
 //==================================
 // STDIO files (OS) - Search functions
 //==================================
@@ -37,6 +37,7 @@ typedef struct pack_s
 
 	int     numfiles;
 	packfile_t  *files;
+	sys_mapping_t map;		// whole pak, data is NULL if it could not be mapped
 } pack_t;
 
 typedef struct
@@ -58,6 +59,7 @@ typedef struct {
     unsigned long startpos;
     unsigned long length;
     unsigned long currentpos;
+	const byte *mapped;		// points into parentpak->map, NULL if reading through the handle
 } vfspack_t;
 
 #define	MAX_FILES_IN_PACK	2048
@@ -70,11 +72,23 @@ static int VFSPAK_ReadBytes (struct vfsfile_s *vfs, void *buffer, int bytestorea
 	vfspack_t *vfsp = (vfspack_t*)vfs;
 	int read;
 
+	// VFSPAK_Seek only warns about seeking before the file, don't read outside it
+	if (vfsp->currentpos < vfsp->startpos)
+		return -1;
+
 	if (vfsp->currentpos - vfsp->startpos + bytestoread > vfsp->length)
 		bytestoread = vfsp->length - (vfsp->currentpos - vfsp->startpos);
 	if (bytestoread <= 0)
 		return -1;
 
+	if (vfsp->mapped) {
+		memcpy(buffer, vfsp->mapped + (vfsp->currentpos - vfsp->startpos), bytestoread);
+		vfsp->currentpos += bytestoread;
+		if (err)
+			*err = VFSERR_NONE;
+		return bytestoread;
+	}
+
 	if (vfsp->parentpak->filepos != vfsp->currentpos) {
 		VFS_SEEK(vfsp->parentpak->handle, vfsp->currentpos, SEEK_SET);
 	}
@@ -134,6 +148,12 @@ static unsigned long VFSPAK_GetLen (struct vfsfile_s *vfs)
 	return vfsp->length;
 }
 
+static const byte *VFSPAK_GetData (struct vfsfile_s *vfs)
+{
+	vfspack_t *vfsp = (vfspack_t*)vfs;
+	return vfsp->mapped;
+}
+
 static void FSPAK_ClosePath(void *handle);
 static void VFSPAK_Close(vfsfile_t *vfs)
 {
@@ -159,6 +179,8 @@ static vfsfile_t *FSPAK_OpenVFS(void *handle, flocation_t *loc, char *mode)
 	vfsp->startpos   = loc->offset;
 	vfsp->length     = loc->len;
 	vfsp->currentpos = vfsp->startpos;
+	if (pack->map.data && (size_t)loc->offset <= pack->map.size && (size_t)loc->len <= pack->map.size - loc->offset)
+		vfsp->mapped = pack->map.data + loc->offset;
 
 	vfsp->funcs.ReadBytes     = strcmp(mode, "rb") ? NULL : VFSPAK_ReadBytes;
 	vfsp->funcs.WriteBytes    = strcmp(mode, "wb") ? NULL : VFSPAK_WriteBytes;
@@ -167,6 +189,7 @@ static vfsfile_t *FSPAK_OpenVFS(void *handle, flocation_t *loc, char *mode)
 	vfsp->funcs.GetLen	      = VFSPAK_GetLen;
 	vfsp->funcs.Close	      = VFSPAK_Close;
 	vfsp->funcs.Flush         = NULL;
+	vfsp->funcs.GetData       = VFSPAK_GetData;
 	if (loc->search)
 		vfsp->funcs.copyprotected = loc->search->copyprotected;
 
@@ -194,6 +217,7 @@ static void FSPAK_ClosePath(void *handle)
 	if (pak->references > 0)
 		return;	//not free yet
 
+	Sys_UnmapFile(&pak->map);
 	VFS_CLOSE (pak->handle);
 	if (pak->files)
 		Q_free(pak->files);
@@ -292,6 +316,7 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 	pack_t			*pack;
 	vfsfile_t		*packhandle;
 	dpackfile_t		info;
+	fsindex_archive_t *index;
 	vfserrno_t err;
 
 	packhandle = file;
@@ -304,6 +329,19 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 	{
 		return NULL;
 	}
+
+	pack = (pack_t *)Q_calloc(1, sizeof (pack_t));
+
+	// unchanged since we last read its directory
+	if ((index = FSIndex_Find(desc, packhandle)))
+	{
+		numpackfiles = FSIndex_NumFiles(index);
+		newfiles = (packfile_t*)Q_malloc (numpackfiles * sizeof(packfile_t));
+		for (i = 0; i < numpackfiles; i++)
+			FSIndex_GetFile(index, i, &newfiles[i], NULL);
+		goto indexed;
+	}
+
 	header.dirofs = LittleLong (header.dirofs);
 	header.dirlen = LittleLong (header.dirlen);
 
@@ -323,8 +361,6 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 
 //	QCRC_Init (&crc);
 
-	pack = (pack_t *)Q_calloc(1, sizeof (pack_t));
-
 // parse the directory
 	for (i=0 ; i<numpackfiles ; i++)
 	{
@@ -342,6 +378,9 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 	if (crc != PAK0_CRC)
 		com_modified = true;
 */
+	FSIndex_Store(desc, numpackfiles, newfiles, NULL);
+
+indexed:
 	strlcpy (pack->filename, desc, sizeof (pack->filename));
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
@@ -349,19 +388,37 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 	pack->filepos = 0;
 	VFS_SEEK(packhandle, pack->filepos, SEEK_SET);
 
+	// desc is only a real file for paks sitting in a directory, not nested ones
+	if (Sys_MapFile(desc, &pack->map) && pack->map.size != VFS_GETLEN(packhandle))
+		Sys_UnmapFile(&pack->map);
+
 	pack->references++;
 
 	return pack;
 }
 
-extern void FSOS_ReadFile(void *handle, flocation_t *loc, char *buffer);
+static void FSPAK_ReadFile(void *handle, flocation_t *loc, char *buffer)
+{
+	pack_t *pak = handle;
+	vfserrno_t err;
+
+	if (pak->map.data && (size_t)loc->offset <= pak->map.size && (size_t)loc->len <= pak->map.size - loc->offset) {
+		memcpy(buffer, pak->map.data + loc->offset, loc->len);
+		return;
+	}
+
+	VFS_SEEK(pak->handle, loc->offset, SEEK_SET);
+	if (VFS_READ(pak->handle, buffer, loc->len, &err) != loc->len)
+		Com_Printf("Can't read file \"%s\" (expected %d bytes)\n", loc->rawname, loc->len);
+	pak->filepos = loc->offset + loc->len;
+}
 
 searchpathfuncs_t packfilefuncs = {
 	FSPAK_PrintPath,
 	FSPAK_ClosePath,
 	FSPAK_BuildHash,
 	FSPAK_FLocate,
-	FSOS_ReadFile,
+	FSPAK_ReadFile,
 	FSPAK_EnumerateFiles,
 	FSPAK_LoadPackFile,
 	NULL,
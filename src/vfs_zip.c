@@ -111,12 +111,47 @@ static void FSZIP_CreteFileFuncs(zlib_filefunc_def *funcs) {
 //==========================================
 // ZIP file  (*.zip, *.pk3) - VFS Functions
 //==========================================
+// Every open file inflates with its own z_stream straight from the archive,
+// so interleaved reads on one pk3 never have to re-inflate each other's data.
+// While inflating we drop a checkpoint (zlib's examples/zran.c) roughly every
+// ZIP_CHECKPOINT_SPAN bytes, a seek then restarts from the nearest checkpoint
+// instead of from the start of the entry. Checkpoints live in the archive so
+// they are reused by later opens of the same file.
+// Stored (uncompressed) entries are served as views into the mapped archive.
+
+#define ZIP_WINDOW_SIZE         32768               // deflate history needed to resume inflating
+#define ZIP_CHECKPOINT_SPAN     (1024 * 1024)       // uncompressed distance between checkpoints
+#define ZIP_INPUT_BUFFER        16384               // only used when the archive isn't mapped
+
+typedef struct zipcheckpoint_s
+{
+	unsigned long	out;				// uncompressed offset
+	unsigned long	in;					// compressed offset of the first full byte
+	int				bits;				// bits of the byte before 'in' still to be used (0-7)
+	unsigned int	windowlen;
+	byte			window[ZIP_WINDOW_SIZE];
+} zipcheckpoint_t;
+
+typedef struct zipentry_s
+{
+	qbool			resolved;			// dataofs is valid
+	int				method;				// 0 (stored) or Z_DEFLATED, anything else is not supported
+	qbool			encrypted;
+	unsigned long	dataofs;			// offset of the entry data inside the archive
+	unsigned long	csize;				// compressed size
+
+	int				numpoints;
+	int				maxpoints;
+	zipcheckpoint_t	**points;			// sorted by 'out'
+} zipentry_t;
+
 typedef struct zipfile_s
 {
-	char filename[MAX_QPATH];
-	unzFile handle;
+	char filename[MAX_OSPATH];	// full path, entries are read by reopening/mapping it if osfile
+	unzFile handle;				// central directory access, never used to read entry data
 	int		numfiles;
 	packfile_t	*files;
+	zipentry_t	*entries;		// same index as files
 
 #ifdef HASH_FILESYSTEM
 	hashtable_t hash;
@@ -125,63 +160,287 @@ typedef struct zipfile_s
 	zlib_filefunc_def zlib_funcs;
 
 	vfsfile_t *raw;
-	vfsfile_t *currentfile;	//our unzip.c can only handle one active file at any one time
-							//so we have to keep closing and switching.
-							//slow, but it works. most of the time we'll only have a single file open anyway.
+	qbool osfile;				// raw is a file on disk, not an entry of another archive
+	sys_mapping_t map;			// whole archive, data is NULL if mapping failed
 	int references;	//and a reference count
 } zipfile_t;
 
 typedef struct {
 	vfsfile_t funcs;
 
-	vfsfile_t *defer;
+	vfsfile_t *defer;			// stored entry, view into the mapped archive
 
-	//in case we're forced away.
 	zipfile_t *parent;
-	int pos;
-	int length;	//try and optimise some things
+	zipentry_t *entry;
+	vfsfile_t *rawfile;			// private handle on the archive if it isn't mapped, NULL when reading through parent->raw
+	byte *inbuf;
+
+	z_stream strm;
+	qbool strm_ready;
+	unsigned long in;			// compressed bytes handed to strm
+	unsigned long out;			// uncompressed bytes produced by strm
+
+	unsigned long pos;			// position seen by the caller
+	unsigned long length;
 	int index;
-	int startpos;
 } vfszip_t;
 
-// VFS-FIXME Need to figure what this function is trying to do
-static void VFSZIP_MakeActive(vfszip_t *vfsz)
+static qbool FSZIP_ResolveEntry(zipfile_t *zip, int index)
 {
-	int i;
-	char buffer[8192];	//must be power of two
+	zipentry_t *entry = &zip->entries[index];
+	int method, level;
 
-	if ((vfszip_t*)vfsz->parent->currentfile == vfsz)
-		return;	//already us
-	if (vfsz->parent->currentfile)
-		unzCloseCurrentFile(vfsz->parent->handle);
+	if (!entry->resolved)
+	{
+		// the local header has a variable size, let unzip walk it once
+		if (unzSetOffset(zip->handle, zip->files[index].filepos) != UNZ_OK
+			|| unzOpenCurrentFile2(zip->handle, &method, &level, 1) != UNZ_OK)
+		{
+			Com_Printf("Can't open file \"%s:%s\"\n", zip->filename, zip->files[index].name);
+			return false;
+		}
+		entry->dataofs = (unsigned long)unzGetCurrentFileZStreamPos64(zip->handle);
+		unzCloseCurrentFile(zip->handle);
+		entry->resolved = true;
+	}
 
-	//unzLocateFileMy(vfsz->parent->handle, vfsz->index, vfsz->startpos);
-	unzSetOffset(vfsz->parent->handle, vfsz->startpos);
-	unzOpenCurrentFile(vfsz->parent->handle);
+	if (entry->encrypted || (entry->method != 0 && entry->method != Z_DEFLATED))
+	{
+		Com_Printf("Can't open file \"%s:%s\" (unsupported compression)\n", zip->filename, zip->files[index].name);
+		return false;
+	}
 
-	if (vfsz->pos > 0)
+	if (zip->map.data && (entry->dataofs > zip->map.size || entry->csize > zip->map.size - entry->dataofs))
 	{
-		Com_DPrintf("VFSZIP_MakeActive: Shockingly inefficient\n");
+		Com_Printf("Can't open file \"%s:%s\" (corrupt)\n", zip->filename, zip->files[index].name);
+		return false;
+	}
+
+	return true;
+}
+
+static void FSZIP_FreeEntries(zipfile_t *zip)
+{
+	int i, j;
 
-		//now we need to seek up to where we had previously gotten to.
-		for (i = 0; i < vfsz->pos-sizeof(buffer); i++)
-			unzReadCurrentFile(vfsz->parent->handle, buffer, sizeof(buffer));
-		unzReadCurrentFile(vfsz->parent->handle, buffer, vfsz->pos - i);
+	if (!zip->entries)
+		return;
+
+	for (i = 0; i < zip->numfiles; i++)
+	{
+		for (j = 0; j < zip->entries[i].numpoints; j++)
+			Q_free(zip->entries[i].points[j]);
+		Q_free(zip->entries[i].points);
 	}
+	Q_free(zip->entries);
+}
 
-	vfsz->parent->currentfile = (vfsfile_t*)vfsz;
+// Archive handle to read entry data from when the archive isn't mapped,
+// the shared one is positioned again before every read.
+static vfsfile_t *VFSZIP_Raw(vfszip_t *vfsz)
+{
+	return vfsz->rawfile ? vfsz->rawfile : vfsz->parent->raw;
 }
 
-static int VFSZIP_ReadBytes (struct vfsfile_s *file, void *buffer, int bytestoread, vfserrno_t *err)
+// Feeds the next chunk of compressed data to the stream, false at the end of the entry.
+static qbool VFSZIP_FillInput(vfszip_t *vfsz)
 {
+	zipentry_t *entry = vfsz->entry;
+	unsigned long chunk = entry->csize - vfsz->in;
 	int read;
+
+	if (chunk == 0)
+		return false;
+
+	if (vfsz->parent->map.data)
+	{
+		// no copy, inflate reads the mapped archive directly
+		chunk = min(chunk, 0x40000000ul);
+		vfsz->strm.next_in = vfsz->parent->map.data + entry->dataofs + vfsz->in;
+	}
+	else
+	{
+		chunk = min(chunk, ZIP_INPUT_BUFFER);
+		if (VFS_SEEK(VFSZIP_Raw(vfsz), entry->dataofs + vfsz->in, SEEK_SET))
+			return false;
+		read = VFS_READ(VFSZIP_Raw(vfsz), vfsz->inbuf, (int)chunk, NULL);
+		if (read <= 0)
+			return false;
+		chunk = read;
+		vfsz->strm.next_in = vfsz->inbuf;
+	}
+
+	vfsz->strm.avail_in = (uInt)chunk;
+	vfsz->in += chunk;
+	return true;
+}
+
+static void VFSZIP_AddCheckpoint(vfszip_t *vfsz, unsigned long out)
+{
+	zipentry_t *entry = vfsz->entry;
+	zipcheckpoint_t *point;
+	unsigned long last = entry->numpoints ? entry->points[entry->numpoints - 1]->out : 0;
+
+	// some other handle may have indexed this far already
+	if (out < last + ZIP_CHECKPOINT_SPAN || vfsz->length - out < ZIP_CHECKPOINT_SPAN)
+		return;
+
+	if (entry->numpoints == entry->maxpoints)
+	{
+		entry->maxpoints = entry->maxpoints ? entry->maxpoints * 2 : 8;
+		entry->points = Q_realloc(entry->points, entry->maxpoints * sizeof(entry->points[0]));
+	}
+
+	point = Q_malloc(sizeof(*point));
+	point->out = out;
+	point->in = vfsz->in - vfsz->strm.avail_in;
+	point->bits = vfsz->strm.data_type & 7;
+	point->windowlen = sizeof(point->window);
+	if (inflateGetDictionary(&vfsz->strm, point->window, &point->windowlen) != Z_OK)
+	{
+		Q_free(point);
+		return;
+	}
+
+	entry->points[entry->numpoints++] = point;
+}
+
+// Puts the stream at the start of the entry (point == NULL) or at a checkpoint.
+static qbool VFSZIP_Restart(vfszip_t *vfsz, zipcheckpoint_t *point)
+{
+	int c;
+
+	if (!vfsz->strm_ready)
+	{
+		memset(&vfsz->strm, 0, sizeof(vfsz->strm));
+		if (inflateInit2(&vfsz->strm, -MAX_WBITS) != Z_OK)
+			return false;
+		vfsz->strm_ready = true;
+	}
+	else if (inflateReset(&vfsz->strm) != Z_OK)
+	{
+		return false;
+	}
+
+	vfsz->strm.next_in = NULL;
+	vfsz->strm.avail_in = 0;
+	vfsz->in = 0;
+	vfsz->out = 0;
+
+	if (!point)
+		return true;
+
+	// a deflate block may start in the middle of a byte
+	vfsz->in = point->in - (point->bits ? 1 : 0);
+	if (point->bits)
+	{
+		if (!VFSZIP_FillInput(vfsz))
+			return false;
+		c = *vfsz->strm.next_in++;
+		vfsz->strm.avail_in--;
+		inflatePrime(&vfsz->strm, point->bits, c >> (8 - point->bits));
+	}
+	inflateSetDictionary(&vfsz->strm, point->window, point->windowlen);
+	vfsz->out = point->out;
+
+	return true;
+}
+
+static int VFSZIP_Inflate(vfszip_t *vfsz, byte *buffer, unsigned long len)
+{
+	int ret;
+
+	vfsz->strm.next_out = buffer;
+	vfsz->strm.avail_out = (uInt)len;
+
+	while (vfsz->strm.avail_out)
+	{
+		if (!vfsz->strm.avail_in && !VFSZIP_FillInput(vfsz))
+			break;
+
+		// stop at block boundaries so we can drop checkpoints
+		ret = inflate(&vfsz->strm, Z_BLOCK);
+		if (ret == Z_STREAM_END)
+			break;
+		if (ret != Z_OK)
+		{
+			Com_Printf("Can't extract file \"%s:%s\" (corrupt)\n", vfsz->parent->filename, vfsz->parent->files[vfsz->index].name);
+			break;
+		}
+
+		if ((vfsz->strm.data_type & 128) && !(vfsz->strm.data_type & 64))
+			VFSZIP_AddCheckpoint(vfsz, vfsz->out + (len - vfsz->strm.avail_out));
+	}
+
+	len -= vfsz->strm.avail_out;
+	vfsz->out += len;
+
+	return (int)len;
+}
+
+// Makes the next inflated byte be the one at 'pos'.
+static qbool VFSZIP_SeekStream(vfszip_t *vfsz, unsigned long pos)
+{
+	zipentry_t *entry = vfsz->entry;
+	zipcheckpoint_t *point = NULL;
+	byte buffer[8192];
+	int lo = 0, hi = entry->numpoints - 1, mid;
+	int read;
+
+	// last checkpoint at or before pos
+	while (lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if (entry->points[mid]->out <= pos)
+		{
+			point = entry->points[mid];
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	if (!vfsz->strm_ready || pos < vfsz->out || (point && point->out > vfsz->out))
+	{
+		if (!VFSZIP_Restart(vfsz, point))
+			return false;
+	}
+
+	while (vfsz->out < pos)
+	{
+		read = VFSZIP_Inflate(vfsz, buffer, min(pos - vfsz->out, sizeof(buffer)));
+		if (read <= 0)
+			return false;
+	}
+
+	return true;
+}
+
+static int VFSZIP_ReadBytes (struct vfsfile_s *file, void *buffer, int bytestoread, vfserrno_t *err)
+{
+	int read = 0;
 	vfszip_t *vfsz = (vfszip_t*)file;
 
 	if (vfsz->defer)
 		return VFS_READ(vfsz->defer, buffer, bytestoread, err);
 
-	VFSZIP_MakeActive(vfsz);
-	read = unzReadCurrentFile(vfsz->parent->handle, buffer, bytestoread);
+	if (bytestoread > 0 && vfsz->pos < vfsz->length)
+	{
+		bytestoread = (int)min((unsigned long)bytestoread, vfsz->length - vfsz->pos);
+
+		if (vfsz->entry->method == Z_DEFLATED)
+		{
+			if ((vfsz->strm_ready && vfsz->out == vfsz->pos) || VFSZIP_SeekStream(vfsz, vfsz->pos))
+				read = VFSZIP_Inflate(vfsz, buffer, bytestoread);
+		}
+		else if (!VFS_SEEK(VFSZIP_Raw(vfsz), vfsz->entry->dataofs + vfsz->pos, SEEK_SET))
+		{
+			read = VFS_READ(VFSZIP_Raw(vfsz), buffer, bytestoread, NULL);
+			read = max(read, 0);
+		}
+	}
 
 	if (err)
 		*err = ((read || bytestoread <= 0) ? VFSERR_NONE : VFSERR_EOF);
@@ -196,7 +455,7 @@ static int VFSZIP_WriteBytes (struct vfsfile_s *file, const void *buffer, int by
 	return 0;
 }
 
-// VFS-FIXME: What is going on here... why not just unzSetOffset
+// Only moves the position, the stream catches up lazily on the next read.
 static int VFSZIP_Seek (struct vfsfile_s *file, unsigned long pos, int whence)
 {
 	vfszip_t *vfsz = (vfszip_t*)file;
@@ -204,47 +463,16 @@ static int VFSZIP_Seek (struct vfsfile_s *file, unsigned long pos, int whence)
 	if (vfsz->defer)
 		return VFS_SEEK(vfsz->defer, pos, whence);
 
-	//This is *really* inefficient
-	if (vfsz->parent->currentfile == file)
+	switch (whence)
 	{
-		char buffer[8192];
-		unsigned int chunk;
-		unsigned int i;
-		unsigned int length;
-
-		vfsz->defer = FS_OpenTemp();
-		if (vfsz->defer)
-		{
-			unzCloseCurrentFile(vfsz->parent->handle);
-			vfsz->parent->currentfile = NULL;	//make it not us
-
-			length = vfsz->length;
-			i = 0;
-			vfsz->pos = 0;
-			VFSZIP_MakeActive(vfsz);
-			while (1)
-			{
-				chunk = length - i;
-				if (chunk > sizeof(buffer))
-					chunk = sizeof(buffer);
-				if (chunk == 0)
-					break;
-				unzReadCurrentFile(vfsz->parent->handle, buffer, chunk);
-				VFS_WRITE(vfsz->defer, buffer, chunk);
-
-				i += chunk;
-			}
-		}
-
-		unzCloseCurrentFile(vfsz->parent->handle);
-		vfsz->parent->currentfile = NULL;	//make it not us
-
-		if (vfsz->defer)
-			return VFS_SEEK(vfsz->defer, pos, SEEK_SET);
+	case SEEK_SET: break;
+	case SEEK_CUR: pos += vfsz->pos; break;
+	case SEEK_END: pos += vfsz->length; break;
+	default:
+		Sys_Error("VFSZIP_Seek: Unknown whence value(%d)\n", whence);
+		return -1;
 	}
 
-
-
 	if (pos > vfsz->length)
 		return -1;
 	vfsz->pos = pos;
@@ -268,44 +496,77 @@ static unsigned long VFSZIP_GetLen (struct vfsfile_s *file)
 	return vfsz->length;
 }
 
+// Stored entries of a mapped archive can be used in place
+static const byte *VFSZIP_GetData (struct vfsfile_s *file)
+{
+	vfszip_t *vfsz = (vfszip_t*)file;
+
+	return vfsz->defer ? VFS_GETDATA(vfsz->defer) : NULL;
+}
+
 static void FSZIP_ClosePath(void *handle);
 static void VFSZIP_Close (struct vfsfile_s *file)
 {
 	vfszip_t *vfsz = (vfszip_t*)file;
 
-	if (vfsz->parent->currentfile == file)
-		vfsz->parent->currentfile = NULL;	//make it not us
+	if (vfsz->strm_ready)
+		inflateEnd(&vfsz->strm);
 
 	if (vfsz->defer)
 		VFS_CLOSE(vfsz->defer);
 
+	if (vfsz->rawfile)
+		VFS_CLOSE(vfsz->rawfile);
+
+	Q_free(vfsz->inbuf);
 	FSZIP_ClosePath(vfsz->parent);
 	Q_free(vfsz);
 }
 
 static vfsfile_t *FSZIP_OpenVFS(void *handle, flocation_t *loc, char *mode)
 {
-	//int rawofs;
 	zipfile_t *zip = handle;
+	zipentry_t *entry;
 	vfszip_t *vfsz;
 
 	if (strcmp(mode, "rb"))
 		return NULL; //urm, unable to write/append
 
+	if (!FSZIP_ResolveEntry(zip, loc->index))
+		return NULL;
+	entry = &zip->entries[loc->index];
+
 	vfsz = Q_calloc(1, sizeof(vfszip_t));
 
 	vfsz->parent = zip;
+	vfsz->entry = entry;
 	vfsz->index = loc->index;
-	vfsz->startpos = zip->files[loc->index].filepos;
 	vfsz->length = loc->len;
 
+	if (zip->map.data)
+	{
+		if (entry->method == 0)
+			vfsz->defer = FSMMAP_OpenView(zip->map.data + entry->dataofs, vfsz->length);
+	}
+	else
+	{
+		// an archive inside another one has no path on disk, share its handle instead
+		if (zip->osfile && !(vfsz->rawfile = VFSOS_Open(zip->filename, "rb")))
+		{
+			Q_free(vfsz);
+			return NULL;
+		}
+		if (entry->method == Z_DEFLATED)
+			vfsz->inbuf = Q_malloc(ZIP_INPUT_BUFFER);
+	}
+
 	vfsz->funcs.ReadBytes  = strcmp(mode, "rb") ? NULL : VFSZIP_ReadBytes;
 	vfsz->funcs.WriteBytes = strcmp(mode, "wb") ? NULL : VFSZIP_WriteBytes;
 	vfsz->funcs.Seek       = VFSZIP_Seek;
-	vfsz->funcs.seekingisabadplan = true;
 	vfsz->funcs.Tell       = VFSZIP_Tell;
 	vfsz->funcs.GetLen     = VFSZIP_GetLen;
 	vfsz->funcs.Close      = VFSZIP_Close;
+	vfsz->funcs.GetData    = VFSZIP_GetData;
 	if (loc->search)
 		vfsz->funcs.copyprotected = loc->search->copyprotected;
 
@@ -336,6 +597,8 @@ static void FSZIP_ClosePath(void *handle)
 
 	unzClose(zip->handle);
 	VFS_CLOSE(zip->raw);
+	Sys_UnmapFile(&zip->map);
+	FSZIP_FreeEntries(zip);
 	if (zip->files)
 		Q_free(zip->files);
 	Q_free(zip);
@@ -462,12 +725,17 @@ static void *FSZIP_LoadZipFile(vfsfile_t *packhandle, const char *desc)
 	packfile_t		*newfiles;
 	zlib_filefunc_def *funcs = NULL;
 	unz_global_info info;
+	fsindex_archive_t *index;
+	fsindex_entry_t *extra;
 	
 	zip   = (zipfile_t *) Q_calloc(1, sizeof(*zip));
 	strlcpy (zip->filename, desc, sizeof (zip->filename));
 	FSZIP_CreteFileFuncs(&(zip->zlib_funcs));
 	zip->raw = packhandle;
-	zip->handle = unzOpen2(desc, funcs);
+	zip->osfile = VFSOS_IsOSFile(packhandle);
+	zip->zlib_funcs.opaque = packhandle;
+	// a nested archive has to be walked through its handle, desc is only a name
+	zip->handle = unzOpen2(desc, zip->osfile ? funcs : &zip->zlib_funcs);
 	if (!zip->handle) goto fail;
 
 	if (unzGetGlobalInfo(zip->handle, &info) != UNZ_OK) goto fail;
@@ -477,6 +745,21 @@ static void *FSZIP_LoadZipFile(vfsfile_t *packhandle, const char *desc)
 
 	// Create a list of the number of files
 	zip->files = newfiles = Q_malloc (zip->numfiles * sizeof(packfile_t));
+	zip->entries = Q_calloc(zip->numfiles, sizeof(zipentry_t));
+
+	// unchanged since we last walked its central directory
+	if ((index = FSIndex_Find(desc, packhandle)) && FSIndex_NumFiles(index) == zip->numfiles) {
+		fsindex_entry_t entry;
+
+		for (i = 0; i < zip->numfiles; i++) {
+			FSIndex_GetFile(index, i, &newfiles[i], &entry);
+			zip->entries[i].method = entry.method;
+			zip->entries[i].encrypted = !!(entry.flags & FSINDEX_ENCRYPTED);
+			zip->entries[i].csize = entry.csize;
+		}
+		goto indexed;
+	}
+
 	if (unzGoToFirstFile(zip->handle) != UNZ_OK) goto fail;
 	for (i = 0; i < zip->numfiles; i++) {
 		unz_file_info file_info;
@@ -485,6 +768,9 @@ static void *FSZIP_LoadZipFile(vfsfile_t *packhandle, const char *desc)
 		Q_strlwr(newfiles[i].name);
 		newfiles[i].filelen = file_info.uncompressed_size;
 		newfiles[i].filepos = unzGetOffset(zip->handle); // VFS-FIXME: Need to verify this
+		zip->entries[i].method = file_info.compression_method;
+		zip->entries[i].encrypted = (file_info.flag & 1);
+		zip->entries[i].csize = file_info.compressed_size;
 		r = unzGoToNextFile (zip->handle);
 		if (r == UNZ_END_OF_LIST_OF_FILE) {
 			break;
@@ -493,9 +779,23 @@ static void *FSZIP_LoadZipFile(vfsfile_t *packhandle, const char *desc)
 		}
 
 	}
+
+	extra = Q_calloc(zip->numfiles, sizeof(*extra));
+	for (i = 0; i < zip->numfiles; i++) {
+		extra[i].method = zip->entries[i].method;
+		extra[i].flags = (zip->entries[i].encrypted ? FSINDEX_ENCRYPTED : 0);
+		extra[i].csize = zip->entries[i].csize;
+	}
+	FSIndex_Store(desc, zip->numfiles, zip->files, extra);
+	Q_free(extra);
+
+indexed:
 	
+	// failing is fine, entries are then read through private file handles
+	if (zip->osfile)
+		Sys_MapFile(zip->filename, &zip->map);
+
 	zip->references = 1;
-	zip->currentfile = NULL;
 
 	return zip;
 
@@ -504,6 +804,7 @@ fail:
 	Q_free(funcs);
 	Q_free(zip->handle);
 	Q_free(zip->files);
+	Q_free(zip->entries);
 	Q_free(zip);
 	return NULL;
 }
@@ -1444,6 +1444,9 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 #endif
 
 	++vm->callLevel;
+	if ( pr_prof_active ) {
+		PR_ProfEnter( PROF_VMMAIN, callnum, NULL );
+	}
 	// if we have a dll loaded, call it directly
 	if ( vm->entryPoint ) 
 	{
@@ -1484,6 +1487,9 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 			r = VM_CallInterpreted2( vm, nargs+1, &args[0] );
 #endif
 	}
+	if ( pr_prof_active ) {
+		PR_ProfLeave();
+	}
 	--vm->callLevel;
 	if ( oldVM != NULL ) // bk001220 - assert(currentVM!=NULL) for oldVM==NULL
 	  currentVM = oldVM;
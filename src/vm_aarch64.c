@@ -0,0 +1,861 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ */
+// vm_aarch64.c -- AArch64 compiler for QVM modules, the counterpart of vm_x86.c
+
+#ifdef USE_PR2
+#ifdef SERVERONLY
+#include "qwsvdef.h"
+#else
+#include "quakedef.h"
+#include "pr_comp.h"
+#include "g_public.h"
+#endif
+#include "vm_local.h"
+
+#if idarm64 && ( defined(__linux__) || defined(__FreeBSD__) )
+
+#include <sys/mman.h>
+
+/*
+  -------------
+  x0-x3	scratch, arguments of the helper functions
+  x16	scratch (IP0)
+  x19*	dataBase
+  x20*	opStack, points at the top of the opstack like edi in vm_x86.c
+  x21*	programStack
+  x22*	current proc stack ( dataBase + programStack )
+  x23*	instructionPointers
+  x24*	dataMask
+  x25*	vm
+  x26*	opStackTop
+  x27*	stackBottom
+  s0-s1	scratch
+  -------------
+
+  All of x19-x27 are callee-saved in the AAPCS64, so they survive the calls
+  into the engine. Every proc saves x29/x30 in OP_ENTER and returns with a
+  plain ret, so vm to vm calls are native bl/ret pairs. OP_LEAVE restores the
+  caller's programStack itself, there is nothing to save around a call.
+
+  The code never depends on how far away a branch target is: conditional
+  branches are always emitted as an inverted b.cond over a b, and pointers are
+  always loaded with four moves. So the first pass can size the code and the
+  second one writes it with the same offsets.
+
+  Memory accesses are masked with dataMask exactly as the interpreter does, so
+  both give the same results for any image VM_CheckInstructions accepts.
+*/
+
+#define REG_X0			0
+#define REG_X1			1
+#define REG_X2			2
+#define REG_X3			3
+#define REG_X16			16
+#define RDATABASE		19
+#define ROPSTACK		20
+#define RPSTACK			21
+#define RPROCBASE		22
+#define RINSPOINTERS	23
+#define RDATAMASK		24
+#define RVM				25
+#define ROPSTACKTOP		26
+#define RSTACKBOTTOM	27
+
+// condition codes
+#define COND_EQ	0x0
+#define COND_NE	0x1
+#define COND_HS	0x2
+#define COND_LO	0x3
+#define COND_MI	0x4
+#define COND_HI	0x8
+#define COND_LS	0x9
+#define COND_GE	0xA
+#define COND_LT	0xB
+#define COND_GT	0xC
+#define COND_LE	0xD
+
+typedef enum
+{
+	FUNC_ENTR = 0,
+	FUNC_CALL,
+	FUNC_SYSC,
+	FUNC_BADJ,
+	FUNC_ERRJ,
+	FUNC_PSOF,
+	FUNC_OSOF,
+	FUNC_LAST
+} funcarm_t;
+
+static	byte     *code;
+static	int      compiledOfs;
+static	int      *instructionOffsets;
+static	intptr_t *instructionPointers;
+
+static  instruction_t *inst = NULL;
+
+static	int	funcOffset[FUNC_LAST];
+
+static void ErrJump( void )
+{
+	SV_Error( "program tried to execute code outside VM" );
+}
+
+
+static void BadJump( void )
+{
+	SV_Error( "program tried to execute code at bad location inside VM" );
+}
+
+
+static void BadStack( void )
+{
+	SV_Error( "program tried to overflow program stack" );
+}
+
+
+static void BadOpStack( void )
+{
+	SV_Error( "program tried to overflow opcode stack" );
+}
+
+/*
+=================
+VM_SystemCall
+
+Called from the generated code with the syscall number already made positive
+=================
+*/
+static int VM_SystemCall( vm_t *vm, unsigned int programStack, int callnum )
+{
+	intptr_t	args[16];
+	int			*img, i;
+
+	// save the stack to allow recursive VM entry
+	vm->programStack = programStack - 8;
+
+	img = (int *)( vm->dataBase + programStack + 4 );
+	img[0] = callnum;
+	for ( i = 0; i < ARRAY_LEN( args ); i++ ) {
+		args[i] = img[i];
+	}
+
+	return vm->systemCall( args );
+}
+
+/*
+=================
+VM_BlockCopy
+
+Same range clipping as OP_BLOCK_COPY in the interpreter
+=================
+*/
+static void VM_BlockCopy( vm_t *vm, unsigned int dest, unsigned int src, unsigned int count )
+{
+	unsigned int dataMask = vm->dataMask;
+
+	src &= dataMask;
+	dest &= dataMask;
+	count = ( ( src + count ) & dataMask ) - src;
+	count = ( ( dest + count ) & dataMask ) - dest;
+
+	memcpy( vm->dataBase + dest, vm->dataBase + src, count );
+}
+
+static void VM_FreeBuffers( void )
+{
+	// should be freed in reversed allocation order
+	Q_free( instructionOffsets );
+	Q_free( inst );
+}
+
+static void Emit4( unsigned int v )
+{
+	if ( code ) {
+		memcpy( code + compiledOfs, &v, 4 );
+	}
+	compiledOfs += 4;
+}
+
+// mov wd, #v
+static void EmitMovW( int rd, unsigned int v )
+{
+	if ( ( v & 0xFFFF0000 ) == 0 ) {
+		Emit4( 0x52800000 | ( v << 5 ) | rd );							// movz wd, #v
+	} else if ( ( ~v & 0xFFFF0000 ) == 0 ) {
+		Emit4( 0x12800000 | ( ( ~v & 0xFFFF ) << 5 ) | rd );			// movn wd, #~v
+	} else {
+		Emit4( 0x52800000 | ( ( v & 0xFFFF ) << 5 ) | rd );				// movz wd, #lo
+		Emit4( 0x72A00000 | ( ( v >> 16 ) << 5 ) | rd );				// movk wd, #hi, lsl 16
+	}
+}
+
+// mov xd, #ptr, always four instructions so the code size doesn't depend on it
+static void EmitMovPtr( int rd, const void *ptr )
+{
+	uint64_t v = (uint64_t)(intptr_t)ptr;
+
+	Emit4( 0xD2800000 | ( (unsigned int)( v & 0xFFFF ) << 5 ) | rd );			// movz xd, #v0
+	Emit4( 0xF2A00000 | ( (unsigned int)( ( v >> 16 ) & 0xFFFF ) << 5 ) | rd );	// movk xd, #v1, lsl 16
+	Emit4( 0xF2C00000 | ( (unsigned int)( ( v >> 32 ) & 0xFFFF ) << 5 ) | rd );	// movk xd, #v2, lsl 32
+	Emit4( 0xF2E00000 | ( (unsigned int)( ( v >> 48 ) & 0xFFFF ) << 5 ) | rd );	// movk xd, #v3, lsl 48
+}
+
+// add wd, wn, #v
+static void EmitAddW( int rd, int rn, unsigned int v )
+{
+	if ( v < 4096 ) {
+		Emit4( 0x11000000 | ( v << 10 ) | ( rn << 5 ) | rd );
+	} else {
+		EmitMovW( REG_X16, v );
+		Emit4( 0x0B000000 | ( REG_X16 << 16 ) | ( rn << 5 ) | rd );		// add wd, wn, w16
+	}
+}
+
+// sub wd, wn, #v
+static void EmitSubW( int rd, int rn, unsigned int v )
+{
+	if ( v < 4096 ) {
+		Emit4( 0x51000000 | ( v << 10 ) | ( rn << 5 ) | rd );
+	} else {
+		EmitMovW( REG_X16, v );
+		Emit4( 0x4B000000 | ( REG_X16 << 16 ) | ( rn << 5 ) | rd );		// sub wd, wn, w16
+	}
+}
+
+// ldr/str with an unsigned offset: base is the opcode for a zero offset, size the access size
+static void EmitLoadStore( unsigned int base, unsigned int regbase, int size, int rt, int rn, unsigned int offset )
+{
+	if ( ( offset & ( size - 1 ) ) == 0 && offset / size < 4096 ) {
+		Emit4( base | ( ( offset / size ) << 10 ) | ( rn << 5 ) | rt );
+	} else {
+		EmitMovW( REG_X16, offset );
+		Emit4( regbase | ( REG_X16 << 16 ) | ( rn << 5 ) | rt );			// [xn, x16]
+	}
+}
+
+#define EmitLdrW(rt, rn, ofs)	EmitLoadStore( 0xB9400000, 0xB8606800, 4, rt, rn, ofs )
+#define EmitLdrH(rt, rn, ofs)	EmitLoadStore( 0x79400000, 0x78606800, 2, rt, rn, ofs )
+#define EmitLdrB(rt, rn, ofs)	EmitLoadStore( 0x39400000, 0x38606800, 1, rt, rn, ofs )
+#define EmitStrW(rt, rn, ofs)	EmitLoadStore( 0xB9000000, 0xB8206800, 4, rt, rn, ofs )
+#define EmitLdrX(rt, rn, ofs)	EmitLoadStore( 0xF9400000, 0xF8606800, 8, rt, rn, ofs )
+#define EmitStrX(rt, rn, ofs)	EmitLoadStore( 0xF9000000, 0xF8206800, 8, rt, rn, ofs )
+
+#define EmitPushW(rt)	Emit4( 0xB8004C00 | ( ROPSTACK << 5 ) | (rt) )		// str wt, [x20, #4]!
+#define EmitPopW(rt)	Emit4( 0xB85FC400 | ( ROPSTACK << 5 ) | (rt) )		// ldr wt, [x20], #-4
+#define EmitPeekW(rt)	Emit4( 0xB9400000 | ( ROPSTACK << 5 ) | (rt) )		// ldr wt, [x20]
+#define EmitPokeW(rt)	Emit4( 0xB9000000 | ( ROPSTACK << 5 ) | (rt) )		// str wt, [x20]
+#define EmitPeekS(rt)	Emit4( 0xBD400000 | ( ROPSTACK << 5 ) | (rt) )		// ldr st, [x20]
+#define EmitPokeS(rt)	Emit4( 0xBD000000 | ( ROPSTACK << 5 ) | (rt) )		// str st, [x20]
+#define EmitLoad2W()	Emit4( 0x297F8001 | ( ROPSTACK << 5 ) )				// ldp w1, w0, [x20, #-4]
+#define EmitLoad2S()	Emit4( 0x2D7F8001 | ( ROPSTACK << 5 ) )				// ldp s1, s0, [x20, #-4]
+#define EmitStore1W()	Emit4( 0xB81FCC00 | ( ROPSTACK << 5 ) )				// str w0, [x20, #-4]!
+#define EmitStore1S()	Emit4( 0xBC1FCC00 | ( ROPSTACK << 5 ) )				// str s0, [x20, #-4]!
+#define EmitIncOpStack(n)	Emit4( 0x91000000 | ( (n) << 10 ) | ( ROPSTACK << 5 ) | ROPSTACK )	// add x20, x20, #n
+#define EmitDecOpStack(n)	Emit4( 0xD1000000 | ( (n) << 10 ) | ( ROPSTACK << 5 ) | ROPSTACK )	// sub x20, x20, #n
+#define EmitProcBase()	Emit4( 0x8B204000 | ( RPSTACK << 16 ) | ( RDATABASE << 5 ) | RPROCBASE )	// add x22, x19, w21, uxtw
+
+static void EmitBranch( unsigned int op, int target )
+{
+	Emit4( op | ( ( ( target - compiledOfs ) >> 2 ) & 0x3FFFFFF ) );
+}
+
+#define EmitB(target)	EmitBranch( 0x14000000, target )
+#define EmitBL(target)	EmitBranch( 0x94000000, target )
+
+// b.cond target, as b.!cond over a b so there is no range limit
+static void EmitJcc( int cond, int target )
+{
+	Emit4( 0x54000040 | ( cond ^ 1 ) );		// b.!cond +8
+	EmitB( target );
+}
+
+static void EmitCallHelper( const void *func )
+{
+	EmitMovPtr( REG_X16, func );
+	Emit4( 0xD63F0000 | ( REG_X16 << 5 ) );		// blr x16
+}
+
+// ldp w1, w0, [x20, #-4]; op w0, w1, w0; str w0, [x20, #-4]!
+static void EmitBinaryW( unsigned int op )
+{
+	EmitLoad2W();
+	Emit4( op | ( REG_X0 << 16 ) | ( REG_X1 << 5 ) | REG_X0 );
+	EmitStore1W();
+}
+
+// ldp s1, s0, [x20, #-4]; op s0, s1, s0; str s0, [x20, #-4]!
+static void EmitBinaryS( unsigned int op )
+{
+	EmitLoad2S();
+	Emit4( op | ( REG_X0 << 16 ) | ( REG_X1 << 5 ) | REG_X0 );
+	EmitStore1S();
+}
+
+// a load through the address on top of the opstack
+static void EmitLoadTop( unsigned int regbase )
+{
+	EmitPeekW( REG_X0 );
+	Emit4( 0x0A000000 | ( RDATAMASK << 16 ) | ( REG_X0 << 5 ) | REG_X0 );		// and w0, w0, w24
+	Emit4( regbase | ( REG_X0 << 16 ) | ( RDATABASE << 5 ) | REG_X0 );			// ldr w0, [x19, x0]
+	EmitPokeW( REG_X0 );
+}
+
+// a store of the top of the opstack to the address below it
+static void EmitStoreTop( unsigned int regbase )
+{
+	EmitLoad2W();
+	EmitDecOpStack( 8 );
+	Emit4( 0x0A000000 | ( RDATAMASK << 16 ) | ( REG_X1 << 5 ) | REG_X1 );		// and w1, w1, w24
+	Emit4( regbase | ( REG_X1 << 16 ) | ( RDATABASE << 5 ) | REG_X0 );			// str w0, [x19, x1]
+}
+
+static int JumpCondition( int op )
+{
+	switch ( op ) {
+		case OP_EQ:  return COND_EQ;
+		case OP_NE:  return COND_NE;
+		case OP_LTI: return COND_LT;
+		case OP_LEI: return COND_LE;
+		case OP_GTI: return COND_GT;
+		case OP_GEI: return COND_GE;
+		case OP_LTU: return COND_LO;
+		case OP_LEU: return COND_LS;
+		case OP_GTU: return COND_HI;
+		case OP_GEU: return COND_HS;
+		// these are false when unordered, like the C comparisons
+		case OP_EQF: return COND_EQ;
+		case OP_NEF: return COND_NE;
+		case OP_LTF: return COND_MI;
+		case OP_LEF: return COND_LS;
+		case OP_GTF: return COND_GT;
+		case OP_GEF: return COND_GE;
+	}
+	return COND_EQ;
+}
+
+static void EmitErrorFunc( void (*func)( void ) )
+{
+	EmitCallHelper( (void *)func );
+	Emit4( 0xD4200000 );					// brk #0, SV_Error doesn't return
+}
+
+static void EmitCallFunc( vm_t *vm )
+{
+	// syscalls have negative numbers
+	Emit4( 0x7100001F | ( REG_X0 << 5 ) );		// cmp w0, #0
+	EmitJcc( COND_LT, funcOffset[FUNC_SYSC] );
+
+	// jump target range check
+	EmitMovW( REG_X16, vm->instructionCount );
+	Emit4( 0x6B00001F | ( REG_X16 << 16 ) | ( REG_X0 << 5 ) );		// cmp w0, w16
+	EmitJcc( COND_HS, funcOffset[FUNC_ERRJ] );
+
+	// the address is popped, the callee returns straight to our caller
+	EmitDecOpStack( 4 );
+	Emit4( 0xF8607800 | ( REG_X0 << 16 ) | ( RINSPOINTERS << 5 ) | REG_X16 );	// ldr x16, [x23, x0, lsl #3]
+	Emit4( 0xD61F0000 | ( REG_X16 << 5 ) );		// br x16
+}
+
+static void EmitSysCallFunc( vm_t *vm )
+{
+	Emit4( 0xA9BF7BFD );					// stp x29, x30, [sp, #-16]!
+	Emit4( 0x2A2003E0 | ( REG_X0 << 16 ) | REG_X2 );	// mvn w2, w0
+	Emit4( 0x2A0003E0 | ( RPSTACK << 16 ) | REG_X1 );	// mov w1, w21
+	Emit4( 0xAA0003E0 | ( RVM << 16 ) | REG_X0 );	// mov x0, x25
+	EmitCallHelper( (void *)VM_SystemCall );
+	// the return value replaces the call address
+	EmitPokeW( REG_X0 );
+	Emit4( 0xA8C17BFD );					// ldp x29, x30, [sp], #16
+	Emit4( 0xD65F03C0 );					// ret
+}
+
+/*
+=================
+VM_Alloc_Compiled
+=================
+*/
+static void *VM_Alloc_Compiled( vm_t *vm, int codeLength, int tableLength )
+{
+	void	*ptr;
+	int		length;
+
+	length = codeLength + tableLength;
+	ptr = mmap( NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( ptr == MAP_FAILED ) {
+		SV_Error( "VM_CompileArm64: mmap failed" );
+		return NULL;
+	}
+
+	vm->codeBase.ptr = (byte*)ptr;
+	vm->codeLength = codeLength;
+	vm->codeSize = length;
+
+	return vm->codeBase.ptr;
+}
+
+/*
+==============
+VM_Destroy_Compiled
+==============
+*/
+static void VM_Destroy_Compiled( vm_t* vm )
+{
+	munmap( vm->codeBase.ptr, vm->codeSize );
+	vm->codeBase.ptr = NULL;
+}
+
+/*
+=================
+VM_Compile
+=================
+*/
+qbool VM_Compile( vm_t *vm, vmHeader_t *header )
+{
+	const char		*errMsg;
+	instruction_t	*ci, *ni;
+	int				instructionCount;
+	int				ip, pass, i, v;
+
+	instructionCount = header->instructionCount;
+
+	inst = (instruction_t*)Q_malloc( (instructionCount + 8 ) * sizeof( instruction_t ) );
+	instructionOffsets = (int*)Q_malloc( instructionCount * sizeof( int ) );
+
+	errMsg = VM_LoadInstructions( (byte *) header + header->codeOffset, header->codeLength, instructionCount, inst );
+	if ( !errMsg ) {
+		errMsg = VM_CheckInstructions( inst, vm->instructionCount, vm->jumpTableTargets, vm->numJumpTableTargets, vm->exactDataLength );
+	}
+	if ( errMsg ) {
+		VM_FreeBuffers();
+		Con_Printf( "VM_CompileArm64 error: %s\n", errMsg );
+		return false;
+	}
+
+	code = NULL; // we will allocate memory after the first pass
+	instructionPointers = NULL;
+
+	memset( funcOffset, 0, sizeof( funcOffset ) );
+
+	for ( pass = 0; pass < 2; pass++ )
+	{
+	compiledOfs = 0;
+
+	// entry point, called as void (*)(void) by VM_CallCompiled
+	Emit4( 0xA9BA7BFD );					// stp x29, x30, [sp, #-96]!
+	Emit4( 0xA90153F3 );					// stp x19, x20, [sp, #16]
+	Emit4( 0xA9025BF5 );					// stp x21, x22, [sp, #32]
+	Emit4( 0xA90363F7 );					// stp x23, x24, [sp, #48]
+	Emit4( 0xA9046BF9 );					// stp x25, x26, [sp, #64]
+	Emit4( 0xA90573FB );					// stp x27, x28, [sp, #80]
+
+	EmitMovPtr( RVM, vm );
+	EmitMovPtr( RDATABASE, vm->dataBase );
+	EmitMovPtr( RINSPOINTERS, instructionPointers );
+	EmitMovW( RDATAMASK, vm->dataMask );
+	EmitMovW( RSTACKBOTTOM, vm->stackBottom );
+	EmitLdrW( RPSTACK, RVM, offsetof( vm_t, programStack ) );
+	EmitLdrX( ROPSTACK, RVM, offsetof( vm_t, opStack ) );
+	EmitLdrX( ROPSTACKTOP, RVM, offsetof( vm_t, opStackTop ) );
+
+	EmitBL( funcOffset[FUNC_ENTR] );
+
+	EmitStrX( ROPSTACK, RVM, offsetof( vm_t, opStack ) );
+
+	Emit4( 0xA94573FB );					// ldp x27, x28, [sp, #80]
+	Emit4( 0xA9446BF9 );					// ldp x25, x26, [sp, #64]
+	Emit4( 0xA94363F7 );					// ldp x23, x24, [sp, #48]
+	Emit4( 0xA9425BF5 );					// ldp x21, x22, [sp, #32]
+	Emit4( 0xA94153F3 );					// ldp x19, x20, [sp, #16]
+	Emit4( 0xA8C67BFD );					// ldp x29, x30, [sp], #96
+	Emit4( 0xD65F03C0 );					// ret
+
+	// main function entry offset
+	funcOffset[FUNC_ENTR] = compiledOfs;
+
+	ip = 0;
+	while ( ip < instructionCount )
+	{
+		instructionOffsets[ ip ] = compiledOfs;
+
+		ci = &inst[ ip ];
+		ni = &inst[ ip + 1 ];
+		ip++;
+
+		switch ( ci->op ) {
+
+		case OP_UNDEF:
+		case OP_IGNORE:
+			break;
+
+		case OP_BREAK:
+			Emit4( 0xD4200000 );			// brk #0
+			break;
+
+		case OP_ENTER:
+			Emit4( 0xA9BF7BFD );			// stp x29, x30, [sp, #-16]!
+			EmitSubW( RPSTACK, RPSTACK, ci->value );
+
+			// programStack overflow check
+			if ( (int)vm_rtChecks.value & 1 ) {
+				Emit4( 0x6B00001F | ( RSTACKBOTTOM << 16 ) | ( RPSTACK << 5 ) );	// cmp w21, w27
+				EmitJcc( COND_LO, funcOffset[FUNC_PSOF] );
+			}
+
+			// opStack overflow check
+			if ( (int)vm_rtChecks.value & 2 ) {
+				Emit4( 0x91000000 | ( ci->opStack << 10 ) | ( ROPSTACK << 5 ) | REG_X16 );	// add x16, x20, #opStack
+				Emit4( 0xEB00001F | ( ROPSTACKTOP << 16 ) | ( REG_X16 << 5 ) );			// cmp x16, x26
+				EmitJcc( COND_HI, funcOffset[FUNC_OSOF] );
+			}
+
+			EmitProcBase();
+			break;
+
+		case OP_LEAVE:
+			EmitAddW( RPSTACK, RPSTACK, ci->value );
+			EmitProcBase();
+			Emit4( 0xA8C17BFD );			// ldp x29, x30, [sp], #16
+			Emit4( 0xD65F03C0 );			// ret
+			break;
+
+		case OP_CONST:
+			// we can only merge with the next instruction if nothing jumps to it
+			if ( !ni->jused ) {
+				if ( ni->op == OP_CALL && ci->value >= 0 ) {
+					// the call address is pushed and popped again
+					EmitBL( instructionOffsets[ ci->value ] );
+					ip++;
+					break;
+				}
+				if ( ni->op == OP_CALL ) {
+					EmitMovW( REG_X0, ci->value );
+					EmitIncOpStack( 4 );
+					EmitBL( funcOffset[FUNC_SYSC] );
+					ip++;
+					break;
+				}
+				if ( ni->op == OP_JUMP ) {
+					EmitB( instructionOffsets[ ci->value ] );
+					ip++;
+					break;
+				}
+				if ( ni->op == OP_LOAD4 || ni->op == OP_LOAD2 || ni->op == OP_LOAD1 ) {
+					v = ci->value & vm->dataMask;
+					if ( ni->op == OP_LOAD4 )
+						EmitLdrW( REG_X0, RDATABASE, v );
+					else if ( ni->op == OP_LOAD2 )
+						EmitLdrH( REG_X0, RDATABASE, v );
+					else
+						EmitLdrB( REG_X0, RDATABASE, v );
+					EmitPushW( REG_X0 );
+					ip++;
+					break;
+				}
+			}
+			EmitMovW( REG_X0, ci->value );
+			EmitPushW( REG_X0 );
+			break;
+
+		case OP_LOCAL:
+			// merge OP_LOCAL + OP_LOAD4/2/1, the address is within the proc frame
+			if ( !ni->jused && ( ni->op == OP_LOAD4 || ni->op == OP_LOAD2 || ni->op == OP_LOAD1 ) ) {
+				if ( ni->op == OP_LOAD4 )
+					EmitLdrW( REG_X0, RPROCBASE, ci->value );
+				else if ( ni->op == OP_LOAD2 )
+					EmitLdrH( REG_X0, RPROCBASE, ci->value );
+				else
+					EmitLdrB( REG_X0, RPROCBASE, ci->value );
+				EmitPushW( REG_X0 );
+				ip++;
+				break;
+			}
+			EmitAddW( REG_X0, RPSTACK, ci->value );
+			EmitPushW( REG_X0 );
+			break;
+
+		case OP_ARG:
+			EmitPopW( REG_X0 );
+			EmitStrW( REG_X0, RPROCBASE, ci->value );
+			break;
+
+		case OP_CALL:
+			EmitPeekW( REG_X0 );
+			EmitBL( funcOffset[FUNC_CALL] );
+			break;
+
+		case OP_PUSH:
+			EmitIncOpStack( 4 );
+			break;
+
+		case OP_POP:
+			EmitDecOpStack( 4 );
+			break;
+
+		case OP_JUMP:
+			EmitPopW( REG_X0 );
+			EmitMovW( REG_X16, instructionCount );
+			Emit4( 0x6B00001F | ( REG_X16 << 16 ) | ( REG_X0 << 5 ) );		// cmp w0, w16
+			EmitJcc( COND_HS, funcOffset[FUNC_BADJ] );
+			Emit4( 0xF8607800 | ( REG_X0 << 16 ) | ( RINSPOINTERS << 5 ) | REG_X16 );	// ldr x16, [x23, x0, lsl #3]
+			Emit4( 0xD61F0000 | ( REG_X16 << 5 ) );		// br x16
+			break;
+
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+			EmitLoad2W();
+			EmitDecOpStack( 8 );
+			Emit4( 0x6B00001F | ( REG_X0 << 16 ) | ( REG_X1 << 5 ) );		// cmp w1, w0
+			EmitJcc( JumpCondition( ci->op ), instructionOffsets[ ci->value ] );
+			break;
+
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+			EmitLoad2S();
+			EmitDecOpStack( 8 );
+			Emit4( 0x1E202000 | ( REG_X0 << 16 ) | ( REG_X1 << 5 ) );		// fcmp s1, s0
+			EmitJcc( JumpCondition( ci->op ), instructionOffsets[ ci->value ] );
+			break;
+
+		case OP_LOAD1:
+			EmitLoadTop( 0x38606800 );		// ldrb
+			break;
+
+		case OP_LOAD2:
+			EmitLoadTop( 0x78606800 );		// ldrh
+			break;
+
+		case OP_LOAD4:
+			EmitLoadTop( 0xB8606800 );		// ldr
+			break;
+
+		case OP_STORE1:
+			EmitStoreTop( 0x38206800 );		// strb
+			break;
+
+		case OP_STORE2:
+			EmitStoreTop( 0x78206800 );		// strh
+			break;
+
+		case OP_STORE4:
+			EmitStoreTop( 0xB8206800 );		// str
+			break;
+
+		case OP_BLOCK_COPY:
+			Emit4( 0x297F8A81 );			// ldp w1, w2, [x20, #-4]
+			EmitDecOpStack( 8 );
+			Emit4( 0xAA0003E0 | ( RVM << 16 ) | REG_X0 );	// mov x0, x25
+			EmitMovW( REG_X3, ci->value );
+			EmitCallHelper( (void *)VM_BlockCopy );
+			break;
+
+		case OP_SEX8:
+			EmitPeekW( REG_X0 );
+			Emit4( 0x13001C00 );			// sxtb w0, w0
+			EmitPokeW( REG_X0 );
+			break;
+
+		case OP_SEX16:
+			EmitPeekW( REG_X0 );
+			Emit4( 0x13003C00 );			// sxth w0, w0
+			EmitPokeW( REG_X0 );
+			break;
+
+		case OP_NEGI:
+			EmitPeekW( REG_X0 );
+			Emit4( 0x4B0003E0 );			// neg w0, w0
+			EmitPokeW( REG_X0 );
+			break;
+
+		case OP_BCOM:
+			EmitPeekW( REG_X0 );
+			Emit4( 0x2A2003E0 );			// mvn w0, w0
+			EmitPokeW( REG_X0 );
+			break;
+
+		case OP_ADD:  EmitBinaryW( 0x0B000000 ); break;	// add
+		case OP_SUB:  EmitBinaryW( 0x4B000000 ); break;	// sub
+		case OP_DIVI: EmitBinaryW( 0x1AC00C00 ); break;	// sdiv
+		case OP_DIVU: EmitBinaryW( 0x1AC00800 ); break;	// udiv
+		case OP_MULI:
+		case OP_MULU: EmitBinaryW( 0x1B007C00 ); break;	// mul
+		case OP_BAND: EmitBinaryW( 0x0A000000 ); break;	// and
+		case OP_BOR:  EmitBinaryW( 0x2A000000 ); break;	// orr
+		case OP_BXOR: EmitBinaryW( 0x4A000000 ); break;	// eor
+		case OP_LSH:  EmitBinaryW( 0x1AC02000 ); break;	// lsl
+		case OP_RSHI: EmitBinaryW( 0x1AC02800 ); break;	// asr
+		case OP_RSHU: EmitBinaryW( 0x1AC02400 ); break;	// lsr
+
+		case OP_MODI:
+		case OP_MODU:
+			EmitLoad2W();
+			if ( ci->op == OP_MODI )
+				Emit4( 0x1AC00C22 );		// sdiv w2, w1, w0
+			else
+				Emit4( 0x1AC00822 );		// udiv w2, w1, w0
+			Emit4( 0x1B008440 );			// msub w0, w2, w0, w1
+			EmitStore1W();
+			break;
+
+		case OP_NEGF:
+			EmitPeekS( REG_X0 );
+			Emit4( 0x1E214000 );			// fneg s0, s0
+			EmitPokeS( REG_X0 );
+			break;
+
+		case OP_ADDF: EmitBinaryS( 0x1E202800 ); break;	// fadd
+		case OP_SUBF: EmitBinaryS( 0x1E203800 ); break;	// fsub
+		case OP_DIVF: EmitBinaryS( 0x1E201800 ); break;	// fdiv
+		case OP_MULF: EmitBinaryS( 0x1E200800 ); break;	// fmul
+
+		case OP_CVIF:
+			EmitPeekW( REG_X0 );
+			Emit4( 0x1E220000 );			// scvtf s0, w0
+			EmitPokeS( REG_X0 );
+			break;
+
+		case OP_CVFI:
+			EmitPeekS( REG_X0 );
+			Emit4( 0x1E380000 );			// fcvtzs w0, s0
+			EmitPokeW( REG_X0 );
+			break;
+
+		default:
+			VM_FreeBuffers();
+			Con_Printf( "VM_CompileArm64: bad opcode %02X\n", ci->op );
+			return false;
+		}
+	}
+
+	// ****************
+	// system functions
+	// ****************
+	funcOffset[FUNC_CALL] = compiledOfs;
+	EmitCallFunc( vm );
+
+	funcOffset[FUNC_SYSC] = compiledOfs;
+	EmitSysCallFunc( vm );
+
+	// ***************
+	// error functions
+	// ***************
+	funcOffset[FUNC_BADJ] = compiledOfs;
+	EmitErrorFunc( BadJump );
+
+	funcOffset[FUNC_ERRJ] = compiledOfs;
+	EmitErrorFunc( ErrJump );
+
+	funcOffset[FUNC_PSOF] = compiledOfs;
+	EmitErrorFunc( BadStack );
+
+	funcOffset[FUNC_OSOF] = compiledOfs;
+	EmitErrorFunc( BadOpStack );
+
+	if ( code == NULL ) {
+		code = (byte*)VM_Alloc_Compiled( vm, PAD(compiledOfs,8), instructionCount * sizeof( intptr_t ) );
+		if ( code == NULL ) {
+			VM_FreeBuffers();
+			return false;
+		}
+		instructionPointers = (intptr_t*)(byte*)(code + PAD(compiledOfs,8));
+	}
+	} // for( pass = 0; pass < 2; pass++ )
+
+	// computed jumps may only land on the instructions which can be jumped to
+	for ( i = 0 ; i < instructionCount ; i++ ) {
+		if ( !inst[i].jused ) {
+			instructionPointers[ i ] = (intptr_t)vm->codeBase.ptr + funcOffset[FUNC_BADJ];
+			continue;
+		}
+		instructionPointers[ i ] = (intptr_t)vm->codeBase.ptr + instructionOffsets[ i ];
+	}
+
+	VM_FreeBuffers();
+
+	if ( mprotect( vm->codeBase.ptr, vm->codeSize, PROT_READ|PROT_EXEC ) ) {
+		VM_Destroy_Compiled( vm );
+		Con_Printf( "VM_CompileArm64: mprotect failed\n" );
+		return false;
+	}
+	__builtin___clear_cache( (char *)vm->codeBase.ptr, (char *)vm->codeBase.ptr + vm->codeLength );
+
+	vm->destroy = VM_Destroy_Compiled;
+
+	Con_Printf( "VM file %s compiled to %i bytes of code\n", vm->name, compiledOfs );
+
+	return true;
+}
+
+/*
+==============
+VM_CallCompiled
+==============
+*/
+int	VM_CallCompiled( vm_t *vm, int nargs, int *args )
+{
+	int		opStack[MAX_OPSTACK_SIZE];
+	unsigned int stackOnEntry;
+	int		*image;
+	int		*oldOpTop;
+	int		i;
+
+	// we might be called recursively, so this might not be the very top
+	stackOnEntry = vm->programStack;
+	oldOpTop = vm->opStackTop;
+
+	vm->programStack -= (MAX_VMMAIN_CALL_ARGS+2)*4;
+
+	// set up the stack frame
+	image = (int*)( vm->dataBase + vm->programStack );
+	for ( i = 0; i < nargs; i++ ) {
+		image[ i + 2 ] = args[ i ];
+	}
+
+	image[1] =  0;	// return stack
+	image[0] = -1;	// will terminate loop on return
+
+	opStack[1] = 0;
+
+	vm->opStack = opStack;
+	vm->opStackTop = opStack + ARRAY_LEN( opStack ) - 1;
+
+	vm->codeBase.func(); // go into generated code
+
+	if ( vm->opStack != &opStack[1] ) {
+		SV_Error( "opStack corrupted in compiled code" );
+	}
+
+	vm->programStack = stackOnEntry;
+	vm->opStackTop = oldOpTop;
+
+	return vm->opStack[0];
+}
+
+#endif // idarm64
+#endif				/* USE_PR2 */
@@ -0,0 +1,820 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+	QVM conformance test: random programs are generated, run through the
+	interpreter and the compiler of this build, and the syscall traces,
+	return values and data segments are compared.
+
+	Programs depend only on the seed, so running the same command on an
+	x86 and an arm64 server also compares the two compilers: the digest
+	printed at the end must be the same on both.
+*/
+
+#ifdef USE_PR2
+#ifdef SERVERONLY
+#include "qwsvdef.h"
+#else
+#include "quakedef.h"
+#endif
+#include "vm_local.h"
+
+#define VMC_MAX_INSTRUCTIONS	65536
+#define VMC_MAX_LABELS			16384
+#define VMC_MAX_TRACE			65536
+
+#define VMC_FUNCS		6
+#define VMC_FRAME		96					// 8 + args + locals
+#define VMC_LOCAL(i)	(48 + 4 * (i))		// 0-3 int, 4-7 float, 8-11 loop counters
+#define VMC_GLOBALS		0x1000
+#define VMC_DATALEN		0x2000
+#define VMC_DATAMASK	0x3FFFF
+
+// system calls of the generated programs, called as OP_CONST -1 - n, OP_CALL
+#define VMC_SYS_TRACE	1
+#define VMC_SYS_HASH	2
+#define VMC_SYS_REENTER	3
+
+enum { VMC_INTERPRETED, VMC_COMPILED, VMC_ENGINES };
+static const char *vmc_engine_names[VMC_ENGINES] = { "interpreter", "compiler" };
+
+typedef struct vmc_engine_s {
+	vm_t	vm;
+	int		*trace;
+	int		tracelen;
+	int		result;
+} vmc_engine_t;
+
+static struct {
+	// assembler
+	byte			*op;
+	int				*value;
+	int				*fixup;			// label the value is resolved from, -1 for none
+	int				count;
+	int				*labels;
+	int				numlabels;
+	qbool			overflow;
+
+	// generator
+	unsigned int	seed;
+	int				funclabels[VMC_FUNCS];
+	int				func;
+
+	// runner
+	vmc_engine_t	engines[VMC_ENGINES];
+	vmc_engine_t	*running;
+} vmc;
+
+/*
+==============================================================
+
+ASSEMBLER
+
+==============================================================
+*/
+
+static int VMC_NewLabel( void )
+{
+	if ( vmc.numlabels >= VMC_MAX_LABELS ) {
+		vmc.overflow = true;
+		return 0;
+	}
+	vmc.labels[vmc.numlabels] = -1;
+	return vmc.numlabels++;
+}
+
+static void VMC_SetLabel( int label )
+{
+	vmc.labels[label] = vmc.count;
+}
+
+static void VMC_Emit( int op, int value, int label )
+{
+	if ( vmc.count >= VMC_MAX_INSTRUCTIONS ) {
+		vmc.overflow = true;
+		return;
+	}
+	vmc.op[vmc.count] = op;
+	vmc.value[vmc.count] = value;
+	vmc.fixup[vmc.count] = label;
+	vmc.count++;
+}
+
+#define E(op, value)	VMC_Emit( (op), (value), -1 )
+#define EL(op, label)	VMC_Emit( (op), 0, (label) )
+
+/*
+==============
+VMC_Assemble
+
+Encodes the instructions into a qvm image, resolving the labels.
+==============
+*/
+static vmHeader_t *VMC_Assemble( void )
+{
+	vmHeader_t	*header;
+	byte		*p;
+	int			i;
+
+	for ( i = 0; i < vmc.count; i++ ) {
+		if ( vmc.fixup[i] >= 0 ) {
+			vmc.value[i] = vmc.labels[vmc.fixup[i]];
+		}
+	}
+
+	header = Q_malloc( sizeof( *header ) + vmc.count * 5 );
+	p = (byte *)( header + 1 );
+	for ( i = 0; i < vmc.count; i++ ) {
+		*p++ = vmc.op[i];
+		if ( ops[vmc.op[i]].size == 4 ) {
+			memcpy( p, &vmc.value[i], 4 );
+			p += 4;
+		} else if ( ops[vmc.op[i]].size == 1 ) {
+			*p++ = vmc.value[i];
+		}
+	}
+
+	header->vmMagic = VM_MAGIC;
+	header->instructionCount = vmc.count;
+	header->codeOffset = sizeof( *header );
+	header->codeLength = p - (byte *)( header + 1 );
+	return header;
+}
+
+/*
+==============================================================
+
+GENERATOR
+
+==============================================================
+*/
+
+static int VMC_Rand( int n )
+{
+	vmc.seed = vmc.seed * 1103515245 + 12345;
+	return ( vmc.seed >> 8 ) % n;
+}
+
+static void VMC_FloatExpr( int depth );
+
+// leaves an int on the opstack
+static void VMC_IntExpr( int depth )
+{
+	static const int binops[] = { OP_ADD, OP_SUB, OP_MULI, OP_MULU, OP_BAND, OP_BOR, OP_BXOR };
+
+	switch ( depth > 3 ? VMC_Rand( 3 ) : VMC_Rand( 16 ) ) {
+	case 0:
+		E( OP_CONST, VMC_Rand( 3 ) ? VMC_Rand( 200 ) - 100 : (int)( vmc.seed * 2654435761u ) );
+		break;
+	case 1:
+		E( OP_LOCAL, VMC_LOCAL( VMC_Rand( 4 ) ) );
+		E( OP_LOAD4, 0 );
+		break;
+	case 2: {
+		// global of every width, sign extended or not
+		int global = VMC_GLOBALS + 4 * VMC_Rand( 64 ), width = VMC_Rand( 5 );
+
+		if ( width == 1 || width == 3 ) {
+			global += 2 * VMC_Rand( 2 );
+		} else if ( width == 2 || width == 4 ) {
+			global += VMC_Rand( 4 );
+		}
+		E( OP_CONST, global );
+		if ( width == 0 ) {
+			E( OP_LOAD4, 0 );
+		} else if ( width == 1 || width == 3 ) {
+			E( OP_LOAD2, 0 );
+			if ( width == 3 ) {
+				E( OP_SEX16, 0 );
+			}
+		} else {
+			E( OP_LOAD1, 0 );
+			if ( width == 4 ) {
+				E( OP_SEX8, 0 );
+			}
+		}
+		break;
+	}
+	case 3:
+		E( OP_LOCAL, VMC_FRAME + 8 + 4 * VMC_Rand( 2 ) );	// argument
+		E( OP_LOAD4, 0 );
+		break;
+	case 4: case 5: case 6:
+		VMC_IntExpr( depth + 1 );
+		VMC_IntExpr( depth + 1 );
+		E( binops[VMC_Rand( ARRAY_LEN( binops ) )], 0 );
+		break;
+	case 7: {
+		int op = VMC_Rand( 3 );
+
+		VMC_IntExpr( depth + 1 );
+		VMC_IntExpr( depth + 1 );
+		E( OP_CONST, 31 );
+		E( OP_BAND, 0 );
+		E( op == 0 ? OP_LSH : op == 1 ? OP_RSHI : OP_RSHU, 0 );
+		break;
+	}
+	case 8: {
+		// the divisor is kept positive and non-zero
+		int op = VMC_Rand( 4 );
+
+		VMC_IntExpr( depth + 1 );
+		VMC_IntExpr( depth + 1 );
+		E( OP_CONST, 255 );
+		E( OP_BAND, 0 );
+		E( OP_CONST, 1 );
+		E( OP_BOR, 0 );
+		E( op == 0 ? OP_DIVI : op == 1 ? OP_DIVU : op == 2 ? OP_MODI : OP_MODU, 0 );
+		break;
+	}
+	case 9:
+		VMC_IntExpr( depth + 1 );
+		E( VMC_Rand( 2 ) ? OP_NEGI : OP_BCOM, 0 );
+		break;
+	case 10:
+		// through a float and back, always finite
+		VMC_IntExpr( depth + 1 );
+		E( OP_CONST, 0xFFFF );
+		E( OP_BAND, 0 );
+		E( OP_CVIF, 0 );
+		E( OP_CONST, 0x3F000000 + VMC_Rand( 4 ) * 0x800000 );
+		E( OP_MULF, 0 );
+		E( OP_CVFI, 0 );
+		break;
+	case 11:
+		// a dropped value followed by a local read
+		E( OP_LOCAL, VMC_LOCAL( VMC_Rand( 4 ) ) );
+		E( OP_LOAD4, 0 );
+		E( OP_POP, 0 );
+		E( OP_LOCAL, VMC_LOCAL( VMC_Rand( 4 ) ) );
+		E( OP_LOAD4, 0 );
+		break;
+	case 12:
+		if ( vmc.func < VMC_FUNCS - 1 ) {
+			// call a later function, directly or through a computed address
+			int f = vmc.func + 1 + VMC_Rand( VMC_FUNCS - 1 - vmc.func );
+
+			VMC_IntExpr( depth + 1 );
+			E( OP_ARG, 8 );
+			VMC_IntExpr( depth + 1 );
+			E( OP_ARG, 12 );
+			EL( OP_CONST, vmc.funclabels[f] );
+			if ( !VMC_Rand( 3 ) ) {
+				E( OP_CONST, 0 );
+				E( OP_ADD, 0 );
+			}
+			E( OP_CALL, 0 );
+			break;
+		}
+		/* fallthrough */
+	case 13:
+		VMC_IntExpr( depth + 1 );
+		E( OP_ARG, 8 );
+		VMC_IntExpr( depth + 1 );
+		E( OP_ARG, 12 );
+		E( OP_CONST, -1 - VMC_SYS_HASH );
+		if ( VMC_Rand( 2 ) ) {
+			E( OP_CONST, 0 );
+			E( OP_ADD, 0 );
+		}
+		E( OP_CALL, 0 );
+		break;
+	default:
+		E( OP_CONST, VMC_Rand( 1000 ) );
+		break;
+	}
+}
+
+// leaves a float on the opstack
+static void VMC_FloatExpr( int depth )
+{
+	// includes the signed zeros, infinity and nan
+	static const int consts[] = { 0x3F800000, 0x40000000, 0xBF000000, 0x00000000, 0x80000000,
+		0x7F800000, 0x7FC00000, 0x3DCCCCCD, 0x4B000001 };
+	static const int binops[] = { OP_ADDF, OP_SUBF, OP_MULF, OP_DIVF };
+
+	switch ( depth > 3 ? VMC_Rand( 3 ) : VMC_Rand( 8 ) ) {
+	case 0:
+		E( OP_CONST, consts[VMC_Rand( ARRAY_LEN( consts ) )] );
+		break;
+	case 1:
+		E( OP_LOCAL, VMC_LOCAL( 4 + VMC_Rand( 4 ) ) );
+		E( OP_LOAD4, 0 );
+		break;
+	case 2:
+		VMC_IntExpr( depth + 1 );
+		E( OP_CVIF, 0 );
+		break;
+	case 3: case 4: case 5:
+		VMC_FloatExpr( depth + 1 );
+		VMC_FloatExpr( depth + 1 );
+		E( binops[VMC_Rand( ARRAY_LEN( binops ) )], 0 );
+		break;
+	case 6:
+		VMC_FloatExpr( depth + 1 );
+		E( OP_NEGF, 0 );
+		break;
+	default:
+		E( OP_CONST, 0x40400000 );
+		break;
+	}
+}
+
+// leaves a float that is never nan or infinite on the opstack: the x86
+// compiler doesn't order nans the way the interpreter does
+static void VMC_FiniteFloatExpr( int depth )
+{
+	static const int consts[] = { 0x3F800000, 0x40000000, 0xBF000000, 0x3DCCCCCD, 0x4B000001 };
+	static const int binops[] = { OP_ADDF, OP_SUBF, OP_MULF };
+
+	switch ( depth > 1 ? VMC_Rand( 2 ) : VMC_Rand( 4 ) ) {
+	case 0:
+		E( OP_CONST, consts[VMC_Rand( ARRAY_LEN( consts ) )] );
+		break;
+	case 1:
+		VMC_IntExpr( 2 );
+		E( OP_CONST, 0xFFFF );
+		E( OP_BAND, 0 );
+		E( OP_CVIF, 0 );
+		break;
+	default:
+		VMC_FiniteFloatExpr( depth + 1 );
+		VMC_FiniteFloatExpr( depth + 1 );
+		E( binops[VMC_Rand( ARRAY_LEN( binops ) )], 0 );
+		break;
+	}
+}
+
+static void VMC_Condition( int target )
+{
+	int op = VMC_Rand( 16 );
+
+	if ( op < 10 ) {
+		VMC_IntExpr( 1 );
+		VMC_IntExpr( 1 );
+		EL( OP_EQ + op, target );
+	} else {
+		VMC_FiniteFloatExpr( 0 );
+		VMC_FiniteFloatExpr( 0 );
+		EL( OP_EQF + op - 10, target );
+	}
+}
+
+static void VMC_Statements( int count, int depth );
+
+static void VMC_Statement( int depth )
+{
+	switch ( depth > 2 ? VMC_Rand( 6 ) : VMC_Rand( 10 ) ) {
+	case 0: case 1:
+		E( OP_LOCAL, VMC_LOCAL( VMC_Rand( 4 ) ) );
+		VMC_IntExpr( 0 );
+		E( OP_STORE4, 0 );
+		break;
+	case 2:
+		E( OP_LOCAL, VMC_LOCAL( 4 + VMC_Rand( 4 ) ) );
+		VMC_FloatExpr( 0 );
+		E( OP_STORE4, 0 );
+		break;
+	case 3: {
+		int width = VMC_Rand( 3 ), global = VMC_GLOBALS + 4 * VMC_Rand( 64 );
+
+		if ( width == 1 ) {
+			global += 2 * VMC_Rand( 2 );
+		} else if ( width == 2 ) {
+			global += VMC_Rand( 4 );
+		}
+		E( OP_CONST, global );
+		VMC_IntExpr( 0 );
+		E( width == 0 ? OP_STORE4 : width == 1 ? OP_STORE2 : OP_STORE1, 0 );
+		break;
+	}
+	case 4: case 5:
+		VMC_IntExpr( 0 );
+		E( OP_ARG, 8 );
+		if ( VMC_Rand( 2 ) ) {
+			VMC_FloatExpr( 0 );
+		} else {
+			VMC_IntExpr( 0 );
+		}
+		E( OP_ARG, 12 );
+		E( OP_CONST, -1 - VMC_SYS_TRACE );
+		E( OP_CALL, 0 );
+		E( OP_POP, 0 );
+		break;
+	case 6: {
+		// if, sometimes with an else reached through a computed jump
+		int then = VMC_NewLabel(), end = VMC_NewLabel();
+
+		VMC_Condition( then );
+		EL( OP_CONST, end );
+		E( OP_JUMP, 0 );
+		VMC_SetLabel( then );
+		VMC_Statements( 1 + VMC_Rand( 3 ), depth + 1 );
+		if ( !VMC_Rand( 3 ) ) {
+			int end2 = VMC_NewLabel();
+
+			EL( OP_CONST, end2 );
+			E( OP_CONST, 0 );
+			E( OP_ADD, 0 );
+			E( OP_JUMP, 0 );
+			VMC_SetLabel( end );
+			VMC_Statements( 1 + VMC_Rand( 2 ), depth + 1 );
+			VMC_SetLabel( end2 );
+		} else {
+			VMC_SetLabel( end );
+		}
+		break;
+	}
+	case 7: {
+		// counted loop, each nesting level has its own counter
+		int top = VMC_NewLabel(), body = VMC_NewLabel(), end = VMC_NewLabel(), count = VMC_Rand( 6 );
+
+		E( OP_LOCAL, VMC_LOCAL( 8 + depth ) );
+		E( OP_CONST, 0 );
+		E( OP_STORE4, 0 );
+		VMC_SetLabel( top );
+		E( OP_LOCAL, VMC_LOCAL( 8 + depth ) );
+		E( OP_LOAD4, 0 );
+		E( OP_CONST, count );
+		EL( OP_LTI, body );
+		EL( OP_CONST, end );
+		E( OP_JUMP, 0 );
+		VMC_SetLabel( body );
+		VMC_Statements( 1 + VMC_Rand( 3 ), depth + 1 );
+		E( OP_LOCAL, VMC_LOCAL( 8 + depth ) );
+		E( OP_LOCAL, VMC_LOCAL( 8 + depth ) );
+		E( OP_LOAD4, 0 );
+		E( OP_CONST, 1 );
+		E( OP_ADD, 0 );
+		E( OP_STORE4, 0 );
+		EL( OP_CONST, top );
+		E( OP_JUMP, 0 );
+		VMC_SetLabel( end );
+		break;
+	}
+	case 8:
+		E( OP_CONST, VMC_GLOBALS + 4 * VMC_Rand( 16 ) );
+		E( OP_CONST, VMC_GLOBALS + 128 + 4 * VMC_Rand( 16 ) );
+		E( OP_BLOCK_COPY, 4 * ( 1 + VMC_Rand( 16 ) ) );
+		break;
+	case 9:
+		VMC_IntExpr( 0 );
+		E( OP_ARG, 8 );
+		E( OP_CONST, -1 - VMC_SYS_REENTER );
+		E( OP_CALL, 0 );
+		E( OP_POP, 0 );
+		break;
+	}
+}
+
+static void VMC_Statements( int count, int depth )
+{
+	while ( count-- ) {
+		VMC_Statement( depth );
+	}
+}
+
+/*
+==============
+VMC_Generate
+
+Function 0 is vmMain( command, arg ). Command 0 runs the program,
+command 1 is the reentry from VMC_SYS_REENTER.
+==============
+*/
+static void VMC_Generate( void )
+{
+	int f, i, program;
+
+	vmc.count = 0;
+	vmc.numlabels = 0;
+	vmc.overflow = false;
+
+	for ( f = 0; f < VMC_FUNCS; f++ ) {
+		vmc.funclabels[f] = VMC_NewLabel();
+	}
+
+	for ( f = 0; f < VMC_FUNCS; f++ ) {
+		vmc.func = f;
+		VMC_SetLabel( vmc.funclabels[f] );
+		E( OP_ENTER, VMC_FRAME );
+		for ( i = 0; i < 8; i++ ) {
+			E( OP_LOCAL, VMC_LOCAL( i ) );
+			E( OP_CONST, i < 4 ? i * 7 : 0x3F800000 + i );
+			E( OP_STORE4, 0 );
+		}
+
+		if ( f == 0 ) {
+			program = VMC_NewLabel();
+			E( OP_LOCAL, VMC_FRAME + 8 );
+			E( OP_LOAD4, 0 );
+			E( OP_CONST, 0 );
+			EL( OP_EQ, program );
+			E( OP_LOCAL, VMC_FRAME + 12 );
+			E( OP_LOAD4, 0 );
+			E( OP_ARG, 8 );
+			E( OP_CONST, 77 );
+			E( OP_ARG, 12 );
+			E( OP_CONST, -1 - VMC_SYS_TRACE );
+			E( OP_CALL, 0 );
+			E( OP_POP, 0 );
+			E( OP_LOCAL, VMC_FRAME + 12 );
+			E( OP_LOAD4, 0 );
+			E( OP_CONST, 3 );
+			E( OP_MULI, 0 );
+			E( OP_LEAVE, VMC_FRAME );
+			VMC_SetLabel( program );
+		}
+
+		VMC_Statements( 3 + VMC_Rand( 8 ), 0 );
+		VMC_IntExpr( 0 );
+		E( OP_LEAVE, VMC_FRAME );
+		// lcc ends every procedure with PUSH LEAVE
+		E( OP_PUSH, 0 );
+		E( OP_LEAVE, VMC_FRAME );
+	}
+}
+
+/*
+==============================================================
+
+RUNNER
+
+==============================================================
+*/
+
+static intptr_t VMC_SystemCalls( intptr_t *args )
+{
+	vmc_engine_t *engine = vmc.running;
+
+	switch ( args[0] ) {
+	case VMC_SYS_TRACE: {
+		int value = (int)args[2];
+
+		// x86 and arm64 produce different default nans
+		if ( ( value & 0x7F800000 ) == 0x7F800000 && ( value & 0x7FFFFF ) ) {
+			value = 0x7FC00000;
+		}
+		if ( engine->tracelen + 3 <= VMC_MAX_TRACE ) {
+			engine->trace[engine->tracelen++] = VMC_SYS_TRACE;
+			engine->trace[engine->tracelen++] = (int)args[1];
+			engine->trace[engine->tracelen++] = value;
+		}
+		return 0;
+	}
+	case VMC_SYS_HASH:
+		return (int)( args[1] * 31 + args[2] * 7 + 5 );
+	case VMC_SYS_REENTER: {
+		int callargs[2], result;
+
+		if ( engine->vm.callLevel > 3 ) {
+			return 0;
+		}
+		callargs[0] = 1;
+		callargs[1] = (int)args[1];
+		engine->vm.callLevel++;
+		if ( engine->vm.compiled ) {
+			result = VM_CallCompiled( &engine->vm, 2, callargs );
+		} else {
+			result = VM_CallInterpreted2( &engine->vm, 2, callargs );
+		}
+		engine->vm.callLevel--;
+		return result;
+	}
+	}
+
+	SV_Error( "vm_conformance: bad system call %i", (int)args[0] );
+	return 0;
+}
+
+/*
+==============
+VMC_Run
+
+Loads the program into one engine and runs vmMain( 0, seed ).
+==============
+*/
+static qbool VMC_Run( vmc_engine_t *engine, vmHeader_t *header, const byte *image, int compiled )
+{
+	vm_t	*vm = &engine->vm, *oldVM;
+	byte	*dataBase = vm->dataBase;
+	int		callargs[3];
+	qbool	loaded;
+#ifndef SERVERONLY
+	qbool	oldsuppress;
+#endif
+
+	memset( vm, 0, sizeof( *vm ) );
+	vm->name = "vm_conformance";
+	vm->systemCall = VMC_SystemCalls;
+	vm->dataBase = dataBase;
+	vm->dataMask = VMC_DATAMASK;
+	vm->dataLength = vm->dataAlloc = VMC_DATAMASK + 1;
+	vm->exactDataLength = VMC_DATALEN;
+	vm->instructionCount = header->instructionCount;
+	vm->codeLength = header->codeLength;
+	vm->programStack = vm->dataMask + 1;
+	vm->stackBottom = vm->programStack - PROGRAM_STACK_SIZE - PROGRAM_STACK_EXTRA;
+	memcpy( vm->dataBase, image, VMC_DATAMASK + 1 );
+
+#ifndef SERVERONLY
+	// the compiler reports every program it compiles
+	oldsuppress = con_suppress;
+	con_suppress = !developer.integer;
+#endif
+	if ( compiled ) {
+		vm->compiled = VM_Compile( vm, header );
+		loaded = vm->compiled;
+	} else {
+		loaded = VM_PrepareInterpreter2( vm, header );
+	}
+#ifndef SERVERONLY
+	con_suppress = oldsuppress;
+#endif
+	if ( !loaded ) {
+		return false;
+	}
+
+	engine->tracelen = 0;
+	vmc.running = engine;
+	oldVM = currentVM;
+	currentVM = vm;
+
+	callargs[0] = 0;
+	callargs[1] = (int)vmc.seed;
+	callargs[2] = 0;
+	vm->callLevel++;
+	if ( vm->compiled ) {
+		engine->result = VM_CallCompiled( vm, 3, callargs );
+	} else {
+		engine->result = VM_CallInterpreted2( vm, 3, callargs );
+	}
+	vm->callLevel--;
+
+	currentVM = oldVM;
+	vmc.running = NULL;
+
+	if ( vm->destroy ) {
+		vm->destroy( vm );
+		vm->destroy = NULL;
+	}
+	return true;
+}
+
+/*
+==============================================================
+
+COMPARER
+
+==============================================================
+*/
+
+static unsigned int VMC_Digest( unsigned int digest, const void *data, int length )
+{
+	const byte *p = (const byte *) data;
+
+	while ( length-- > 0 ) {
+		digest = ( digest ^ *p++ ) * 16777619u;
+	}
+	return digest;
+}
+
+/*
+==============
+VMC_Compare
+
+Returns true when the compiled run matches the interpreted one,
+otherwise prints the first difference.
+==============
+*/
+static qbool VMC_Compare( int program, const vmc_engine_t *ref, const vmc_engine_t *test )
+{
+	int i;
+
+	if ( test->result != ref->result ) {
+		Con_Printf( "program %i: %s returned %i, %s returned %i\n", program,
+			vmc_engine_names[VMC_INTERPRETED], ref->result, vmc_engine_names[VMC_COMPILED], test->result );
+		return false;
+	}
+
+	for ( i = 0; i < ref->tracelen && i < test->tracelen; i++ ) {
+		if ( test->trace[i] != ref->trace[i] ) {
+			Con_Printf( "program %i: system call %i differs, word %i is %08x, expected %08x\n", program,
+				i / 3, i % 3, test->trace[i], ref->trace[i] );
+			return false;
+		}
+	}
+	if ( test->tracelen != ref->tracelen ) {
+		Con_Printf( "program %i: %i system calls, expected %i\n", program, test->tracelen / 3, ref->tracelen / 3 );
+		return false;
+	}
+
+	for ( i = 0; i < VMC_DATALEN; i++ ) {
+		if ( test->vm.dataBase[i] != ref->vm.dataBase[i] ) {
+			Con_Printf( "program %i: data byte %04x is %02x, expected %02x\n", program,
+				i, test->vm.dataBase[i], ref->vm.dataBase[i] );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+==============
+VM_Conformance_f
+
+vm_conformance [programs] [seed]
+==============
+*/
+void VM_Conformance_f( void )
+{
+	int			programs, seed, program, instructions = 0, rejected = 0, failed = 0, mark, i;
+	unsigned int digest = 2166136261u;
+	vmHeader_t	*header;
+	byte		*image;
+	double		start;
+
+	if ( Cmd_Argc() > 3 ) {
+		Con_Printf( "Usage: %s [programs] [seed]\n", Cmd_Argv( 0 ) );
+		return;
+	}
+	programs = Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 ) ) : 1000;
+	seed = Cmd_Argc() > 2 ? Q_atoi( Cmd_Argv( 2 ) ) : 0;
+
+	vmc.op = Q_malloc( VMC_MAX_INSTRUCTIONS );
+	vmc.value = Q_malloc( VMC_MAX_INSTRUCTIONS * sizeof( *vmc.value ) );
+	vmc.fixup = Q_malloc( VMC_MAX_INSTRUCTIONS * sizeof( *vmc.fixup ) );
+	vmc.labels = Q_malloc( VMC_MAX_LABELS * sizeof( *vmc.labels ) );
+	image = Q_malloc( VMC_DATAMASK + 1 );
+	for ( i = 0; i < VMC_ENGINES; i++ ) {
+		memset( &vmc.engines[i], 0, sizeof( vmc.engines[i] ) );
+		vmc.engines[i].vm.dataBase = Q_malloc( VMC_DATAMASK + 1 );
+		vmc.engines[i].trace = Q_malloc( VMC_MAX_TRACE * sizeof( int ) );
+	}
+
+	start = Sys_DoubleTime();
+	for ( program = 0; program < programs; program++ ) {
+		vmc.seed = ( seed + program ) * 2654435761u + 17;
+		for ( i = 0; i < VMC_DATALEN; i++ ) {
+			image[i] = VMC_Rand( 256 );
+		}
+		VMC_Generate();
+		if ( vmc.overflow ) {
+			rejected++;
+			continue;
+		}
+		header = VMC_Assemble();
+		instructions += header->instructionCount;
+
+		mark = Hunk_LowMark();
+		if ( !VMC_Run( &vmc.engines[VMC_INTERPRETED], header, image, false ) ) {
+			rejected++;
+		} else if ( !VMC_Run( &vmc.engines[VMC_COMPILED], header, image, true ) ) {
+			Con_Printf( "This build has no QVM compiler for this platform.\n" );
+			Hunk_FreeToLowMark( mark );
+			Q_free( header );
+			break;
+		} else {
+			if ( !VMC_Compare( program, &vmc.engines[VMC_INTERPRETED], &vmc.engines[VMC_COMPILED] ) ) {
+				failed++;
+			}
+			digest = VMC_Digest( digest, &vmc.engines[VMC_INTERPRETED].result, sizeof( int ) );
+			digest = VMC_Digest( digest, vmc.engines[VMC_INTERPRETED].trace, vmc.engines[VMC_INTERPRETED].tracelen * sizeof( int ) );
+			digest = VMC_Digest( digest, vmc.engines[VMC_INTERPRETED].vm.dataBase, VMC_DATALEN );
+		}
+		Hunk_FreeToLowMark( mark );
+		Q_free( header );
+	}
+
+	if ( program == programs ) {
+		Con_Printf( "%i programs, %i instructions, %i rejected, %i failed in %.2f seconds\n",
+			programs, instructions, rejected, failed, Sys_DoubleTime() - start );
+		Con_Printf( "digest %08x (seed %i, vm_rtChecks %i)\n", digest, seed, (int)vm_rtChecks.value );
+	}
+
+	for ( i = 0; i < VMC_ENGINES; i++ ) {
+		Q_free( vmc.engines[i].vm.dataBase );
+		Q_free( vmc.engines[i].trace );
+	}
+	Q_free( image );
+	Q_free( vmc.labels );
+	Q_free( vmc.fixup );
+	Q_free( vmc.value );
+	Q_free( vmc.op );
+}
+
+#endif /* USE_PR2 */
@@ -20,6 +20,7 @@
 #include "quakedef.h"
 #endif
 #include "vm_local.h"
+#include "pr_prof.h"
 
 
 char *VM_Indent( vm_t *vm ) {
@@ -225,9 +226,16 @@ nextInstruction2:
                 VM_StackTrace(vm, ci - (instruction_t *)vm->codeBase.ptr, programStack);
 				SV_Error( "VM opStack overflow" );
 			}
+			if ( pr_prof_active ) {
+				PR_ProfEnter( PROF_QVM, ci - 1 - inst, NULL );
+			}
 			break;
 
 		case OP_LEAVE:
+			if ( pr_prof_active ) {
+				PR_ProfLeave();
+			}
+
 			// remove our stack frame
 			programStack += v0;
 
@@ -2577,9 +2577,10 @@ __compile:
 			//if ( !ci->fpu )
 			EmitLoadFloatEDI( vm );					// fld dword ptr [edi] | movss xmm0, dword ptr [edi]
 			if ( HasSSEFP() ) {
-				EmitString( "0F 57 C9" );			// xorps xmm1, xmm1
-				EmitString( "0F 5C C8" );			// subps xmm1, xmm0
-				EmitString( "0F 28 C1" );			// movaps xmm0, xmm1
+				// flip the sign like fchs, 0 - x would turn -0 into 0
+				EmitString( "66 0F 7E C0" );		// movd eax, xmm0
+				EmitString( "35 00 00 00 80" );		// xor eax, 0x80000000
+				EmitString( "66 0F 6E C0" );		// movd xmm0, eax
 			} else {
 				EmitString( "D9 E0" );				// fchs
 			}
@@ -2960,7 +2961,7 @@ int	VM_CallCompiled( vm_t *vm, int nargs, int *args )
 
 	return vm->opStack[0];
 }
-#else
+#elif !idarm64 || !( defined(__linux__) || defined(__FreeBSD__) )
 int	VM_CallCompiled( vm_t *vm, int nargs, int *args ) { return 0;}
 qbool VM_Compile( vm_t *vm, vmHeader_t *header ) { return false; }
 #endif